@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
 #include "analyzer.h"
 #include "map.h"
 #include "log.h"
@@ -9,6 +11,8 @@ typedef enum {
     ENV_KIND_TRANS,
     ENV_KIND_FUNC,
     ENV_KIND_BLOCK,
+    ENV_KIND_LOOP,  // A body of a loop, break and continue are allowed in it
+    ENV_KIND_SWITCH, // A body of a switch, case, default and break are allowed in it
 } EnvKind;
 
 struct env_t;
@@ -20,28 +24,35 @@ struct env_t {
     char const* name;
     EnvKind kind;
     union {
+        struct {
+            UintMap* cases; // Values of case labels
+            int has_default;
+        } switch_stmt;
     } value;
     StringMap* children; // Map<char const*, Env*>
 };
 
-Env* env_new(Token* name, Env* parent);
+Env* env_new(Token* name_tok, char const* name, Env* parent);
 void env_drop(Env* env);
 
 static void env_elem_dtor(void* env_ref) {
     env_drop(*(Env**)env_ref);
 }
 
-Env* env_new(Token* name_tok, Env* parent) {
+Env* env_new(Token* name_tok, char const* name, Env* parent) {
     Env* e = (Env*)malloc(sizeof(Env));
     e->parent = parent;
     e->name_tok = name_tok;
-    e->name = e->name_tok ? token_to_string(e->name_tok) : NULL;
+    e->name = name ? strdup(name) : NULL;
     e->children = string_map_new(sizeof(Env*), env_elem_dtor);
 
     return e;
 }
 
 void env_drop(Env* env) {
+    if (env->kind == ENV_KIND_SWITCH) {
+        uint_map_drop(env->value.switch_stmt.cases);
+    }
     if (env->name) {
         free((char*)env->name);
     }
@@ -60,24 +71,30 @@ Env* env_insert(Env* env, Env* child) {
     return *e;
 }
 
-Env* env_lookup(Env* env, Token* name_tok) {
-    char const* name = token_to_string(name_tok);
-    Env* found_env = string_map_find(env->children, name);
-    free((char*)name);
-
-    if (found_env) {
-        return found_env;
+Env* env_lookup(Env* env, char const* name) {
+    for(; env != NULL; env = env->parent) {
+        Env** e = string_map_find(env->children, name);
+        if (e) {
+            return *e;
+        }
     }
 
-    if (env->parent == NULL) {
-        return NULL;
+    return NULL;
+}
+
+// Returns the innermost env of 'kind' in the current function, NULL if there is none
+static Env* env_enclosing(Env* env, EnvKind kind) {
+    for(; env != NULL && env->kind != ENV_KIND_FUNC; env = env->parent) {
+        if (env->kind == kind) {
+            return env;
+        }
     }
 
-    return env_lookup(env->parent, name_tok);
+    return NULL;
 }
 
-static void analyze(Analyzer* a, Node* node, Env* env);
-static Type* analyze_expr(Analyzer* a, Node* node, Env* env);
+static void analyze(Analyzer* a, NodeTable* t, NodeIndex node, Env* env);
+static Type* analyze_expr(Analyzer* a, NodeTable* t, NodeIndex node, Env* env);
 
 struct analyzer_t {
     TypeArena* arena;
@@ -94,206 +111,522 @@ void analyzer_drop(Analyzer* a) {
     free(a);
 }
 
-void analyzer_analyze(Analyzer* a, Node* node) {
-    analyze(a, node, NULL);
+void analyzer_analyze(Analyzer* a, NodeTable* t) {
+    analyze(a, t, node_table_root(t), NULL);
+}
+
+typedef struct {
+    NodeIndex node;
+    Env* env;       // An env which the node is placed in
+    Env* inner_env; // An env which the node opens, Nullable
+    int entered;
+    uint32_t index; // An index of the next child in extra
+} AnalyzeFrame;
+
+static void push_analyze_frame(Vector* stack, NodeIndex node, Env* env) {
+    AnalyzeFrame* frame = (AnalyzeFrame*)vector_append(stack);
+    frame->node = node;
+    frame->env = env;
+    frame->inner_env = NULL;
+    frame->entered = 0;
+    frame->index = 0;
 }
 
-void analyze(Analyzer* a, Node* node, Env* env) {
-    switch(node->kind) {
-    case NODE_TRANS_UNIT:
-    {
-        printf("LOG: translation unit\n");
-        Env* t_env = env_new(NULL, env); // TODO: Set a name of the translation unit
-        t_env->kind = ENV_KIND_TRANS;
-
-        Vector* decls = node->value.trans_unit.decls;
-        for(size_t i=0; i<vector_len(decls); ++i) {
-            Node** n = (Node**)vector_at(decls, i);
-            analyze(a, *n, t_env);
+// Walks statements with an explicit stack instead of recursion.
+// A frame stays on the stack while its children are analyzed, and is revisited after them.
+void analyze(Analyzer* a, NodeTable* t, NodeIndex root, Env* root_env) {
+    Vector* stack = vector_new(sizeof(AnalyzeFrame)); // Vector<AnalyzeFrame>
+    push_analyze_frame(stack, root, root_env);
+
+    while(vector_len(stack) > 0) {
+        AnalyzeFrame* frame = (AnalyzeFrame*)vector_at(stack, vector_len(stack) - 1);
+        NodeIndex node = frame->node;
+        Env* env = frame->env;
+
+        switch(t->kinds[node]) {
+        case NODE_TRANS_UNIT:
+        {
+            if (!frame->entered) {
+                fprintf(DEBUGOUT, "LOG: translation unit\n");
+                frame->inner_env = env_new(NULL, NULL, env); // TODO: Set a name of the translation unit
+                frame->inner_env->kind = ENV_KIND_TRANS;
+                frame->entered = 1;
+                frame->index = t->lhs[node];
+            }
+
+            if (frame->index < t->rhs[node]) {
+                NodeIndex n = t->extra[frame->index];
+                frame->index++;
+                push_analyze_frame(stack, n, frame->inner_env);
+                break;
+            }
+
+            env_drop(frame->inner_env);
+            vector_pop(stack);
+            break;
         }
 
-        env_drop(t_env);
-        break;
-    }
+        case NODE_FUNC_DEF:
+        {
+            if (!frame->entered) {
+                fprintf(DEBUGOUT, "LOG: function def\n");
 
-    case NODE_FUNC_DEF:
-    {
-        printf("LOG: function def\n");
+                NodeIndex decl = t->extra[t->lhs[node] + 1];
+                assert(t->kinds[decl] == NODE_DECLARATOR);
+                NodeIndex id = node_table_declarator_extract_id(t, decl);
+                assert(id != NODE_INDEX_NONE); // TODO: error handling
 
-        node_fprint(stdout, node->value.func_def.decl);
-        assert(node->value.func_def.decl->kind == NODE_DECLARATOR);
-        Token* id_tok = node_declarator_extract_id_token(node->value.func_def.decl);
-        assert(id_tok); // TODO: error handling
+                // TODO: Lookup a decl
 
-        // TODO: Lookup a decl
+                frame->inner_env = env_new(node_table_token(t, id), node_table_ident(t, id), env);
+                frame->inner_env->kind = ENV_KIND_FUNC;
+                frame->entered = 1;
 
-        Env* f_env = env_new(id_tok, env);
-        f_env->kind = ENV_KIND_FUNC;
+                push_analyze_frame(stack, t->rhs[node], frame->inner_env);
+                break;
+            }
 
-        // fprint_impl(fp, node->value.func_def.decl_spec, 0);
-        // fprint_impl(fp, node->value.func_def.decl, 0);
-        analyze(a, node->value.func_def.block, f_env);
+            env_insert(env, frame->inner_env);
+            vector_pop(stack);
+            break;
+        }
 
-        env_insert(env, f_env);
+        case NODE_STMT_COMPOUND:
+        {
+            if (!frame->entered) {
+                fprintf(DEBUGOUT, "LOG: statement compound\n");
+                frame->inner_env = env_new(NULL, NULL, env);
+                frame->inner_env->kind = ENV_KIND_BLOCK;
+                frame->entered = 1;
+                frame->index = t->lhs[node];
+            }
 
-        break;
-    }
+            if (frame->index < t->rhs[node]) {
+                NodeIndex n = t->extra[frame->index];
+                frame->index++;
+                push_analyze_frame(stack, n, frame->inner_env);
+                break;
+            }
+
+            env_drop(frame->inner_env);
+            vector_pop(stack);
+            break;
+        }
+
+        case NODE_STMT_EXPR:
+            vector_pop(stack);
+            if (t->lhs[node] != NODE_INDEX_NONE) {
+                analyze_expr(a, t, t->lhs[node], env);
+            }
+            break;
+
+        case NODE_STMT_IF:
+        {
+            vector_pop(stack);
 
-    case NODE_STMT_COMPOUND:
-    {
-        printf("LOG: statement compound\n");
+            // TODO: Dig a scope
+            analyze_expr(a, t, t->lhs[node], env);
 
-        Env* b_env = env_new(NULL, env);
-        b_env->kind = ENV_KIND_BLOCK;
+            NodeIndex then_b = t->extra[t->rhs[node]];
+            NodeIndex else_b = t->extra[t->rhs[node] + 1];
 
-        Vector* stmts = node->value.stmt_compound.stmts;
-        for(size_t i=0; i<vector_len(stmts); ++i) {
-            Node** n = (Node**)vector_at(stmts, i);
-            analyze(a, *n, b_env);
+            // Pushed in reverse order
+            if (else_b != NODE_INDEX_NONE) {
+                push_analyze_frame(stack, else_b, env);
+            }
+            push_analyze_frame(stack, then_b, env);
+            break;
         }
 
-        env_drop(b_env);
-        break;
-    }
+        case NODE_STMT_WHILE:
+        case NODE_STMT_DO:
+        case NODE_STMT_FOR:
+        {
+            if (!frame->entered) {
+                fprintf(DEBUGOUT, "LOG: statement loop\n");
+
+                NodeIndex body;
+                if (t->kinds[node] == NODE_STMT_FOR) {
+                    for(uint32_t k=0; k<3; ++k) {
+                        NodeIndex e = t->extra[t->lhs[node] + k];
+                        if (e != NODE_INDEX_NONE) {
+                            analyze_expr(a, t, e, env);
+                        }
+                    }
+                    body = t->rhs[node];
+                } else if (t->kinds[node] == NODE_STMT_WHILE) {
+                    analyze_expr(a, t, t->lhs[node], env);
+                    body = t->rhs[node];
+                } else {
+                    analyze_expr(a, t, t->rhs[node], env);
+                    body = t->lhs[node];
+                }
+
+                frame->inner_env = env_new(NULL, NULL, env);
+                frame->inner_env->kind = ENV_KIND_LOOP;
+                frame->entered = 1;
+
+                push_analyze_frame(stack, body, frame->inner_env);
+                break;
+            }
 
-    case NODE_STMT_EXPR:
-        if (node->value.stmt_expr.expr) {
-            analyze_expr(a, node->value.stmt_expr.expr, env);
+            env_drop(frame->inner_env);
+            vector_pop(stack);
+            break;
         }
-        break;
 
-    case NODE_STMT_IF:
-        // TODO: Dig a scope
-        analyze_expr(a, node->value.stmt_if.cond, env);
+        case NODE_STMT_SWITCH:
+        {
+            if (!frame->entered) {
+                fprintf(DEBUGOUT, "LOG: statement switch\n");
+                analyze_expr(a, t, t->lhs[node], env);
+
+                frame->inner_env = env_new(NULL, NULL, env);
+                frame->inner_env->kind = ENV_KIND_SWITCH;
+                frame->inner_env->value.switch_stmt.cases = uint_map_new(1, NULL);
+                frame->inner_env->value.switch_stmt.has_default = 0;
+                frame->entered = 1;
 
-        analyze(a, node->value.stmt_if.then_b, env);
+                push_analyze_frame(stack, t->rhs[node], frame->inner_env);
+                break;
+            }
 
-        if (node->value.stmt_if.else_b) {
-            analyze(a, node->value.stmt_if.else_b, env);
+            env_drop(frame->inner_env);
+            vector_pop(stack);
+            break;
         }
-        break;
 
-    case NODE_STMT_JUMP:
-        printf("LOG: statement jump\n");
+        case NODE_STMT_CASE:
+        case NODE_STMT_DEFAULT:
+        {
+            vector_pop(stack);
+            fprintf(DEBUGOUT, "LOG: statement label\n");
+
+            Env* sw = env_enclosing(env, ENV_KIND_SWITCH);
+            if (sw == NULL) {
+                fprintf(stderr, "'%s' is not in a switch\n", t->kinds[node] == NODE_STMT_CASE ? "case" : "default");
+                // TODO: error handling...
+                assert(0);
+            }
+
+            if (t->kinds[node] == NODE_STMT_CASE) {
+                NodeIndex expr = t->lhs[node];
+                analyze_expr(a, t, expr, env);
+
+                long value;
+                if (!analyzer_eval_const(t, expr, &value)) {
+                    fprintf(stderr, "Case label is not an integer constant expression\n");
+                    // TODO: error handling...
+                    assert(0);
+                }
+
+                int found;
+                uint_map_insert(sw->value.switch_stmt.cases, (size_t)value, &found);
+                if (found) {
+                    fprintf(stderr, "Duplicate case value: %ld\n", value);
+                    // TODO: error handling...
+                    assert(0);
+                }
+
+                push_analyze_frame(stack, t->rhs[node], env);
+                break;
+            }
+
+            if (sw->value.switch_stmt.has_default) {
+                fprintf(stderr, "Multiple default labels in one switch\n");
+                // TODO: error handling...
+                assert(0);
+            }
+            sw->value.switch_stmt.has_default = 1;
+
+            push_analyze_frame(stack, t->lhs[node], env);
+            break;
+        }
 
-        switch(node->value.stmt_jump.kind) {
-        case TOK_KIND_RETURN:
-            analyze_expr(a, node->value.stmt_jump.expr, env);
+        case NODE_STMT_JUMP:
+            vector_pop(stack);
+            fprintf(DEBUGOUT, "LOG: statement jump\n");
+
+            switch((TokenKind)t->rhs[node]) {
+            case TOK_KIND_RETURN:
+                analyze_expr(a, t, t->lhs[node], env);
+                break;
+
+            case TOK_KIND_BREAK:
+                if (!env_enclosing(env, ENV_KIND_LOOP) && !env_enclosing(env, ENV_KIND_SWITCH)) {
+                    fprintf(stderr, "'break' is not in a loop or a switch\n");
+                    // TODO: error handling...
+                    assert(0);
+                }
+                break;
+
+            case TOK_KIND_CONTINUE:
+                if (!env_enclosing(env, ENV_KIND_LOOP)) {
+                    fprintf(stderr, "'continue' is not in a loop\n");
+                    // TODO: error handling...
+                    assert(0);
+                }
+                break;
+
+            default:
+                // TODO: error handling...
+                assert(0);
+                break;
+            }
             break;
 
         default:
             // TODO: error handling...
+            fprintf(stderr, "Unknown kind: %d\n", t->kinds[node]);
             assert(0);
             break;
         }
-        break;
-
-    default:
-        // TODO: error handling...
-        fprintf(stderr, "Unknown kind: %d\n", node->kind);
-        assert(0);
-        break;
     }
+
+    vector_drop(stack);
 }
 
 // Returns NULL, if failed to type check
-Type* analyze_expr(Analyzer* a, Node* node, Env* env) {
-    switch(node->kind) {
-    case NODE_EXPR_BIN:
-    {
-        printf("LOG: expr binary = ");
-        token_fprint_buf(stdout, node->value.expr_bin.op);
-        printf("\n");
-
-        analyze_expr(a, node->value.expr_bin.lhs, env);
-        analyze_expr(a, node->value.expr_bin.rhs, env);
-
-        break;
-    }
+//
+// Nodes of the subtree are contiguous and in postorder in the table,
+// so types of children are already set when a node is visited.
+Type* analyze_expr(Analyzer* a, NodeTable* t, NodeIndex root, Env* env) {
+    for(NodeIndex node = node_table_subtree_begin(t, root); node <= root; ++node) {
+        t->types[node] = NULL; // TODO: fix
+
+        switch(t->kinds[node]) {
+        case NODE_EXPR_BIN:
+        {
+            fprintf(DEBUGOUT, "LOG: expr binary = ");
+            token_fprint_buf(DEBUGOUT, t->buffer, node_table_token(t, node));
+            fprintf(DEBUGOUT, "\n");
+
+            break;
+        }
 
-    case NODE_EXPR_POSTFIX:
-    {
-        fprintf(DEBUGOUT,"LOG: postfix = \n");
+        case NODE_EXPR_UNARY:
+        {
+            fprintf(DEBUGOUT, "LOG: expr unary = ");
+            token_fprint_buf(DEBUGOUT, t->buffer, node_table_token(t, node));
+            fprintf(DEBUGOUT, "\n");
 
-        analyze_expr(a, node->value.expr_postfix.lhs, env);
+            break;
+        }
 
-        switch(node->value.expr_postfix.kind) {
-        case NODE_EXPR_POSTFIX_KIND_FUNC_CALL:
-            if (node->value.expr_postfix.rhs) {
-                analyze_expr(a, node->value.expr_postfix.rhs, env);
+        case NODE_EXPR_COND:
+        {
+            fprintf(DEBUGOUT, "LOG: expr cond\n");
+
+            break;
+        }
+
+        case NODE_EXPR_POSTFIX:
+        {
+            fprintf(DEBUGOUT,"LOG: postfix = \n");
+
+            switch((NodeExprPostfixKind)t->extra[t->rhs[node]]) {
+            case NODE_EXPR_POSTFIX_KIND_FUNC_CALL:
+            case NODE_EXPR_POSTFIX_KIND_INC:
+            case NODE_EXPR_POSTFIX_KIND_DEC:
+                break;
+
+            default:
+                assert(0); // TODO: error handling
             }
+
             break;
+        }
 
-        default:
-            assert(0); // TODO: error handling
+        case NODE_LIT_INT:
+        {
+            fprintf(DEBUGOUT, "LOG: lit int = %ld\n", node_table_lit_int(t, node));
+
+            Type* ty = type_arena_malloc(a->arena);
+            ty->kind = TYPE_KIND_INT;
+            ty->value.int_.bits = -1;
+
+            t->types[node] = ty;
+
+            break;
         }
 
-        break;
-    }
+        case NODE_LIT_STRING:
+        {
+            fprintf(DEBUGOUT, "LOG: lit string = %s\n", node_table_string(t, node));
 
-    case NODE_LIT_INT:
-    {
-        printf("LOG: lit int = %d\n", node->value.lit_int.v);
+            Type* ty_inner = type_arena_malloc(a->arena);
+            ty_inner->kind = TYPE_KIND_INT;
+            ty_inner->value.int_.bits = 8;
 
-        Type* ty = type_arena_malloc(a->arena);
-        ty->kind = TYPE_KIND_INT;
-        ty->value.int_.bits = -1;
+            Type* ty = type_arena_malloc(a->arena);
+            ty->kind = TYPE_KIND_PTR;
+            ty->value.ptr.inner = ty_inner;
 
-        return ty;
-    }
+            t->types[node] = ty;
 
-    case NODE_LIT_STRING:
-    {
-        printf("LOG: lit string = %d\n", node->value.lit_string.v);
+            break;
+        }
 
-        Type* ty_inner = type_arena_malloc(a->arena);
-        ty_inner->kind = TYPE_KIND_INT;
-        ty_inner->value.int_.bits = 8;
+        case NODE_ID:
+        {
+            fprintf(DEBUGOUT, "LOG: id =");
+            token_fprint_buf(DEBUGOUT, t->buffer, node_table_token(t, node));
+            fprintf(DEBUGOUT, "\n");
 
-        Type* ty = type_arena_malloc(a->arena);
-        ty->kind = TYPE_KIND_PTR;
-        ty->value.ptr.inner = ty_inner;
+            Env* found = env_lookup(env, node_table_ident(t, node));
+            if (found == NULL) {
+                fprintf(DEBUGOUT, "! NOT FOUND\n");
+                break;
+            }
+            fprintf(DEBUGOUT, "! FOUND\n");
+
+            break; // TODO: fix
+        }
 
-        node->ty = ty;
+        case NODE_ARGS_LIST:
+        {
+            fprintf(DEBUGOUT, "LOG: args list\n");
 
-        return ty;
+            break; // TODO: fix
+        }
+
+        default:
+            // TODO: error handling...
+            fprintf(stderr, "Unknown kind: %d", t->kinds[node]);
+            assert(0);
+            break;
+        }
     }
 
-    case NODE_ID:
-    {
-        fprintf(DEBUGOUT, "LOG: id =");
-        token_fprint_buf(DEBUGOUT, node->value.id.tok);
-        fprintf(DEBUGOUT, "\n");
+    return t->types[root];
+}
+
+typedef struct {
+    long value;
+    int constant;
+} ConstValue;
+
+// Returns 0 if the result is not a constant, e.g. of a division by zero
+static int eval_const_bin(TokenKind op, long l, long r, long* value) {
+    // Wraps around as the native code does
+    unsigned long ul = (unsigned long)l;
+    unsigned long ur = (unsigned long)r;
+    switch(op) {
+    case TOK_KIND_PLUS:     *value = (long)(ul + ur); return 1;
+    case TOK_KIND_MINUS:    *value = (long)(ul - ur); return 1;
+    case TOK_KIND_MUL:      *value = (long)(ul * ur); return 1;
+    case TOK_KIND_AND:      *value = l & r; return 1;
+    case TOK_KIND_OR:       *value = l | r; return 1;
+    case TOK_KIND_XOR:      *value = l ^ r; return 1;
+    case TOK_KIND_EQ:       *value = l == r; return 1;
+    case TOK_KIND_NE:       *value = l != r; return 1;
+    case TOK_KIND_LT:       *value = l < r; return 1;
+    case TOK_KIND_GT:       *value = l > r; return 1;
+    case TOK_KIND_LE:       *value = l <= r; return 1;
+    case TOK_KIND_GE:       *value = l >= r; return 1;
+
+    case TOK_KIND_DIV:
+    case TOK_KIND_MOD:
+        if (r == 0 || (l == LONG_MIN && r == -1)) {
+            return 0;
+        }
+        *value = op == TOK_KIND_DIV ? l / r : l % r;
+        return 1;
 
-        Env* found = env_lookup(env, node->value.id.tok);
-        if (found == NULL) {
-            fprintf(DEBUGOUT, "! NOT FOUND\n");
-            return NULL;
+    case TOK_KIND_LSHIFT:
+    case TOK_KIND_RSHIFT:
+        if (r < 0 || r >= 64) {
+            return 0;
         }
-        fprintf(DEBUGOUT, "! FOUND\n");
+        *value = op == TOK_KIND_LSHIFT ? (long)(ul << r) : l >> r;
+        return 1;
 
-        return NULL; // TODO: fix
+    default:
+        return 0; // e.g. assignments and the comma operator
     }
+}
 
-    case NODE_ARGS_LIST:
-    {
-        fprintf(DEBUGOUT, "LOG: args list\n");
+// Nodes of the subtree are visited in postorder like analyze_expr. Operands which are not evaluated,
+// e.g. the right of '0 && x' or an arm of '?:', need not be constants.
+int analyzer_eval_const(NodeTable* t, NodeIndex root, long* value) {
+    NodeIndex begin = node_table_subtree_begin(t, root);
+    ConstValue* values = (ConstValue*)malloc(sizeof(ConstValue) * (root - begin + 1));
+    assert(values); // TODO: error handling...
+#define VALUE_OF(node) (&values[(node) - begin])
+
+    for(NodeIndex node = begin; node <= root; ++node) {
+        ConstValue* v = VALUE_OF(node);
+        v->value = 0;
+        v->constant = 0;
+
+        switch(t->kinds[node]) {
+        case NODE_LIT_INT:
+            v->value = node_table_lit_int(t, node);
+            v->constant = 1;
+            break;
 
-        Vector* args = node->value.args_list.args;
-        for(size_t i=0; i<vector_len(args); ++i) {
-            Node** n = (Node**)vector_at(args, i);
-            analyze_expr(a, *n, env); // TODO: error handling
+        case NODE_EXPR_UNARY:
+        {
+            ConstValue const* x = VALUE_OF(t->lhs[node]);
+            if (!x->constant) {
+                break;
+            }
+
+            v->constant = 1;
+            switch(node_table_token(t, node)->kind) {
+            case TOK_KIND_PLUS:     v->value = x->value; break;
+            case TOK_KIND_MINUS:    v->value = (long)(0 - (unsigned long)x->value); break;
+            case TOK_KIND_TILDE:    v->value = ~x->value; break;
+            case TOK_KIND_NOT:      v->value = !x->value; break;
+            default:                v->constant = 0; break; // e.g. '&' and '*'
+            }
+            break;
         }
 
-        return NULL; // TODO: fix
-    }
+        case NODE_EXPR_BIN:
+        {
+            ConstValue const* l = VALUE_OF(t->lhs[node]);
+            ConstValue const* r = VALUE_OF(t->rhs[node]);
+            TokenKind op = (TokenKind)node_table_token(t, node)->kind;
+            if (op == TOK_KIND_LOGICAL_AND || op == TOK_KIND_LOGICAL_OR) {
+                // The left decides it alone, if it short-circuits
+                int is_and = op == TOK_KIND_LOGICAL_AND;
+                if (l->constant && (l->value != 0) != is_and) {
+                    v->value = !is_and;
+                    v->constant = 1;
+                } else if (l->constant && r->constant) {
+                    v->value = r->value != 0;
+                    v->constant = 1;
+                }
+                break;
+            }
 
-    default:
-        // TODO: error handling...
-        fprintf(stderr, "Unknown kind: %d", node->kind);
-        assert(0);
-        break;
+            if (l->constant && r->constant) {
+                v->constant = eval_const_bin(op, l->value, r->value, &v->value);
+            }
+            break;
+        }
+
+        case NODE_EXPR_COND:
+        {
+            ConstValue const* cond = VALUE_OF(t->lhs[node]);
+            if (cond->constant) {
+                *v = *VALUE_OF(t->extra[t->rhs[node] + (cond->value ? 0 : 1)]);
+            }
+            break;
+        }
+
+        default:
+            break; // e.g. identifiers and calls
+        }
     }
+
+    ConstValue result = *VALUE_OF(root);
+#undef VALUE_OF
+    free(values);
+
+    *value = result.value;
+    return result.constant;
 }
 
 int analyzer_success(Analyzer* a) {
@@ -1,7 +1,7 @@
 #ifndef CC_ANALYZER_H
 #define CC_ANALYZER_H
 
-#include "node.h"
+#include "node_table.h"
 #include "type_arena.h"
 
 struct analyzer_t;
@@ -10,7 +10,10 @@ typedef struct analyzer_t Analyzer;
 Analyzer* analyzer_new(TypeArena* arena);
 void analyzer_drop(Analyzer* a);
 
-void analyzer_analyze(Analyzer* a, Node* node);
+void analyzer_analyze(Analyzer* a, NodeTable* t);
 int analyzer_success(Analyzer* a);
 
+// Folds an integer constant expression, e.g. a case label, into 'value'. Returns 0 if it is not a constant.
+int analyzer_eval_const(NodeTable* t, NodeIndex node, long* value);
+
 #endif /*CC_ANALYZER_H*/
@@ -37,6 +37,25 @@ void* arena_malloc(Arena *arena) {
     return vector_append(arena->current);
 }
 
+void arena_reset(Arena *arena) {
+    // 'current' is the largest one since each chunk doubles the previous one
+    for(size_t i=0; i<vector_len(arena->current); ++i) {
+        void* e = vector_at(arena->current, i);
+        arena->dtor(e);
+    }
+    vector_truncate(arena->current, 0);
+
+    for(size_t i=0; i<vector_len(arena->chain); ++i) {
+        Vector** c = (Vector**)vector_at(arena->chain, i);
+        for(size_t j=0; j<vector_len(*c); ++j) {
+            void* e = vector_at(*c, j);
+            arena->dtor(e);
+        }
+        vector_drop(*c);
+    }
+    vector_truncate(arena->chain, 0);
+}
+
 void arena_drop(Arena *arena) {
     if (!arena) {
         return;
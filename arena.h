@@ -9,5 +9,7 @@ typedef struct arena_t Arena;
 Arena* arena_new(size_t elem_size, void (*dtor)(void*));
 void* arena_malloc(Arena *arena);
 void arena_drop(Arena *arena);
+// Destructs all elements, and keeps the largest chunk for following allocations
+void arena_reset(Arena *arena);
 
 #endif /* CC_ARENA_H */
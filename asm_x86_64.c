@@ -1,12 +1,16 @@
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
-#include <stdarg.h>
+#include <limits.h>
 #include "asm_x86_64.h"
 #include "ir.h"
 #include "ir_inst_defs.h"
+#include "asm_x86_64_defs.h"
 #include "vector.h"
 #include "map.h"
 #include "log.h"
+#include "literal.h"
+#include "hash.h"
 
 static void built_from_ir(ASM_X86_64 *a, IRModule* m);
 static void built_from_ir_function(ASM_X86_64 *a, IRFunction* f);
@@ -14,130 +18,20 @@ static void collect_labels_from_ir_bb(ASM_X86_64 *a, IRBB* bb);
 static void built_from_ir_bb(ASM_X86_64 *a, IRBB* bb);
 static void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst);
 static void built_from_ir_global_inst(ASM_X86_64 *a, IRInst* inst);
+static void isel_prepare(ASM_X86_64* a, IRFunction* f);
 
-struct asm_x86_64_t {
-    Vector* insts;         // Vector<ASM_X86_64_Inst>
-    Vector* values;        // Vector<ASM_X86_64_Var>
-    Vector* global_values; // Vector<ASM_X86_64_Var>
-    Vector* offsets;       // Vector<size_t>
-    size_t string_label_count;
-    size_t code_label_count;
-    UintMap* labels;
-};
-
-typedef enum asm_x86_64_op_t {
-    ASM_X86_64_OP_PUSHQ, // v
-    ASM_X86_64_OP_POPQ,  // v
-    ASM_X86_64_OP_MOVQ,  // d, s
-    ASM_X86_64_OP_MOVL,  // d, s
-    ASM_X86_64_OP_ADDQ,  // d, s
-    ASM_X86_64_OP_SUBQ,  // d, s
-    ASM_X86_64_OP_LEAQ,  // d, s
-    ASM_X86_64_OP_CALL,  // v
-    ASM_X86_64_OP_CMPQ,  // d, s
-    ASM_X86_64_OP_JMP,   // v
-    ASM_X86_64_OP_JE,    // v
-    ASM_X86_64_OP_RET,   // (none)
-} ASM_X86_64_Op;
-
-typedef enum asm_x86_64_reg_t {
-    ASM_X86_64_REG_RAX,
-    ASM_X86_64_REG_RBX,
-    ASM_X86_64_REG_RCX,
-    ASM_X86_64_REG_RDX,
-    ASM_X86_64_REG_RSP,
-    ASM_X86_64_REG_RBP,
-    ASM_X86_64_REG_RSI,
-    ASM_X86_64_REG_RDI,
-    ASM_X86_64_REG_RIP,
-
-    ASM_X86_64_REG_EAX,
-} ASM_X86_64_Reg;
-
-static ASM_X86_64_Reg arg_regs[4] = {
+// Integer arguments of SysV ABI, the rest are passed on the stack
+static ASM_X86_64_Reg arg_regs[6] = {
     ASM_X86_64_REG_RDI,
     ASM_X86_64_REG_RSI,
     ASM_X86_64_REG_RDX,
     ASM_X86_64_REG_RCX,
+    ASM_X86_64_REG_R8,
+    ASM_X86_64_REG_R9,
 };
-
-typedef enum asm_x86_64_value_kind_t {
-    ASM_X86_64_VALUE_KIND_SYMBOL,
-    ASM_X86_64_VALUE_KIND_IMM_INT,
-    ASM_X86_64_VALUE_KIND_STRING,
-    ASM_X86_64_VALUE_KIND_REG,
-    ASM_X86_64_VALUE_KIND_DISP_REG,
-} ASM_X86_64_ValueKind;
-
-struct asm_x86_64_value_t;
-typedef struct asm_x86_64_value_t ASM_X86_64_Value;
-
-struct asm_x86_64_value_t {
-    ASM_X86_64_ValueKind kind;
-    union {
-        char const* symbol;
-        int imm_int;
-        struct {
-            char const* label;
-        } string;
-        ASM_X86_64_Reg reg;
-        struct {
-            char const* symbol;
-            int disp; // 32bits
-            ASM_X86_64_Reg reg;
-        } disp_reg;
-    } value;
-};
-
-typedef enum asm_x86_64_var_kind_t {
-    ASM_X86_64_VAR_REF,
-    ASM_X86_64_VAR_VAL,
-} ASM_X86_64_VarKind;
-
-typedef struct asm_x86_64_var_t {
-    ASM_X86_64_VarKind kind;
-    union {
-        IRSymbolID ref;
-        ASM_X86_64_Value val;
-    } value;
-} ASM_X86_64_Var;
-
-typedef enum asm_x86_64_inst_kind_t {
-    ASM_X86_64_INST_KIND_SECTION,
-    ASM_X86_64_INST_KIND_STRING,
-    ASM_X86_64_INST_KIND_TEXT,
-    ASM_X86_64_INST_KIND_GLOBAL,
-    ASM_X86_64_INST_KIND_TYPE,
-    ASM_X86_64_INST_KIND_LABEL,
-    ASM_X86_64_INST_KIND_OP,
-} ASM_X86_64_InstKind;
-
-struct asm_x86_64_inst_t {
-    ASM_X86_64_InstKind kind;
-    union {
-        struct {
-            char const* name;
-        } section;
-        struct {
-            char const* s;
-        } string;
-        struct {
-            char const* name;
-        } global;
-        struct {
-            char const* name;
-            char const* type;
-        } type;
-        struct {
-            char const* name;
-            int generated;
-        } label;
-        struct {
-            ASM_X86_64_Op op;
-            ASM_X86_64_Value args[4];
-        } op;
-    } value;
-};
+#define ARG_REGS_NUM (sizeof(arg_regs) / sizeof(ASM_X86_64_Reg))
+#define STACK_ALIGN 16
+#define RED_ZONE_SIZE 128
 
 static void asm_x86_64_inst_destruct(ASM_X86_64_Inst* inst) {
     switch(inst->kind) {
@@ -153,15 +47,26 @@ static void asm_x86_64_inst_destruct(ASM_X86_64_Inst* inst) {
     }
 }
 
-ASM_X86_64* asm_x86_64_new(IRModule* m) {
+ASM_X86_64* asm_x86_64_new(IRModule* m, ASM_X86_64_Options const* opts) {
     ASM_X86_64* a = (ASM_X86_64*)malloc(sizeof(ASM_X86_64));
     a->insts = vector_new(sizeof(ASM_X86_64_Inst));
     a->values = vector_new(sizeof(ASM_X86_64_Var));
     a->global_values = vector_new(sizeof(ASM_X86_64_Var));
-    a->offsets = vector_new(sizeof(size_t));
-    a->string_label_count = 0;
+    a->offsets = vector_new(sizeof(int));
+    a->opts.omit_frame_pointer = opts ? opts->omit_frame_pointer : 0;
+    a->opts.strength_reduce = opts ? opts->strength_reduce : 1;
+    a->opts.jump_tables = opts ? opts->jump_tables : 1;
+    a->opts.tree_isel = opts ? opts->tree_isel : 1;
     a->code_label_count = 0;
+    a->func_name = NULL;
+    a->frame_pointer = 1;
+    a->frame_size = 0;
+    a->stack_params_num = 0;
+    a->tail_called = 0;
+    a->funcs = vector_new(sizeof(ASM_X86_64_Func));
     a->labels = uint_map_new(sizeof(char const*), NULL);
+    a->nodes = NULL;
+    a->nodes_len = 0;
 
     built_from_ir(a, m);
 
@@ -179,13 +84,19 @@ void asm_x86_64_drop(ASM_X86_64 *a) {
     vector_drop(a->global_values);
     vector_drop(a->offsets);
     uint_map_drop(a->labels);
+    vector_drop(a->funcs);
+    free(a->nodes);
 
     free(a);
 }
 
-static void fprint_inst_op(FILE* fp, char const* op, int num, ...);
+#define WRITE_LIT(w, s) writer_put_bytes((w), (s), sizeof(s) - 1)
+
+static void write_insts(Writer* w, ASM_X86_64* a, size_t begin, size_t end);
+static void write_inst_op(Writer* w, char const* op, ASM_X86_64_Value* a0, ASM_X86_64_Value* a1);
+static void write_value(Writer* w, ASM_X86_64_Value* v);
+static void write_reg(Writer* w, ASM_X86_64_Reg reg);
 static void fprint_value(FILE* fp, ASM_X86_64_Value* v);
-static void fprint_reg(FILE* fp, ASM_X86_64_Reg reg);
 
 static void asm_x86_64_set_val(ASM_X86_64 *a, IRSymbolID id, ASM_X86_64_Value value, int is_global) {
     Vector* mem = a->values;
@@ -223,108 +134,289 @@ static ASM_X86_64_Value* asm_x86_64_get_val(ASM_X86_64 *a, IRSymbolID id, int is
     assert(0); // TODO: implement
 }
 
-static void asm_x86_64_set_local(ASM_X86_64 *a, IRSymbolID id, size_t offset) {
+static void asm_x86_64_set_local(ASM_X86_64 *a, IRSymbolID id, int offset) {
     while(vector_len(a->offsets) <= id) {
         void* e = vector_append(a->offsets);
         assert(e);
     }
 
-    fprintf(DEBUGOUT, "SET LOCAL = %ld <- %ld\n", id, offset);
-    size_t* o = vector_at(a->offsets, id);
+    fprintf(DEBUGOUT, "SET LOCAL = %ld <- %d\n", id, offset);
+    int* o = vector_at(a->offsets, id);
     *o = offset;
 }
 
-static size_t asm_x86_64_get_local(ASM_X86_64 *a, IRSymbolID id) {
+// Negative in the red zone
+static int asm_x86_64_get_local(ASM_X86_64 *a, IRSymbolID id) {
     fprintf(DEBUGOUT, "GET LOCAL = %ld\n", id);
     assert(id <= vector_len(a->offsets));
 
-    size_t* o = vector_at(a->offsets, id);
+    int* o = vector_at(a->offsets, id);
     return *o;
 }
 
-void asm_x86_64_fprint(FILE* fp, ASM_X86_64* a) {
-	fprintf(fp, ".file	\"simple_00.c\"\n"); // TODO
-	fprintf(fp, ".text\n");                  // TODO
+void asm_x86_64_write(Writer* w, ASM_X86_64* a) {
+    asm_x86_64_write_header(w, a);
+    for(size_t i=0; i<vector_len(a->funcs); ++i) {
+        asm_x86_64_write_function(w, a, i);
+    }
+}
 
+void asm_x86_64_write_header(Writer* w, ASM_X86_64* a) {
+    WRITE_LIT(w, ".file\t\"simple_00.c\"\n"); // TODO
+    WRITE_LIT(w, ".text\n");                   // TODO
+
+    size_t end = vector_len(a->insts);
+    if (vector_len(a->funcs) > 0) {
+        ASM_X86_64_Func* f = vector_at(a->funcs, 0);
+        end = f->begin;
+    }
+    write_insts(w, a, 0, end);
+}
+
+void asm_x86_64_write_function(Writer* w, ASM_X86_64* a, size_t index) {
+    ASM_X86_64_Func* f = vector_at(a->funcs, index);
+    write_insts(w, a, f->begin, f->end);
+}
+
+size_t asm_x86_64_functions_len(ASM_X86_64* a) {
+    return vector_len(a->funcs);
+}
+
+char const* asm_x86_64_function_name(ASM_X86_64* a, size_t index) {
+    ASM_X86_64_Func* f = vector_at(a->funcs, index);
+    return f->name;
+}
+
+size_t asm_x86_64_ops_len(ASM_X86_64* a) {
+    size_t len = 0;
     for(size_t i=0; i<vector_len(a->insts); ++i) {
+        ASM_X86_64_Inst* inst = vector_at(a->insts, i);
+        if (inst->kind == ASM_X86_64_INST_KIND_OP) {
+            len++;
+        }
+    }
+
+    return len;
+}
+
+void write_insts(Writer* w, ASM_X86_64* a, size_t begin, size_t end) {
+    for(size_t i=begin; i<end; ++i) {
         ASM_X86_64_Inst* inst = vector_at(a->insts, i);
         switch(inst->kind) {
         case ASM_X86_64_INST_KIND_SECTION:
-            fprintf(fp, "\t");
-            fprintf(fp, ".section\t%s\n", inst->value.section.name);
+            WRITE_LIT(w, "\t.section\t");
+            writer_put_str(w, inst->value.section.name);
+            writer_put_char(w, '\n');
             break;
 
         case ASM_X86_64_INST_KIND_STRING:
-            fprintf(fp, "\t");
-            fprintf(fp, ".string\t\"%s\"\n", inst->value.string.s);
+            WRITE_LIT(w, "\t.string\t\"");
+            literal_write_string(w, inst->value.string.s, inst->value.string.len);
+            WRITE_LIT(w, "\"\n");
+            break;
+
+        case ASM_X86_64_INST_KIND_ALIGN:
+            WRITE_LIT(w, "\t.balign\t");
+            writer_put_int(w, inst->value.align.bytes);
+            writer_put_char(w, '\n');
+            break;
+
+        case ASM_X86_64_INST_KIND_JUMP_TABLE_ENTRY:
+            WRITE_LIT(w, "\t.long\t");
+            writer_put_str(w, inst->value.jump_table_entry.label);
+            writer_put_char(w, '-');
+            writer_put_str(w, inst->value.jump_table_entry.table);
+            writer_put_char(w, '\n');
             break;
 
         case ASM_X86_64_INST_KIND_TEXT:
-            fprintf(fp, "\t");
-            fprintf(fp, ".text\n");
+            WRITE_LIT(w, "\t.text\n");
             break;
 
         case ASM_X86_64_INST_KIND_GLOBAL:
-            fprintf(fp, "\t");
-            fprintf(fp, ".globl\t%s\n", inst->value.global.name);
+            WRITE_LIT(w, "\t.globl\t");
+            writer_put_str(w, inst->value.global.name);
+            writer_put_char(w, '\n');
             break;
 
         case ASM_X86_64_INST_KIND_TYPE:
-            fprintf(fp, "\t");
-            fprintf(fp, ".type\t%s, %s\n", inst->value.type.name, inst->value.type.type);
+            WRITE_LIT(w, "\t.type\t");
+            writer_put_str(w, inst->value.type.name);
+            WRITE_LIT(w, ", ");
+            writer_put_str(w, inst->value.type.type);
+            writer_put_char(w, '\n');
             break;
 
         case ASM_X86_64_INST_KIND_LABEL:
-            fprintf(fp, "%s:\n", inst->value.label.name);
+            writer_put_str(w, inst->value.label.name);
+            WRITE_LIT(w, ":\n");
             break;
 
         case ASM_X86_64_INST_KIND_OP:
         {
-            fprintf(fp, "\t");
+            writer_put_char(w, '\t');
             ASM_X86_64_Value* args = inst->value.op.args;
             switch(inst->value.op.op) {
             case ASM_X86_64_OP_PUSHQ:
-                fprint_inst_op(fp, "pushq", 1, &args[0]);
+                write_inst_op(w, "pushq", &args[0], NULL);
                 break;
 
             case ASM_X86_64_OP_POPQ:
-                fprint_inst_op(fp, "popq", 1, &args[0]);
+                write_inst_op(w, "popq", &args[0], NULL);
                 break;
 
             case ASM_X86_64_OP_MOVQ:
-                fprint_inst_op(fp, "movq", 2, &args[1], &args[0]);
+                write_inst_op(w, "movq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_MOVL:
+                write_inst_op(w, "movl", &args[1], &args[0]);
                 break;
 
             case ASM_X86_64_OP_ADDQ:
-                fprint_inst_op(fp, "addq", 2, &args[1], &args[0]);
+                write_inst_op(w, "addq", &args[1], &args[0]);
                 break;
 
             case ASM_X86_64_OP_SUBQ:
-                fprint_inst_op(fp, "subq", 2, &args[1], &args[0]);
+                write_inst_op(w, "subq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_IMULQ:
+                write_inst_op(w, "imulq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_IMULQ_WIDE:
+                write_inst_op(w, "imulq", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_IDIVQ:
+                write_inst_op(w, "idivq", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_CQTO:
+                write_inst_op(w, "cqto", NULL, NULL);
+                break;
+
+            case ASM_X86_64_OP_NEGQ:
+                write_inst_op(w, "negq", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_ANDQ:
+                write_inst_op(w, "andq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_ORQ:
+                write_inst_op(w, "orq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_XORQ:
+                write_inst_op(w, "xorq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_SHLQ:
+                write_inst_op(w, "shlq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_SHRQ:
+                write_inst_op(w, "shrq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_SARQ:
+                write_inst_op(w, "sarq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_MOVABSQ:
+                write_inst_op(w, "movabsq", &args[1], &args[0]);
                 break;
 
             case ASM_X86_64_OP_LEAQ:
-                fprint_inst_op(fp, "leaq", 2, &args[1], &args[0]);
+                write_inst_op(w, "leaq", &args[1], &args[0]);
                 break;
 
             case ASM_X86_64_OP_CALL:
-                fprint_inst_op(fp, "call", 1, &args[0]);
+                write_inst_op(w, "call", &args[0], NULL);
                 break;
 
             case ASM_X86_64_OP_CMPQ:
-                fprint_inst_op(fp, "cmp", 2, &args[1], &args[0]);
+                write_inst_op(w, "cmp", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_SETE:
+                write_inst_op(w, "sete", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_SETNE:
+                write_inst_op(w, "setne", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_SETL:
+                write_inst_op(w, "setl", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_SETLE:
+                write_inst_op(w, "setle", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_SETG:
+                write_inst_op(w, "setg", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_SETGE:
+                write_inst_op(w, "setge", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_MOVZBQ:
+                write_inst_op(w, "movzbq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_MOVSLQ:
+                write_inst_op(w, "movslq", &args[1], &args[0]);
+                break;
+
+            case ASM_X86_64_OP_CMOVNE:
+                write_inst_op(w, "cmovne", &args[1], &args[0]);
                 break;
 
             case ASM_X86_64_OP_JMP:
-                fprint_inst_op(fp, "jmp", 1, &args[0]);
+                write_inst_op(w, "jmp", &args[0], NULL);
                 break;
 
             case ASM_X86_64_OP_JE:
-                fprint_inst_op(fp, "je", 1, &args[0]);
+                write_inst_op(w, "je", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_JNE:
+                write_inst_op(w, "jne", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_JA:
+                write_inst_op(w, "ja", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_JL:
+                write_inst_op(w, "jl", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_JLE:
+                write_inst_op(w, "jle", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_JG:
+                write_inst_op(w, "jg", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_JGE:
+                write_inst_op(w, "jge", &args[0], NULL);
+                break;
+
+            case ASM_X86_64_OP_JMP_INDIRECT:
+                WRITE_LIT(w, "jmp\t*");
+                write_value(w, &args[0]);
+                writer_put_char(w, '\n');
                 break;
 
             case ASM_X86_64_OP_RET:
-                fprint_inst_op(fp, "ret", 0);
+                write_inst_op(w, "ret", NULL, NULL);
                 break;
 
             default:
@@ -336,53 +428,74 @@ void asm_x86_64_fprint(FILE* fp, ASM_X86_64* a) {
     }
 }
 
-void fprint_inst_op(FILE* fp, char const* op, int num, ...) {
-    va_list ap;
+void asm_x86_64_fprint(FILE* fp, ASM_X86_64* a) {
+    fflush(fp);
 
-    fprintf(fp, "%s", op);
+    Writer* w = writer_new(fileno(fp), 0);
+    asm_x86_64_write(w, a);
+    writer_flush(w);
+    writer_drop(w);
+}
 
-    va_start(ap, num);
-    for(int i=0; i<num; ++i) {
-        if (i == 0) {
-            fprintf(fp, "\t");
-        } else {
-            fprintf(fp, ", ");
-        }
-        ASM_X86_64_Value* arg = va_arg(ap, ASM_X86_64_Value*);
-        fprint_value(fp, arg);
+// Operands are given in the AT&T order. Both are nullable.
+void write_inst_op(Writer* w, char const* op, ASM_X86_64_Value* a0, ASM_X86_64_Value* a1) {
+    writer_put_str(w, op);
+    if (a0) {
+        writer_put_char(w, '\t');
+        write_value(w, a0);
     }
-    va_end(ap);
-
-    fprintf(fp, "\n");
+    if (a1) {
+        WRITE_LIT(w, ", ");
+        write_value(w, a1);
+    }
+    writer_put_char(w, '\n');
 }
 
-void fprint_value(FILE* fp, ASM_X86_64_Value* v) {
+void write_value(Writer* w, ASM_X86_64_Value* v) {
     switch(v->kind) {
     case ASM_X86_64_VALUE_KIND_SYMBOL:
-        fprintf(fp, "%s", v->value.symbol);
+        writer_put_str(w, v->value.symbol);
         break;
 
     case ASM_X86_64_VALUE_KIND_IMM_INT:
-        fprintf(fp, "$%d", v->value.imm_int);
+        writer_put_char(w, '$');
+        writer_put_int(w, v->value.imm_int);
         break;
 
     case ASM_X86_64_VALUE_KIND_STRING:
-        fprintf(fp, "%s(%%rip)", v->value.string.label);
+        writer_put_str(w, v->value.string.label);
+        WRITE_LIT(w, "(%rip)");
         break;
 
     case ASM_X86_64_VALUE_KIND_REG:
-        fprint_reg(fp, v->value.reg);
+        write_reg(w, v->value.reg);
         break;
 
     case ASM_X86_64_VALUE_KIND_DISP_REG:
         if (v->value.disp_reg.symbol) {
-            fprintf(fp, "%s", v->value.disp_reg.symbol);
+            writer_put_str(w, v->value.disp_reg.symbol);
         } else {
-            fprintf(fp, "%d", v->value.disp_reg.disp);
+            writer_put_int(w, v->value.disp_reg.disp);
         }
-        fprintf(fp, "(");
-        fprint_reg(fp, v->value.disp_reg.reg);
-        fprintf(fp, ")");
+        writer_put_char(w, '(');
+        write_reg(w, v->value.disp_reg.reg);
+        writer_put_char(w, ')');
+        break;
+
+    case ASM_X86_64_VALUE_KIND_INDEX:
+        writer_put_int(w, v->value.index.disp);
+        writer_put_char(w, '(');
+        write_reg(w, v->value.index.base);
+        WRITE_LIT(w, ", ");
+        write_reg(w, v->value.index.index);
+        WRITE_LIT(w, ", ");
+        writer_put_int(w, v->value.index.scale);
+        writer_put_char(w, ')');
+        break;
+
+    case ASM_X86_64_VALUE_KIND_IMM_INT64:
+        writer_put_char(w, '$');
+        writer_put_int(w, v->value.imm_int64);
         break;
 
     default:
@@ -391,55 +504,81 @@ void fprint_value(FILE* fp, ASM_X86_64_Value* v) {
     }
 }
 
-void fprint_reg(FILE* fp, ASM_X86_64_Reg reg) {
-    char const* reg_name;
-    switch(reg) {
-    case ASM_X86_64_REG_RAX:
-        reg_name = "rax";
-        break;
+#define REG_NAME(s) { s, sizeof(s) - 1 }
+static struct {
+    char const* name;
+    size_t len;
+} const reg_names[] = {
+    [ASM_X86_64_REG_RAX] = REG_NAME("%rax"),
+    [ASM_X86_64_REG_RBX] = REG_NAME("%rbx"),
+    [ASM_X86_64_REG_RCX] = REG_NAME("%rcx"),
+    [ASM_X86_64_REG_RDX] = REG_NAME("%rdx"),
+    [ASM_X86_64_REG_RSP] = REG_NAME("%rsp"),
+    [ASM_X86_64_REG_RBP] = REG_NAME("%rbp"),
+    [ASM_X86_64_REG_RSI] = REG_NAME("%rsi"),
+    [ASM_X86_64_REG_RDI] = REG_NAME("%rdi"),
+    [ASM_X86_64_REG_R8]  = REG_NAME("%r8"),
+    [ASM_X86_64_REG_R9]  = REG_NAME("%r9"),
+    [ASM_X86_64_REG_RIP] = REG_NAME("%rip"),
+    [ASM_X86_64_REG_EAX] = REG_NAME("%eax"),
+    [ASM_X86_64_REG_AL]  = REG_NAME("%al"),
+    [ASM_X86_64_REG_CL]  = REG_NAME("%cl"),
+};
+#undef REG_NAME
 
-    case ASM_X86_64_REG_RBX:
-        reg_name = "rbx";
-        break;
+void write_reg(Writer* w, ASM_X86_64_Reg reg) {
+    if ((size_t)reg >= sizeof(reg_names) / sizeof(reg_names[0]) || reg_names[reg].name == NULL) {
+        fprintf(stderr, "Unexpected kind: %d\n", reg);
+        assert(0); // TODO: error handling...
+    }
 
-    case ASM_X86_64_REG_RCX:
-        reg_name = "rcx";
-        break;
+    writer_put_bytes(w, reg_names[reg].name, reg_names[reg].len);
+}
 
-    case ASM_X86_64_REG_RDX:
-        reg_name = "rdx";
+// For debug logs
+void fprint_value(FILE* fp, ASM_X86_64_Value* v) {
+    switch(v->kind) {
+    case ASM_X86_64_VALUE_KIND_SYMBOL:
+        fprintf(fp, "%s", v->value.symbol);
         break;
 
-    case ASM_X86_64_REG_RSP:
-        reg_name = "rsp";
+    case ASM_X86_64_VALUE_KIND_IMM_INT:
+        fprintf(fp, "$%d", v->value.imm_int);
         break;
 
-    case ASM_X86_64_REG_RBP:
-        reg_name = "rbp";
+    case ASM_X86_64_VALUE_KIND_STRING:
+        fprintf(fp, "%s(%%rip)", v->value.string.label);
         break;
 
-    case ASM_X86_64_REG_RSI:
-        reg_name = "rsi";
+    case ASM_X86_64_VALUE_KIND_REG:
+        fprintf(fp, "%s", reg_names[v->value.reg].name);
         break;
 
-    case ASM_X86_64_REG_RDI:
-        reg_name = "rdi";
+    case ASM_X86_64_VALUE_KIND_DISP_REG:
+        if (v->value.disp_reg.symbol) {
+            fprintf(fp, "%s", v->value.disp_reg.symbol);
+        } else {
+            fprintf(fp, "%d", v->value.disp_reg.disp);
+        }
+        fprintf(fp, "(%s)", reg_names[v->value.disp_reg.reg].name);
         break;
 
-    case ASM_X86_64_REG_RIP:
-        reg_name = "rip";
+    case ASM_X86_64_VALUE_KIND_INDEX:
+        fprintf(fp, "%d(%s, %s, %d)",
+                v->value.index.disp,
+                reg_names[v->value.index.base].name,
+                reg_names[v->value.index.index].name,
+                v->value.index.scale);
         break;
 
-    case ASM_X86_64_REG_EAX:
-        reg_name = "eax";
+    case ASM_X86_64_VALUE_KIND_IMM_INT64:
+        fprintf(fp, "$%ld", v->value.imm_int64);
         break;
 
     default:
-        fprintf(stderr, "Unexpected kind: %d\n", reg);
+        fprintf(stderr, "Unknown kind: %d", v->kind);
         assert(0); // TODO: error handling...
     }
-
-    fprintf(fp, "%%%s", reg_name);
 }
 
 void built_from_ir(ASM_X86_64 *a, IRModule* m) {
@@ -464,7 +603,37 @@ static void built_from_ir_function_bb_built_iter(IRBB* bb, void* args) {
     built_from_ir_bb(a, bb);
 }
 
+struct calls_info_t {
+    int has_calls;
+    size_t outgoing_size;   // The largest area of stack arguments
+};
+
+static void calls_info_iter(IRBB* bb, void* args) {
+    struct calls_info_t* info = (struct calls_info_t*)args;
+    for(size_t i=0; i<vector_len(bb->insts); ++i) {
+        IRInst* inst = vector_at(bb->insts, i);
+        if (inst->kind != IR_INST_KIND_LET || inst->value.let.rhs.kind != IR_INST_VALUE_KIND_CALL) {
+            continue;
+        }
+        info->has_calls = 1;
+
+        size_t args_num = vector_len(inst->value.let.rhs.value.call.args);
+        if (args_num > ARG_REGS_NUM && (args_num - ARG_REGS_NUM) * 8 > info->outgoing_size) {
+            info->outgoing_size = (args_num - ARG_REGS_NUM) * 8;
+        }
+    }
+}
+
 void built_from_ir_function(ASM_X86_64 *a, IRFunction* f) {
+    ASM_X86_64_Func* func = (ASM_X86_64_Func*)vector_append(a->funcs);
+    func->name = f->name;
+    func->begin = vector_len(a->insts);
+
+    // Labels are named in each function, so instructions of a function do not depend on others
+    a->func_name = f->name;
+    a->code_label_count = 0;
+    a->stack_params_num = f->params_num > ARG_REGS_NUM ? f->params_num - ARG_REGS_NUM : 0;
+
     {
         // .text
         ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
@@ -495,33 +664,69 @@ void built_from_ir_function(ASM_X86_64 *a, IRFunction* f) {
         inst->value.label.generated = 0;
     }
 
-    {
-        // pushq rbp
-        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-        inst->kind = ASM_X86_64_INST_KIND_OP;
-        inst->value.op.op = ASM_X86_64_OP_PUSHQ;
-        inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
-        inst->value.op.args[0].value.reg = ASM_X86_64_REG_RBP;
+    struct calls_info_t calls = { 0, 0 };
+    ir_bb_visit(f->entry, calls_info_iter, &calls);
+
+    isel_prepare(a, f);
+
+    // Stack arguments of calls are stored at the bottom of the frame, so RSP does not move around calls.
+    // Locals are above them, except folded values which have no slots.
+    size_t stack_size = calls.outgoing_size;
+    for(size_t i=0; i<vector_len(f->locals); ++i) {
+        size_t* local = vector_at(f->locals, i);
+        assert(*local <= 16);
+        if (i < a->nodes_len && a->nodes[i].folded) {
+            continue;
+        }
+        stack_size += *local;
     }
 
-    {
-        // movq rbp, rsp
-        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-        inst->kind = ASM_X86_64_INST_KIND_OP;
-        inst->value.op.op = ASM_X86_64_OP_MOVQ;
-        inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
-        inst->value.op.args[0].value.reg = ASM_X86_64_REG_RBP;
-        inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_REG;
-        inst->value.op.args[1].value.reg = ASM_X86_64_REG_RSP;
+    // Leaf functions keep locals in the red zone below RSP, and do not touch RSP at all
+    a->frame_pointer = !a->opts.omit_frame_pointer;
+    int red_zone = a->opts.omit_frame_pointer && !calls.has_calls && stack_size <= RED_ZONE_SIZE;
+
+    if (a->frame_pointer) {
+        // RSP is aligned after pushq rbp, and kept aligned at calls
+        stack_size = (stack_size + STACK_ALIGN - 1) & ~(size_t)(STACK_ALIGN - 1);
+    } else if (red_zone) {
+        stack_size = 0;
+    } else if (calls.has_calls) {
+        // RSP is misaligned by the return address
+        stack_size = ((stack_size + 8 + STACK_ALIGN - 1) & ~(size_t)(STACK_ALIGN - 1)) - 8;
     }
+    a->frame_size = stack_size;
 
-    size_t stack_size = 0;
+    int offset = red_zone ? -RED_ZONE_SIZE : (int)calls.outgoing_size;
     for(size_t i=0; i<vector_len(f->locals); ++i) {
         size_t* local = vector_at(f->locals, i);
 
-        asm_x86_64_set_local(a, i, stack_size);
-        assert(*local <= 16);
-        stack_size += *local;
+        asm_x86_64_set_local(a, i, offset);
+        if (i < a->nodes_len && a->nodes[i].folded) {
+            continue;
+        }
+        offset += (int)*local;
+    }
+
+    if (a->frame_pointer) {
+        {
+            // pushq rbp
+            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+            inst->kind = ASM_X86_64_INST_KIND_OP;
+            inst->value.op.op = ASM_X86_64_OP_PUSHQ;
+            inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+            inst->value.op.args[0].value.reg = ASM_X86_64_REG_RBP;
+        }
+
+        {
+            // movq rbp, rsp
+            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+            inst->kind = ASM_X86_64_INST_KIND_OP;
+            inst->value.op.op = ASM_X86_64_OP_MOVQ;
+            inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+            inst->value.op.args[0].value.reg = ASM_X86_64_REG_RBP;
+            inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_REG;
+            inst->value.op.args[1].value.reg = ASM_X86_64_REG_RSP;
+        }
     }
 
     if (stack_size != 0) {
@@ -537,62 +742,1203 @@ void built_from_ir_function(ASM_X86_64 *a, IRFunction* f) {
 
     ir_bb_visit(f->entry, built_from_ir_function_bb_collect_labels_iter, a);
     ir_bb_visit(f->entry, built_from_ir_function_bb_built_iter, a);
+
+    // Re-fetch, 'funcs' may be reallocated
+    func = (ASM_X86_64_Func*)vector_at(a->funcs, vector_len(a->funcs) - 1);
+    func->end = vector_len(a->insts);
+}
+
+// Restores RSP (and RBP) of the caller
+static void built_epilogue(ASM_X86_64* a) {
+    if (a->frame_pointer) {
+        {
+            // movq rsp, rbp
+            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+            inst->kind = ASM_X86_64_INST_KIND_OP;
+            inst->value.op.op = ASM_X86_64_OP_MOVQ;
+            inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+            inst->value.op.args[0].value.reg = ASM_X86_64_REG_RSP;
+            inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_REG;
+            inst->value.op.args[1].value.reg = ASM_X86_64_REG_RBP;
+        }
+
+        {
+            // popq rbp
+            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+            inst->kind = ASM_X86_64_INST_KIND_OP;
+            inst->value.op.op = ASM_X86_64_OP_POPQ;
+            inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+            inst->value.op.args[0].value.reg = ASM_X86_64_REG_RBP;
+        }
+
+        return;
+    }
+
+    if (a->frame_size != 0) {
+        // addq rsp, 'frame_size'
+        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+        inst->kind = ASM_X86_64_INST_KIND_OP;
+        inst->value.op.op = ASM_X86_64_OP_ADDQ;
+        inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+        inst->value.op.args[0].value.reg = ASM_X86_64_REG_RSP;
+        inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_IMM_INT;
+        inst->value.op.args[1].value.imm_int = (int)a->frame_size;
+    }
 }
 
-static char const* make_code_label(size_t index) {
-    char* label_id = (char*)malloc(sizeof(char) * 10);
-    snprintf(label_id, 10, ".L%07ld", index);
+// The 'index'th stack argument of the current function
+static ASM_X86_64_Value incoming_arg(ASM_X86_64* a, size_t index) {
+    // Above the return address, and the saved RBP or the frame
+    int disp = (int)(index * 8);
+    disp += a->frame_pointer ? 16 : (int)a->frame_size + 8;
+
+    ASM_X86_64_Value value = {
+        .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
+        .value = {
+            .disp_reg = {
+                .symbol = NULL,
+                .disp = disp,
+                .reg = a->frame_pointer ? ASM_X86_64_REG_RBP : ASM_X86_64_REG_RSP,
+            },
+        },
+    };
 
-    return label_id;
+    return value;
 }
 
-void collect_labels_from_ir_bb(ASM_X86_64 *a, IRBB* bb) {
-    char const* label_id = make_code_label(a->code_label_count);
-    char const** m = uint_map_insert(a->labels, bb->id, NULL);
-    *m = label_id;
+static ASM_X86_64_Value reg_value(ASM_X86_64_Reg reg) {
+    ASM_X86_64_Value value = {
+        .kind = ASM_X86_64_VALUE_KIND_REG,
+        .value = {
+            .reg = reg,
+        },
+    };
 
-    a->code_label_count++;
+    return value;
 }
 
-void built_from_ir_bb(ASM_X86_64 *a, IRBB* bb) {
-    char const** m = uint_map_find(a->labels, bb->id);
-    assert(m);
-    char const* label_id = *m;
+static ASM_X86_64_Value imm_value(int imm) {
+    ASM_X86_64_Value value = {
+        .kind = ASM_X86_64_VALUE_KIND_IMM_INT,
+        .value = {
+            .imm_int = imm,
+        },
+    };
 
-    {
-        // .label 'label_id'
-        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-        inst->kind = ASM_X86_64_INST_KIND_LABEL;
-        inst->value.label.name = label_id;
-        inst->value.label.generated = 1;
+    return value;
+}
+
+// Arguments are in the order of ASM_X86_64_Op, e.g. (d, s). Both are nullable.
+static void built_op(ASM_X86_64* a, ASM_X86_64_Op op, ASM_X86_64_Value a0, ASM_X86_64_Value const* a1) {
+    // e.g. an operand which is already in RAX
+    if (op == ASM_X86_64_OP_MOVQ && a1 && a0.kind == ASM_X86_64_VALUE_KIND_REG
+        && a1->kind == ASM_X86_64_VALUE_KIND_REG && a0.value.reg == a1->value.reg) {
+        return;
     }
 
-    for(size_t i=0; i<vector_len(bb->insts); ++i) {
-        IRInst* inst = vector_at(bb->insts, i);
-        built_from_ir_inst(a, inst);
+    ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+    inst->kind = ASM_X86_64_INST_KIND_OP;
+    inst->value.op.op = op;
+    inst->value.op.args[0] = a0;
+    if (a1) {
+        inst->value.op.args[1] = *a1;
     }
-    assert(bb->term);
-    built_from_ir_inst(a, bb->term);
 }
 
-void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
-    switch(inst->kind) {
-    case IR_INST_KIND_LET:
-    {
-        IRSymbolID var_id = inst->value.let.id;
-        IRInstValue* let_rhs = &inst->value.let.rhs;
-        switch(let_rhs->kind) {
-        case IR_INST_VALUE_KIND_REF:
-        {
-            ASM_X86_64_Value* ref_val =
-                asm_x86_64_get_val(a, let_rhs->value.ref.sym, let_rhs->value.ref.is_global);
+static void built_op_reg_reg(ASM_X86_64* a, ASM_X86_64_Op op, ASM_X86_64_Reg d, ASM_X86_64_Reg s) {
+    ASM_X86_64_Value src = reg_value(s);
+    built_op(a, op, reg_value(d), &src);
+}
 
-            asm_x86_64_set_val(a, var_id, *ref_val, 0);
+static void built_op_reg_imm(ASM_X86_64* a, ASM_X86_64_Op op, ASM_X86_64_Reg d, int imm) {
+    ASM_X86_64_Value src = imm_value(imm);
+    built_op(a, op, reg_value(d), &src);
+}
 
-            break;
-        }
+// Returns k if 'v' is 2^k, otherwise -1
+static int log2_exact(unsigned long v) {
+    if (v == 0 || (v & (v - 1)) != 0) {
+        return -1;
+    }
 
-        case IR_INST_VALUE_KIND_ADDR_OF:
+    int k = 0;
+    while((v >> k) != 1) {
+        ++k;
+    }
+    return k;
+}
+
+// RAX <- 'x' * 'c'
+static void built_mul_imm(ASM_X86_64* a, ASM_X86_64_Value const* x, int c) {
+    built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), x);
+
+    unsigned long m = c < 0 ? -(unsigned long)(long)c : (unsigned long)c;
+    if (!a->opts.strength_reduce || m == 0) {
+        built_op_reg_imm(a, ASM_X86_64_OP_IMULQ, ASM_X86_64_REG_RAX, c);
+        return;
+    }
+
+    // c = (+/-) m' * 2^k, where m' is 1, 3, 5 or 9
+    int k = 0;
+    while((m & 1) == 0) {
+        m >>= 1;
+        ++k;
+    }
+    if (m != 1 && m != 3 && m != 5 && m != 9) {
+        built_op_reg_imm(a, ASM_X86_64_OP_IMULQ, ASM_X86_64_REG_RAX, c);
+        return;
+    }
+
+    if (m != 1) {
+        // leaq RAX, (RAX, RAX, m'-1)
+        ASM_X86_64_Value src = {
+            .kind = ASM_X86_64_VALUE_KIND_INDEX,
+            .value = {
+                .index = {
+                    .disp = 0,
+                    .base = ASM_X86_64_REG_RAX,
+                    .index = ASM_X86_64_REG_RAX,
+                    .scale = (int)m - 1,
+                },
+            },
+        };
+        built_op(a, ASM_X86_64_OP_LEAQ, reg_value(ASM_X86_64_REG_RAX), &src);
+    }
+    if (k != 0) {
+        built_op_reg_imm(a, ASM_X86_64_OP_SHLQ, ASM_X86_64_REG_RAX, k);
+    }
+    if (c < 0) {
+        built_op(a, ASM_X86_64_OP_NEGQ, reg_value(ASM_X86_64_REG_RAX), NULL);
+    }
+}
+
+// The magic number and the shift of signed division by 'd' for 64bits, Hacker's Delight 10-1.
+// |d| must be 2 or more.
+static void signed_div_magic(long d, long* magic, int* shift) {
+    unsigned long const two63 = 1UL << 63;
+    unsigned long ad = d < 0 ? -(unsigned long)d : (unsigned long)d;
+    unsigned long t = two63 + ((unsigned long)d >> 63);
+    unsigned long anc = t - 1 - t % ad;
+    unsigned long q1 = two63 / anc;
+    unsigned long r1 = two63 - q1 * anc;
+    unsigned long q2 = two63 / ad;
+    unsigned long r2 = two63 - q2 * ad;
+    unsigned long delta;
+    int p = 63;
+    do {
+        ++p;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            ++q1;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            ++q2;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while(q1 < delta || (q1 == delta && r1 == 0));
+
+    *magic = (long)(q2 + 1);
+    if (d < 0) {
+        *magic = -*magic;
+    }
+    *shift = p - 64;
+}
+
+// RAX <- 'x' / 'd' or 'x' % 'd', truncated toward zero without idiv. 'd' must not be 0.
+static void built_div_imm(ASM_X86_64* a, ASM_X86_64_Value const* x, int d, int is_mod) {
+    unsigned long ad = d < 0 ? -(unsigned long)(long)d : (unsigned long)d;
+    if (ad == 1) {
+        if (is_mod) {
+            built_op_reg_imm(a, ASM_X86_64_OP_MOVQ, ASM_X86_64_REG_RAX, 0);
+            return;
+        }
+        built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), x);
+        if (d < 0) {
+            built_op(a, ASM_X86_64_OP_NEGQ, reg_value(ASM_X86_64_REG_RAX), NULL);
+        }
+        return;
+    }
+
+    // The dividend is kept in RCX
+    built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RCX), x);
+
+    int k = log2_exact(ad);
+    if (k > 0) {
+        // Negative dividends are biased by 2^k-1, so that the arithmetic shift rounds toward zero
+        built_op_reg_reg(a, ASM_X86_64_OP_MOVQ, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RCX);
+        built_op_reg_imm(a, ASM_X86_64_OP_SARQ, ASM_X86_64_REG_RAX, 63);
+        built_op_reg_imm(a, ASM_X86_64_OP_SHRQ, ASM_X86_64_REG_RAX, 64 - k);
+        built_op_reg_reg(a, ASM_X86_64_OP_ADDQ, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RCX);
+
+        if (is_mod) {
+            // x - ((x + bias) & -2^k)
+            built_op_reg_imm(a, ASM_X86_64_OP_ANDQ, ASM_X86_64_REG_RAX, (int)-(long)ad);
+            built_op_reg_reg(a, ASM_X86_64_OP_SUBQ, ASM_X86_64_REG_RCX, ASM_X86_64_REG_RAX);
+            built_op_reg_reg(a, ASM_X86_64_OP_MOVQ, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RCX);
+            return;
+        }
+
+        built_op_reg_imm(a, ASM_X86_64_OP_SARQ, ASM_X86_64_REG_RAX, k);
+        if (d < 0) {
+            built_op(a, ASM_X86_64_OP_NEGQ, reg_value(ASM_X86_64_REG_RAX), NULL);
+        }
+        return;
+    }
+
+    long magic;
+    int shift;
+    signed_div_magic(d, &magic, &shift);
+
+    {
+        // movabsq RAX, 'magic'
+        ASM_X86_64_Value src = {
+            .kind = ASM_X86_64_VALUE_KIND_IMM_INT64,
+            .value = {
+                .imm_int64 = magic,
+            },
+        };
+        built_op(a, ASM_X86_64_OP_MOVABSQ, reg_value(ASM_X86_64_REG_RAX), &src);
+    }
+
+    // RDX <- the high half of 'magic' * x
+    built_op(a, ASM_X86_64_OP_IMULQ_WIDE, reg_value(ASM_X86_64_REG_RCX), NULL);
+    if (d > 0 && magic < 0) {
+        built_op_reg_reg(a, ASM_X86_64_OP_ADDQ, ASM_X86_64_REG_RDX, ASM_X86_64_REG_RCX);
+    } else if (d < 0 && magic > 0) {
+        built_op_reg_reg(a, ASM_X86_64_OP_SUBQ, ASM_X86_64_REG_RDX, ASM_X86_64_REG_RCX);
+    }
+    if (shift != 0) {
+        built_op_reg_imm(a, ASM_X86_64_OP_SARQ, ASM_X86_64_REG_RDX, shift);
+    }
+
+    // Adds 1 to negative quotients
+    built_op_reg_reg(a, ASM_X86_64_OP_MOVQ, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RDX);
+    built_op_reg_imm(a, ASM_X86_64_OP_SHRQ, ASM_X86_64_REG_RAX, 63);
+    built_op_reg_reg(a, ASM_X86_64_OP_ADDQ, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RDX);
+
+    if (is_mod) {
+        // x - q * d
+        built_op_reg_imm(a, ASM_X86_64_OP_IMULQ, ASM_X86_64_REG_RAX, d);
+        built_op_reg_reg(a, ASM_X86_64_OP_SUBQ, ASM_X86_64_REG_RCX, ASM_X86_64_REG_RAX);
+        built_op_reg_reg(a, ASM_X86_64_OP_MOVQ, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RCX);
+    }
+}
+
+// 'reg' <- 1 if the condition of 'set_op' holds by flags, otherwise 0
+static void built_setcc(ASM_X86_64* a, ASM_X86_64_Op set_op, ASM_X86_64_Reg reg) {
+    ASM_X86_64_Reg reg8 = reg == ASM_X86_64_REG_RAX ? ASM_X86_64_REG_AL : ASM_X86_64_REG_CL;
+    assert(reg == ASM_X86_64_REG_RAX || reg == ASM_X86_64_REG_RCX);
+
+    built_op(a, set_op, reg_value(reg8), NULL);
+    built_op_reg_reg(a, ASM_X86_64_OP_MOVZBQ, reg, reg8);
+}
+
+// RAX <- 'lhs' 'op' 'rhs'. RCX and RDX are clobbered.
+static void built_op_bin(ASM_X86_64* a, TokenKind op, ASM_X86_64_Value const* lhs, ASM_X86_64_Value const* rhs) {
+    switch(op) {
+    case TOK_KIND_PLUS:
+    case TOK_KIND_MINUS:
+    case TOK_KIND_AND:
+    case TOK_KIND_OR:
+    case TOK_KIND_XOR:
+    {
+        ASM_X86_64_Op asm_op =
+            op == TOK_KIND_PLUS ? ASM_X86_64_OP_ADDQ :
+            op == TOK_KIND_MINUS ? ASM_X86_64_OP_SUBQ :
+            op == TOK_KIND_AND ? ASM_X86_64_OP_ANDQ :
+            op == TOK_KIND_OR ? ASM_X86_64_OP_ORQ :
+            ASM_X86_64_OP_XORQ;
+        built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), lhs);
+        built_op(a, asm_op, reg_value(ASM_X86_64_REG_RAX), rhs);
+        break;
+    }
+
+    case TOK_KIND_MUL:
+        if (rhs->kind == ASM_X86_64_VALUE_KIND_IMM_INT) {
+            built_mul_imm(a, lhs, rhs->value.imm_int);
+        } else if (lhs->kind == ASM_X86_64_VALUE_KIND_IMM_INT) {
+            built_mul_imm(a, rhs, lhs->value.imm_int);
+        } else {
+            built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), lhs);
+            built_op(a, ASM_X86_64_OP_IMULQ, reg_value(ASM_X86_64_REG_RAX), rhs);
+        }
+        break;
+
+    case TOK_KIND_DIV:
+    case TOK_KIND_MOD:
+        if (a->opts.strength_reduce && rhs->kind == ASM_X86_64_VALUE_KIND_IMM_INT && rhs->value.imm_int != 0) {
+            built_div_imm(a, lhs, rhs->value.imm_int, op == TOK_KIND_MOD);
+            break;
+        }
+
+        // idiv takes no immediates
+        built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RCX), rhs);
+        built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), lhs);
+        built_op(a, ASM_X86_64_OP_CQTO, reg_value(ASM_X86_64_REG_RAX), NULL);
+        built_op(a, ASM_X86_64_OP_IDIVQ, reg_value(ASM_X86_64_REG_RCX), NULL);
+        if (op == TOK_KIND_MOD) {
+            built_op_reg_reg(a, ASM_X86_64_OP_MOVQ, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RDX);
+        }
+        break;
+
+    case TOK_KIND_LSHIFT:
+    case TOK_KIND_RSHIFT:
+    {
+        ASM_X86_64_Op asm_op = op == TOK_KIND_LSHIFT ? ASM_X86_64_OP_SHLQ : ASM_X86_64_OP_SARQ;
+        if (rhs->kind == ASM_X86_64_VALUE_KIND_IMM_INT) {
+            built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), lhs);
+            built_op_reg_imm(a, asm_op, ASM_X86_64_REG_RAX, rhs->value.imm_int & 63);
+            break;
+        }
+
+        built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RCX), rhs);
+        built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), lhs);
+        built_op_reg_reg(a, asm_op, ASM_X86_64_REG_RAX, ASM_X86_64_REG_CL);
+        break;
+    }
+
+    case TOK_KIND_LT:
+    case TOK_KIND_GT:
+    case TOK_KIND_LE:
+    case TOK_KIND_GE:
+    case TOK_KIND_EQ:
+    case TOK_KIND_NE:
+    {
+        ASM_X86_64_Op set_op =
+            op == TOK_KIND_LT ? ASM_X86_64_OP_SETL :
+            op == TOK_KIND_GT ? ASM_X86_64_OP_SETG :
+            op == TOK_KIND_LE ? ASM_X86_64_OP_SETLE :
+            op == TOK_KIND_GE ? ASM_X86_64_OP_SETGE :
+            op == TOK_KIND_EQ ? ASM_X86_64_OP_SETE :
+            ASM_X86_64_OP_SETNE;
+        built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), lhs);
+        built_op(a, ASM_X86_64_OP_CMPQ, reg_value(ASM_X86_64_REG_RAX), rhs);
+        built_setcc(a, set_op, ASM_X86_64_REG_RAX);
+        break;
+    }
+
+    default:
+        fprintf(stderr, "Unsupported operator: %s\n", token_kind_to_string(op));
+        assert(0); // TODO: error handling...
+    }
+}
+
+// e.g. ".Lmain.0"
+static char const* make_code_label(char const* func_name, size_t index) {
+    size_t size = strlen(func_name) + 24;
+    char* label_id = (char*)malloc(sizeof(char) * size);
+    snprintf(label_id, size, ".L%s.%ld", func_name, index);
+
+    return label_id;
+}
+
+void collect_labels_from_ir_bb(ASM_X86_64 *a, IRBB* bb) {
+    char const* label_id = make_code_label(a->func_name, a->code_label_count);
+    char const** m = uint_map_insert(a->labels, bb->id, NULL);
+    *m = label_id;
+
+    a->code_label_count++;
+}
+
+struct phi_copies_args_t {
+    ASM_X86_64* a;
+    IRBB* bb;
+};
+
+// Stores values which phis of 'next' take from 'bb' into slots of the phis. Terminators only read slots
+// and clobber RAX, so the copies are placed before them even if the other successor does not need them.
+static void built_phi_copies_iter(IRBB* next, void* args) {
+    struct phi_copies_args_t* p = (struct phi_copies_args_t*)args;
+    ASM_X86_64* a = p->a;
+
+    for(size_t i=0; i<vector_len(next->insts); ++i) {
+        IRInst* inst = vector_at(next->insts, i);
+        if (inst->value.let.rhs.kind != IR_INST_VALUE_KIND_PHI) {
+            break;
+        }
+
+        Vector* incomings = inst->value.let.rhs.value.phi.incomings;
+        for(size_t k=0; k<vector_len(incomings); ++k) {
+            IRPhiIncoming* in = (IRPhiIncoming*)vector_at(incomings, k);
+            if (in->bb != p->bb) {
+                continue;
+            }
+
+            ASM_X86_64_Value slot = {
+                .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
+                .value = {
+                    .disp_reg = {
+                        .symbol = NULL,
+                        .disp = asm_x86_64_get_local(a, inst->value.let.id),
+                        .reg = ASM_X86_64_REG_RSP,
+                    },
+                },
+            };
+            ASM_X86_64_Value src = *asm_x86_64_get_val(a, in->sym, 0);
+            if (src.kind != ASM_X86_64_VALUE_KIND_IMM_INT && src.kind != ASM_X86_64_VALUE_KIND_REG) {
+                built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), &src);
+                src = reg_value(ASM_X86_64_REG_RAX);
+            }
+            built_op(a, ASM_X86_64_OP_MOVQ, slot, &src);
+        }
+    }
+}
+
+void built_from_ir_bb(ASM_X86_64 *a, IRBB* bb) {
+    char const** m = uint_map_find(a->labels, bb->id);
+    assert(m);
+    char const* label_id = *m;
+
+    {
+        // .label 'label_id'
+        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+        inst->kind = ASM_X86_64_INST_KIND_LABEL;
+        inst->value.label.name = label_id;
+        inst->value.label.generated = 1;
+    }
+
+    a->tail_called = 0;
+    for(size_t i=0; i<vector_len(bb->insts); ++i) {
+        IRInst* inst = vector_at(bb->insts, i);
+        built_from_ir_inst(a, inst);
+    }
+    assert(bb->term);
+    if (a->tail_called && bb->term->kind == IR_INST_KIND_RET) {
+        return;
+    }
+
+    struct phi_copies_args_t p = { a, bb };
+    ir_bb_foreach_nexts(bb, built_phi_copies_iter, &p);
+    built_from_ir_inst(a, bb->term);
+}
+
+// Switches with at least this many cases, which fill this percentage of their range, jump through tables
+#define SWITCH_TABLE_MIN_CASES 4
+#define SWITCH_TABLE_MIN_DENSITY 40
+// Ranges of this many cases or less are compared one by one, and larger ones are split in halves
+#define SWITCH_LINEAR_MAX_CASES 3
+
+static void built_jump_to(ASM_X86_64* a, ASM_X86_64_Op op, char const* label) {
+    ASM_X86_64_Value target = {
+        .kind = ASM_X86_64_VALUE_KIND_SYMBOL,
+        .value = {
+            .symbol = label,
+        },
+    };
+    built_op(a, op, target, NULL);
+}
+
+static char const* bb_label(ASM_X86_64* a, IRBB* bb) {
+    char const** m = uint_map_find(a->labels, bb->id);
+    assert(m);
+    return *m;
+}
+
+// Tables are indexed by 32 bits immediates, so wider values are compared one by one
+static int is_dense_cases(IRSwitchCase* cases, size_t len) {
+    if (len < SWITCH_TABLE_MIN_CASES || cases[0].value != (int)cases[0].value
+        || cases[len - 1].value != (int)cases[len - 1].value) {
+        return 0;
+    }
+
+    long range = (long)cases[len - 1].value - (long)cases[0].value + 1;
+    return (long)len * 100 >= range * SWITCH_TABLE_MIN_DENSITY;
+}
+
+// Jumps to RAX - 'lo' th entry of a table in .rodata, or to 'default_label' if RAX is out of the range
+static void built_jump_table(ASM_X86_64* a, IRSwitchCase* cases, size_t len, char const* default_label) {
+    int lo = (int)cases[0].value;
+    int hi = (int)cases[len - 1].value;
+
+    char* table = (char*)make_code_label(a->func_name, a->code_label_count);
+    a->code_label_count++;
+
+    // Values below 'lo' wrap around, so one unsigned comparison checks both bounds
+    built_op_reg_reg(a, ASM_X86_64_OP_MOVQ, ASM_X86_64_REG_RCX, ASM_X86_64_REG_RAX);
+    if (lo != 0) {
+        built_op_reg_imm(a, ASM_X86_64_OP_SUBQ, ASM_X86_64_REG_RCX, lo);
+    }
+    built_op_reg_imm(a, ASM_X86_64_OP_CMPQ, ASM_X86_64_REG_RCX, (int)((long)hi - (long)lo));
+    built_jump_to(a, ASM_X86_64_OP_JA, default_label);
+
+    {
+        // leaq RDX, 'table'(%rip)
+        ASM_X86_64_Value addr = {
+            .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
+            .value = {
+                .disp_reg = {
+                    .symbol = table,
+                    .disp = 0,
+                    .reg = ASM_X86_64_REG_RIP,
+                },
+            },
+        };
+        built_op(a, ASM_X86_64_OP_LEAQ, reg_value(ASM_X86_64_REG_RDX), &addr);
+    }
+
+    {
+        // movslq RCX, (RDX, RCX, 4)
+        ASM_X86_64_Value entry = {
+            .kind = ASM_X86_64_VALUE_KIND_INDEX,
+            .value = {
+                .index = {
+                    .disp = 0,
+                    .base = ASM_X86_64_REG_RDX,
+                    .index = ASM_X86_64_REG_RCX,
+                    .scale = 4,
+                },
+            },
+        };
+        built_op(a, ASM_X86_64_OP_MOVSLQ, reg_value(ASM_X86_64_REG_RCX), &entry);
+    }
+
+    // Entries are offsets from the table, so it needs no relocations
+    built_op_reg_reg(a, ASM_X86_64_OP_ADDQ, ASM_X86_64_REG_RCX, ASM_X86_64_REG_RDX);
+    built_op(a, ASM_X86_64_OP_JMP_INDIRECT, reg_value(ASM_X86_64_REG_RCX), NULL);
+
+    {
+        // .section .rodata
+        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+        inst->kind = ASM_X86_64_INST_KIND_SECTION;
+        inst->value.section.name = ".rodata";
+    }
+
+    {
+        // .balign 4
+        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+        inst->kind = ASM_X86_64_INST_KIND_ALIGN;
+        inst->value.align.bytes = 4;
+    }
+
+    {
+        // .label 'table'
+        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+        inst->kind = ASM_X86_64_INST_KIND_LABEL;
+        inst->value.label.name = table;
+        inst->value.label.generated = 1;
+    }
+
+    size_t k = 0;
+    for(long v=lo; v<=hi; ++v) {
+        char const* label = default_label;
+        if (cases[k].value == v) {
+            label = bb_label(a, cases[k].bb);
+            k++;
+        }
+
+        // .long 'label'-'table'
+        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+        inst->kind = ASM_X86_64_INST_KIND_JUMP_TABLE_ENTRY;
+        inst->value.jump_table_entry.label = label;
+        inst->value.jump_table_entry.table = table;
+    }
+
+    {
+        // .text
+        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+        inst->kind = ASM_X86_64_INST_KIND_TEXT;
+    }
+}
+
+// Compares RAX with a case value, through RCX if it does not fit in an immediate
+static void built_cmp_case(ASM_X86_64* a, long value) {
+    if (value == (int)value) {
+        built_op_reg_imm(a, ASM_X86_64_OP_CMPQ, ASM_X86_64_REG_RAX, (int)value);
+        return;
+    }
+
+    ASM_X86_64_Value src = {
+        .kind = ASM_X86_64_VALUE_KIND_IMM_INT64,
+        .value = {
+            .imm_int64 = value,
+        },
+    };
+    built_op(a, ASM_X86_64_OP_MOVABSQ, reg_value(ASM_X86_64_REG_RCX), &src);
+    built_op_reg_reg(a, ASM_X86_64_OP_CMPQ, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RCX);
+}
+
+// Jumps to the case of RAX in sorted 'cases', or to 'default_label'.
+// Dense ranges jump through tables, and the others are split at the middle case into a balanced compare tree.
+static void built_switch_cases(ASM_X86_64* a, IRSwitchCase* cases, size_t len, char const* default_label) {
+    if (a->opts.jump_tables && is_dense_cases(cases, len)) {
+        built_jump_table(a, cases, len, default_label);
+        return;
+    }
+
+    if (len <= SWITCH_LINEAR_MAX_CASES) {
+        for(size_t i=0; i<len; ++i) {
+            built_cmp_case(a, cases[i].value);
+            built_jump_to(a, ASM_X86_64_OP_JE, bb_label(a, cases[i].bb));
+        }
+        built_jump_to(a, ASM_X86_64_OP_JMP, default_label);
+        return;
+    }
+
+    size_t mid = len / 2;
+    char* left = (char*)make_code_label(a->func_name, a->code_label_count);
+    a->code_label_count++;
+
+    built_cmp_case(a, cases[mid].value);
+    built_jump_to(a, ASM_X86_64_OP_JL, left);
+    built_switch_cases(a, cases + mid, len - mid, default_label);
+
+    {
+        // .label 'left'
+        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+        inst->kind = ASM_X86_64_INST_KIND_LABEL;
+        inst->value.label.name = left;
+        inst->value.label.generated = 1;
+    }
+    built_switch_cases(a, cases, mid, default_label);
+}
+
+// Instruction selection over expression trees.
+// A binary operation whose only use is a binary operation or a terminator in the same block, with no calls between them,
+// is folded into the user. The tree is computed in registers at the root instead of going through slots, and each
+// operation takes the tile of the least instructions, e.g. 'a + b * 4 + 8' is one leaq. Leaves are read from slots
+// directly as operands, which covers immediates and memory operands. Roots are computed into RAX, and subtrees into
+// registers of the pool, which built_op_bin never clobbers.
+
+// Deeper trees are cut, so computing them does not recurse without bound
+#define ISEL_MAX_DEPTH 32
+
+static ASM_X86_64_Reg const isel_pool[] = {
+    ASM_X86_64_REG_RSI,
+    ASM_X86_64_REG_RDI,
+    ASM_X86_64_REG_R8,
+    ASM_X86_64_REG_R9,
+};
+#define ISEL_POOL_NUM ((int)(sizeof(isel_pool) / sizeof(ASM_X86_64_Reg)))
+
+// leaq 'disp'('base', 'index', 'scale')
+typedef struct {
+    IRSymbolID base;
+    IRSymbolID index;
+    int scale;
+    int disp;
+} IselAddr;
+
+static ASM_X86_64_Node* isel_node(ASM_X86_64* a, IRSymbolID id) {
+    assert(id < a->nodes_len);
+    return &a->nodes[id];
+}
+
+static int isel_is_tree(ASM_X86_64* a, IRSymbolID id) {
+    return isel_node(a, id)->folded;
+}
+
+// Immediates of operands are 32 bits sign-extended
+static int isel_is_imm(ASM_X86_64* a, IRSymbolID id) {
+    IRInstValue* v = isel_node(a, id)->value;
+    return v != NULL && v->kind == IR_INST_VALUE_KIND_IMM_INT && v->value.imm_int == (int)v->value.imm_int;
+}
+
+static int isel_imm(ASM_X86_64* a, IRSymbolID id) {
+    assert(isel_is_imm(a, id));
+    return (int)isel_node(a, id)->value->value.imm_int;
+}
+
+// Instructions to have the value in a register
+static int isel_reg_cost(ASM_X86_64* a, IRSymbolID id) {
+    return isel_is_tree(a, id) ? isel_node(a, id)->cost : 1;
+}
+
+static int isel_need(ASM_X86_64* a, IRSymbolID id) {
+    return isel_is_tree(a, id) ? isel_node(a, id)->need : 0;
+}
+
+static int isel_depth(ASM_X86_64* a, IRSymbolID id) {
+    return isel_is_tree(a, id) ? isel_node(a, id)->depth : 0;
+}
+
+static int max_int(int x, int y) {
+    return x > y ? x : y;
+}
+
+// Operators of two-address instructions, 'op s, d'. Others are built by built_op_bin.
+// Multiplications by immediates are left to built_op_bin, which reduces them.
+static int isel_has_op_tile(ASM_X86_64* a, IRInstValue* v) {
+    switch(v->value.op_bin.op) {
+    case TOK_KIND_PLUS:
+    case TOK_KIND_MINUS:
+    case TOK_KIND_AND:
+    case TOK_KIND_OR:
+    case TOK_KIND_XOR:
+        return 1;
+
+    case TOK_KIND_MUL:
+        return !isel_is_imm(a, v->value.op_bin.lhs) && !isel_is_imm(a, v->value.op_bin.rhs);
+
+    case TOK_KIND_LSHIFT:
+    case TOK_KIND_RSHIFT:
+        return isel_is_imm(a, v->value.op_bin.rhs);
+
+    default:
+        return 0;
+    }
+}
+
+static int isel_is_commutative(TokenKind op) {
+    return op == TOK_KIND_PLUS || op == TOK_KIND_AND || op == TOK_KIND_OR || op == TOK_KIND_XOR || op == TOK_KIND_MUL;
+}
+
+static int isel_is_comparison(TokenKind op) {
+    return op == TOK_KIND_LT || op == TOK_KIND_GT || op == TOK_KIND_LE || op == TOK_KIND_GE
+        || op == TOK_KIND_EQ || op == TOK_KIND_NE;
+}
+
+static ASM_X86_64_Op isel_op(TokenKind op) {
+    switch(op) {
+    case TOK_KIND_PLUS:
+        return ASM_X86_64_OP_ADDQ;
+    case TOK_KIND_MINUS:
+        return ASM_X86_64_OP_SUBQ;
+    case TOK_KIND_AND:
+        return ASM_X86_64_OP_ANDQ;
+    case TOK_KIND_OR:
+        return ASM_X86_64_OP_ORQ;
+    case TOK_KIND_XOR:
+        return ASM_X86_64_OP_XORQ;
+    case TOK_KIND_MUL:
+        return ASM_X86_64_OP_IMULQ;
+    case TOK_KIND_LSHIFT:
+        return ASM_X86_64_OP_SHLQ;
+    case TOK_KIND_RSHIFT:
+        return ASM_X86_64_OP_SARQ;
+    default:
+        assert(0); // unreachable
+        return ASM_X86_64_OP_ADDQ;
+    }
+}
+
+// A folded 'x * 2^k' or 'x << k', which is an index of addresses
+static int isel_match_scaled(ASM_X86_64* a, IRSymbolID id, IRSymbolID* x, int* scale) {
+    if (!isel_is_tree(a, id)) {
+        return 0;
+    }
+    IRInstValue* v = isel_node(a, id)->value;
+    IRSymbolID lhs = v->value.op_bin.lhs;
+    IRSymbolID rhs = v->value.op_bin.rhs;
+
+    switch(v->value.op_bin.op) {
+    case TOK_KIND_MUL:
+        if (isel_is_imm(a, lhs) && !isel_is_imm(a, rhs)) {
+            IRSymbolID t = lhs;
+            lhs = rhs;
+            rhs = t;
+        }
+        if (isel_is_imm(a, lhs) || !isel_is_imm(a, rhs)) {
+            return 0;
+        }
+        if (isel_imm(a, rhs) != 2 && isel_imm(a, rhs) != 4 && isel_imm(a, rhs) != 8) {
+            return 0;
+        }
+        *scale = isel_imm(a, rhs);
+        break;
+
+    case TOK_KIND_LSHIFT:
+        if (isel_is_imm(a, lhs) || !isel_is_imm(a, rhs) || isel_imm(a, rhs) < 1 || isel_imm(a, rhs) > 3) {
+            return 0;
+        }
+        *scale = 1 << isel_imm(a, rhs);
+        break;
+
+    default:
+        return 0;
+    }
+
+    *x = lhs;
+    return 1;
+}
+
+// 'x' + 'y', where one of them may be scaled
+static int isel_match_sum(ASM_X86_64* a, IRSymbolID x, IRSymbolID y, IselAddr* addr) {
+    if (isel_is_imm(a, x) || isel_is_imm(a, y)) {
+        return 0;
+    }
+
+    IRSymbolID scaled;
+    int scale;
+    if (isel_match_scaled(a, y, &scaled, &scale)) {
+        addr->base = x;
+        addr->index = scaled;
+        addr->scale = scale;
+    } else if (isel_match_scaled(a, x, &scaled, &scale)) {
+        addr->base = y;
+        addr->index = scaled;
+        addr->scale = scale;
+    } else {
+        addr->base = x;
+        addr->index = y;
+        addr->scale = 1;
+    }
+    return 1;
+}
+
+static int isel_match_addr(ASM_X86_64* a, IRInstValue* v, IselAddr* addr) {
+    TokenKind op = v->value.op_bin.op;
+    IRSymbolID lhs = v->value.op_bin.lhs;
+    IRSymbolID rhs = v->value.op_bin.rhs;
+
+    IRSymbolID sum;
+    if (op == TOK_KIND_PLUS && isel_is_imm(a, rhs) && !isel_is_imm(a, lhs)) {
+        addr->disp = isel_imm(a, rhs);
+        sum = lhs;
+    } else if (op == TOK_KIND_PLUS && isel_is_imm(a, lhs) && !isel_is_imm(a, rhs)) {
+        addr->disp = isel_imm(a, lhs);
+        sum = rhs;
+    } else if (op == TOK_KIND_MINUS && isel_is_imm(a, rhs) && !isel_is_imm(a, lhs) && isel_imm(a, rhs) != INT_MIN) {
+        addr->disp = -isel_imm(a, rhs);
+        sum = lhs;
+    } else if (op == TOK_KIND_PLUS) {
+        addr->disp = 0;
+        return isel_match_sum(a, lhs, rhs, addr);
+    } else {
+        return 0;
+    }
+
+    // A displacement alone is an addq, so it needs a folded sum
+    if (!isel_is_tree(a, sum) || isel_node(a, sum)->value->value.op_bin.op != TOK_KIND_PLUS) {
+        return 0;
+    }
+    IRInstValue* s = isel_node(a, sum)->value;
+    return isel_match_sum(a, s->value.op_bin.lhs, s->value.op_bin.rhs, addr);
+}
+
+// Chooses the cheapest tile of the binary operation 'n', for the current folding of its children
+static void isel_choose_tile(ASM_X86_64* a, ASM_X86_64_Node* n) {
+    IRInstValue* v = n->value;
+    IRSymbolID lhs = v->value.op_bin.lhs;
+    IRSymbolID rhs = v->value.op_bin.rhs;
+    int lhs_tree = isel_is_tree(a, lhs);
+    int rhs_tree = isel_is_tree(a, rhs);
+
+    // The right hand side tree is computed first, and kept in a register of the pool
+    n->need = rhs_tree ? 1 + max_int(isel_need(a, rhs), isel_need(a, lhs)) : isel_need(a, lhs);
+    if (isel_has_op_tile(a, v)) {
+        n->tile = ASM_X86_64_TILE_OP;
+        n->cost = isel_reg_cost(a, lhs) + (rhs_tree ? isel_node(a, rhs)->cost : 0) + 1;
+
+        if (isel_is_commutative(v->value.op_bin.op) && !lhs_tree && rhs_tree) {
+            n->tile = ASM_X86_64_TILE_OP_SWAPPED;
+            n->cost = isel_node(a, rhs)->cost + 1;
+            n->need = isel_need(a, rhs);
+        }
+    } else {
+        // Not exact, but sequences of built_op_bin are longer than the others
+        n->tile = ASM_X86_64_TILE_BUILT;
+        n->cost = (lhs_tree ? isel_node(a, lhs)->cost : 0) + (rhs_tree ? isel_node(a, rhs)->cost : 0) + 3;
+    }
+
+    IselAddr addr;
+    if (isel_match_addr(a, v, &addr)) {
+        int cost = isel_reg_cost(a, addr.base) + isel_reg_cost(a, addr.index) + 1;
+        if (cost < n->cost) {
+            n->tile = ASM_X86_64_TILE_LEA;
+            n->cost = cost;
+            n->need = 1 + max_int(isel_need(a, addr.index), isel_need(a, addr.base));
+        }
+    }
+
+    n->depth = 1 + max_int(isel_depth(a, lhs), isel_depth(a, rhs));
+}
+
+// 'id' may be folded into a user at 'pos' of block 'bb', after the last call at 'call_pos' if 'has_call'
+static int isel_can_fold(ASM_X86_64* a, IRSymbolID id, IRBBID bb, int has_call, size_t call_pos) {
+    ASM_X86_64_Node* n = isel_node(a, id);
+    return a->opts.tree_isel
+        && n->value != NULL
+        && n->value->kind == IR_INST_VALUE_KIND_OP_BIN
+        && n->uses == 1
+        && n->bb == bb
+        && (!has_call || n->pos > call_pos);
+}
+
+static void isel_fold_op_bin(ASM_X86_64* a, ASM_X86_64_Node* n, IRBBID bb, int has_call, size_t call_pos) {
+    IRSymbolID lhs = n->value->value.op_bin.lhs;
+    IRSymbolID rhs = n->value->value.op_bin.rhs;
+    isel_node(a, lhs)->folded = isel_can_fold(a, lhs, bb, has_call, call_pos);
+    isel_node(a, rhs)->folded = isel_can_fold(a, rhs, bb, has_call, call_pos);
+    isel_choose_tile(a, n);
+
+    // Subtrees which need too many registers, or too deep, are computed into their slots as before
+    while(n->need > ISEL_POOL_NUM || n->depth > ISEL_MAX_DEPTH) {
+        IRSymbolID cut = lhs;
+        if (!isel_is_tree(a, lhs)
+            || (isel_is_tree(a, rhs) && isel_need(a, rhs) + isel_depth(a, rhs) > isel_need(a, lhs) + isel_depth(a, lhs))) {
+            cut = rhs;
+        }
+        assert(isel_is_tree(a, cut));
+        isel_node(a, cut)->folded = 0;
+        isel_choose_tile(a, n);
+    }
+}
+
+static void isel_use(ASM_X86_64* a, IRSymbolID id) {
+    isel_node(a, id)->uses++;
+}
+
+static void isel_count_iter(IRBB* bb, void* args) {
+    ASM_X86_64* a = (ASM_X86_64*)args;
+    for(size_t i=0; i<vector_len(bb->insts); ++i) {
+        IRInst* inst = vector_at(bb->insts, i);
+        assert(inst->kind == IR_INST_KIND_LET);
+        IRInstValue* v = &inst->value.let.rhs;
+
+        ASM_X86_64_Node* n = isel_node(a, inst->value.let.id);
+        n->value = v;
+        n->bb = bb->id;
+        n->pos = i;
+
+        switch(v->kind) {
+        case IR_INST_VALUE_KIND_REF:
+            if (!v->value.ref.is_global) {
+                isel_use(a, v->value.ref.sym);
+            }
+            break;
+
+        case IR_INST_VALUE_KIND_ADDR_OF:
+            isel_use(a, v->value.addr_of.sym);
+            break;
+
+        case IR_INST_VALUE_KIND_OP_BIN:
+            isel_use(a, v->value.op_bin.lhs);
+            isel_use(a, v->value.op_bin.rhs);
+            break;
+
+        case IR_INST_VALUE_KIND_SELECT:
+            isel_use(a, v->value.select.cond);
+            isel_use(a, v->value.select.then_sym);
+            isel_use(a, v->value.select.else_sym);
+            break;
+
+        case IR_INST_VALUE_KIND_PHI:
+        {
+            Vector* incomings = v->value.phi.incomings;
+            for(size_t k=0; k<vector_len(incomings); ++k) {
+                isel_use(a, ((IRPhiIncoming*)vector_at(incomings, k))->sym);
+            }
+            break;
+        }
+
+        case IR_INST_VALUE_KIND_CALL:
+            isel_use(a, v->value.call.lhs);
+            for(size_t k=0; k<vector_len(v->value.call.args); ++k) {
+                isel_use(a, *(IRSymbolID*)vector_at(v->value.call.args, k));
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    switch(bb->term->kind) {
+    case IR_INST_KIND_RET:
+        isel_use(a, bb->term->value.ret.id);
+        break;
+    case IR_INST_KIND_BRANCH:
+        isel_use(a, bb->term->value.branch.cond);
+        break;
+    case IR_INST_KIND_SWITCH:
+        isel_use(a, bb->term->value.switch_.cond);
+        break;
+    default:
+        break;
+    }
+}
+
+static void isel_fold_iter(IRBB* bb, void* args) {
+    ASM_X86_64* a = (ASM_X86_64*)args;
+    int has_call = 0;
+    size_t call_pos = 0;
+    for(size_t i=0; i<vector_len(bb->insts); ++i) {
+        IRInst* inst = vector_at(bb->insts, i);
+        ASM_X86_64_Node* n = isel_node(a, inst->value.let.id);
+
+        if (n->value->kind == IR_INST_VALUE_KIND_OP_BIN) {
+            isel_fold_op_bin(a, n, bb->id, has_call, call_pos);
+        } else if (n->value->kind == IR_INST_VALUE_KIND_CALL) {
+            has_call = 1;
+            call_pos = i;
+        }
+    }
+
+    IRSymbolID cond;
+    switch(bb->term->kind) {
+    case IR_INST_KIND_RET:
+        cond = bb->term->value.ret.id;
+        break;
+    case IR_INST_KIND_BRANCH:
+        cond = bb->term->value.branch.cond;
+        break;
+    case IR_INST_KIND_SWITCH:
+        cond = bb->term->value.switch_.cond;
+        break;
+    default:
+        return;
+    }
+    isel_node(a, cond)->folded = isel_can_fold(a, cond, bb->id, has_call, call_pos);
+}
+
+void isel_prepare(ASM_X86_64* a, IRFunction* f) {
+    free(a->nodes);
+    a->nodes_len = f->locals_id;
+    a->nodes = (ASM_X86_64_Node*)calloc(a->nodes_len + 1, sizeof(ASM_X86_64_Node));
+    assert(a->nodes); // TODO: error handling...
+
+    ir_bb_visit(f->entry, isel_count_iter, a);
+    ir_bb_visit(f->entry, isel_fold_iter, a);
+
+    size_t folded = 0;
+    for(size_t i=0; i<a->nodes_len; ++i) {
+        folded += (size_t)a->nodes[i].folded;
+    }
+    fprintf(DEBUGOUT, "ISEL: %zu of %zu values are folded\n", folded, a->nodes_len);
+}
+
+static void isel_eval(ASM_X86_64* a, IRSymbolID id, ASM_X86_64_Reg d, int pool);
+
+// 'd' <- the value of 'id'
+static void isel_load(ASM_X86_64* a, IRSymbolID id, ASM_X86_64_Reg d, int pool) {
+    if (isel_is_tree(a, id)) {
+        isel_eval(a, id, d, pool);
+        return;
+    }
+    built_op(a, ASM_X86_64_OP_MOVQ, reg_value(d), asm_x86_64_get_val(a, id, 0));
+}
+
+// The value of 'id' as a source operand. A tree is computed into the next register of the pool.
+static ASM_X86_64_Value isel_operand(ASM_X86_64* a, IRSymbolID id, int* pool) {
+    if (!isel_is_tree(a, id)) {
+        return *asm_x86_64_get_val(a, id, 0);
+    }
+
+    assert(*pool < ISEL_POOL_NUM);
+    ASM_X86_64_Reg reg = isel_pool[*pool];
+    isel_eval(a, id, reg, *pool + 1);
+    (*pool)++;
+    return reg_value(reg);
+}
+
+// 'd' <- the tree of 'id'. Registers of the pool from 'pool' are free, and RAX, RCX and RDX are clobbered.
+void isel_eval(ASM_X86_64* a, IRSymbolID id, ASM_X86_64_Reg d, int pool) {
+    ASM_X86_64_Node* n = isel_node(a, id);
+    TokenKind op = n->value->value.op_bin.op;
+    IRSymbolID lhs = n->value->value.op_bin.lhs;
+    IRSymbolID rhs = n->value->value.op_bin.rhs;
+
+    switch(n->tile) {
+    case ASM_X86_64_TILE_OP:
+    {
+        ASM_X86_64_Value src = isel_operand(a, rhs, &pool);
+        isel_load(a, lhs, d, pool);
+        if (op == TOK_KIND_LSHIFT || op == TOK_KIND_RSHIFT) {
+            src.value.imm_int &= 63;
+        }
+        built_op(a, isel_op(op), reg_value(d), &src);
+        break;
+    }
+
+    case ASM_X86_64_TILE_OP_SWAPPED:
+    {
+        isel_load(a, rhs, d, pool);
+        built_op(a, isel_op(op), reg_value(d), asm_x86_64_get_val(a, lhs, 0));
+        break;
+    }
+
+    case ASM_X86_64_TILE_LEA:
+    {
+        IselAddr addr;
+        int matched = isel_match_addr(a, n->value, &addr);
+        assert(matched);
+        (void)matched;
+
+        assert(pool < ISEL_POOL_NUM);
+        ASM_X86_64_Reg index = isel_pool[pool];
+        isel_load(a, addr.index, index, pool + 1);
+        isel_load(a, addr.base, d, pool + 1);
+
+        // leaq 'd', 'disp'('d', 'index', 'scale')
+        ASM_X86_64_Value src = {
+            .kind = ASM_X86_64_VALUE_KIND_INDEX,
+            .value = {
+                .index = {
+                    .disp = addr.disp,
+                    .base = d,
+                    .index = index,
+                    .scale = addr.scale,
+                },
+            },
+        };
+        built_op(a, ASM_X86_64_OP_LEAQ, reg_value(d), &src);
+        break;
+    }
+
+    case ASM_X86_64_TILE_BUILT:
+    {
+        ASM_X86_64_Value rhs_val = isel_operand(a, rhs, &pool);
+        ASM_X86_64_Value lhs_val;
+        if (isel_is_tree(a, lhs)) {
+            isel_eval(a, lhs, ASM_X86_64_REG_RAX, pool);
+            lhs_val = reg_value(ASM_X86_64_REG_RAX);
+        } else {
+            lhs_val = *asm_x86_64_get_val(a, lhs, 0);
+        }
+        built_op_bin(a, op, &lhs_val, &rhs_val);
+        built_op_reg_reg(a, ASM_X86_64_OP_MOVQ, d, ASM_X86_64_REG_RAX);
+        break;
+    }
+
+    default:
+        assert(0); // unreachable
+    }
+}
+
+// Jumps to 'then_bb' if the folded comparison 'id' holds, and to 'else_bb' otherwise
+static void isel_branch_cmp(ASM_X86_64* a, IRSymbolID id, IRBB* then_bb, IRBB* else_bb) {
+    ASM_X86_64_Node* n = isel_node(a, id);
+    TokenKind op = n->value->value.op_bin.op;
+    ASM_X86_64_Op jcc_op =
+        op == TOK_KIND_LT ? ASM_X86_64_OP_JL :
+        op == TOK_KIND_GT ? ASM_X86_64_OP_JG :
+        op == TOK_KIND_LE ? ASM_X86_64_OP_JLE :
+        op == TOK_KIND_GE ? ASM_X86_64_OP_JGE :
+        op == TOK_KIND_EQ ? ASM_X86_64_OP_JE :
+        ASM_X86_64_OP_JNE;
+
+    int pool = 0;
+    ASM_X86_64_Value rhs_val = isel_operand(a, n->value->value.op_bin.rhs, &pool);
+    isel_load(a, n->value->value.op_bin.lhs, ASM_X86_64_REG_RAX, pool);
+    built_op(a, ASM_X86_64_OP_CMPQ, reg_value(ASM_X86_64_REG_RAX), &rhs_val);
+
+    built_jump_to(a, jcc_op, bb_label(a, then_bb));
+    built_jump_to(a, ASM_X86_64_OP_JMP, bb_label(a, else_bb));
+}
+
+void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
+    switch(inst->kind) {
+    case IR_INST_KIND_LET:
+    {
+        IRSymbolID var_id = inst->value.let.id;
+        IRInstValue* let_rhs = &inst->value.let.rhs;
+        switch(let_rhs->kind) {
+        case IR_INST_VALUE_KIND_REF:
+        {
+            ASM_X86_64_Value* ref_val =
+                asm_x86_64_get_val(a, let_rhs->value.ref.sym, let_rhs->value.ref.is_global);
+
+            asm_x86_64_set_val(a, var_id, *ref_val, 0);
+
+            break;
+        }
+
+        case IR_INST_VALUE_KIND_ADDR_OF:
         {
             ASM_X86_64_Value* ref_val = asm_x86_64_get_val(a, let_rhs->value.addr_of.sym, 0);
 
@@ -603,68 +1949,94 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
                 },
             };
 
-            // leaq RAX, 'ref_val'
-            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-            inst->kind = ASM_X86_64_INST_KIND_OP;
-            inst->value.op.op = ASM_X86_64_OP_LEAQ;
-            inst->value.op.args[0] = dest;
-            inst->value.op.args[1] = *ref_val;
+            {
+                // leaq RAX, 'ref_val'
+                ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                inst->kind = ASM_X86_64_INST_KIND_OP;
+                inst->value.op.op = ASM_X86_64_OP_LEAQ;
+                inst->value.op.args[0] = dest;
+                inst->value.op.args[1] = *ref_val;
+            }
 
-            asm_x86_64_set_val(a, var_id, dest, 0);
+            // Saved, since RAX is clobbered by following instructions, e.g. other arguments of a call
+            int var_target_offset = asm_x86_64_get_local(a, var_id);
+            ASM_X86_64_Value slot = {
+                .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
+                .value = {
+                    .disp_reg = {
+                        .symbol = NULL,
+                        .disp = var_target_offset,
+                        .reg = ASM_X86_64_REG_RSP,
+                    },
+                },
+            };
+            {
+                // movq 'slot', RAX
+                ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                inst->kind = ASM_X86_64_INST_KIND_OP;
+                inst->value.op.op = ASM_X86_64_OP_MOVQ;
+                inst->value.op.args[0] = slot;
+                inst->value.op.args[1] = dest;
+            }
+
+            asm_x86_64_set_val(a, var_id, slot, 0);
 
             break;
         }
 
         case IR_INST_VALUE_KIND_IMM_INT:
         {
-            ASM_X86_64_Value value = {
-                .kind = ASM_X86_64_VALUE_KIND_IMM_INT,
+            long imm = let_rhs->value.imm_int;
+            if (imm == (int)imm) {
+                asm_x86_64_set_val(a, var_id, imm_value((int)imm), 0);
+                break;
+            }
+
+            // Wider values can not be operands, so they are loaded by movabsq and saved
+            ASM_X86_64_Value src = {
+                .kind = ASM_X86_64_VALUE_KIND_IMM_INT64,
+                .value = {
+                    .imm_int64 = imm,
+                },
+            };
+            ASM_X86_64_Value dest = reg_value(ASM_X86_64_REG_RAX);
+            built_op(a, ASM_X86_64_OP_MOVABSQ, dest, &src);
+
+            int var_target_offset = asm_x86_64_get_local(a, var_id);
+            ASM_X86_64_Value slot = {
+                .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
                 .value = {
-                    .imm_int = let_rhs->value.imm_int, // TODO: fix size
+                    .disp_reg = {
+                        .symbol = NULL,
+                        .disp = var_target_offset,
+                        .reg = ASM_X86_64_REG_RSP,
+                    },
                 },
             };
-            asm_x86_64_set_val(a, var_id, value, 0);
+            built_op(a, ASM_X86_64_OP_MOVQ, slot, &dest);
+            asm_x86_64_set_val(a, var_id, slot, 0);
 
             break;
         }
 
         case IR_INST_VALUE_KIND_OP_BIN:
         {
-            // TODO: !!! implement correctly !!!
-
-            ASM_X86_64_Value* lhs_val = asm_x86_64_get_val(a, let_rhs->value.op_bin.lhs, 0);
-            ASM_X86_64_Value* rhs_val = asm_x86_64_get_val(a, let_rhs->value.op_bin.rhs, 0);
-
-            // Move value into RAX (TODO: fix size of data)
-            {
-                // movq rax, 'lhs_val'
-                ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-                inst->kind = ASM_X86_64_INST_KIND_OP;
-                inst->value.op.op = ASM_X86_64_OP_MOVQ;
-                inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
-                inst->value.op.args[0].value.reg = ASM_X86_64_REG_RAX;
-                inst->value.op.args[1] = *lhs_val;
+            // Computed by its user
+            if (isel_is_tree(a, var_id)) {
+                break;
             }
 
-            // Add value to RAX (TODO: fix size of data)
-            {
-                // addq rax, 'rhs_val'
-                ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-                inst->kind = ASM_X86_64_INST_KIND_OP;
-                inst->value.op.op = ASM_X86_64_OP_ADDQ;
-                inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
-                inst->value.op.args[0].value.reg = ASM_X86_64_REG_RAX;
-                inst->value.op.args[1] = *rhs_val;
-            }
+            // (TODO: fix size of data)
+            isel_eval(a, var_id, ASM_X86_64_REG_RAX, 0);
 
             // Result is saved in RAX (TODO: fix size of data)
-            size_t var_target_offset = asm_x86_64_get_local(a, var_id);
+            int var_target_offset = asm_x86_64_get_local(a, var_id);
             ASM_X86_64_Value dest = {
                 .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
                 .value = {
                     .disp_reg = {
                         .symbol = NULL,
-                        .disp = (int)var_target_offset, // TODO: fix
+                        .disp = var_target_offset,
                         .reg = ASM_X86_64_REG_RSP,
                     },
                 },
@@ -673,7 +2045,7 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
                 // movq 'var_target(RSP)', RAX
                 ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
                 inst->kind = ASM_X86_64_INST_KIND_OP;
-                inst->value.op.op = ASM_X86_64_OP_ADDQ;
+                inst->value.op.op = ASM_X86_64_OP_MOVQ;
                 inst->value.op.args[0] = dest;
                 inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_REG;
                 inst->value.op.args[1].value.reg = ASM_X86_64_REG_RAX;
@@ -684,6 +2056,58 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
             break;
         }
 
+        case IR_INST_VALUE_KIND_SELECT:
+        {
+            ASM_X86_64_Value cond_val = *asm_x86_64_get_val(a, let_rhs->value.select.cond, 0);
+            ASM_X86_64_Value then_val = *asm_x86_64_get_val(a, let_rhs->value.select.then_sym, 0);
+            ASM_X86_64_Value else_val = *asm_x86_64_get_val(a, let_rhs->value.select.else_sym, 0);
+
+            // Without branches, cmov takes no immediates
+            built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RAX), &else_val);
+            built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RCX), &then_val);
+            built_op(a, ASM_X86_64_OP_MOVQ, reg_value(ASM_X86_64_REG_RDX), &cond_val);
+            built_op_reg_imm(a, ASM_X86_64_OP_CMPQ, ASM_X86_64_REG_RDX, 0);
+            built_op_reg_reg(a, ASM_X86_64_OP_CMOVNE, ASM_X86_64_REG_RAX, ASM_X86_64_REG_RCX);
+
+            // Result is saved in RAX
+            int var_target_offset = asm_x86_64_get_local(a, var_id);
+            ASM_X86_64_Value dest = {
+                .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
+                .value = {
+                    .disp_reg = {
+                        .symbol = NULL,
+                        .disp = var_target_offset,
+                        .reg = ASM_X86_64_REG_RSP,
+                    },
+                },
+            };
+            ASM_X86_64_Value rax = reg_value(ASM_X86_64_REG_RAX);
+            built_op(a, ASM_X86_64_OP_MOVQ, dest, &rax);
+
+            asm_x86_64_set_val(a, var_id, dest, 0);
+
+            break;
+        }
+
+        case IR_INST_VALUE_KIND_PHI:
+        {
+            // Stored by predecessors before they jump here
+            int var_target_offset = asm_x86_64_get_local(a, var_id);
+            ASM_X86_64_Value slot = {
+                .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
+                .value = {
+                    .disp_reg = {
+                        .symbol = NULL,
+                        .disp = var_target_offset,
+                        .reg = ASM_X86_64_REG_RSP,
+                    },
+                },
+            };
+            asm_x86_64_set_val(a, var_id, slot, 0);
+
+            break;
+        }
+
         case IR_INST_VALUE_KIND_CALL:
         {
             IRSymbolID lhs_id = let_rhs->value.call.lhs;
@@ -693,11 +2117,38 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
             fprint_value(DEBUGOUT, lhs_val);
             fprintf(DEBUGOUT, "\n");
 
-            // TODO: support register passing
-            for(size_t i=0; i<vector_len(let_rhs->value.call.args); ++i) {
-                assert(i<sizeof(arg_regs)/sizeof(ASM_X86_64_Reg));
+            // Stack arguments first, RAX is used to move them. Values of arguments are not in registers.
+            Vector* call_args = let_rhs->value.call.args;
+            for(size_t i=ARG_REGS_NUM; i<vector_len(call_args); ++i) {
+                IRSymbolID* arg = vector_at(call_args, i);
+                ASM_X86_64_Value src = *asm_x86_64_get_val(a, *arg, 0);
+
+                if (src.kind != ASM_X86_64_VALUE_KIND_IMM_INT && src.kind != ASM_X86_64_VALUE_KIND_REG) {
+                    // movq RAX, 'src'
+                    ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                    inst->kind = ASM_X86_64_INST_KIND_OP;
+                    inst->value.op.op = ASM_X86_64_OP_MOVQ;
+                    inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+                    inst->value.op.args[0].value.reg = ASM_X86_64_REG_RAX;
+                    inst->value.op.args[1] = src;
+
+                    src.kind = ASM_X86_64_VALUE_KIND_REG;
+                    src.value.reg = ASM_X86_64_REG_RAX;
+                }
+
+                // movq '8*n(RSP)', 'src'
+                ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                inst->kind = ASM_X86_64_INST_KIND_OP;
+                inst->value.op.op = ASM_X86_64_OP_MOVQ;
+                inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_DISP_REG;
+                inst->value.op.args[0].value.disp_reg.symbol = NULL;
+                inst->value.op.args[0].value.disp_reg.disp = (int)((i - ARG_REGS_NUM) * 8);
+                inst->value.op.args[0].value.disp_reg.reg = ASM_X86_64_REG_RSP;
+                inst->value.op.args[1] = src;
+            }
 
-                IRSymbolID* arg = vector_at(let_rhs->value.call.args, i);
+            for(size_t i=0; i<vector_len(call_args) && i<ARG_REGS_NUM; ++i) {
+                IRSymbolID* arg = vector_at(call_args, i);
                 ASM_X86_64_Value* arg_val = asm_x86_64_get_val(a, *arg, 0);
 
                 // movq ARG_REG, 'arg_val'
@@ -709,6 +2160,76 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
                 inst->value.op.args[1] = *arg_val;
             }
 
+            // Tail calls reuse the frame of the caller of this function, so stack arguments must fit
+            // in the area of stack parameters of this function. Indirect calls are not supported.
+            size_t stack_args_num = vector_len(call_args) > ARG_REGS_NUM ? vector_len(call_args) - ARG_REGS_NUM : 0;
+            if (let_rhs->value.call.is_tail
+                && lhs_val->kind == ASM_X86_64_VALUE_KIND_SYMBOL
+                && stack_args_num <= a->stack_params_num) {
+                // Stack arguments are copied after all arguments are read, since sources may be parameters
+                for(size_t i=0; i<stack_args_num; ++i) {
+                    {
+                        // movq RAX, '8*n(RSP)'
+                        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                        inst->kind = ASM_X86_64_INST_KIND_OP;
+                        inst->value.op.op = ASM_X86_64_OP_MOVQ;
+                        inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+                        inst->value.op.args[0].value.reg = ASM_X86_64_REG_RAX;
+                        inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_DISP_REG;
+                        inst->value.op.args[1].value.disp_reg.symbol = NULL;
+                        inst->value.op.args[1].value.disp_reg.disp = (int)(i * 8);
+                        inst->value.op.args[1].value.disp_reg.reg = ASM_X86_64_REG_RSP;
+                    }
+
+                    {
+                        // movq 'incoming_arg', RAX
+                        ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                        inst->kind = ASM_X86_64_INST_KIND_OP;
+                        inst->value.op.op = ASM_X86_64_OP_MOVQ;
+                        inst->value.op.args[0] = incoming_arg(a, i);
+                        inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_REG;
+                        inst->value.op.args[1].value.reg = ASM_X86_64_REG_RAX;
+                    }
+                }
+
+                {
+                    // movl EAX, 0, for variadic callees
+                    ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                    inst->kind = ASM_X86_64_INST_KIND_OP;
+                    inst->value.op.op = ASM_X86_64_OP_MOVL;
+                    inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+                    inst->value.op.args[0].value.reg = ASM_X86_64_REG_EAX;
+                    inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_IMM_INT;
+                    inst->value.op.args[1].value.imm_int = 0;
+                }
+
+                built_epilogue(a);
+
+                {
+                    // jmp 'lhs_val', the callee returns to the caller of this function
+                    ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                    inst->kind = ASM_X86_64_INST_KIND_OP;
+                    inst->value.op.op = ASM_X86_64_OP_JMP;
+                    inst->value.op.args[0] = *lhs_val;
+                }
+
+                a->tail_called = 1;
+                break;
+            }
+
+            {
+                // movl EAX, 0
+                // AL is the number of vector registers for variadic functions. Callees are not known to be
+                // variadic or not without prototypes, so it is always set.
+                ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                inst->kind = ASM_X86_64_INST_KIND_OP;
+                inst->value.op.op = ASM_X86_64_OP_MOVL;
+                inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
+                inst->value.op.args[0].value.reg = ASM_X86_64_REG_EAX;
+                inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_IMM_INT;
+                inst->value.op.args[1].value.imm_int = 0;
+            }
+
             {
                 // call 'lhs_val'
                 ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
@@ -718,13 +2239,13 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
             }
 
             // Result is saved in RAX (TODO: fix size of data)
-            size_t var_target_offset = asm_x86_64_get_local(a, var_id);
+            int var_target_offset = asm_x86_64_get_local(a, var_id);
             ASM_X86_64_Value dest = {
                 .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
                 .value = {
                     .disp_reg = {
                         .symbol = NULL,
-                        .disp = (int)var_target_offset, // TODO: fix
+                        .disp = var_target_offset,
                         .reg = ASM_X86_64_REG_RSP,
                     },
                 },
@@ -744,6 +2265,43 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
             break;
         }
 
+        case IR_INST_VALUE_KIND_PARAM:
+        {
+            size_t index = let_rhs->value.param.index;
+            if (index >= ARG_REGS_NUM) {
+                ASM_X86_64_Value value = incoming_arg(a, index - ARG_REGS_NUM);
+                asm_x86_64_set_val(a, var_id, value, 0);
+
+                break;
+            }
+
+            // Saved before calls clobber argument registers
+            int var_target_offset = asm_x86_64_get_local(a, var_id);
+            ASM_X86_64_Value dest = {
+                .kind = ASM_X86_64_VALUE_KIND_DISP_REG,
+                .value = {
+                    .disp_reg = {
+                        .symbol = NULL,
+                        .disp = var_target_offset,
+                        .reg = ASM_X86_64_REG_RSP,
+                    },
+                },
+            };
+            {
+                // movq 'var_target(RSP)', ARG_REG
+                ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
+                inst->kind = ASM_X86_64_INST_KIND_OP;
+                inst->value.op.op = ASM_X86_64_OP_MOVQ;
+                inst->value.op.args[0] = dest;
+                inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_REG;
+                inst->value.op.args[1].value.reg = arg_regs[index];
+            }
+
+            asm_x86_64_set_val(a, var_id, dest, 0);
+
+            break;
+        }
+
         default:
             fprintf(stderr, "Unexpected kind: %d\n", let_rhs->kind);
             assert(0); // TODO: error handling
@@ -753,39 +2311,10 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
 
     case IR_INST_KIND_RET:
     {
-        IRSymbolID var_id = inst->value.ret.id;
-        ASM_X86_64_Value* ret_val = asm_x86_64_get_val(a, var_id, 0);
-
         // Set a result (TODO: fix size of data)
-        {
-            // movq rax, 'ret_val'
-            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-            inst->kind = ASM_X86_64_INST_KIND_OP;
-            inst->value.op.op = ASM_X86_64_OP_MOVQ;
-            inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
-            inst->value.op.args[0].value.reg = ASM_X86_64_REG_RAX;
-            inst->value.op.args[1] = *ret_val;
-        }
-
-        {
-            // movq rsp, rbp
-            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-            inst->kind = ASM_X86_64_INST_KIND_OP;
-            inst->value.op.op = ASM_X86_64_OP_MOVQ;
-            inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
-            inst->value.op.args[0].value.reg = ASM_X86_64_REG_RSP;
-            inst->value.op.args[1].kind = ASM_X86_64_VALUE_KIND_REG;
-            inst->value.op.args[1].value.reg = ASM_X86_64_REG_RBP;
-        }
+        isel_load(a, inst->value.ret.id, ASM_X86_64_REG_RAX, 0);
 
-        {
-            // popq rbp
-            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-            inst->kind = ASM_X86_64_INST_KIND_OP;
-            inst->value.op.op = ASM_X86_64_OP_POPQ;
-            inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
-            inst->value.op.args[0].value.reg = ASM_X86_64_REG_RBP;
-        }
+        built_epilogue(a);
 
         {
             // ret
@@ -799,19 +2328,16 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
 
     case IR_INST_KIND_BRANCH:
     {
-        ASM_X86_64_Value* cond_val = asm_x86_64_get_val(a, inst->value.branch.cond, 0);
-
-        {
-            // movq RAX, 'cond'
-            ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
-            inst->kind = ASM_X86_64_INST_KIND_OP;
-            inst->value.op.op = ASM_X86_64_OP_MOVQ;
-
-            inst->value.op.args[0].kind = ASM_X86_64_VALUE_KIND_REG;
-            inst->value.op.args[0].value.reg = ASM_X86_64_REG_RAX;
-            inst->value.op.args[1] = *cond_val;
+        IRSymbolID cond = inst->value.branch.cond;
+        if (isel_is_tree(a, cond) && isel_is_comparison(isel_node(a, cond)->value->value.op_bin.op)) {
+            // Flags of the comparison are used directly, without setcc
+            isel_branch_cmp(a, cond, inst->value.branch.then_bb, inst->value.branch.else_bb);
+            break;
         }
 
+        // movq RAX, 'cond'
+        isel_load(a, cond, ASM_X86_64_REG_RAX, 0);
+
         {
             // cmpq RAX, 0
             ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
@@ -874,6 +2400,18 @@ void built_from_ir_inst(ASM_X86_64 *a, IRInst* inst) {
         break;
     }
 
+    case IR_INST_KIND_SWITCH:
+    {
+        // movq RAX, 'cond'
+        isel_load(a, inst->value.switch_.cond, ASM_X86_64_REG_RAX, 0);
+
+        Vector* cases = inst->value.switch_.cases;
+        IRSwitchCase* first = vector_len(cases) > 0 ? (IRSwitchCase*)vector_at(cases, 0) : NULL;
+        built_switch_cases(a, first, vector_len(cases), bb_label(a, inst->value.switch_.default_bb));
+
+        break;
+    }
+
     default:
         assert(0); // TODO: error handling
     }
@@ -905,9 +2443,10 @@ void built_from_ir_global_inst(ASM_X86_64 *a, IRInst* inst) {
 
     case IR_INST_VALUE_KIND_STRING:
     {
-        char* label_id = (char*)malloc(sizeof(char) * 10);
-        snprintf(label_id, 10, ".S%07ld", a->string_label_count);
-        a->string_label_count++;
+        // Named by the contents, so references to it do not depend on the order of definitions
+        uint64_t h = hash_bytes(HASH_INIT, let_rhs->value.string.buf, let_rhs->value.string.len);
+        char* label_id = (char*)malloc(sizeof(char) * 19);
+        snprintf(label_id, 19, ".S%016lx", (unsigned long)h);
 
         {
             // .section .rodata
@@ -928,7 +2467,8 @@ void built_from_ir_global_inst(ASM_X86_64 *a, IRInst* inst) {
             // .string 'string'
             ASM_X86_64_Inst* inst = (ASM_X86_64_Inst*)vector_append(a->insts);
             inst->kind = ASM_X86_64_INST_KIND_STRING;
-            inst->value.string.s = let_rhs->value.string;
+            inst->value.string.s = let_rhs->value.string.buf;
+            inst->value.string.len = let_rhs->value.string.len;
         }
 
         ASM_X86_64_Value str = {
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include "ir.h"
+#include "writer.h"
 
 struct asm_x86_64_t;
 typedef struct asm_x86_64_t ASM_X86_64;
@@ -10,9 +11,25 @@ typedef struct asm_x86_64_t ASM_X86_64;
 struct asm_x86_64_inst_t;
 typedef struct asm_x86_64_inst_t ASM_X86_64_Inst;
 
-ASM_X86_64* asm_x86_64_new(IRModule* mod);
+typedef struct {
+    int omit_frame_pointer; // RBP is not set up, and leaf functions use the red zone
+    int strength_reduce;    // Multiplications and divisions by constants use shifts, LEA and multiplications
+    int jump_tables;        // Dense switches jump through tables, otherwise all switches use compare trees
+    int tree_isel;          // Instructions are selected over expression trees, otherwise for each IR instruction
+} ASM_X86_64_Options;
+
+// 'opts' is nullable, then frame pointers are kept, and the other options are enabled
+ASM_X86_64* asm_x86_64_new(IRModule* mod, ASM_X86_64_Options const* opts);
 void asm_x86_64_drop(ASM_X86_64 *a);
 
+void asm_x86_64_write(Writer* w, ASM_X86_64* a);
+// Parts of asm_x86_64_write. Outputs of functions depend only on themselves, so they can be spliced.
+void asm_x86_64_write_header(Writer* w, ASM_X86_64* a);
+void asm_x86_64_write_function(Writer* w, ASM_X86_64* a, size_t index);
+size_t asm_x86_64_functions_len(ASM_X86_64* a);
+char const* asm_x86_64_function_name(ASM_X86_64* a, size_t index);
+// Number of machine instructions, directives and labels are not counted
+size_t asm_x86_64_ops_len(ASM_X86_64* a);
 void asm_x86_64_fprint(FILE* fp, ASM_X86_64* a);
 
 #endif /*CC_ASM_X86_64_H*/
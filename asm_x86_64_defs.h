@@ -0,0 +1,213 @@
+#ifndef CC_ASM_X86_64_DEFS_H
+#define CC_ASM_X86_64_DEFS_H
+
+#include <stddef.h>
+#include "asm_x86_64.h"
+#include "vector.h"
+#include "map.h"
+
+typedef enum asm_x86_64_tile_t {
+    ASM_X86_64_TILE_OP,         // d <- lhs, then 'op rhs, d', e.g. addq
+    ASM_X86_64_TILE_OP_SWAPPED, // d <- rhs, then 'op lhs, d', for commutative operators
+    ASM_X86_64_TILE_LEA,        // leaq disp(base, index, scale), d
+    ASM_X86_64_TILE_BUILT,      // The sequence of built_op_bin in RAX, e.g. division and comparisons
+} ASM_X86_64_Tile;
+
+// A definition of the current function, as a node of expression trees for instruction selection
+typedef struct asm_x86_64_node_t {
+    IRInstValue* value;     // reference, Nullable, the right hand side
+    IRBBID bb;
+    size_t pos;             // Index of the definition in the block
+    size_t uses;
+    int folded;             // Computed by its only user in registers, and never stored to the slot
+    ASM_X86_64_Tile tile;   // Of binary operations
+    int cost;               // Instructions to compute the tree into a register
+    int need;               // Pool registers to compute the tree
+    int depth;
+} ASM_X86_64_Node;
+
+// TODO: encapsulate
+struct asm_x86_64_t {
+    Vector* insts;         // Vector<ASM_X86_64_Inst>
+    Vector* values;        // Vector<ASM_X86_64_Var>
+    Vector* global_values; // Vector<ASM_X86_64_Var>
+    Vector* offsets;       // Vector<int>, displacements of locals from RSP
+    ASM_X86_64_Options opts;
+    size_t code_label_count;    // In the current function
+    char const* func_name;      // The current function, reference
+    int frame_pointer;          // The current function sets up RBP
+    size_t frame_size;          // Subtracted from RSP in the prologue of the current function
+    size_t stack_params_num;    // Of the current function, passed on the stack by callers
+    int tail_called;            // The last call was lowered into a jump, so RET after it is never reached
+    UintMap* labels;
+    Vector* funcs;              // Vector<ASM_X86_64_Func>
+    ASM_X86_64_Node* nodes;     // Indexed by IRSymbolID of the current function
+    size_t nodes_len;
+};
+
+// A range of instructions of a function, which does not depend on other functions
+typedef struct asm_x86_64_func_t {
+    char const* name;   // reference
+    size_t begin;       // Index of insts
+    size_t end;
+} ASM_X86_64_Func;
+
+typedef enum asm_x86_64_op_t {
+    ASM_X86_64_OP_PUSHQ, // v
+    ASM_X86_64_OP_POPQ,  // v
+    ASM_X86_64_OP_MOVQ,  // d, s
+    ASM_X86_64_OP_MOVL,  // d, s
+    ASM_X86_64_OP_ADDQ,  // d, s
+    ASM_X86_64_OP_SUBQ,  // d, s
+    ASM_X86_64_OP_IMULQ, // d, s
+    ASM_X86_64_OP_IMULQ_WIDE, // v, RDX:RAX <- RAX * v
+    ASM_X86_64_OP_IDIVQ, // v, RAX <- RDX:RAX / v, RDX <- RDX:RAX % v
+    ASM_X86_64_OP_CQTO,  // (none), RDX:RAX <- sign-extended RAX
+    ASM_X86_64_OP_NEGQ,  // v
+    ASM_X86_64_OP_ANDQ,  // d, s
+    ASM_X86_64_OP_ORQ,   // d, s
+    ASM_X86_64_OP_XORQ,  // d, s
+    ASM_X86_64_OP_SHLQ,  // d, s (imm or CL)
+    ASM_X86_64_OP_SHRQ,  // d, s (imm or CL)
+    ASM_X86_64_OP_SARQ,  // d, s (imm or CL)
+    ASM_X86_64_OP_MOVABSQ, // d, s (imm64)
+    ASM_X86_64_OP_LEAQ,  // d, s
+    ASM_X86_64_OP_CALL,  // v
+    ASM_X86_64_OP_CMPQ,  // d, s
+    ASM_X86_64_OP_SETE,  // v (8bits)
+    ASM_X86_64_OP_SETNE, // v (8bits)
+    ASM_X86_64_OP_SETL,  // v (8bits)
+    ASM_X86_64_OP_SETLE, // v (8bits)
+    ASM_X86_64_OP_SETG,  // v (8bits)
+    ASM_X86_64_OP_SETGE, // v (8bits)
+    ASM_X86_64_OP_MOVZBQ, // d, s (8bits)
+    ASM_X86_64_OP_MOVSLQ, // d, s (32bits)
+    ASM_X86_64_OP_CMOVNE, // d (reg), s
+    ASM_X86_64_OP_JMP,   // v
+    ASM_X86_64_OP_JE,    // v
+    ASM_X86_64_OP_JNE,   // v
+    ASM_X86_64_OP_JA,    // v
+    ASM_X86_64_OP_JL,    // v
+    ASM_X86_64_OP_JLE,   // v
+    ASM_X86_64_OP_JG,    // v
+    ASM_X86_64_OP_JGE,   // v
+    ASM_X86_64_OP_JMP_INDIRECT, // v (reg)
+    ASM_X86_64_OP_RET,   // (none)
+} ASM_X86_64_Op;
+
+typedef enum asm_x86_64_reg_t {
+    ASM_X86_64_REG_RAX,
+    ASM_X86_64_REG_RBX,
+    ASM_X86_64_REG_RCX,
+    ASM_X86_64_REG_RDX,
+    ASM_X86_64_REG_RSP,
+    ASM_X86_64_REG_RBP,
+    ASM_X86_64_REG_RSI,
+    ASM_X86_64_REG_RDI,
+    ASM_X86_64_REG_R8,
+    ASM_X86_64_REG_R9,
+    ASM_X86_64_REG_RIP,
+
+    ASM_X86_64_REG_EAX,
+    ASM_X86_64_REG_AL,
+    ASM_X86_64_REG_CL,
+} ASM_X86_64_Reg;
+
+typedef enum asm_x86_64_value_kind_t {
+    ASM_X86_64_VALUE_KIND_SYMBOL,
+    ASM_X86_64_VALUE_KIND_IMM_INT,
+    ASM_X86_64_VALUE_KIND_STRING,
+    ASM_X86_64_VALUE_KIND_REG,
+    ASM_X86_64_VALUE_KIND_DISP_REG,
+    ASM_X86_64_VALUE_KIND_INDEX,
+    ASM_X86_64_VALUE_KIND_IMM_INT64,
+} ASM_X86_64_ValueKind;
+
+struct asm_x86_64_value_t;
+typedef struct asm_x86_64_value_t ASM_X86_64_Value;
+
+struct asm_x86_64_value_t {
+    ASM_X86_64_ValueKind kind;
+    union {
+        char const* symbol;
+        int imm_int;
+        struct {
+            char const* label;
+        } string;
+        ASM_X86_64_Reg reg;
+        struct {
+            char const* symbol;
+            int disp; // 32bits
+            ASM_X86_64_Reg reg;
+        } disp_reg;
+        struct {
+            int disp;
+            ASM_X86_64_Reg base;
+            ASM_X86_64_Reg index;
+            int scale; // 1, 2, 4 or 8
+        } index;
+        long imm_int64;
+    } value;
+};
+
+typedef enum asm_x86_64_var_kind_t {
+    ASM_X86_64_VAR_REF,
+    ASM_X86_64_VAR_VAL,
+} ASM_X86_64_VarKind;
+
+typedef struct asm_x86_64_var_t {
+    ASM_X86_64_VarKind kind;
+    union {
+        IRSymbolID ref;
+        ASM_X86_64_Value val;
+    } value;
+} ASM_X86_64_Var;
+
+typedef enum asm_x86_64_inst_kind_t {
+    ASM_X86_64_INST_KIND_SECTION,
+    ASM_X86_64_INST_KIND_STRING,
+    ASM_X86_64_INST_KIND_ALIGN,
+    ASM_X86_64_INST_KIND_JUMP_TABLE_ENTRY,
+    ASM_X86_64_INST_KIND_TEXT,
+    ASM_X86_64_INST_KIND_GLOBAL,
+    ASM_X86_64_INST_KIND_TYPE,
+    ASM_X86_64_INST_KIND_LABEL,
+    ASM_X86_64_INST_KIND_OP,
+} ASM_X86_64_InstKind;
+
+struct asm_x86_64_inst_t {
+    ASM_X86_64_InstKind kind;
+    union {
+        struct {
+            char const* name;
+        } section;
+        struct {
+            char const* s;
+            size_t len;
+        } string;
+        struct {
+            int bytes;
+        } align;
+        struct {
+            char const* label;  // reference
+            char const* table;  // reference, the entry is the offset of 'label' from it
+        } jump_table_entry;
+        struct {
+            char const* name;
+        } global;
+        struct {
+            char const* name;
+            char const* type;
+        } type;
+        struct {
+            char const* name;
+            int generated;
+        } label;
+        struct {
+            ASM_X86_64_Op op;
+            ASM_X86_64_Value args[4];
+        } op;
+    } value;
+};
+
+#endif /*CC_ASM_X86_64_DEFS_H*/
@@ -0,0 +1,479 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ast_cache.h"
+#include "hash.h"
+#include "log.h"
+#include "build_id.h"
+#include "cache_file.h"
+
+#define AST_CACHE_MAGIC "CCASTv01"
+// Layout of the file. Caches of other builds are rejected by 'build_hash'.
+#define AST_CACHE_VERSION 8
+#define AST_CACHE_TYPE_NONE ((uint32_t)UINT32_MAX)
+
+typedef enum {
+    SECTION_TOKENS,         // Token[tokens_len]
+    SECTION_KINDS,          // uint8_t[nodes_len]
+    SECTION_MAIN_TOKENS,    // uint32_t[nodes_len]
+    SECTION_LHS,            // uint32_t[nodes_len]
+    SECTION_RHS,            // uint32_t[nodes_len]
+    SECTION_EXTRA,          // uint32_t[extra_len]
+    SECTION_TYPES,          // CachedType[types_len]
+    SECTION_NODE_TYPES,     // uint32_t[nodes_len], index of types or AST_CACHE_TYPE_NONE
+    SECTION_STRINGS,        // StringPoolEntry[strings_len]
+    SECTION_STRING_BYTES,   // char[string_bytes_len]
+    SECTION_IDENTS,         // StringPoolEntry[idents_len]
+    SECTION_IDENT_BYTES,    // char[ident_bytes_len]
+    SECTION_NUM,
+} Section;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t source_hash;
+    uint64_t build_hash;
+    uint64_t payload_hash;  // of the bytes after the header, against a corrupted file
+    uint64_t tokens_len;
+    uint64_t nodes_len;
+    uint64_t extra_len;
+    uint64_t types_len;
+    uint64_t strings_len;
+    uint64_t string_bytes_len;
+    uint64_t idents_len;
+    uint64_t ident_bytes_len;
+    uint64_t offsets[SECTION_NUM];
+} CachedHeader;
+
+typedef struct {
+    uint32_t kind;
+    int32_t bits;
+    uint32_t inner; // index of types, AST_CACHE_TYPE_NONE if not a pointer
+} CachedType;
+
+uint64_t ast_cache_source_hash(char const* buffer) {
+    return hash_string(HASH_INIT, buffer);
+}
+
+// Types are interned structurally, there are only a few distinct ones
+static uint32_t intern_type(Vector* types, Type* ty) {
+    CachedType c = {
+        .kind = (uint32_t)ty->kind,
+        .bits = 0,
+        .inner = AST_CACHE_TYPE_NONE,
+    };
+    switch(ty->kind) {
+    case TYPE_KIND_INT:
+        c.bits = ty->value.int_.bits;
+        break;
+    case TYPE_KIND_PTR:
+        c.inner = intern_type(types, ty->value.ptr.inner);
+        break;
+    }
+
+    for(size_t i=0; i<vector_len(types); ++i) {
+        CachedType* e = (CachedType*)vector_at(types, i);
+        if (e->kind == c.kind && e->bits == c.bits && e->inner == c.inner) {
+            return (uint32_t)i;
+        }
+    }
+
+    CachedType* e = (CachedType*)vector_append(types);
+    *e = c;
+    return (uint32_t)(vector_len(types) - 1);
+}
+
+static int write_section(FILE* fp, CachedHeader* h, Section s, void const* data, size_t size) {
+    static char const zeros[8] = {0};
+
+    long pos = ftell(fp);
+    if (pos < 0) {
+        return 1;
+    }
+    size_t pad = (8 - (size_t)pos % 8) % 8;
+    if (fwrite(zeros, 1, pad, fp) != pad) {
+        return 1;
+    }
+
+    h->offsets[s] = (uint64_t)pos + pad;
+    if (size > 0 && fwrite(data, 1, size, fp) != size) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int ast_cache_save(char const* path, uint64_t source_hash, Vector* tokens, NodeTable* t) {
+    int err = 0;
+
+    size_t tokens_len = vector_len(tokens);
+
+    Vector* types = vector_new(sizeof(CachedType)); // Vector<CachedType>
+    uint32_t* node_types = (uint32_t*)malloc(sizeof(uint32_t) * (t->len + 1));
+    for(size_t i=0; i<t->len; ++i) {
+        node_types[i] = t->types[i] ? intern_type(types, t->types[i]) : AST_CACHE_TYPE_NONE;
+    }
+
+    size_t string_bytes_len;
+    char const* string_bytes = string_pool_bytes(t->strings, &string_bytes_len);
+    size_t ident_bytes_len;
+    char const* ident_bytes = string_pool_bytes(t->idents, &ident_bytes_len);
+
+    CachedHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, AST_CACHE_MAGIC, sizeof(h.magic));
+    h.version = AST_CACHE_VERSION;
+    h.source_hash = source_hash;
+    h.build_hash = hash_string(HASH_INIT, build_id());
+    h.tokens_len = tokens_len;
+    h.nodes_len = t->len;
+    h.extra_len = t->extra_len;
+    h.types_len = vector_len(types);
+    h.strings_len = string_pool_len(t->strings);
+    h.string_bytes_len = string_bytes_len;
+    h.idents_len = string_pool_len(t->idents);
+    h.ident_bytes_len = ident_bytes_len;
+
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* fp = open_memstream(&buf, &len);
+    assert(fp); // TODO: error handling...
+
+    err |= fwrite(&h, sizeof(h), 1, fp) != 1;
+    err |= write_section(fp, &h, SECTION_TOKENS, tokens_len > 0 ? vector_at(tokens, 0) : NULL, sizeof(Token) * tokens_len);
+    err |= write_section(fp, &h, SECTION_KINDS, t->kinds, sizeof(uint8_t) * t->len);
+    err |= write_section(fp, &h, SECTION_MAIN_TOKENS, t->main_tokens, sizeof(uint32_t) * t->len);
+    err |= write_section(fp, &h, SECTION_LHS, t->lhs, sizeof(uint32_t) * t->len);
+    err |= write_section(fp, &h, SECTION_RHS, t->rhs, sizeof(uint32_t) * t->len);
+    err |= write_section(fp, &h, SECTION_EXTRA, t->extra, sizeof(uint32_t) * t->extra_len);
+    err |= write_section(fp, &h, SECTION_TYPES, vector_len(types) > 0 ? vector_at(types, 0) : NULL, sizeof(CachedType) * vector_len(types));
+    err |= write_section(fp, &h, SECTION_NODE_TYPES, node_types, sizeof(uint32_t) * t->len);
+    err |= write_section(fp, &h, SECTION_STRINGS, string_pool_entries(t->strings), sizeof(StringPoolEntry) * h.strings_len);
+    err |= write_section(fp, &h, SECTION_STRING_BYTES, string_bytes, string_bytes_len);
+    err |= write_section(fp, &h, SECTION_IDENTS, string_pool_entries(t->idents), sizeof(StringPoolEntry) * h.idents_len);
+    err |= write_section(fp, &h, SECTION_IDENT_BYTES, ident_bytes, ident_bytes_len);
+    err |= fclose(fp) != 0;
+
+    // Offsets are known now
+    if (err == 0) {
+        h.payload_hash = hash_bytes(HASH_INIT, buf + sizeof(h), len - sizeof(h));
+        memcpy(buf, &h, sizeof(h));
+        err = cache_write_atomic(path, buf, len, 0644);
+    }
+    if (err) {
+        fprintf(stderr, "Failed to write ast cache: %s\n", path);
+    }
+
+    free(buf);
+    free(node_types);
+    vector_drop(types);
+
+    return err;
+}
+
+static int section_in_range(CachedHeader const* h, Section s, size_t size, size_t file_len) {
+    return h->offsets[s] % 8 == 0 && h->offsets[s] <= file_len && size <= file_len - h->offsets[s];
+}
+
+// Returns NULL if entries point out of the bytes
+static StringPool* load_string_pool(char const* base, CachedHeader const* h, Section entries_s, size_t len, Section bytes_s, size_t bytes_len) {
+    StringPoolEntry const* entries = (StringPoolEntry const*)(base + h->offsets[entries_s]);
+    for(size_t i=0; i<len; ++i) {
+        if ((uint64_t)entries[i].offset + entries[i].len >= bytes_len) {
+            return NULL;
+        }
+    }
+
+    return string_pool_new_borrowed(base + h->offsets[bytes_s], bytes_len, entries, len);
+}
+
+// Tokens must lie in the source, which is the one of 'source_hash' only unless the hash collides
+static int tokens_valid(Token const* tokens, size_t len, size_t buffer_len) {
+    for(size_t i=0; i<len; ++i) {
+        if (tokens[i].kind > TOK_KIND_EOF || (uint64_t)tokens[i].pos + tokens[i].len > buffer_len) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Inner types precede outer ones, as they are interned
+static int types_valid(CachedType const* types, size_t len) {
+    for(size_t i=0; i<len; ++i) {
+        switch(types[i].kind) {
+        case TYPE_KIND_INT:
+            break;
+        case TYPE_KIND_PTR:
+            if (types[i].inner >= i) {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Children precede their parent in postorder
+static int child_valid(uint32_t c, size_t i) {
+    return c < i;
+}
+
+static int nullable_child_valid(uint32_t c, size_t i) {
+    return c == NODE_INDEX_NONE || c < i;
+}
+
+// 'n' entries of 'extra' from 'begin'
+static int extra_valid(CachedHeader const* h, uint32_t begin, uint64_t n) {
+    return (uint64_t)begin + n <= h->extra_len;
+}
+
+static int extra_children_valid(CachedHeader const* h, uint32_t const* extra, uint32_t begin, uint32_t end, size_t i) {
+    if (begin > end || !extra_valid(h, begin, end - begin)) {
+        return 0;
+    }
+    for(uint32_t k=begin; k<end; ++k) {
+        if (!child_valid(extra[k], i)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Checks the layout of each kind in node_table.h, so that the loaded table is as safe to walk as a built one
+static int nodes_valid(CachedHeader const* h, char const* base) {
+    uint8_t const* kinds = (uint8_t const*)(base + h->offsets[SECTION_KINDS]);
+    uint32_t const* main_tokens = (uint32_t const*)(base + h->offsets[SECTION_MAIN_TOKENS]);
+    uint32_t const* lhs = (uint32_t const*)(base + h->offsets[SECTION_LHS]);
+    uint32_t const* rhs = (uint32_t const*)(base + h->offsets[SECTION_RHS]);
+    uint32_t const* extra = (uint32_t const*)(base + h->offsets[SECTION_EXTRA]);
+    uint32_t const* node_types = (uint32_t const*)(base + h->offsets[SECTION_NODE_TYPES]);
+
+    if (h->nodes_len == 0 || h->nodes_len >= NODE_INDEX_NONE || kinds[h->nodes_len - 1] != NODE_TRANS_UNIT) {
+        return 0;
+    }
+
+    for(size_t i=0; i<h->nodes_len; ++i) {
+        if (main_tokens[i] >= h->tokens_len
+            || (node_types[i] != AST_CACHE_TYPE_NONE && node_types[i] >= h->types_len)) {
+            return 0;
+        }
+
+        uint32_t l = lhs[i];
+        uint32_t r = rhs[i];
+        int valid = 0;
+        switch(kinds[i]) {
+        case NODE_TRANS_UNIT:
+        case NODE_STMT_COMPOUND:
+        case NODE_ARGS_LIST:
+        case NODE_PARAM_LIST:
+            valid = extra_children_valid(h, extra, l, r, i);
+            break;
+
+        case NODE_FUNC_DEF:
+            valid = extra_valid(h, l, 2) && extra_children_valid(h, extra, l, l + 2, i) && child_valid(r, i);
+            break;
+
+        case NODE_STMT_EXPR:
+            valid = nullable_child_valid(l, i);
+            break;
+
+        case NODE_STMT_IF:
+            valid = child_valid(l, i) && extra_valid(h, r, 2)
+                && child_valid(extra[r], i) && nullable_child_valid(extra[r + 1], i);
+            break;
+
+        case NODE_STMT_WHILE:
+        case NODE_STMT_DO:
+        case NODE_STMT_SWITCH:
+        case NODE_STMT_CASE:
+        case NODE_EXPR_BIN:
+            valid = child_valid(l, i) && child_valid(r, i);
+            break;
+
+        case NODE_STMT_DEFAULT:
+        case NODE_EXPR_UNARY:
+        case NODE_DECLARATOR:
+            valid = child_valid(l, i);
+            break;
+
+        case NODE_STMT_FOR:
+            valid = extra_valid(h, l, 3) && nullable_child_valid(extra[l], i)
+                && nullable_child_valid(extra[l + 1], i) && nullable_child_valid(extra[l + 2], i)
+                && child_valid(r, i);
+            break;
+
+        case NODE_STMT_JUMP:
+            valid = nullable_child_valid(l, i) && r < TOK_KIND_EOF;
+            break;
+
+        case NODE_EXPR_COND:
+            valid = child_valid(l, i) && extra_valid(h, r, 2)
+                && child_valid(extra[r], i) && child_valid(extra[r + 1], i);
+            break;
+
+        case NODE_EXPR_POSTFIX:
+            valid = child_valid(l, i) && extra_valid(h, r, 2)
+                && extra[r] <= NODE_EXPR_POSTFIX_KIND_DEC && nullable_child_valid(extra[r + 1], i);
+            break;
+
+        case NODE_LIT_INT:
+            valid = 1;
+            break;
+
+        case NODE_LIT_STRING:
+            valid = l < h->strings_len;
+            break;
+
+        case NODE_ID:
+            valid = r < h->idents_len;
+            break;
+
+        case NODE_DIRECT_DECLARATOR:
+        case NODE_PARAM_DECL:
+            valid = child_valid(l, i) && nullable_child_valid(r, i);
+            break;
+        }
+        if (!valid) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+NodeTable* ast_cache_load(char const* path, uint64_t source_hash, char const* buffer, TypeArena* types) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CachedHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t file_len = (size_t)st.st_size;
+
+    void* mapping = mmap(NULL, file_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    char const* base = (char const*)mapping;
+
+    CachedHeader const* h = (CachedHeader const*)base;
+    if (memcmp(h->magic, AST_CACHE_MAGIC, sizeof(h->magic)) != 0
+        || h->version != AST_CACHE_VERSION
+        || h->source_hash != source_hash
+        || h->build_hash != hash_string(HASH_INIT, build_id())) {
+        fprintf(DEBUGOUT, "LOG: ast cache is stale\n");
+        munmap(mapping, file_len);
+        return NULL;
+    }
+
+    if (h->payload_hash != hash_bytes(HASH_INIT, base + sizeof(*h), file_len - sizeof(*h))) {
+        fprintf(DEBUGOUT, "LOG: ast cache is broken\n");
+        munmap(mapping, file_len);
+        return NULL;
+    }
+
+    size_t sizes[SECTION_NUM] = {
+        [SECTION_TOKENS] = sizeof(Token) * h->tokens_len,
+        [SECTION_KINDS] = sizeof(uint8_t) * h->nodes_len,
+        [SECTION_MAIN_TOKENS] = sizeof(uint32_t) * h->nodes_len,
+        [SECTION_LHS] = sizeof(uint32_t) * h->nodes_len,
+        [SECTION_RHS] = sizeof(uint32_t) * h->nodes_len,
+        [SECTION_EXTRA] = sizeof(uint32_t) * h->extra_len,
+        [SECTION_TYPES] = sizeof(CachedType) * h->types_len,
+        [SECTION_NODE_TYPES] = sizeof(uint32_t) * h->nodes_len,
+        [SECTION_STRINGS] = sizeof(StringPoolEntry) * h->strings_len,
+        [SECTION_STRING_BYTES] = h->string_bytes_len,
+        [SECTION_IDENTS] = sizeof(StringPoolEntry) * h->idents_len,
+        [SECTION_IDENT_BYTES] = h->ident_bytes_len,
+    };
+    for(int s=0; s<SECTION_NUM; ++s) {
+        if (!section_in_range(h, (Section)s, sizes[s], file_len)) {
+            fprintf(DEBUGOUT, "LOG: ast cache is broken\n");
+            munmap(mapping, file_len);
+            return NULL;
+        }
+    }
+
+    if (!tokens_valid((Token const*)(base + h->offsets[SECTION_TOKENS]), h->tokens_len, strlen(buffer))
+        || !types_valid((CachedType const*)(base + h->offsets[SECTION_TYPES]), h->types_len)
+        || !nodes_valid(h, base)) {
+        fprintf(DEBUGOUT, "LOG: ast cache is broken\n");
+        munmap(mapping, file_len);
+        return NULL;
+    }
+
+    StringPool* strings = load_string_pool(base, h, SECTION_STRINGS, h->strings_len, SECTION_STRING_BYTES, h->string_bytes_len);
+    StringPool* idents = load_string_pool(base, h, SECTION_IDENTS, h->idents_len, SECTION_IDENT_BYTES, h->ident_bytes_len);
+    if (strings == NULL || idents == NULL) {
+        fprintf(DEBUGOUT, "LOG: ast cache is broken\n");
+        if (strings) {
+            string_pool_drop(strings);
+        }
+        if (idents) {
+            string_pool_drop(idents);
+        }
+        munmap(mapping, file_len);
+        return NULL;
+    }
+
+    // Types, inner ones are validated to precede outer ones
+    CachedType const* cached_types = (CachedType const*)(base + h->offsets[SECTION_TYPES]);
+    Type** type_table = (Type**)malloc(sizeof(Type*) * (h->types_len + 1));
+    for(size_t i=0; i<h->types_len; ++i) {
+        Type* ty = type_arena_malloc(types);
+        ty->kind = (TypeKind)cached_types[i].kind;
+        switch(ty->kind) {
+        case TYPE_KIND_INT:
+            ty->value.int_.bits = cached_types[i].bits;
+            break;
+        case TYPE_KIND_PTR:
+            ty->value.ptr.inner = type_table[cached_types[i].inner];
+            break;
+        }
+        type_table[i] = ty;
+    }
+
+    // Node table, columns point into the mapping
+    NodeTable* t = (NodeTable*)malloc(sizeof(NodeTable));
+    t->buffer = buffer;
+    t->tokens = (Token*)(base + h->offsets[SECTION_TOKENS]);
+    t->len = h->nodes_len;
+    t->cap = h->nodes_len;
+    t->kinds = (uint8_t*)(base + h->offsets[SECTION_KINDS]);
+    t->main_tokens = (uint32_t*)(base + h->offsets[SECTION_MAIN_TOKENS]);
+    t->lhs = (uint32_t*)(base + h->offsets[SECTION_LHS]);
+    t->rhs = (uint32_t*)(base + h->offsets[SECTION_RHS]);
+    t->extra = (uint32_t*)(base + h->offsets[SECTION_EXTRA]);
+    t->extra_len = h->extra_len;
+    t->extra_cap = h->extra_len;
+    t->strings = strings;
+    t->idents = idents;
+    t->borrows_pools = 0;
+    t->mapping = mapping;
+    t->mapping_len = file_len;
+
+    uint32_t const* node_types = (uint32_t const*)(base + h->offsets[SECTION_NODE_TYPES]);
+    t->types = (Type**)malloc(sizeof(Type*) * (h->nodes_len + 1));
+    for(size_t i=0; i<h->nodes_len; ++i) {
+        t->types[i] = node_types[i] == AST_CACHE_TYPE_NONE ? NULL : type_table[node_types[i]];
+    }
+    free(type_table);
+
+    return t;
+}
@@ -0,0 +1,22 @@
+#ifndef CC_AST_CACHE_H
+#define CC_AST_CACHE_H
+
+#include <stdint.h>
+#include "node_table.h"
+#include "type_arena.h"
+#include "vector.h"
+
+// A binary cache of the analyzed AST: tokens, the node table, types of nodes and interned identifiers.
+// The file is mmap-ed on load, and columns of the node table point into the mapping directly.
+// It is valid only for a source whose content hash is 'source_hash'.
+
+uint64_t ast_cache_source_hash(char const* buffer);
+
+// Returns 0 on success. The file is replaced atomically.
+int ast_cache_save(char const* path, uint64_t source_hash, Vector* tokens, NodeTable* t);
+
+// Returns NULL, if the cache does not exist or is stale.
+// Tokens of the table point into 'buffer', and types are allocated from 'types'.
+NodeTable* ast_cache_load(char const* path, uint64_t source_hash, char const* buffer, TypeArena* types);
+
+#endif /* CC_AST_CACHE_H */
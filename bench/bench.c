@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lexer.h"
+#include "parser.h"
+#include "node_arena.h"
+#include "node_table.h"
+#include "type_arena.h"
+#include "analyzer.h"
+#include "ir.h"
+#include "ir_pass.h"
+#include "ir_ifconv.h"
+#include "asm_x86_64.h"
+#include "writer.h"
+#include "vector.h"
+
+// Runs phases of the compiler over inputs, and reports the median time and the throughput of each phase.
+// Debug outputs of phases are discarded, but formatting them is still counted as a part of phases.
+// Medians can be saved as a baseline, and a later run is compared with it to flag regressions.
+
+#define BENCH_DEFAULT_RUNS 5
+#define BENCH_MAX_RUNS 100
+#define BENCH_DEFAULT_THRESHOLD 10.0 // %
+#define BENCH_MIN_COMPARED_MS 0.1   // Shorter phases are too noisy to be flagged
+
+typedef enum {
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_FLATTEN,
+    PHASE_ANALYZE,
+    PHASE_IR,
+    PHASE_CODEGEN,
+    PHASE_EMIT,
+    PHASE_NUM,
+} Phase;
+
+static char const* const phase_names[PHASE_NUM] = {
+    "lex",
+    "parse",
+    "flatten",
+    "analyze",
+    "ir",
+    "codegen",
+    "emit",
+};
+
+// Units of the throughput of each phase
+static char const* const phase_units[PHASE_NUM] = {
+    "tokens",
+    "tokens",
+    "nodes",
+    "nodes",
+    "IR insts",
+    "asm insts",
+    "bytes",
+};
+
+typedef struct {
+    double sec[PHASE_NUM];
+    size_t items[PHASE_NUM];
+} Sample;
+
+// A line of a baseline file, "PATH PHASE MS"
+typedef struct {
+    char path[256];
+    char phase[16];
+    double ms;
+} BaselineEntry;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char* read_file(char const* path, size_t* len) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t size = (size_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    char* buf = (char*)malloc(size + 1);
+    size_t n = fread(buf, 1, size, fp);
+    buf[n] = '\0';
+    fclose(fp);
+
+    *len = n;
+    return buf;
+}
+
+// Returns 0 on success
+static int run_once(char const* buffer, char const* path, Sample* s) {
+    int err = 0;
+    double t0 = now_sec();
+
+    Vector* tokens = vector_new(sizeof(Token)); // Vector<Token>
+    Lexer* lex = lexer_new(buffer, path);
+    for(;;) {
+        Token* tok = (Token*)vector_append(tokens);
+        *tok = lexer_read(lex);
+        if (tok->kind == TOK_KIND_EOF) {
+            break;
+        }
+    }
+    if (lexer_error(lex)) {
+        fprintf(stderr, "%s: %s\n", path, lexer_error(lex));
+        lexer_delete(lex);
+        vector_drop(tokens);
+        return 1;
+    }
+    lexer_delete(lex);
+    double t1 = now_sec();
+
+    NodeArena* nodes = node_arena_new();
+    Parser* parser = parser_new(buffer, tokens, nodes);
+    ParserResult res = parser_parse(parser);
+    double t2 = now_sec();
+    if (res.result == PARSER_ERROR) {
+        parser_drop(parser);
+        node_arena_drop(nodes);
+        vector_drop(tokens);
+        return 1;
+    }
+
+    NodeTable* table = node_table_new(res.value.node, buffer, tokens);
+    parser_drop(parser);
+    node_arena_drop(nodes);
+    double t3 = now_sec();
+
+    TypeArena* types = type_arena_new();
+    Analyzer* analyzer = analyzer_new(types);
+    analyzer_analyze(analyzer, table);
+    double t4 = now_sec();
+
+    IRBuilder* builder = ir_builder_new();
+    IRModule* mod = ir_builder_new_module(builder, table);
+    IRPassOptions pass_opts = {
+        .if_conversion_threshold = IR_IFCONV_DEFAULT_THRESHOLD,
+        .move_loop_invariants = 1,
+    };
+    IRPassManager* pm = ir_pass_manager_new(&pass_opts);
+    ir_pass_manager_add_list(pm, ir_pass_preset(IR_PASS_MAX_LEVEL));
+    err = ir_pass_manager_run(pm, mod);
+    ir_pass_manager_drop(pm);
+    double t5 = now_sec();
+
+    ASM_X86_64* a = asm_x86_64_new(mod, NULL);
+    double t6 = now_sec();
+
+    Writer* w = writer_new(WRITER_NO_FD, 0);
+    asm_x86_64_write(w, a);
+    err |= writer_flush(w);
+    double t7 = now_sec();
+
+    s->sec[PHASE_LEX] = t1 - t0;
+    s->sec[PHASE_PARSE] = t2 - t1;
+    s->sec[PHASE_FLATTEN] = t3 - t2;
+    s->sec[PHASE_ANALYZE] = t4 - t3;
+    s->sec[PHASE_IR] = t5 - t4;
+    s->sec[PHASE_CODEGEN] = t6 - t5;
+    s->sec[PHASE_EMIT] = t7 - t6;
+
+    s->items[PHASE_LEX] = vector_len(tokens);
+    s->items[PHASE_PARSE] = vector_len(tokens);
+    s->items[PHASE_FLATTEN] = table->len;
+    s->items[PHASE_ANALYZE] = table->len;
+    s->items[PHASE_IR] = ir_module_insts_len(mod);
+    s->items[PHASE_CODEGEN] = asm_x86_64_ops_len(a);
+    s->items[PHASE_EMIT] = writer_total_bytes(w);
+
+    writer_drop(w);
+    asm_x86_64_drop(a);
+    ir_module_drop(mod);
+    ir_builder_drop(builder);
+    analyzer_drop(analyzer);
+    type_arena_drop(types);
+    node_table_drop(table);
+    vector_drop(tokens);
+
+    return err;
+}
+
+static int cmp_double(void const* a, void const* b) {
+    double da = *(double const*)a;
+    double db = *(double const*)b;
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+static void fprint_rate(FILE* fp, double items_per_sec) {
+    if (items_per_sec >= 1e6) {
+        fprintf(fp, "%9.2f M", items_per_sec / 1e6);
+    } else if (items_per_sec >= 1e3) {
+        fprintf(fp, "%9.2f K", items_per_sec / 1e3);
+    } else {
+        fprintf(fp, "%9.2f  ", items_per_sec);
+    }
+}
+
+static double median_sec(Sample* samples, int runs, int phase) {
+    double secs[BENCH_MAX_RUNS];
+    for(int i=0; i<runs; ++i) {
+        secs[i] = samples[i].sec[phase];
+    }
+    qsort(secs, (size_t)runs, sizeof(double), cmp_double);
+
+    return secs[runs / 2];
+}
+
+static void fprint_report(FILE* fp, char const* path, size_t len, Sample* samples, int runs) {
+    fprintf(fp, "= BENCH %s (%zu bytes, median of %d runs) =\n", path, len, runs);
+    fprintf(fp, "%-8s %10s %10s %14s\n", "phase", "time(ms)", "items", "rate(/s)");
+
+    double total = 0;
+    for(int p=0; p<PHASE_NUM; ++p) {
+        double median = median_sec(samples, runs, p);
+        total += median;
+
+        // Items do not vary between runs
+        size_t items = samples[0].items[p];
+        fprintf(fp, "%-8s %10.3f %10zu ", phase_names[p], median * 1000, items);
+        fprint_rate(fp, median > 0 ? (double)items / median : 0);
+        fprintf(fp, " %s\n", phase_units[p]);
+    }
+    fprintf(fp, "%-8s %10.3f %10zu ", "total", total * 1000, len);
+    fprint_rate(fp, total > 0 ? (double)len / total : 0);
+    fprintf(fp, " bytes\n\n");
+}
+
+// Returns NULL if the file can not be read
+static Vector* load_baseline(char const* path) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    Vector* entries = vector_new(sizeof(BaselineEntry)); // Vector<BaselineEntry>
+    BaselineEntry e;
+    while(fscanf(fp, "%255s %15s %lf", e.path, e.phase, &e.ms) == 3) {
+        *(BaselineEntry*)vector_append(entries) = e;
+    }
+    fclose(fp);
+
+    return entries;
+}
+
+static BaselineEntry* find_baseline(Vector* entries, char const* path, char const* phase) {
+    for(size_t i=0; i<vector_len(entries); ++i) {
+        BaselineEntry* e = (BaselineEntry*)vector_at(entries, i);
+        if (strcmp(e->path, path) == 0 && strcmp(e->phase, phase) == 0) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+static void save_medians(FILE* fp, char const* path, Sample* samples, int runs) {
+    double total = 0;
+    for(int p=0; p<PHASE_NUM; ++p) {
+        double median = median_sec(samples, runs, p);
+        total += median;
+        fprintf(fp, "%s %s %.6f\n", path, phase_names[p], median * 1000);
+    }
+    fprintf(fp, "%s %s %.6f\n", path, "total", total * 1000);
+}
+
+// Returns the number of phases slower than the baseline by more than 'threshold' %
+static int fprint_compare(FILE* fp, Vector* baseline, char const* path, Sample* samples, int runs, double threshold) {
+    fprintf(fp, "= COMPARE %s (threshold %.1f%%) =\n", path, threshold);
+    fprintf(fp, "%-8s %12s %10s %9s\n", "phase", "baseline(ms)", "now(ms)", "change");
+
+    int regressions = 0;
+    double total = 0;
+    for(int p=0; p<=PHASE_NUM; ++p) {
+        char const* name = p < PHASE_NUM ? phase_names[p] : "total";
+        double ms;
+        if (p < PHASE_NUM) {
+            ms = median_sec(samples, runs, p) * 1000;
+            total += ms;
+        } else {
+            ms = total;
+        }
+
+        BaselineEntry* e = find_baseline(baseline, path, name);
+        if (e == NULL) {
+            fprintf(fp, "%-8s %12s %10.3f\n", name, "-", ms);
+            continue;
+        }
+
+        double change = e->ms > 0 ? (ms - e->ms) / e->ms * 100 : 0;
+        int regressed = change > threshold && e->ms >= BENCH_MIN_COMPARED_MS;
+        regressions += regressed;
+        fprintf(fp, "%-8s %12.3f %10.3f %+8.1f%%%s\n", name, e->ms, ms, change, regressed ? "  REGRESSION" : "");
+    }
+    fprintf(fp, "\n");
+
+    return regressions;
+}
+
+static void fprint_usage(FILE* fp, char const* prog) {
+    fprintf(fp, "Usage: %s [-r RUNS] [-s BASELINE | -c BASELINE [-t PERCENT]] file...\n", prog);
+    fprintf(fp, "  -s BASELINE  Save medians into BASELINE\n");
+    fprintf(fp, "  -c BASELINE  Compare medians with BASELINE, and fail if a phase is slower by more than PERCENT\n");
+    fprintf(fp, "  -t PERCENT   Threshold of -c (%.0f by default)\n", BENCH_DEFAULT_THRESHOLD);
+}
+
+int main(int argc, char* argv[]) {
+    int runs = BENCH_DEFAULT_RUNS;
+    char const* save_path = NULL;
+    char const* compare_path = NULL;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    int first = 1;
+    while(first + 1 < argc && argv[first][0] == '-') {
+        char const* opt = argv[first];
+        char const* arg = argv[first + 1];
+        if (strcmp(opt, "-r") == 0) {
+            runs = atoi(arg);
+        } else if (strcmp(opt, "-s") == 0) {
+            save_path = arg;
+        } else if (strcmp(opt, "-c") == 0) {
+            compare_path = arg;
+        } else if (strcmp(opt, "-t") == 0) {
+            threshold = atof(arg);
+        } else {
+            break;
+        }
+        first += 2;
+    }
+    if (first >= argc || runs <= 0 || runs > BENCH_MAX_RUNS || (save_path && compare_path)) {
+        fprint_usage(stderr, argv[0]);
+        return 1;
+    }
+
+    Vector* baseline = NULL;
+    if (compare_path) {
+        baseline = load_baseline(compare_path);
+        if (baseline == NULL) {
+            fprintf(stderr, "Failed to open the baseline: %s\n", compare_path);
+            return 1;
+        }
+    }
+    FILE* save = NULL;
+    if (save_path) {
+        save = fopen(save_path, "w");
+        if (save == NULL) {
+            fprintf(stderr, "Failed to open the baseline: %s\n", save_path);
+            return 1;
+        }
+    }
+
+    // Phases print debug logs to stdout, so the report goes to the original one
+    fflush(stdout);
+    FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+    int null_fd = open("/dev/null", O_WRONLY);
+    assert(out && null_fd != -1); // TODO: error handling...
+
+    int err = 0;
+    int regressions = 0;
+    for(int i=first; i<argc; ++i) {
+        size_t len;
+        char* buffer = read_file(argv[i], &len);
+        if (buffer == NULL) {
+            fprintf(stderr, "Failed to open file: %s\n", argv[i]);
+            err = 1;
+            continue;
+        }
+
+        Sample samples[BENCH_MAX_RUNS];
+        int failed = 0;
+        for(int r=0; r<runs && !failed; ++r) {
+            fflush(stdout);
+            int saved = dup(STDOUT_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+
+            failed = run_once(buffer, argv[i], &samples[r]);
+
+            fflush(stdout);
+            dup2(saved, STDOUT_FILENO);
+            close(saved);
+        }
+        free(buffer);
+
+        if (failed) {
+            fprintf(stderr, "FAILED: %s\n", argv[i]);
+            err = 1;
+            continue;
+        }
+        fprint_report(out, argv[i], len, samples, runs);
+        if (save) {
+            save_medians(save, argv[i], samples, runs);
+        }
+        if (baseline) {
+            regressions += fprint_compare(out, baseline, argv[i], samples, runs, threshold);
+        }
+        fflush(out);
+    }
+
+    if (baseline) {
+        fprintf(out, "%d regression(s) over %.1f%%\n", regressions, threshold);
+        vector_drop(baseline);
+    }
+    if (save) {
+        fclose(save);
+        fprintf(out, "Saved the baseline: %s\n", save_path);
+    }
+    close(null_fd);
+    fclose(out);
+    return err || regressions > 0;
+}
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Generates a synthetic C source for benchmarks to stdout.
+// Outputs are deterministic, so timings of the same kind and size are comparable across builds.
+
+typedef struct {
+    char const* name;
+    void (*gen)(long n);
+    long default_n;
+    char const* desc;
+} Kind;
+
+// Thousands of small functions
+static void gen_funcs(long n) {
+    for(long i=0; i<n; ++i) {
+        printf("int f%ld(void) {\n", i);
+        printf("    puts(\"f%ld\");\n", i);
+        printf("    return %ld + %ld;\n", i % 100, (i * 7) % 100);
+        printf("}\n\n");
+    }
+
+    printf("int main(void) {\n");
+    printf("    return f0() + f%ld();\n", n - 1);
+    printf("}\n");
+}
+
+// A deep '+' chain in an expression
+static void gen_chain(long n) {
+    printf("int g(void) {\n");
+    printf("    return 1;\n");
+    printf("}\n\n");
+
+    printf("int main(void) {\n");
+    printf("    return 0");
+    for(long i=0; i<n; ++i) {
+        if (i % 8 == 7) {
+            printf(" + g()");
+        } else {
+            printf(" + %ld", i % 10);
+        }
+        if (i % 16 == 15) {
+            printf("\n        ");
+        }
+    }
+    printf(";\n");
+    printf("}\n");
+}
+
+// Nested ifs, with an else branch at every level
+static void gen_ifs(long n) {
+    printf("int main(void) {\n");
+    for(long i=0; i<n; ++i) {
+        printf("if (%ld) {\n", i % 2);
+    }
+    printf("puts(\"innermost\");\n");
+    for(long i=0; i<n; ++i) {
+        printf("} else {\n");
+        printf("puts(\"else\");\n");
+        printf("}\n");
+    }
+    printf("return 0;\n");
+    printf("}\n");
+}
+
+// Many distinct string literals, and duplicated ones
+static void gen_strings(long n) {
+    printf("int main(void) {\n");
+    for(long i=0; i<n; ++i) {
+        if (i % 4 == 3) {
+            printf("    puts(\"duplicated string\");\n");
+        } else {
+            printf("    puts(\"string literal number %ld\\n\");\n", i);
+        }
+    }
+    printf("    return 0;\n");
+    printf("}\n");
+}
+
+// Many calls of a few functions
+static void gen_calls(long n) {
+    printf("int a(void) {\n");
+    printf("    return 1;\n");
+    printf("}\n\n");
+    printf("int b(void) {\n");
+    printf("    return 2;\n");
+    printf("}\n\n");
+
+    printf("int main(void) {\n");
+    for(long i=0; i<n; ++i) {
+        printf("    %s();\n", i % 2 == 0 ? "a" : "b");
+    }
+    printf("    return 0;\n");
+    printf("}\n");
+}
+
+// A hot loop of '*', '/' and '%' by constants, which reports its own clock ticks when it runs.
+// It is for timing generated code rather than the compiler, e.g. with and without -fstrength-reduce.
+static void gen_arith(long n) {
+    // Tail calls are jumps, so the recursion does not grow the stack
+    printf("int f(int n, int acc) {\n");
+    printf("    if (n) {\n");
+    printf("        return f(n - 1, (acc * 9 + n * 40 + acc / 7 + n %% 10 + acc %% 1000 / 3) %% 1000003);\n");
+    printf("    }\n");
+    printf("    return acc;\n");
+    printf("}\n\n");
+
+    printf("int report(int start, int acc) {\n");
+    printf("    printf(\"ticks: %%ld, result: %%ld\\n\", clock() - start, acc);\n");
+    printf("    return 0;\n");
+    printf("}\n\n");
+
+    printf("int main(void) {\n");
+    printf("    return report(clock(), f(%ld, 1));\n", n);
+    printf("}\n");
+}
+
+// A hot loop which selects values by pseudo-random bits, so branches in it are not predictable.
+// It is for timing generated code, e.g. with and without if-conversion.
+static void gen_select(long n) {
+    // A linear congruential generator, whose low bits have short periods
+    printf("int next(int s) {\n");
+    printf("    return (s * 1103515245 + 12345) %% 2147483648;\n");
+    printf("}\n\n");
+
+    printf("int pick(int s, int acc) {\n");
+    printf("    if ((s >> 16) & 1) {\n");
+    printf("        return acc + (s & 127);\n");
+    printf("    }\n");
+    printf("    return acc - ((s >> 8) & 63);\n");
+    printf("}\n\n");
+
+    printf("int loop(int n, int s, int acc) {\n");
+    printf("    if (n) {\n");
+    printf("        return loop(n - 1, next(s), pick(s, acc));\n");
+    printf("    }\n");
+    printf("    return acc;\n");
+    printf("}\n\n");
+
+    printf("int report(int start, int acc) {\n");
+    printf("    printf(\"ticks: %%ld, result: %%ld\\n\", clock() - start, acc);\n");
+    printf("    return 0;\n");
+    printf("}\n\n");
+
+    printf("int main(void) {\n");
+    printf("    return report(clock(), loop(%ld, 1, 0));\n", n);
+    printf("}\n");
+}
+
+// A hot loop which computes the same value every iteration, driven by pseudo-random bits since there are no variables.
+// It is for timing generated code, e.g. with and without loop-invariant code motion.
+static void gen_loop(long n) {
+    printf("int spin(int k) {\n");
+    printf("    while (rand() & 15) {\n");
+    printf("        labs((k * 37 + 11) / 7 + (k ^ 91) * 13 %% 1009 + (k << 3) - k / 3 + (k | 5) * (k & 12) %% 17);\n");
+    printf("    }\n");
+    printf("    return (k * 37 + 11) / 7 + (k ^ 91) * 13 %% 1009 + (k << 3) - k / 3 + (k | 5) * (k & 12) %% 17;\n");
+    printf("}\n\n");
+
+    printf("int loop(int n, int acc) {\n");
+    printf("    if (n) {\n");
+    printf("        return loop(n - 1, (acc + spin(n %% 1000)) %% 1000003);\n");
+    printf("    }\n");
+    printf("    return acc;\n");
+    printf("}\n\n");
+
+    printf("int report(int start, int acc) {\n");
+    printf("    printf(\"ticks: %%ld, result: %%ld\\n\", clock() - start, acc);\n");
+    printf("    return 0;\n");
+    printf("}\n\n");
+
+    printf("int main(void) {\n");
+    printf("    return report(clock(), loop(%ld, 0));\n", n);
+    printf("}\n");
+}
+
+#define DISPATCH_OPS 16
+
+// A hot loop of an interpreter, which dispatches pseudo-random opcodes by a switch or by an equivalent if-chain.
+// Both give the same result, e.g. for timing jump tables against compare trees and chains of branches.
+static void gen_dispatch_common(long n, int by_switch) {
+    printf("int next(int s) {\n");
+    printf("    return (s * 1103515245 + 12345) %% 2147483648;\n");
+    printf("}\n\n");
+
+    printf("int step(int op, int s, int acc) {\n");
+    if (by_switch) {
+        printf("    switch (op) {\n");
+    }
+    for(int k=0; k<DISPATCH_OPS; ++k) {
+        if (by_switch) {
+            printf("    case %d:\n", k);
+        } else {
+            printf("    if (op == %d) {\n", k);
+        }
+        printf("        return (acc * %d + ((s >> %d) & 255)) %% 1000003;\n", 2 * k + 3, k % 8);
+        if (!by_switch) {
+            printf("    }\n");
+        }
+    }
+    if (by_switch) {
+        printf("    }\n");
+    }
+    printf("    return acc;\n");
+    printf("}\n\n");
+
+    printf("int loop(int n, int s, int acc) {\n");
+    printf("    if (n) {\n");
+    printf("        return loop(n - 1, next(s), step((s >> 16) %% %d, s, acc));\n", DISPATCH_OPS);
+    printf("    }\n");
+    printf("    return acc;\n");
+    printf("}\n\n");
+
+    printf("int report(int start, int acc) {\n");
+    printf("    printf(\"ticks: %%ld, result: %%ld\\n\", clock() - start, acc);\n");
+    printf("    return 0;\n");
+    printf("}\n\n");
+
+    printf("int main(void) {\n");
+    printf("    return report(clock(), loop(%ld, 1, 0));\n", n);
+    printf("}\n");
+}
+
+static void gen_dispatch(long n) {
+    gen_dispatch_common(n, 1);
+}
+
+static void gen_dispatch_if(long n) {
+    gen_dispatch_common(n, 0);
+}
+
+static Kind const kinds[] = {
+    { "funcs",   gen_funcs,   2000,  "N functions and main" },
+    { "chain",   gen_chain,   20000, "a '+' chain of N terms" },
+    { "ifs",     gen_ifs,     500,   "ifs nested N levels" },
+    { "strings", gen_strings, 10000, "N string literals" },
+    { "calls",   gen_calls,   20000, "N calls" },
+    { "arith",   gen_arith,   50000000, "a loop of N iterations of arithmetic by constants" },
+    { "select",  gen_select,  50000000, "a loop of N iterations of selects by random bits" },
+    { "loop",    gen_loop,    3000000, "N loops of invariant arithmetic, 15 iterations on average" },
+    { "dispatch", gen_dispatch, 50000000, "a loop of N iterations of a switch over random opcodes" },
+    { "dispatch-if", gen_dispatch_if, 50000000, "the same as dispatch by a chain of ifs" },
+};
+
+static void fprint_usage(FILE* fp, char const* prog) {
+    fprintf(fp, "Usage: %s KIND [N]\n", prog);
+    fprintf(fp, "Kinds:\n");
+    for(size_t i=0; i<sizeof(kinds)/sizeof(kinds[0]); ++i) {
+        fprintf(fp, "  %-8s %s (N=%ld by default)\n", kinds[i].name, kinds[i].desc, kinds[i].default_n);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        fprint_usage(stderr, argv[0]);
+        return 1;
+    }
+
+    for(size_t i=0; i<sizeof(kinds)/sizeof(kinds[0]); ++i) {
+        if (strcmp(argv[1], kinds[i].name) != 0) {
+            continue;
+        }
+
+        long n = argc == 3 ? strtol(argv[2], NULL, 10) : kinds[i].default_n;
+        if (n <= 0) {
+            fprintf(stderr, "Invalid size: %s\n", argv[2]);
+            return 1;
+        }
+        kinds[i].gen(n);
+        return 0;
+    }
+
+    fprintf(stderr, "Unknown kind: %s\n", argv[1]);
+    fprint_usage(stderr, argv[0]);
+    return 1;
+}
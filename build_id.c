@@ -0,0 +1,10 @@
+#include "build_id.h"
+
+// Built without the Makefile, then each build has its own caches
+#ifndef CC_BUILD_ID
+#define CC_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+char const* build_id() {
+    return CC_BUILD_ID;
+}
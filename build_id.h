@@ -0,0 +1,8 @@
+#ifndef CC_BUILD_ID_H
+#define CC_BUILD_ID_H
+
+// A hash of the sources of this build, given by the Makefile. Caches of outputs are keyed by it,
+// so any change of the compiler invalidates them.
+char const* build_id();
+
+#endif /* CC_BUILD_ID_H */
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache_file.h"
+
+int cache_write_atomic(char const* path, void const* buf, size_t len, mode_t mode) {
+    size_t tmp_size = strlen(path) + 8;
+    char* tmp_path = (char*)malloc(tmp_size);
+    snprintf(tmp_path, tmp_size, "%s.XXXXXX", path);
+    int fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        free(tmp_path);
+        return 1;
+    }
+
+    int err = 0;
+    char const* p = (char const*)buf;
+    while(len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = 1;
+            break;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    err |= fchmod(fd, mode) != 0;
+    err |= fsync(fd) != 0;
+    err |= close(fd) != 0;
+
+    if (err == 0 && rename(tmp_path, path) != 0) {
+        err = 1;
+    }
+    if (err) {
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+
+    return err;
+}
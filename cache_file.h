@@ -0,0 +1,12 @@
+#ifndef CC_CACHE_FILE_H
+#define CC_CACHE_FILE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Writes 'buf' into 'path' through a temporary file next to it, which is synced and then renamed over
+// 'path'. Readers, including other processes, see either the old file or the new one, never a partial one.
+// Returns 0 on success.
+int cache_write_atomic(char const* path, void const* buf, size_t len, mode_t mode);
+
+#endif /* CC_CACHE_FILE_H */
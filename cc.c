@@ -1,6 +1,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/wait.h>
 #include "cc.h"
 #include "vector.h"
 #include "log.h"
@@ -8,34 +14,93 @@
 #include "parser.h"
 #include "analyzer.h"
 #include "ir.h"
+#include "ir_pass.h"
 #include "asm_x86_64.h"
+#include "writer.h"
+#include "jit_x86_64.h"
+#include "ir_interp.h"
+#include "compile_cache.h"
+#include "func_cache.h"
+#include "hash.h"
+#include "build_id.h"
+#include "ast_cache.h"
+
+extern char** environ;
+
+struct cc_workspace_t {
+    Vector* tokens;         // Vector<Token>
+    NodeArena* nodes;
+    TypeArena* types;
+    StringPool* strings;
+    StringPool* idents;
+};
+
+CCWorkspace* cc_workspace_new() {
+    CCWorkspace* ws = malloc(sizeof(CCWorkspace));
+    ws->tokens = vector_new(sizeof(Token));
+    ws->nodes = node_arena_new();
+    ws->types = type_arena_new();
+    ws->strings = string_pool_new();
+    ws->idents = string_pool_new();
+
+    return ws;
+}
+
+void cc_workspace_drop(CCWorkspace* ws) {
+    string_pool_drop(ws->idents);
+    string_pool_drop(ws->strings);
+    type_arena_drop(ws->types);
+    node_arena_drop(ws->nodes);
+    vector_drop(ws->tokens);
+
+    free(ws);
+}
+
+static void cc_workspace_reset(CCWorkspace* ws) {
+    string_pool_clear(ws->idents);
+    string_pool_clear(ws->strings);
+    type_arena_reset(ws->types);
+    node_arena_reset(ws->nodes);
+    vector_truncate(ws->tokens, 0);
+}
 
 struct cc_t {
     char const* buffer;
     char const* fpath;
-    Vector* tokens;         // phase1, Vector<Token>
-    NodeArena* nodes;       // phase1
+    CCOptions const* opts;  // reference
+    CCWorkspace* ws;
+    int owns_ws;
+    Vector* tokens;         // phase1, Vector<Token>, in 'ws'
+    NodeArena* nodes;       // phase1, in 'ws'
     Parser* parser;         // phase1
-    TypeArena* types;       // phase2
+    NodeTable* table;       // phase2, flattened AST
+    TypeArena* types;       // phase2, in 'ws'
     Analyzer* analyzer;     // phase2
     IRBuilder* ir_builder;  // phase3
     IRModule* ir_mod;       // phase3
+    int cacheable;          // The output is stored into the compile cache
+    CompileCacheKey cache_key;
     enum {
         CC_STATE_INIT,
     } state;
 };
 
-CC* cc_new(char const* buffer, char const* fpath) {
+CC* cc_new(char const* buffer, char const* fpath, CCOptions const* opts, CCWorkspace* ws) {
     CC* cc = malloc(sizeof(CC));
     cc->buffer = buffer;
     cc->fpath = fpath;
+    cc->opts = opts;
+    cc->ws = ws ? ws : cc_workspace_new();
+    cc->owns_ws = ws == NULL;
     cc->tokens = NULL;
     cc->nodes = NULL;
     cc->parser = NULL;
+    cc->table = NULL;
     cc->types = NULL;
     cc->analyzer = NULL;
     cc->ir_builder = NULL;
     cc->ir_mod = NULL;
+    cc->cacheable = 0;
     cc->state = CC_STATE_INIT;
 
     return cc;
@@ -51,33 +116,35 @@ void cc_drop(CC* cc) {
 
     if (cc->analyzer) {
         analyzer_drop(cc->analyzer);
+    }
 
-        assert(cc->types);
-        type_arena_drop(cc->types);
+    if (cc->table) {
+        node_table_drop(cc->table);
     }
 
     if (cc->parser) {
         parser_drop(cc->parser);
-
-        assert(cc->nodes);
-        node_arena_drop(cc->nodes);
     }
 
-    if (cc->tokens) {
-        vector_drop(cc->tokens);
+    // Tokens, nodes and types are in the workspace
+    if (cc->owns_ws) {
+        cc_workspace_drop(cc->ws);
+    } else {
+        cc_workspace_reset(cc->ws);
     }
 
     free(cc);
 }
 
-static void cc_lex(CC* cc) {
-    cc->tokens = vector_new(sizeof(Token)); // Vector<Token>
+// Returns 0 on success
+static int cc_lex(CC* cc) {
+    cc->tokens = cc->ws->tokens;
 
     Lexer* lex = lexer_new(cc->buffer, cc->fpath);
     for(;;) {
         Token tok = lexer_read(lex);
 
-        token_fprint(DEBUGOUT, &tok); printf("\n");
+        token_fprint(DEBUGOUT, cc->buffer, &tok); fprintf(DEBUGOUT, "\n");
 
         Token* elem = (Token*)vector_append(cc->tokens);
         assert(elem);
@@ -87,29 +154,123 @@ static void cc_lex(CC* cc) {
             break;
         }
     }
+
+    int err = 0;
+    if (lexer_error(lex)) {
+        fprintf(stderr, "%s: %s\n", cc->fpath, lexer_error(lex));
+        err = 1;
+    }
     lexer_delete(lex);
+
+    return err;
 }
 
 ParserResult cc_parse(CC* cc) {
-    cc_lex(cc); // TODO: pass lexer to parser
+    if (cc_lex(cc)) { // TODO: pass lexer to parser
+        ParserResult res;
+        res.result = PARSER_ERROR;
+        res.error.kind = PARSER_ERROR_KIND_LEXER;
+        return res;
+    }
 
-    cc->nodes = node_arena_new();
-    cc->parser = parser_new(cc->tokens, cc->nodes);
+    cc->nodes = cc->ws->nodes;
+    cc->parser = parser_new(cc->buffer, cc->tokens, cc->nodes);
+    if (cc->opts->parser_memo) {
+        parser_set_memoize(cc->parser, 1);
+    }
+
+    ParserResult res = parser_parse(cc->parser);
+
+    fprintf(DEBUGOUT, "= PARSER STATS =\n");
+    parser_fprint_stats(DEBUGOUT, cc->parser);
+    fprintf(DEBUGOUT, "\n");
+
+    return res;
+}
+
+// Flattens the tree into the node table, and releases the tree
+static void cc_flatten(CC* cc, Node* node) {
+    cc->table = node_table_new_with_pools(node, cc->buffer, cc->tokens, cc->ws->strings, cc->ws->idents);
 
-    return parser_parse(cc->parser);
+    fprintf(DEBUGOUT, "= NODE TABLE STATS =\n");
+    node_table_fprint_stats(DEBUGOUT, cc->table, node);
+    fprintf(DEBUGOUT, "\n");
+
+    parser_drop(cc->parser);
+    cc->parser = NULL;
+    node_arena_reset(cc->nodes);
+    cc->nodes = NULL;
 }
 
 // TODO: returns AnalyzerResult
 void cc_analyze(CC* cc, Node* node) {
-    cc->types = type_arena_new();
+    cc_flatten(cc, node);
+
+    cc->types = cc->ws->types;
     cc->analyzer = analyzer_new(cc->types);
 
-    analyzer_analyze(cc->analyzer, node);
+    analyzer_analyze(cc->analyzer, cc->table);
+
+    if (cc->opts->ast_cache_path) {
+        uint64_t hash = ast_cache_source_hash(cc->buffer);
+        ast_cache_save(cc->opts->ast_cache_path, hash, cc->tokens, cc->table); // Failures are not fatal
+    }
 }
 
-static IRModule* cc_build_ir(CC* cc, Node* node) {
+int cc_load_ast_cache(CC* cc) {
+    if (!cc->opts->ast_cache_path) {
+        return 0;
+    }
+
+    assert(cc->table == NULL && cc->types == NULL);
+
+    uint64_t hash = ast_cache_source_hash(cc->buffer);
+    cc->types = cc->ws->types;
+    cc->table = ast_cache_load(cc->opts->ast_cache_path, hash, cc->buffer, cc->types);
+    if (cc->table == NULL) {
+        type_arena_reset(cc->types);
+        cc->types = NULL;
+        return 0;
+    }
+
+    fprintf(DEBUGOUT, "= NODE TABLE STATS (CACHED) =\n");
+    node_table_fprint_stats(DEBUGOUT, cc->table, NULL);
+    fprintf(DEBUGOUT, "\n");
+
+    return 1;
+}
+
+// Comma separated names of IR passes
+static char const* cc_passes(CCOptions const* opts) {
+    return opts->passes ? opts->passes : ir_pass_preset(opts->opt_level);
+}
+
+static IRModule* cc_build_ir(CC* cc, IRBuilderFunctionFilter filter, void* args) {
     cc->ir_builder = ir_builder_new();
-    cc->ir_mod = ir_builder_new_module(cc->ir_builder, node);
+    if (filter) {
+        ir_builder_set_function_filter(cc->ir_builder, filter, args);
+    }
+    cc->ir_mod = ir_builder_new_module(cc->ir_builder, cc->table);
+
+    IRPassOptions pass_opts = {
+        .if_conversion_threshold = cc->opts->if_conversion_threshold,
+        .move_loop_invariants = cc->opts->move_loop_invariants,
+    };
+    IRPassManager* pm = ir_pass_manager_new(&pass_opts);
+    int unknown = ir_pass_manager_add_list(pm, cc_passes(cc->opts));
+    assert(!unknown); // Checked by options_parse
+    (void)unknown;
+    if (cc->opts->dump_passes) {
+        ir_pass_manager_set_dump(pm, DEBUGOUT);
+    }
+
+    if (ir_pass_manager_run(pm, cc->ir_mod)) {
+        fflush(DEBUGOUT);
+        assert(0); // TODO: error handling...
+    }
+    ir_pass_manager_fprint_stats(DEBUGOUT, pm);
+    fprintf(DEBUGOUT, "\n");
+    ir_pass_manager_drop(pm);
 
     fprintf(DEBUGOUT,"= IR =\n");
     ir_module_fprint(DEBUGOUT, cc->ir_mod);
@@ -119,67 +280,396 @@ static IRModule* cc_build_ir(CC* cc, Node* node) {
     return cc->ir_mod;
 }
 
+static double elapsed_sec(struct timespec const* begin, struct timespec const* end) {
+    return (double)(end->tv_sec - begin->tv_sec) + (double)(end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+// Default output path as gcc does, e.g. "dir/foo.c" -> "foo.s"
+static void default_output_path(char* buf, size_t size, char const* input_path, CCStage stage) {
+    if (stage == CC_STAGE_EXE) {
+        snprintf(buf, size, "a.out");
+        return;
+    }
+
+    char const* base = strrchr(input_path, '/');
+    base = base ? base + 1 : input_path;
+    size_t len = strlen(base);
+    if (len >= 2 && base[len - 2] == '.' && base[len - 1] == 'c') {
+        len -= 2;
+    }
+    snprintf(buf, size, "%.*s.%c", (int)len, base, stage == CC_STAGE_ASM ? 's' : 'o');
+}
+
+static char const* cc_output_path(CC* cc, char* buf, size_t size) {
+    if (cc->opts->output_path) {
+        return cc->opts->output_path;
+    }
+
+    default_output_path(buf, size, cc->fpath, cc->opts->stage);
+    return buf;
+}
+
+int cc_fetch_compile_cache(CC* cc) {
+    CCOptions const* opts = cc->opts;
+    if (!opts->compile_cache_dir || opts->run || opts->interp) {
+        return 0;
+    }
+
+    char default_path[256];
+    char const* out_path = cc_output_path(cc, default_path, sizeof(default_path));
+    if (strcmp(out_path, "-") == 0) {
+        return 0;
+    }
+
+    // Options which affect the output, in full since the key is a digest of them
+    char const* passes = cc_passes(opts);
+    size_t flags_size = 160 + strlen(passes);
+    char* flags = (char*)malloc(flags_size);
+    snprintf(flags, flags_size, "build=%s;stage=%d;omit-fp=%d;sr=%d;ifc=%zu;licm=%d;jt=%d;isel=%d;passes=%s",
+             build_id(), (int)opts->stage, opts->omit_frame_pointer, opts->strength_reduce, opts->if_conversion_threshold,
+             opts->move_loop_invariants, opts->jump_tables, opts->tree_isel, passes);
+    cc->cache_key = compile_cache_key(cc->buffer, strlen(cc->buffer), flags);
+    free(flags);
+    cc->cacheable = 1;
+
+    int hit = compile_cache_fetch(opts->compile_cache_dir, &cc->cache_key, out_path);
+
+    fprintf(DEBUGOUT, "= COMPILE CACHE =\n");
+    fprintf(DEBUGOUT, "%s: %s\n", hit ? "hit" : "miss", out_path);
+    compile_cache_fprint_stats(DEBUGOUT);
+    fprintf(DEBUGOUT, "\n");
+
+    return hit;
+}
+
+// Spawns 'argv' with its stdin connected to a pipe. Returns the write end of the pipe, or -1.
+static int spawn_with_pipe(char* const argv[], pid_t* pid) {
+    int fds[2];
+    if (pipe(fds) == -1) {
+        return -1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    int res = posix_spawnp(pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[0]);
+    if (res != 0) {
+        close(fds[1]);
+        return -1;
+    }
+
+    return fds[1];
+}
+
+// Returns 0 if the child exited successfully
+static int wait_child(pid_t pid) {
+    int status;
+    while(waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return 1;
+        }
+    }
+
+    return !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// A function of the source for -fincremental
+typedef struct {
+    char const* name;       // reference
+    uint64_t fingerprint;
+    char const* text;       // Nullable, reused code owned by the old cache
+    size_t len;
+    size_t begin;           // Offsets of generated code in the output
+    size_t end;
+} IncrementalFunc;
+
+typedef struct {
+    NodeTable* table;       // reference
+    FuncCache* cache;       // Loaded from the previous compilation
+    Vector* funcs;          // Vector<IncrementalFunc>, in the source order
+    uint32_t next_token;    // The first token of the next function
+    uint64_t seed;          // Of fingerprints, covers options which affect generated code
+} Incremental;
+
+// Only functions without reusable code are built
+static int incremental_filter(NodeIndex func_def, char const* name, void* args) {
+    Incremental* inc = (Incremental*)args;
+    NodeTable* t = inc->table;
+    NodeIndex id = node_table_declarator_extract_id(t, t->extra[t->lhs[func_def] + 1]);
+
+    IncrementalFunc* f = (IncrementalFunc*)vector_append(inc->funcs);
+    f->name = name;
+    f->fingerprint = func_cache_fingerprint(t, id, inc->next_token, &inc->next_token, inc->seed);
+    f->text = func_cache_find(inc->cache, name, f->fingerprint, &f->len);
+    f->begin = 0;
+    f->end = 0;
+
+    return f->text == NULL;
+}
+
+// Writes reused functions as is, and generated ones in between
+static void cc_write_incremental(Writer* w, ASM_X86_64* a, Incremental* inc) {
+    asm_x86_64_write_header(w, a);
+
+    size_t generated = 0;
+    for(size_t i=0; i<vector_len(inc->funcs); ++i) {
+        IncrementalFunc* f = (IncrementalFunc*)vector_at(inc->funcs, i);
+        if (f->text) {
+            writer_put_bytes(w, f->text, f->len);
+            continue;
+        }
+
+        assert(generated < asm_x86_64_functions_len(a));
+        assert(strcmp(asm_x86_64_function_name(a, generated), f->name) == 0);
+        f->begin = writer_total_bytes(w);
+        asm_x86_64_write_function(w, a, generated++);
+        f->end = writer_total_bytes(w);
+    }
+}
+
+// Stores code of all functions for the next compilation. 'asm_text' is the whole output.
+static void cc_save_incremental(CC* cc, Incremental* inc, char const* asm_text) {
+    FuncCache* next = func_cache_new();
+    size_t reused = 0;
+    for(size_t i=0; i<vector_len(inc->funcs); ++i) {
+        IncrementalFunc* f = (IncrementalFunc*)vector_at(inc->funcs, i);
+        if (f->text) {
+            func_cache_put(next, f->name, f->fingerprint, f->text, f->len);
+            reused++;
+        } else {
+            func_cache_put(next, f->name, f->fingerprint, asm_text + f->begin, f->end - f->begin);
+        }
+    }
+    func_cache_save(next, cc->opts->incremental_path); // Failures are not fatal
+    func_cache_drop(next);
+
+    fprintf(DEBUGOUT, "= INCREMENTAL =\n");
+    fprintf(DEBUGOUT, "functions: %zu\n", vector_len(inc->funcs));
+    fprintf(DEBUGOUT, "reused: %zu\n", reused);
+    fprintf(DEBUGOUT, "rebuilt: %zu\n", vector_len(inc->funcs) - reused);
+    func_cache_fprint_stats(DEBUGOUT, inc->cache);
+    fprintf(DEBUGOUT, "\n");
+}
+
 // TODO: returns CompileResult
-int cc_compile(CC* cc, Node* node) {
+int cc_compile(CC* cc) {
     int err = 0;
-    IRModule* ir_mod = cc_build_ir(cc, node);
 
-    ASM_X86_64* asm_x86_64 = asm_x86_64_new(ir_mod);
+    Incremental inc = {0};
+    int incremental = cc->opts->incremental_path != NULL;
+    if (incremental) {
+        inc.table = cc->table;
+        inc.cache = func_cache_load(cc->opts->incremental_path);
+        inc.funcs = vector_new(sizeof(IncrementalFunc));
+        // Outputs of another build or other codegen options are not reused
+        inc.seed = hash_string(HASH_INIT, build_id());
+        inc.seed = hash_bytes(inc.seed, &cc->opts->omit_frame_pointer, sizeof(cc->opts->omit_frame_pointer));
+        inc.seed = hash_bytes(inc.seed, &cc->opts->strength_reduce, sizeof(cc->opts->strength_reduce));
+        inc.seed = hash_bytes(inc.seed, &cc->opts->if_conversion_threshold, sizeof(cc->opts->if_conversion_threshold));
+        inc.seed = hash_bytes(inc.seed, &cc->opts->move_loop_invariants, sizeof(cc->opts->move_loop_invariants));
+        inc.seed = hash_bytes(inc.seed, &cc->opts->jump_tables, sizeof(cc->opts->jump_tables));
+        inc.seed = hash_bytes(inc.seed, &cc->opts->tree_isel, sizeof(cc->opts->tree_isel));
+        inc.seed = hash_string(inc.seed, cc_passes(cc->opts));
+    }
+    IRModule* ir_mod = cc_build_ir(cc, incremental ? incremental_filter : NULL, &inc);
 
-    fprintf(DEBUGOUT, "= ASM =\n");
-    asm_x86_64_fprint(DEBUGOUT, asm_x86_64);
-    fprintf(DEBUGOUT, "\n");
-    fflush(DEBUGOUT);
+    ASM_X86_64_Options asm_opts = {
+        .omit_frame_pointer = cc->opts->omit_frame_pointer,
+        .strength_reduce = cc->opts->strength_reduce,
+        .jump_tables = cc->opts->jump_tables,
+        .tree_isel = cc->opts->tree_isel,
+    };
+    ASM_X86_64* asm_x86_64 = asm_x86_64_new(ir_mod, &asm_opts);
 
-    // TODO: fix
-    char spath[16] = "/tmp/ccXXXXXX.s";
-    int fd = mkstemps(spath, 2);
+    CCStage stage = cc->opts->stage;
+    char default_path[256];
+    char const* out_path = cc_output_path(cc, default_path, sizeof(default_path));
+    int to_stdout = stage == CC_STAGE_ASM && strcmp(out_path, "-") == 0;
+
+    // The assembly is written to the output directly with -S, otherwise it is streamed into the assembler
+    int fd = -1;
+    pid_t pid = 0;
+    switch(stage) {
+    case CC_STAGE_ASM:
+        if (to_stdout) {
+            fflush(stdout);
+            fd = STDOUT_FILENO;
+        } else {
+            fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        break;
+
+    case CC_STAGE_OBJ:
+    {
+        char* const argv[] = {"as", "-o", (char*)out_path, NULL};
+        fd = spawn_with_pipe(argv, &pid);
+        break;
+    }
+
+    case CC_STAGE_EXE:
+    {
+        // gcc assembles from stdin and links, so no intermediate files are left on our side
+        char* const argv[] = {"gcc", "-x", "assembler", "-", "-o", (char*)out_path, NULL};
+        fd = spawn_with_pipe(argv, &pid);
+        break;
+    }
+    }
     if (fd == -1) {
         // TODO: fix
-        fprintf(stderr, "Failed to open asm file: \n");
+        fprintf(stderr, "Failed to open output: %s\n", out_path);
         err = 1;
         goto exit;
     }
-    FILE* fp = fdopen(fd, "wb");
-    asm_x86_64_fprint(fp, asm_x86_64);
-    fclose(fp);
 
-    char opath[16];
-    memcpy(opath, spath, 16);
-    opath[14] = 'o';
+    // Formats once into the output, and keeps a copy in memory for the debug output
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    Writer* w = writer_new(fd, !to_stdout || incremental);
+    if (incremental) {
+        cc_write_incremental(w, asm_x86_64, &inc);
+    } else {
+        asm_x86_64_write(w, asm_x86_64);
+    }
+    int werr = writer_flush(w);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (incremental && !werr) {
+        size_t asm_len;
+        cc_save_incremental(cc, &inc, writer_memory(w, &asm_len));
+    }
+    if (!to_stdout) {
+        close(fd);
 
-    char cmd[1024];
-    int n = snprintf(cmd, 1024, "as %s -o %s", spath, opath);
-    if (n < 0 || n >= 1024) {
-        // TODO: fix
-        fprintf(stderr, "Failed to write cmd: \n");
-        err = 1;
-        goto exit;
+        size_t asm_len;
+        char const* asm_text = writer_memory(w, &asm_len);
+        fprintf(DEBUGOUT, "= ASM =\n");
+        fwrite(asm_text, 1, asm_len, DEBUGOUT);
+        fprintf(DEBUGOUT, "\n");
+    }
+
+    double sec = elapsed_sec(&begin, &end);
+    fprintf(DEBUGOUT, "= ASM WRITER STATS =\n");
+    fprintf(DEBUGOUT, "bytes: %zu\n", writer_total_bytes(w));
+    fprintf(DEBUGOUT, "time: %.6f sec\n", sec);
+    if (sec > 0) {
+        fprintf(DEBUGOUT, "throughput: %.2f MB/s\n", (double)writer_total_bytes(w) / sec / (1024 * 1024));
     }
-    int cmd_res = system(cmd);
-    if (cmd_res != 0) {
+    fprintf(DEBUGOUT, "\n");
+    fflush(DEBUGOUT);
+    writer_drop(w);
+
+    if (pid != 0 && wait_child(pid)) {
         // TODO: fix
-        fprintf(stderr, "FAILED: as");
+        fprintf(stderr, "FAILED: %s\n", stage == CC_STAGE_OBJ ? "as" : "gcc");
         err = 1;
         goto exit;
     }
 
-    n = snprintf(cmd, 1024, "gcc %s -o a.out", opath);
-    if (n < 0 || n >= 1024) {
+    if (werr) {
         // TODO: fix
-        fprintf(stderr, "Failed to write cmd: \n");
+        fprintf(stderr, "Failed to write asm: %s\n", out_path);
         err = 1;
         goto exit;
     }
-    cmd_res = system(cmd);
-    if (cmd_res != 0) {
+
+    if (cc->cacheable) {
+        // A failure to store is not an error of the compilation
+        compile_cache_store(cc->opts->compile_cache_dir, &cc->cache_key, out_path, cc->opts->compile_cache_max_size);
+
+        fprintf(DEBUGOUT, "= COMPILE CACHE =\n");
+        fprintf(DEBUGOUT, "stored: %s\n", out_path);
+        compile_cache_fprint_stats(DEBUGOUT);
+        fprintf(DEBUGOUT, "\n");
+    }
+
+exit:
+    asm_x86_64_drop(asm_x86_64);
+    if (incremental) {
+        vector_drop(inc.funcs);
+        func_cache_drop(inc.cache);
+    }
+    return err;
+}
+
+int cc_run(CC* cc, int* exit_code) {
+    int err = 0;
+    IRModule* ir_mod = cc_build_ir(cc, NULL, NULL);
+
+    ASM_X86_64_Options asm_opts = {
+        .omit_frame_pointer = cc->opts->omit_frame_pointer,
+        .strength_reduce = cc->opts->strength_reduce,
+        .jump_tables = cc->opts->jump_tables,
+        .tree_isel = cc->opts->tree_isel,
+    };
+    ASM_X86_64* asm_x86_64 = asm_x86_64_new(ir_mod, &asm_opts);
+
+    fprintf(DEBUGOUT, "= ASM =\n");
+    asm_x86_64_fprint(DEBUGOUT, asm_x86_64);
+    fprintf(DEBUGOUT, "\n");
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    JIT_X86_64* jit = jit_x86_64_new(asm_x86_64);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (jit == NULL) {
         // TODO: fix
-        fprintf(stderr, "FAILED: gcc");
+        fprintf(stderr, "FAILED: jit\n");
         err = 1;
         goto exit;
     }
 
+    fprintf(DEBUGOUT, "= JIT =\n");
+    fprintf(DEBUGOUT, "code: %zu bytes\n", jit_x86_64_code_size(jit));
+    fprintf(DEBUGOUT, "data: %zu bytes\n", jit_x86_64_data_size(jit));
+    fprintf(DEBUGOUT, "encode: %.6f sec\n", elapsed_sec(&begin, &end));
+    fprintf(DEBUGOUT, "\n");
+    fflush(DEBUGOUT);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    err = jit_x86_64_run(jit, "main", exit_code);
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!err) {
+        fprintf(DEBUGOUT, "\n= RUN =\n");
+        fprintf(DEBUGOUT, "exit code: %d\n", *exit_code);
+        fprintf(DEBUGOUT, "run: %.6f sec\n", elapsed_sec(&begin, &end));
+        fflush(DEBUGOUT);
+    }
+
+    jit_x86_64_drop(jit);
+
 exit:
     asm_x86_64_drop(asm_x86_64);
     return err;
 }
+
+int cc_interp(CC* cc, int* exit_code) {
+    IRModule* ir_mod = cc_build_ir(cc, NULL, NULL);
+
+    IRInterp* interp = ir_interp_new(ir_mod);
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    long result;
+    int err = ir_interp_run(interp, "main", &result);
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!err) {
+        *exit_code = (int)result;
+
+        fprintf(DEBUGOUT, "\n= INTERP =\n");
+        fprintf(DEBUGOUT, "exit code: %d\n", *exit_code);
+        ir_interp_fprint_stats(DEBUGOUT, interp);
+        fprintf(DEBUGOUT, "run: %.6f sec\n", elapsed_sec(&begin, &end));
+        fflush(DEBUGOUT);
+    }
+
+    ir_interp_drop(interp);
+    return err;
+}
@@ -3,15 +3,34 @@
 
 #include "parser.h"
 #include "analyzer.h"
+#include "options.h"
 
 struct cc_t;
 typedef struct cc_t CC;
 
-CC* cc_new(char const* buffer, char const* fpath);
+// Tokens, arenas of nodes and types, and pools of strings and identifiers which are reset and reused
+// by following compiles, e.g. jobs of the server, so their memory stays warm
+struct cc_workspace_t;
+typedef struct cc_workspace_t CCWorkspace;
+
+CCWorkspace* cc_workspace_new();
+void cc_workspace_drop(CCWorkspace* ws);
+
+// 'ws' is nullable, then buffers are allocated for this compile only
+CC* cc_new(char const* buffer, char const* fpath, CCOptions const* opts, CCWorkspace* ws);
 void cc_drop(CC* cc);
 
 ParserResult cc_parse(CC* cc);
+// The tree is released after this call, the rest phases use the flattened one
 void cc_analyze(CC* cc, Node* node);
-int cc_compile(CC* cc, Node* node);
+// Restores the analyzed AST instead of cc_parse and cc_analyze. Returns 1 on a cache hit.
+int cc_load_ast_cache(CC* cc);
+// Copies the cached output instead of all phases. Returns 1 on a cache hit.
+int cc_fetch_compile_cache(CC* cc);
+int cc_compile(CC* cc);
+// Runs the program in-process. Returns 0 on success, and the result of main is set to 'exit_code'.
+int cc_run(CC* cc, int* exit_code);
+// Evaluates the IR by the interpreter, same as cc_run otherwise
+int cc_interp(CC* cc, int* exit_code);
 
 #endif /* CC_H */
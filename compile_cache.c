@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "compile_cache.h"
+#include "hash.h"
+#include "cache_file.h"
+#include "vector.h"
+
+#define COMPILE_CACHE_KEY_LEN (HASH_SHA256_LEN * 2) // hex chars
+
+static struct {
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;
+} stats;
+
+CompileCacheKey compile_cache_key(char const* buffer, size_t len, char const* flags) {
+    CompileCacheKey key;
+    HashSha256 s;
+    hash_sha256_init(&s);
+    hash_sha256_update(&s, flags, strlen(flags) + 1); // With '\0' as the separator
+    hash_sha256_update(&s, buffer, len);
+    hash_sha256_final(&s, key.digest);
+
+    return key;
+}
+
+static void entry_path(char* buf, size_t size, char const* dir, CompileCacheKey const* key) {
+    char name[COMPILE_CACHE_KEY_LEN + 1];
+    for(size_t i=0; i<HASH_SHA256_LEN; ++i) {
+        snprintf(&name[i * 2], 3, "%02x", key->digest[i]);
+    }
+    snprintf(buf, size, "%s/%s", dir, name);
+}
+
+// Returns 0 on success
+static int read_all(int fd, char* buf, size_t len) {
+    while(len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+// Returns 0 on success
+static int copy_fd(int in, int out) {
+    char buf[64 * 1024];
+    for(;;) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return 1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+
+        char* p = buf;
+        while(n > 0) {
+            ssize_t w = write(out, p, (size_t)n);
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                return 1;
+            }
+            p += w;
+            n -= w;
+        }
+    }
+}
+
+int compile_cache_fetch(char const* dir, CompileCacheKey const* key, char const* out_path) {
+    char path[4096];
+    entry_path(path, sizeof(path), dir, key);
+
+    int in = open(path, O_RDONLY);
+    if (in == -1) {
+        stats.misses++;
+        return 0;
+    }
+
+    struct stat st;
+    int out = -1;
+    int err = fstat(in, &st) != 0;
+    if (!err) {
+        // Keeps the mode, e.g. executables
+        out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+        err = out == -1 || copy_fd(in, out);
+    }
+    if (out != -1) {
+        close(out);
+    }
+    close(in);
+
+    if (err) {
+        stats.misses++;
+        return 0;
+    }
+
+    // The mtime is the last use for LRU
+    utimensat(AT_FDCWD, path, NULL, 0);
+
+    stats.hits++;
+    return 1;
+}
+
+typedef struct {
+    char* name;
+    off_t size;
+    struct timespec mtime;
+} Entry;
+
+static int entry_older(void const* a, void const* b) {
+    Entry const* ea = (Entry const*)a;
+    Entry const* eb = (Entry const*)b;
+    if (ea->mtime.tv_sec != eb->mtime.tv_sec) {
+        return ea->mtime.tv_sec < eb->mtime.tv_sec ? -1 : 1;
+    }
+    if (ea->mtime.tv_nsec != eb->mtime.tv_nsec) {
+        return ea->mtime.tv_nsec < eb->mtime.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+static void evict(char const* dir, size_t max_size) {
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+
+    Vector* entries = vector_new(sizeof(Entry)); // Vector<Entry>
+    size_t total = 0;
+    struct dirent* de;
+    while((de = readdir(d)) != NULL) {
+        if (strlen(de->d_name) != COMPILE_CACHE_KEY_LEN) {
+            continue; // '.', '..' and temporary files
+        }
+
+        struct stat st;
+        if (fstatat(dirfd(d), de->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        Entry* e = (Entry*)vector_append(entries);
+        e->name = strdup(de->d_name);
+        e->size = st.st_size;
+        e->mtime = st.st_mtim;
+        total += (size_t)st.st_size;
+    }
+
+    if (total > max_size && vector_len(entries) > 0) {
+        qsort(vector_at(entries, 0), vector_len(entries), sizeof(Entry), entry_older);
+
+        for(size_t i=0; i<vector_len(entries) && total > max_size; ++i) {
+            Entry* e = vector_at(entries, i);
+            if (unlinkat(dirfd(d), e->name, 0) == 0) {
+                total -= (size_t)e->size;
+                stats.evictions++;
+            }
+        }
+    }
+
+    for(size_t i=0; i<vector_len(entries); ++i) {
+        Entry* e = vector_at(entries, i);
+        free(e->name);
+    }
+    vector_drop(entries);
+    closedir(d);
+}
+
+int compile_cache_store(char const* dir, CompileCacheKey const* key, char const* out_path, size_t max_size) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create cache dir: %s\n", dir);
+        return 1;
+    }
+
+    int in = open(out_path, O_RDONLY);
+    if (in == -1) {
+        return 1;
+    }
+    struct stat st;
+    char* buf = NULL;
+    int err = fstat(in, &st) != 0;
+    if (!err) {
+        buf = (char*)malloc((size_t)st.st_size + 1);
+        err = read_all(in, buf, (size_t)st.st_size);
+    }
+    close(in);
+
+    char path[4096];
+    entry_path(path, sizeof(path), dir, key);
+    if (!err) {
+        // Keeps the mode, e.g. executables
+        err = cache_write_atomic(path, buf, (size_t)st.st_size, st.st_mode & 0777);
+    }
+    free(buf);
+    if (err) {
+        fprintf(stderr, "Failed to store the output into the cache: %s\n", path);
+        return 1;
+    }
+    stats.stores++;
+
+    evict(dir, max_size);
+
+    return 0;
+}
+
+void compile_cache_reset_stats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void compile_cache_fprint_stats(FILE* fp) {
+    fprintf(fp, "hits: %zu\n", stats.hits);
+    fprintf(fp, "misses: %zu\n", stats.misses);
+    fprintf(fp, "stores: %zu\n", stats.stores);
+    fprintf(fp, "evictions: %zu\n", stats.evictions);
+}
@@ -0,0 +1,29 @@
+#ifndef CC_COMPILE_CACHE_H
+#define CC_COMPILE_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "hash.h"
+
+// A content-addressed cache of outputs (.s, .o and executables) in a local directory.
+// Entries are named by a SHA-256 of the input, the options which affect the output and the compiler version.
+// Entries are published by rename, and the least recently used ones are evicted over the size limit.
+
+typedef struct {
+    uint8_t digest[HASH_SHA256_LEN];
+} CompileCacheKey;
+
+CompileCacheKey compile_cache_key(char const* buffer, size_t len, char const* flags);
+
+// Copies the cached output to 'out_path'. Returns 1 on a hit.
+int compile_cache_fetch(char const* dir, CompileCacheKey const* key, char const* out_path);
+
+// Stores 'out_path' as the output of 'key', and evicts entries over 'max_size' bytes. Returns 0 on success.
+int compile_cache_store(char const* dir, CompileCacheKey const* key, char const* out_path, size_t max_size);
+
+// Counters since the last reset, e.g. of a job of the server
+void compile_cache_fprint_stats(FILE* fp);
+void compile_cache_reset_stats();
+
+#endif /* CC_COMPILE_CACHE_H */
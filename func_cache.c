@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "func_cache.h"
+#include "hash.h"
+#include "cache_file.h"
+#include "vector.h"
+
+#define FUNC_CACHE_MAGIC "CCFNv001"
+
+typedef struct {
+    char* name;
+    uint64_t fingerprint;
+    char* text;
+    size_t len;
+} Entry;
+
+// On disk: magic, u32 count, then entries of (u64 fingerprint, u32 name_len, u32 text_len, name, text)
+typedef struct {
+    uint64_t fingerprint;
+    uint32_t name_len;
+    uint32_t text_len;
+} CachedEntry;
+
+struct func_cache_t {
+    Vector* entries;    // Vector<Entry>
+    size_t hits;
+    size_t misses;
+};
+
+FuncCache* func_cache_new() {
+    FuncCache* c = (FuncCache*)malloc(sizeof(FuncCache));
+    assert(c); // TODO: error handling...
+    c->entries = vector_new(sizeof(Entry));
+    c->hits = 0;
+    c->misses = 0;
+
+    return c;
+}
+
+void func_cache_drop(FuncCache* c) {
+    for(size_t i=0; i<vector_len(c->entries); ++i) {
+        Entry* e = (Entry*)vector_at(c->entries, i);
+        free(e->name);
+        free(e->text);
+    }
+    vector_drop(c->entries);
+    free(c);
+}
+
+static Entry* find_entry(FuncCache* c, char const* name) {
+    for(size_t i=0; i<vector_len(c->entries); ++i) {
+        Entry* e = (Entry*)vector_at(c->entries, i);
+        if (strcmp(e->name, name) == 0) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+FuncCache* func_cache_load(char const* path) {
+    FuncCache* c = func_cache_new();
+
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return c;
+    }
+
+    char magic[8];
+    uint32_t count;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, FUNC_CACHE_MAGIC, sizeof(magic)) != 0
+        || fread(&count, sizeof(count), 1, fp) != 1) {
+        fclose(fp);
+        return c;
+    }
+
+    for(uint32_t i=0; i<count; ++i) {
+        CachedEntry ce;
+        if (fread(&ce, sizeof(ce), 1, fp) != 1) {
+            break;
+        }
+
+        char* name = (char*)malloc(ce.name_len + 1);
+        char* text = (char*)malloc(ce.text_len + 1);
+        if (fread(name, 1, ce.name_len, fp) != ce.name_len || fread(text, 1, ce.text_len, fp) != ce.text_len) {
+            // Truncated, entries read so far are still valid
+            free(name);
+            free(text);
+            break;
+        }
+        name[ce.name_len] = '\0';
+        text[ce.text_len] = '\0';
+
+        Entry* e = (Entry*)vector_append(c->entries);
+        e->name = name;
+        e->fingerprint = ce.fingerprint;
+        e->text = text;
+        e->len = ce.text_len;
+    }
+    fclose(fp);
+
+    return c;
+}
+
+uint64_t func_cache_fingerprint(NodeTable* t, NodeIndex id, uint32_t begin, uint32_t* end, uint64_t seed) {
+    // The body is the first brace after the name through its matching one
+    uint32_t i = t->main_tokens[id];
+    while(t->tokens[i].kind != TOK_KIND_LBRACE && t->tokens[i].kind != TOK_KIND_EOF) {
+        ++i;
+    }
+    for(int depth = 0; t->tokens[i].kind != TOK_KIND_EOF; ++i) {
+        if (t->tokens[i].kind == TOK_KIND_LBRACE) {
+            ++depth;
+        } else if (t->tokens[i].kind == TOK_KIND_RBRACE && --depth == 0) {
+            ++i;
+            break;
+        }
+    }
+    *end = i;
+
+    // Tokens rather than bytes, so whitespace and comments do not matter
+    uint64_t h = seed;
+    for(uint32_t k=begin; k<*end; ++k) {
+        Token const* tok = &t->tokens[k];
+        uint8_t kind = (uint8_t)tok->kind;
+        h = hash_bytes(h, &kind, sizeof(kind));
+        h = hash_bytes(h, token_begin(t->buffer, tok), token_len(tok));
+    }
+
+    return h;
+}
+
+char const* func_cache_find(FuncCache* c, char const* name, uint64_t fingerprint, size_t* len) {
+    Entry* e = find_entry(c, name);
+    if (e == NULL || e->fingerprint != fingerprint) {
+        c->misses++;
+        return NULL;
+    }
+
+    c->hits++;
+    *len = e->len;
+    return e->text;
+}
+
+void func_cache_put(FuncCache* c, char const* name, uint64_t fingerprint, char const* text, size_t len) {
+    Entry* e = find_entry(c, name);
+    if (e) {
+        free(e->text);
+    } else {
+        e = (Entry*)vector_append(c->entries);
+        e->name = strdup(name);
+    }
+
+    e->fingerprint = fingerprint;
+    e->text = (char*)malloc(len + 1);
+    memcpy(e->text, text, len);
+    e->text[len] = '\0';
+    e->len = len;
+}
+
+int func_cache_save(FuncCache* c, char const* path) {
+    char* buf = NULL;
+    size_t len = 0;
+    FILE* fp = open_memstream(&buf, &len);
+    assert(fp); // TODO: error handling...
+
+    uint32_t count = (uint32_t)vector_len(c->entries);
+    int err = fwrite(FUNC_CACHE_MAGIC, 8, 1, fp) != 1;
+    err |= fwrite(&count, sizeof(count), 1, fp) != 1;
+    for(size_t i=0; i<vector_len(c->entries) && !err; ++i) {
+        Entry* e = (Entry*)vector_at(c->entries, i);
+        CachedEntry ce = {
+            .fingerprint = e->fingerprint,
+            .name_len = (uint32_t)strlen(e->name),
+            .text_len = (uint32_t)e->len,
+        };
+        err |= fwrite(&ce, sizeof(ce), 1, fp) != 1;
+        err |= fwrite(e->name, 1, ce.name_len, fp) != ce.name_len;
+        err |= fwrite(e->text, 1, ce.text_len, fp) != ce.text_len;
+    }
+    err |= fclose(fp) != 0;
+
+    if (err == 0) {
+        err = cache_write_atomic(path, buf, len, 0644);
+    }
+    if (err) {
+        fprintf(stderr, "Failed to write function cache: %s\n", path);
+    }
+    free(buf);
+
+    return err;
+}
+
+void func_cache_fprint_stats(FILE* fp, FuncCache* c) {
+    fprintf(fp, "entries: %zu\n", vector_len(c->entries));
+    fprintf(fp, "hits: %zu\n", c->hits);
+    fprintf(fp, "misses: %zu\n", c->misses);
+}
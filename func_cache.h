@@ -0,0 +1,35 @@
+#ifndef CC_FUNC_CACHE_H
+#define CC_FUNC_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "node_table.h"
+
+// A cache of generated assembly per function for incremental recompilation.
+// Each entry is keyed by the function name and a fingerprint of its tokens, so a function is reused
+// as long as its own text is unchanged, regardless of edits to other functions.
+
+struct func_cache_t;
+typedef struct func_cache_t FuncCache;
+
+FuncCache* func_cache_new();
+// Returns an empty cache, if the file does not exist or is invalid
+FuncCache* func_cache_load(char const* path);
+void func_cache_drop(FuncCache* c);
+
+// Fingerprints tokens from 'begin' through the closing brace of the function named by 'id' (NODE_ID).
+// 'end' is set to the index next to the closing brace, which is 'begin' of the next function.
+uint64_t func_cache_fingerprint(NodeTable* t, NodeIndex id, uint32_t begin, uint32_t* end, uint64_t seed);
+
+// Returns NULL on a miss. The text is owned by the cache.
+char const* func_cache_find(FuncCache* c, char const* name, uint64_t fingerprint, size_t* len);
+// Replaces an entry of the same name
+void func_cache_put(FuncCache* c, char const* name, uint64_t fingerprint, char const* text, size_t len);
+
+// Returns 0 on success. The file is replaced atomically.
+int func_cache_save(FuncCache* c, char const* path);
+
+void func_cache_fprint_stats(FILE* fp, FuncCache* c);
+
+#endif /* CC_FUNC_CACHE_H */
@@ -0,0 +1,27 @@
+#ifndef CC_HASH_H
+#define CC_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_INIT ((uint64_t)0xcbf29ce484222325ULL)
+
+// FNV-1a, 'h' is HASH_INIT or a result of the previous call to chain inputs
+uint64_t hash_bytes(uint64_t h, void const* data, size_t len);
+uint64_t hash_string(uint64_t h, char const* str);
+
+// SHA-256, for keys whose collisions must not happen in practice, e.g. names of cached outputs
+#define HASH_SHA256_LEN 32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t len;           // bytes so far
+    uint8_t block[64];
+    size_t block_len;
+} HashSha256;
+
+void hash_sha256_init(HashSha256* s);
+void hash_sha256_update(HashSha256* s, void const* data, size_t len);
+void hash_sha256_final(HashSha256* s, uint8_t digest[HASH_SHA256_LEN]);
+
+#endif /* CC_HASH_H */
@@ -1,21 +1,31 @@
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "ir.h"
 #include "ir_inst_defs.h"
 #include "vector.h"
 #include "map.h"
 #include "log.h"
+#include "literal.h"
+#include "analyzer.h"
 
 static void ir_bb_append_inst(IRBB* bb, IRInst* inst) {
     IRInst* i = vector_append(bb->insts);
     *i = *inst;
 }
 
+static void ir_bb_add_prev_iter(IRBB* next, void* args) {
+    IRBB** prev = vector_append(next->prevs);
+    *prev = (IRBB*)args;
+}
+
 static void ir_bb_terminate(IRBB* bb, IRInst inst) {
     assert(bb->term == NULL);
     // Set terminal
     bb->term = (IRInst*)malloc(sizeof(IRInst));
     *bb->term = inst;
+
+    ir_bb_foreach_nexts(bb, ir_bb_add_prev_iter, bb);
 }
 
 static void ir_function_coustruct(IRFunction* f, char const* name, IRModule* m) {
@@ -26,6 +36,7 @@ static void ir_function_coustruct(IRFunction* f, char const* name, IRModule* m)
     f->bb_id = 0;
     f->locals = vector_new(sizeof(size_t));
     f->locals_id = 0;
+    f->params_num = 0;
 
     ir_bb_construct(f->entry, f->bb_id);
     f->bb_id++;
@@ -96,36 +107,110 @@ static IRSymbolID insert_definition(IRModule* m, IRInstValue v) {
     return sym_id;
 }
 
-static void build_trans_unit(IRBuilder* builder, Node* node, IRModule* m);
-static void build_top_level(IRBuilder* builder, Node* node, IRModule* m);
-static void build_statement(IRBuilder* builder, Node* node, IRFunction* m);
-static IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f);
+static void build_trans_unit(IRBuilder* builder, NodeIndex node, IRModule* m);
+static void build_top_level(IRBuilder* builder, NodeIndex node, IRModule* m);
+static void build_statement(IRBuilder* builder, NodeIndex node, IRFunction* m);
+static IRSymbolID build_expression(IRBuilder* builder, NodeIndex node, IRFunction* f);
+
+#define DEF_NONE ((IRSymbolID)-1)
 
 struct ir_builder_t {
+    NodeTable* nodes;       // reference
+    Vector* string_defs;    // Vector<IRSymbolID>, definitions of pooled strings indexed by string ids of nodes
+    Vector* symbol_defs;    // Vector<IRSymbolID>, definitions of symbols indexed by ident ids of nodes
     IRFunction* current_func;
     IRBB* current_bb;
+    IRBuilderFunctionFilter filter; // Nullable
+    void* filter_args;
+    StringMap* params;      // StringMap<IRSymbolID>, parameters of the current function, Nullable
 };
 
 IRBuilder* ir_builder_new() {
     IRBuilder* builder = (IRBuilder*)malloc(sizeof(IRBuilder));
+    builder->nodes = NULL;
+    builder->string_defs = NULL;
+    builder->symbol_defs = NULL;
     builder->current_func = NULL;
     builder->current_bb = NULL;
+    builder->filter = NULL;
+    builder->filter_args = NULL;
+    builder->params = NULL;
 
     return builder;
 }
 
+void ir_builder_set_function_filter(IRBuilder* builder, IRBuilderFunctionFilter filter, void* args) {
+    builder->filter = filter;
+    builder->filter_args = args;
+}
+
 void ir_builder_drop(IRBuilder* builder) {
     free(builder);
 }
 
-IRModule* ir_builder_new_module(IRBuilder* builder, Node* node) {
+IRModule* ir_builder_new_module(IRBuilder* builder, NodeTable* nodes) {
     IRModule* m = ir_module_new();
 
-    build_trans_unit(builder, node, m);
+    builder->nodes = nodes;
+    builder->string_defs = vector_new(sizeof(IRSymbolID));
+    for(size_t i=0; i<string_pool_len(nodes->strings); ++i) {
+        IRSymbolID* d = (IRSymbolID*)vector_append(builder->string_defs);
+        *d = DEF_NONE;
+    }
+    builder->symbol_defs = vector_new(sizeof(IRSymbolID));
+    for(size_t i=0; i<string_pool_len(nodes->idents); ++i) {
+        IRSymbolID* d = (IRSymbolID*)vector_append(builder->symbol_defs);
+        *d = DEF_NONE;
+    }
+
+    build_trans_unit(builder, node_table_root(nodes), m);
+
+    vector_drop(builder->string_defs);
+    builder->string_defs = NULL;
+    vector_drop(builder->symbol_defs);
+    builder->symbol_defs = NULL;
+    builder->nodes = NULL;
 
     return m;
 }
 
+// Identical literals share one definition
+static IRSymbolID ir_builder_string_def(IRBuilder* builder, IRModule* m, uint32_t str_id) {
+    NodeTable* t = builder->nodes;
+    IRSymbolID* str_def = (IRSymbolID*)vector_at(builder->string_defs, str_id);
+    if (*str_def == DEF_NONE) {
+        IRInstValue sval = {
+            .kind = IR_INST_VALUE_KIND_STRING,
+            .value = {
+                .string = {
+                    .buf = string_pool_at(t->strings, str_id),
+                    .len = string_pool_str_len(t->strings, str_id),
+                },
+            },
+        };
+        *str_def = insert_definition(m, sval);
+    }
+
+    return *str_def;
+}
+
+// A symbol has one definition however many times it is referred, 'id' is NODE_ID
+static IRSymbolID ir_builder_symbol_def(IRBuilder* builder, IRModule* m, NodeIndex id) {
+    NodeTable* t = builder->nodes;
+    IRSymbolID* sym_def = (IRSymbolID*)vector_at(builder->symbol_defs, node_table_ident_id(t, id));
+    if (*sym_def == DEF_NONE) {
+        IRInstValue val = {
+            .kind = IR_INST_VALUE_KIND_SYMBOL,
+            .value = {
+                .symbol = strdup(node_table_ident(t, id)),
+            },
+        };
+        *sym_def = insert_definition(m, val);
+    }
+
+    return *sym_def;
+}
+
 static IRFunction* ir_builder_build_function(IRBuilder* builder, char const* name, IRModule* m) {
     IRFunction* f = vector_append(m->functions);
     ir_function_coustruct(f, name, m);
@@ -159,184 +244,800 @@ static IRSymbolID ir_builder_build_local(IRBuilder* builder) {
     return sym_id;
 }
 
-void build_trans_unit(IRBuilder* builder, Node* node, IRModule* m) {
-    switch(node->kind) {
+// Parameters are received into locals at the entry, and names are resolved to them
+static void ir_builder_build_params(IRBuilder* builder, NodeIndex declarator, IRFunction* f) {
+    NodeTable* t = builder->nodes;
+    builder->params = string_map_new(sizeof(IRSymbolID), NULL);
+
+    NodeIndex params = node_table_declarator_extract_params(t, declarator);
+    if (params == NODE_INDEX_NONE) {
+        return;
+    }
+
+    for(uint32_t i=t->lhs[params]; i<t->rhs[params]; ++i) {
+        NodeIndex param = t->extra[i];
+        assert(t->kinds[param] == NODE_PARAM_DECL);
+        if (t->rhs[param] == NODE_INDEX_NONE) {
+            continue; // e.g. (void)
+        }
+        NodeIndex id = node_table_declarator_extract_id(t, t->rhs[param]);
+        assert(id != NODE_INDEX_NONE); // TODO: error handling...
+
+        IRSymbolID sym_id = ir_builder_build_local(builder);
+        IRInst inst = {
+            .kind = IR_INST_KIND_LET,
+            .value = {
+                .let = {
+                    .id = sym_id,
+                    .rhs = {
+                        .kind = IR_INST_VALUE_KIND_PARAM,
+                        .value = {
+                            .param = {
+                                .index = f->params_num,
+                            },
+                        },
+                    },
+                },
+            },
+        };
+        ir_bb_append_inst(builder->current_bb, &inst);
+        ir_function_set_local(f, sym_id, 8); // TODO: fix
+        f->params_num++;
+
+        IRSymbolID* e = (IRSymbolID*)string_map_insert(builder->params, node_table_ident(t, id), NULL);
+        *e = sym_id;
+    }
+}
+
+void build_trans_unit(IRBuilder* builder, NodeIndex node, IRModule* m) {
+    NodeTable* t = builder->nodes;
+
+    switch(t->kinds[node]) {
     case NODE_TRANS_UNIT:
     {
-        printf("LOG: transition unit\n");
+        fprintf(DEBUGOUT, "LOG: transition unit\n");
 
-        Vector* decls = node->value.trans_unit.decls;
-
-        for(size_t i=0; i<vector_len(decls); ++i) {
-            Node** n = (Node**)vector_at(decls, i);
-            build_top_level(builder, *n, m);
+        for(uint32_t i=t->lhs[node]; i<t->rhs[node]; ++i) {
+            build_top_level(builder, t->extra[i], m);
         }
 
         break;
     }
 
     default:
-        fprintf(stderr, "Kind = %d\n", node->kind);
+        fprintf(stderr, "Kind = %d\n", t->kinds[node]);
         assert(0); // TODO: error handling
     }
 }
 
-void build_top_level(IRBuilder* builder, Node* node, IRModule* m) {
-    switch(node->kind) {
+void build_top_level(IRBuilder* builder, NodeIndex node, IRModule* m) {
+    NodeTable* t = builder->nodes;
+
+    switch(t->kinds[node]) {
     case NODE_FUNC_DEF:
     {
-        printf("LOG: function def\n");
+        fprintf(DEBUGOUT, "LOG: function def\n");
 
-        Token* id_tok = node_declarator_extract_id_token(node->value.func_def.decl);
-        assert(id_tok);
+        NodeIndex id = node_table_declarator_extract_id(t, t->extra[t->lhs[node] + 1]);
+        assert(id != NODE_INDEX_NONE);
 
-        IRInstValue fval = {
-            .kind = IR_INST_VALUE_KIND_SYMBOL,
-            .value = {
-                .symbol = token_to_string(id_tok),
-            },
-        };
-        insert_definition(m, fval);
+        ir_builder_symbol_def(builder, m, id);
 
-        IRFunction* f = ir_builder_build_function(builder, token_to_string(id_tok), m);
+        if (builder->filter && !builder->filter(node, node_table_ident(t, id), builder->filter_args)) {
+            // Code of the function is reused, but strings used by it are still defined in the module
+            for(NodeIndex n = node_table_subtree_begin(t, node); n <= node; ++n) {
+                if (t->kinds[n] == NODE_LIT_STRING) {
+                    ir_builder_string_def(builder, m, node_table_string_id(t, n));
+                }
+            }
+            break;
+        }
+
+        IRFunction* f = ir_builder_build_function(builder, strdup(node_table_ident(t, id)), m);
         ir_builder_set_current_func(builder, f);
-        build_statement(builder, node->value.func_def.block, f);
+        ir_builder_build_params(builder, t->extra[t->lhs[node] + 1], f);
+        build_statement(builder, t->rhs[node], f);
+
+        // Reaching the end of a function returns 0, e.g. after a loop in main
+        if (builder->current_bb->term == NULL) {
+            IRSymbolID sym_id = ir_builder_build_local(builder);
+            IRInst imm = {
+                .kind = IR_INST_KIND_LET,
+                .value = {
+                    .let = {
+                        .id = sym_id,
+                        .rhs = {
+                            .kind = IR_INST_VALUE_KIND_IMM_INT,
+                            .value = {
+                                .imm_int = 0,
+                            },
+                        },
+                    },
+                },
+            };
+            ir_bb_append_inst(builder->current_bb, &imm);
+            ir_function_set_local(f, sym_id, 8); // TODO: fix
+
+            IRInst inst = {
+                .kind = IR_INST_KIND_RET,
+                .value = {
+                    .ret = {
+                        .id = sym_id,
+                    },
+                },
+            };
+            ir_bb_terminate(builder->current_bb, inst);
+        }
+
+        string_map_drop(builder->params);
+        builder->params = NULL;
 
         break;
     }
 
     default:
-        fprintf(stderr, "Kind = %d\n", node->kind);
+        fprintf(stderr, "Kind = %d\n", t->kinds[node]);
         assert(0); // TODO: error handling
     }
 }
 
-void build_statement(IRBuilder* builder, Node* node, IRFunction* f) {
-    switch(node->kind) {
-    case NODE_STMT_COMPOUND:
-    {
-        printf("LOG: statement compound\n");
+typedef struct {
+    NodeIndex node;
+    int phase;
+    uint32_t index;     // An index of the next child of compound statements in extra
+    IRBB* else_bb;      // Nullable
+    IRBB* final_bb;     // Also the target of break in loops
+    IRBB* continue_bb;  // Of loops, Nullable
+    IRSymbolID cond;    // Of switches
+    Vector* cases;      // Of switches, Nullable, Vector<IRSwitchCase>
+    IRBB* default_bb;   // Of switches, Nullable
+} BuildFrame;
+
+static void push_build_frame(Vector* stack, NodeIndex node) {
+    BuildFrame* frame = (BuildFrame*)vector_append(stack);
+    frame->node = node;
+    frame->phase = 0;
+    frame->index = 0;
+    frame->else_bb = NULL;
+    frame->final_bb = NULL;
+    frame->continue_bb = NULL;
+    frame->cond = 0;
+    frame->cases = NULL;
+    frame->default_bb = NULL;
+}
 
-        Vector* stmts = node->value.stmt_compound.stmts;
-        for(size_t i=0; i<vector_len(stmts); ++i) {
-            Node** n = (Node**)vector_at(stmts, i);
-            build_statement(builder, *n, f);
-        }
-        break;
+static void terminate_by_jump(IRBuilder* builder, IRBB* next_bb) {
+    if (builder->current_bb->term != NULL) {
+        return;
     }
 
-    case NODE_STMT_EXPR:
-        printf("LOG: statement expr\n");
+    IRInst inst = {
+        .kind = IR_INST_KIND_JUMP,
+        .value = {
+            .jump = {
+                .next_bb = next_bb,
+            },
+        },
+    };
+    ir_bb_terminate(builder->current_bb, inst);
+}
+
+static void terminate_by_branch(IRBuilder* builder, IRSymbolID cond, IRBB* then_bb, IRBB* else_bb) {
+    IRInst inst = {
+        .kind = IR_INST_KIND_BRANCH,
+        .value = {
+            .branch = {
+                .cond = cond,
+                .then_bb = then_bb,
+                .else_bb = else_bb,
+            },
+        },
+    };
+    ir_bb_terminate(builder->current_bb, inst);
+}
 
-        if (node->value.stmt_expr.expr) {
-            build_expression(builder, node->value.stmt_expr.expr, f);
+// The innermost loop which encloses the top of 'stack', NULL if there is no loop
+static BuildFrame* find_loop_frame(Vector* stack) {
+    for(size_t i=vector_len(stack); i>0; --i) {
+        BuildFrame* frame = (BuildFrame*)vector_at(stack, i - 1);
+        if (frame->continue_bb != NULL) {
+            return frame;
         }
-        break;
+    }
 
-    case NODE_STMT_IF:
-        fprintf(DEBUGOUT, "LOG: statement if\n");
+    return NULL;
+}
 
-        IRSymbolID cond = build_expression(builder, node->value.stmt_if.cond, f);
+// The innermost switch which encloses the top of 'stack', NULL if there is no switch
+static BuildFrame* find_switch_frame(Vector* stack) {
+    for(size_t i=vector_len(stack); i>0; --i) {
+        BuildFrame* frame = (BuildFrame*)vector_at(stack, i - 1);
+        if (frame->cases != NULL) {
+            return frame;
+        }
+    }
 
-        IRBB* then_bb = ir_builder_build_bb(builder);
-        IRBB* else_bb = NULL;
-        if (node->value.stmt_if.else_b) {
-            else_bb = ir_builder_build_bb(builder);
+    return NULL;
+}
+
+// The innermost loop or switch which encloses the top of 'stack', NULL if there is neither
+static BuildFrame* find_break_frame(Vector* stack) {
+    for(size_t i=vector_len(stack); i>0; --i) {
+        BuildFrame* frame = (BuildFrame*)vector_at(stack, i - 1);
+        if (frame->continue_bb != NULL || frame->cases != NULL) {
+            return frame;
         }
-        IRBB* final_bb = ir_builder_build_bb(builder);
+    }
 
-        // Terminate current bb
-        IRInst inst = {
-            .kind = IR_INST_KIND_BRANCH,
-            .value = {
-                .branch = {
-                    .cond = cond,
-                    .then_bb = then_bb,
-                    .else_bb = else_bb != NULL ? else_bb : final_bb,
-                },
-            },
-        };
-        ir_bb_terminate(builder->current_bb, inst);
+    return NULL;
+}
 
-        // then block
-        ir_builder_set_current_bb(builder, then_bb);
-        build_statement(builder, node->value.stmt_if.then_b, f);
-        if (builder->current_bb->term == NULL) {
-            IRInst then_inst = {
-                .kind = IR_INST_KIND_JUMP,
-                .value = {
-                    .jump = {
-                        .next_bb = final_bb,
-                    },
-                },
-            };
-            ir_bb_terminate(builder->current_bb, then_inst);
+static int cmp_switch_case(void const* a, void const* b) {
+    long va = ((IRSwitchCase const*)a)->value;
+    long vb = ((IRSwitchCase const*)b)->value;
+    return va < vb ? -1 : va > vb ? 1 : 0;
+}
+
+// Walks statements with an explicit stack instead of recursion.
+// A frame stays on the stack while its children are built, and 'phase' tells what to do next.
+void build_statement(IRBuilder* builder, NodeIndex root, IRFunction* f) {
+    NodeTable* t = builder->nodes;
+    Vector* stack = vector_new(sizeof(BuildFrame)); // Vector<BuildFrame>
+    push_build_frame(stack, root);
+
+    while(vector_len(stack) > 0) {
+        BuildFrame* frame = (BuildFrame*)vector_at(stack, vector_len(stack) - 1);
+        NodeIndex node = frame->node;
+
+        switch(t->kinds[node]) {
+        case NODE_STMT_COMPOUND:
+        {
+            if (frame->phase == 0) {
+                fprintf(DEBUGOUT, "LOG: statement compound\n");
+                frame->phase = 1;
+                frame->index = t->lhs[node];
+            }
+
+            if (frame->index < t->rhs[node]) {
+                // Statements after return, break or continue are only reached through case labels in them
+                if (builder->current_bb->term != NULL) {
+                    ir_builder_set_current_bb(builder, ir_builder_build_bb(builder));
+                }
+
+                NodeIndex n = t->extra[frame->index];
+                frame->index++;
+                push_build_frame(stack, n);
+                break;
+            }
+
+            vector_pop(stack);
+            break;
         }
 
-        // then block
-        if (node->value.stmt_if.else_b) {
-            ir_builder_set_current_bb(builder, else_bb);
-            build_statement(builder, node->value.stmt_if.else_b, f);
-            if (builder->current_bb->term == NULL) {
-                IRInst else_inst = {
-                    .kind = IR_INST_KIND_JUMP,
+        case NODE_STMT_EXPR:
+            vector_pop(stack);
+            fprintf(DEBUGOUT, "LOG: statement expr\n");
+
+            if (t->lhs[node] != NODE_INDEX_NONE) {
+                build_expression(builder, t->lhs[node], f);
+            }
+            break;
+
+        case NODE_STMT_IF:
+            switch(frame->phase) {
+            case 0:
+            {
+                fprintf(DEBUGOUT, "LOG: statement if\n");
+
+                IRSymbolID cond = build_expression(builder, t->lhs[node], f);
+                NodeIndex then_b = t->extra[t->rhs[node]];
+
+                IRBB* then_bb = ir_builder_build_bb(builder);
+                IRBB* else_bb = NULL;
+                if (t->extra[t->rhs[node] + 1] != NODE_INDEX_NONE) {
+                    else_bb = ir_builder_build_bb(builder);
+                }
+                IRBB* final_bb = ir_builder_build_bb(builder);
+
+                // Terminate current bb
+                IRInst inst = {
+                    .kind = IR_INST_KIND_BRANCH,
                     .value = {
-                        .jump = {
-                            .next_bb = final_bb,
+                        .branch = {
+                            .cond = cond,
+                            .then_bb = then_bb,
+                            .else_bb = else_bb != NULL ? else_bb : final_bb,
                         },
                     },
                 };
-                ir_bb_terminate(builder->current_bb, else_inst);
+                ir_bb_terminate(builder->current_bb, inst);
+
+                frame->phase = 1;
+                frame->else_bb = else_bb;
+                frame->final_bb = final_bb;
+
+                // then block
+                ir_builder_set_current_bb(builder, then_bb);
+                push_build_frame(stack, then_b);
+                break;
             }
-        }
 
-        ir_builder_set_current_bb(builder, final_bb);
+            case 1:
+                terminate_by_jump(builder, frame->final_bb);
 
-        break;
+                // else block
+                if (frame->else_bb != NULL) {
+                    NodeIndex else_b = t->extra[t->rhs[node] + 1];
+                    frame->phase = 2;
+
+                    ir_builder_set_current_bb(builder, frame->else_bb);
+                    push_build_frame(stack, else_b);
+                    break;
+                }
+
+                ir_builder_set_current_bb(builder, frame->final_bb);
+                vector_pop(stack);
+                break;
 
-    case NODE_STMT_JUMP:
-        printf("LOG: statement jump\n");
+            case 2:
+                terminate_by_jump(builder, frame->final_bb);
+
+                ir_builder_set_current_bb(builder, frame->final_bb);
+                vector_pop(stack);
+                break;
+
+            default:
+                assert(0); // unreachable
+            }
+            break;
+
+        // while (cond) body
+        //   cond_bb: cond, BRANCH -> body_bb, final_bb
+        //   body_bb: body, JUMP -> cond_bb
+        case NODE_STMT_WHILE:
+            switch(frame->phase) {
+            case 0:
+            {
+                fprintf(DEBUGOUT, "LOG: statement while\n");
+
+                IRBB* cond_bb = ir_builder_build_bb(builder);
+                IRBB* body_bb = ir_builder_build_bb(builder);
+                IRBB* final_bb = ir_builder_build_bb(builder);
+
+                terminate_by_jump(builder, cond_bb);
+                ir_builder_set_current_bb(builder, cond_bb);
+                IRSymbolID cond = build_expression(builder, t->lhs[node], f);
+                terminate_by_branch(builder, cond, body_bb, final_bb);
+
+                frame->phase = 1;
+                frame->continue_bb = cond_bb;
+                frame->final_bb = final_bb;
+
+                ir_builder_set_current_bb(builder, body_bb);
+                push_build_frame(stack, t->rhs[node]);
+                break;
+            }
+
+            case 1:
+                terminate_by_jump(builder, frame->continue_bb);
+
+                ir_builder_set_current_bb(builder, frame->final_bb);
+                vector_pop(stack);
+                break;
+
+            default:
+                assert(0); // unreachable
+            }
+            break;
 
-        switch(node->value.stmt_jump.kind) {
-        case TOK_KIND_RETURN:
+        // do body while (cond);
+        //   body_bb: body, JUMP -> cond_bb
+        //   cond_bb: cond, BRANCH -> body_bb, final_bb
+        case NODE_STMT_DO:
+            switch(frame->phase) {
+            case 0:
+            {
+                fprintf(DEBUGOUT, "LOG: statement do\n");
+
+                IRBB* body_bb = ir_builder_build_bb(builder);
+                IRBB* cond_bb = ir_builder_build_bb(builder);
+                IRBB* final_bb = ir_builder_build_bb(builder);
+
+                terminate_by_jump(builder, body_bb);
+
+                frame->phase = 1;
+                frame->else_bb = body_bb;
+                frame->continue_bb = cond_bb;
+                frame->final_bb = final_bb;
+
+                ir_builder_set_current_bb(builder, body_bb);
+                push_build_frame(stack, t->lhs[node]);
+                break;
+            }
+
+            case 1:
+            {
+                terminate_by_jump(builder, frame->continue_bb);
+
+                ir_builder_set_current_bb(builder, frame->continue_bb);
+                IRSymbolID cond = build_expression(builder, t->rhs[node], f);
+                terminate_by_branch(builder, cond, frame->else_bb, frame->final_bb);
+
+                ir_builder_set_current_bb(builder, frame->final_bb);
+                vector_pop(stack);
+                break;
+            }
+
+            default:
+                assert(0); // unreachable
+            }
+            break;
+
+        // for (init; cond; step) body
+        //   init, JUMP -> cond_bb
+        //   cond_bb: cond, BRANCH -> body_bb, final_bb (or JUMP -> body_bb without cond)
+        //   body_bb: body, JUMP -> step_bb
+        //   step_bb: step, JUMP -> cond_bb
+        case NODE_STMT_FOR:
         {
-            IRSymbolID expr_ref = build_expression(builder, node->value.stmt_jump.expr, f);
+            NodeIndex init = t->extra[t->lhs[node]];
+            NodeIndex cond = t->extra[t->lhs[node] + 1];
+            NodeIndex step = t->extra[t->lhs[node] + 2];
 
-            IRInst inst = {
-                .kind = IR_INST_KIND_RET,
-                .value = {
-                    .ret = {
-                        .id = expr_ref,
+            switch(frame->phase) {
+            case 0:
+            {
+                fprintf(DEBUGOUT, "LOG: statement for\n");
+
+                if (init != NODE_INDEX_NONE) {
+                    build_expression(builder, init, f);
+                }
+
+                IRBB* cond_bb = ir_builder_build_bb(builder);
+                IRBB* body_bb = ir_builder_build_bb(builder);
+                IRBB* step_bb = ir_builder_build_bb(builder);
+                IRBB* final_bb = ir_builder_build_bb(builder);
+
+                terminate_by_jump(builder, cond_bb);
+                ir_builder_set_current_bb(builder, cond_bb);
+                if (cond != NODE_INDEX_NONE) {
+                    IRSymbolID cond_sym = build_expression(builder, cond, f);
+                    terminate_by_branch(builder, cond_sym, body_bb, final_bb);
+                } else {
+                    terminate_by_jump(builder, body_bb);
+                }
+
+                frame->phase = 1;
+                frame->else_bb = cond_bb;
+                frame->continue_bb = step_bb;
+                frame->final_bb = final_bb;
+
+                ir_builder_set_current_bb(builder, body_bb);
+                push_build_frame(stack, t->rhs[node]);
+                break;
+            }
+
+            case 1:
+                terminate_by_jump(builder, frame->continue_bb);
+
+                ir_builder_set_current_bb(builder, frame->continue_bb);
+                if (step != NODE_INDEX_NONE) {
+                    build_expression(builder, step, f);
+                }
+                terminate_by_jump(builder, frame->else_bb);
+
+                ir_builder_set_current_bb(builder, frame->final_bb);
+                vector_pop(stack);
+                break;
+
+            default:
+                assert(0); // unreachable
+            }
+            break;
+        }
+
+        // switch (cond) body
+        //   dispatch_bb: cond, SWITCH -> case_bbs..., default_bb (or final_bb without default)
+        //   case_bb: stmt, JUMP -> the next case_bb to fall through
+        //   the last block of body: JUMP -> final_bb
+        case NODE_STMT_SWITCH:
+            switch(frame->phase) {
+            case 0:
+            {
+                fprintf(DEBUGOUT, "LOG: statement switch\n");
+
+                IRSymbolID cond = build_expression(builder, t->lhs[node], f);
+
+                frame->phase = 1;
+                frame->else_bb = builder->current_bb;
+                frame->final_bb = ir_builder_build_bb(builder);
+                frame->cond = cond;
+                frame->cases = vector_new(sizeof(IRSwitchCase));
+
+                // Statements before the first label are never reached
+                ir_builder_set_current_bb(builder, ir_builder_build_bb(builder));
+                push_build_frame(stack, t->rhs[node]);
+                break;
+            }
+
+            case 1:
+            {
+                terminate_by_jump(builder, frame->final_bb);
+
+                if (vector_len(frame->cases) > 1) {
+                    qsort(vector_at(frame->cases, 0), vector_len(frame->cases), sizeof(IRSwitchCase), cmp_switch_case);
+                }
+
+                IRInst inst = {
+                    .kind = IR_INST_KIND_SWITCH,
+                    .value = {
+                        .switch_ = {
+                            .cond = frame->cond,
+                            .cases = frame->cases,
+                            .default_bb = frame->default_bb != NULL ? frame->default_bb : frame->final_bb,
+                        },
                     },
-                },
-            };
-            ir_bb_terminate(builder->current_bb, inst);
+                };
+                ir_bb_terminate(frame->else_bb, inst);
+
+                ir_builder_set_current_bb(builder, frame->final_bb);
+                vector_pop(stack);
+                break;
+            }
+
+            default:
+                assert(0); // unreachable
+            }
+            break;
 
+        case NODE_STMT_CASE:
+        case NODE_STMT_DEFAULT:
+        {
+            vector_pop(stack);
+            fprintf(DEBUGOUT, "LOG: statement label\n");
+
+            // The previous statement falls through to the label
+            IRBB* bb = ir_builder_build_bb(builder);
+            terminate_by_jump(builder, bb);
+            ir_builder_set_current_bb(builder, bb);
+
+            BuildFrame* sw = find_switch_frame(stack);
+            assert(sw); // Checked by the analyzer
+
+            if (t->kinds[node] == NODE_STMT_CASE) {
+                IRSwitchCase* c = (IRSwitchCase*)vector_append(sw->cases);
+                int constant = analyzer_eval_const(t, t->lhs[node], &c->value);
+                assert(constant); // Checked by the analyzer
+                (void)constant;
+                c->bb = bb;
+                push_build_frame(stack, t->rhs[node]);
+            } else {
+                sw->default_bb = bb;
+                push_build_frame(stack, t->lhs[node]);
+            }
             break;
         }
 
+        case NODE_STMT_JUMP:
+            vector_pop(stack);
+            fprintf(DEBUGOUT, "LOG: statement jump\n");
+
+            switch((TokenKind)t->rhs[node]) {
+            case TOK_KIND_RETURN:
+            {
+                IRSymbolID expr_ref = build_expression(builder, t->lhs[node], f);
+
+                // e.g. "return f(x);", the call is the last instruction and its result is returned as is
+                size_t insts_len = vector_len(builder->current_bb->insts);
+                if (insts_len > 0) {
+                    IRInst* last = vector_at(builder->current_bb->insts, insts_len - 1);
+                    if (last->value.let.id == expr_ref && last->value.let.rhs.kind == IR_INST_VALUE_KIND_CALL) {
+                        last->value.let.rhs.value.call.is_tail = 1;
+                    }
+                }
+
+                IRInst inst = {
+                    .kind = IR_INST_KIND_RET,
+                    .value = {
+                        .ret = {
+                            .id = expr_ref,
+                        },
+                    },
+                };
+                ir_bb_terminate(builder->current_bb, inst);
+
+                break;
+            }
+
+            case TOK_KIND_BREAK:
+            {
+                BuildFrame* target = find_break_frame(stack);
+                assert(target); // Checked by the analyzer
+
+                terminate_by_jump(builder, target->final_bb);
+                break;
+            }
+
+            case TOK_KIND_CONTINUE:
+            {
+                BuildFrame* loop = find_loop_frame(stack);
+                assert(loop); // Checked by the analyzer
+
+                terminate_by_jump(builder, loop->continue_bb);
+                break;
+            }
+
+            default:
+                assert(0); // TODO: error handling...
+                break;
+            }
+            break;
+
         default:
             assert(0); // TODO: error handling...
             break;
         }
-        break;
+    }
 
-    default:
-        assert(0); // TODO: error handling...
-        break;
+    vector_drop(stack);
+}
+
+// '&&' and '||' branch after their left operands, i.e. after the node at 'lhs' is built
+typedef struct {
+    NodeIndex lhs;
+    NodeIndex node;
+} LogicalSplit;
+
+typedef struct {
+    IRBB* from_bb;          // The block which branches around the right operand
+    IRSymbolID short_sym;   // The result if the right operand is skipped
+    IRBB* final_bb;
+} LogicalFrame;
+
+struct build_expression_arg_t {
+    IRBuilder* builder;
+    IRFunction* f;
+    Vector* syms;       // Vector<IRSymbolID>, results of visited expressions
+    Vector* splits;     // Vector<LogicalSplit>, sorted by 'lhs'
+    size_t next_split;
+    Vector* logicals;   // Vector<LogicalFrame>, logical operators whose right operands are being built
+};
+
+static void push_sym(struct build_expression_arg_t* state, IRSymbolID sym_id) {
+    IRSymbolID* s = (IRSymbolID*)vector_append(state->syms);
+    *s = sym_id;
+}
+
+static IRSymbolID pop_sym(struct build_expression_arg_t* state) {
+    IRSymbolID* s = (IRSymbolID*)vector_pop(state->syms);
+    assert(s);
+    return *s;
+}
+
+static IRSymbolID build_let(IRBuilder* builder, IRInstValue rhs) {
+    IRSymbolID sym_id = ir_builder_build_local(builder);
+    IRInst inst = {
+        .kind = IR_INST_KIND_LET,
+        .value = {
+            .let = {
+                .id = sym_id,
+                .rhs = rhs,
+            },
+        },
+    };
+    ir_bb_append_inst(builder->current_bb, &inst);
+    ir_function_set_local(builder->current_func, sym_id, 8); // TODO: fix
+
+    return sym_id;
+}
+
+static IRSymbolID build_imm_int(IRBuilder* builder, long v) {
+    IRInstValue imm = {
+        .kind = IR_INST_VALUE_KIND_IMM_INT,
+        .value = {
+            .imm_int = v,
+        },
+    };
+    return build_let(builder, imm);
+}
+
+static int is_logical_op(NodeTable* t, NodeIndex node) {
+    if (t->kinds[node] != NODE_EXPR_BIN) {
+        return 0;
     }
+    TokenKind op = (TokenKind)node_table_token(t, node)->kind;
+    return op == TOK_KIND_LOGICAL_AND || op == TOK_KIND_LOGICAL_OR;
+}
+
+// The right operand of 'a && b' and 'a || b' is evaluated only if 'a' does not decide the result
+//   from_bb: a, short = 0 (1 for ||), BR a -> rhs_bb, final_bb (final_bb, rhs_bb for ||)
+//   rhs_bb: b, r = b != 0, JUMP -> final_bb
+//   final_bb: phi [from_bb: short], [the last block of b: r]
+// The left operand has been built, and its result is on the top of 'syms'.
+static void build_logical_branch(struct build_expression_arg_t* state, NodeIndex node) {
+    IRBuilder* builder = state->builder;
+    int is_and = node_table_token(builder->nodes, node)->kind == TOK_KIND_LOGICAL_AND;
+
+    IRSymbolID lhs_sym = *(IRSymbolID*)vector_at(state->syms, vector_len(state->syms) - 1);
+    IRSymbolID short_sym = build_imm_int(builder, is_and ? 0 : 1);
+
+    IRBB* rhs_bb = ir_builder_build_bb(builder);
+    IRBB* final_bb = ir_builder_build_bb(builder);
+    terminate_by_branch(builder, lhs_sym, is_and ? rhs_bb : final_bb, is_and ? final_bb : rhs_bb);
+
+    LogicalFrame* frame = (LogicalFrame*)vector_append(state->logicals);
+    frame->from_bb = builder->current_bb;
+    frame->short_sym = short_sym;
+    frame->final_bb = final_bb;
+
+    ir_builder_set_current_bb(builder, rhs_bb);
 }
 
-IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
-    switch(node->kind) {
+// Both operands have been built, and the result is merged in the final block
+static IRSymbolID build_logical_join(struct build_expression_arg_t* state, NodeIndex node) {
+    IRBuilder* builder = state->builder;
+    IRSymbolID rhs_sym = pop_sym(state);
+    pop_sym(state); // Consumed by the branch
+
+    LogicalFrame frame = *(LogicalFrame*)vector_pop(state->logicals);
+
+    IRInstValue ne = {
+        .kind = IR_INST_VALUE_KIND_OP_BIN,
+        .value = {
+            .op_bin = {
+                .op = TOK_KIND_NE,
+                .lhs = rhs_sym,
+                .rhs = build_imm_int(builder, 0),
+            },
+        },
+    };
+    IRSymbolID bool_sym = build_let(builder, ne);
+
+    IRBB* rhs_end_bb = builder->current_bb;
+    terminate_by_jump(builder, frame.final_bb);
+    ir_builder_set_current_bb(builder, frame.final_bb);
+
+    Vector* incomings = vector_new(sizeof(IRPhiIncoming)); // Vector<IRPhiIncoming>
+    IRPhiIncoming* from = (IRPhiIncoming*)vector_append(incomings);
+    from->bb = frame.from_bb;
+    from->sym = frame.short_sym;
+    IRPhiIncoming* rhs = (IRPhiIncoming*)vector_append(incomings);
+    rhs->bb = rhs_end_bb;
+    rhs->sym = bool_sym;
+
+    fprintf(DEBUGOUT, "LOG: expr logical = %s\n", token_kind_to_string(node_table_token(builder->nodes, node)->kind));
+
+    IRInstValue phi = {
+        .kind = IR_INST_VALUE_KIND_PHI,
+        .value = {
+            .phi = {
+                .incomings = incomings,
+            },
+        },
+    };
+    return build_let(builder, phi);
+}
+
+// Called in postorder, so results of children are on the top of 'syms'
+static void build_expression_node(struct build_expression_arg_t* state, NodeIndex node) {
+    IRBuilder* builder = state->builder;
+    IRFunction* f = state->f;
+    NodeTable* t = builder->nodes;
+
+    switch(t->kinds[node]) {
     case NODE_EXPR_BIN:
     {
-        printf("LOG: expr bin = ");
-        token_fprint_buf(stdout, node->value.expr_bin.op);
-        printf("\n");
+        if (is_logical_op(t, node)) {
+            push_sym(state, build_logical_join(state, node));
+            break;
+        }
+
+        fprintf(DEBUGOUT, "LOG: expr bin = ");
+        token_fprint_buf(DEBUGOUT, t->buffer, node_table_token(t, node));
+        fprintf(DEBUGOUT, "\n");
 
-        IRSymbolID lhs_sym = build_expression(builder, node->value.expr_bin.lhs, f);
-        IRSymbolID rhs_sym = build_expression(builder, node->value.expr_bin.rhs, f);
+        IRSymbolID rhs_sym = pop_sym(state);
+        IRSymbolID lhs_sym = pop_sym(state);
 
         IRSymbolID sym_id = ir_builder_build_local(builder);
 
@@ -344,7 +1045,7 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
             .kind = IR_INST_VALUE_KIND_OP_BIN,
             .value = {
                 .op_bin = {
-                    .op = node->value.expr_bin.op, // TODO: Change to builtin enums...
+                    .op = (TokenKind)node_table_token(t, node)->kind,
                     .lhs = lhs_sym,
                     .rhs = rhs_sym,
                 },
@@ -362,30 +1063,37 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
         ir_bb_append_inst(builder->current_bb, &inst);
         ir_function_set_local(f, sym_id, 8); // TODO: fix
 
-        return sym_id;
+        push_sym(state, sym_id);
+        break;
     }
 
     case NODE_EXPR_POSTFIX:
     {
-        printf("LOG: expr post = \n");
+        fprintf(DEBUGOUT, "LOG: expr post = \n");
 
-        IRSymbolID lhs_sym = build_expression(builder, node->value.expr_postfix.lhs, f);
-
-        switch(node->value.expr_postfix.kind) {
+        switch((NodeExprPostfixKind)t->extra[t->rhs[node]]) {
         case NODE_EXPR_POSTFIX_KIND_FUNC_CALL:
         {
+            NodeIndex args_list = t->extra[t->rhs[node] + 1];
+            size_t args_num = 0;
+            if (args_list != NODE_INDEX_NONE) {
+                assert(t->kinds[args_list] == NODE_ARGS_LIST);
+                args_num = t->rhs[args_list] - t->lhs[args_list];
+            }
+
+            // Arguments are on the top of the stack, and the callee is under them
+            size_t args_base = vector_len(state->syms) - args_num;
+
             Vector* args = vector_new(sizeof(IRSymbolID)); // Vector<IRSymbolID>
-            Node* args_list = node->value.expr_postfix.rhs;
-            if (args_list) {
-                assert(args_list->kind == NODE_ARGS_LIST);
-                for(size_t i=0; i<vector_len(args_list->value.args_list.args); ++i) {
-                    Node** a = (Node**)vector_at(args_list->value.args_list.args, i);
-                    IRSymbolID a_sym = build_expression(builder, *a, f);
-
-                    IRSymbolID* args_e = (IRSymbolID*)vector_append(args);
-                    *args_e = a_sym;
-                }
+            for(size_t i=0; i<args_num; ++i) {
+                IRSymbolID* a_sym = (IRSymbolID*)vector_at(state->syms, args_base + i);
+
+                IRSymbolID* args_e = (IRSymbolID*)vector_append(args);
+                *args_e = *a_sym;
             }
+            vector_truncate(state->syms, args_base);
+
+            IRSymbolID lhs_sym = pop_sym(state);
 
             IRSymbolID sym_id = ir_builder_build_local(builder);
 
@@ -395,6 +1103,7 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
                     .call = {
                         .lhs = lhs_sym,
                         .args = args,
+                        .is_tail = 0,
                     },
                 },
             };
@@ -410,7 +1119,8 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
             ir_bb_append_inst(builder->current_bb, &inst);
             ir_function_set_local(f, sym_id, 8); // TODO: fix
 
-            return sym_id;
+            push_sym(state, sym_id);
+            break;
         }
 
         default:
@@ -419,15 +1129,19 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
         break;
     }
 
+    case NODE_ARGS_LIST:
+        // DO NOTHING, arguments are consumed by the call
+        break;
+
     case NODE_LIT_INT:
     {
-        printf("LOG: lit_int\n");
+        fprintf(DEBUGOUT, "LOG: lit_int\n");
         IRSymbolID sym_id = ir_builder_build_local(builder);
 
         IRInstValue imm = {
             .kind = IR_INST_VALUE_KIND_IMM_INT,
             .value = {
-                .imm_int = node->value.lit_int.v,
+                .imm_int = node_table_lit_int(t, node),
             },
         };
         IRInst inst = {
@@ -442,20 +1156,15 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
         ir_bb_append_inst(builder->current_bb, &inst);
         ir_function_set_local(f, sym_id, 8); // TODO: fix
 
-        return sym_id;
+        push_sym(state, sym_id);
+        break;
     }
 
     case NODE_LIT_STRING:
     {
-        printf("LOG: lit_string\n");
+        fprintf(DEBUGOUT, "LOG: lit_string\n");
 
-        IRInstValue sval = {
-            .kind = IR_INST_VALUE_KIND_STRING,
-            .value = {
-                .string = node->value.lit_string.v,
-            },
-        };
-        IRSymbolID str_sym_id = insert_definition(f->mod, sval);
+        IRSymbolID str_sym_id = ir_builder_string_def(builder, f->mod, node_table_string_id(t, node));
 
         //
         IRSymbolID ref_sym_id = ir_builder_build_local(builder);
@@ -505,19 +1214,40 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
         ir_bb_append_inst(builder->current_bb, &inst);
         ir_function_set_local(f, sym_id, 8); // TODO: fix
 
-        return sym_id;
+        push_sym(state, sym_id);
+        break;
     }
 
     case NODE_ID:
     {
-        // TODO: implement
-        IRInstValue val = {
-            .kind = IR_INST_VALUE_KIND_SYMBOL,
-            .value = {
-                .symbol = token_to_string(node->value.id.tok),
-            },
-        };
-        IRSymbolID tmp_sym_id = insert_definition(f->mod, val);
+        IRSymbolID* param = builder->params ? string_map_find(builder->params, node_table_ident(t, node)) : NULL;
+        if (param) {
+            IRSymbolID sym_id = ir_builder_build_local(builder);
+            IRInst inst = {
+                .kind = IR_INST_KIND_LET,
+                .value = {
+                    .let = {
+                        .id = sym_id,
+                        .rhs = {
+                            .kind = IR_INST_VALUE_KIND_REF,
+                            .value = {
+                                .ref = {
+                                    .is_global = 0,
+                                    .sym = *param,
+                                },
+                            },
+                        },
+                    },
+                },
+            };
+            ir_bb_append_inst(builder->current_bb, &inst);
+            ir_function_set_local(f, sym_id, 8); // TODO: fix
+
+            push_sym(state, sym_id);
+            break;
+        }
+
+        IRSymbolID tmp_sym_id = ir_builder_symbol_def(builder, f->mod, node);
 
         IRSymbolID sym_id = ir_builder_build_local(builder);
 
@@ -542,7 +1272,8 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
         ir_bb_append_inst(builder->current_bb, &inst);
         ir_function_set_local(f, sym_id, 8); // TODO: fix
 
-        return sym_id;
+        push_sym(state, sym_id);
+        break;
     }
 
     default:
@@ -550,6 +1281,74 @@ IRSymbolID build_expression(IRBuilder* builder, Node* node, IRFunction* f) {
     }
 }
 
+static int cmp_logical_split(void const* a, void const* b) {
+    NodeIndex va = ((LogicalSplit const*)a)->lhs;
+    NodeIndex vb = ((LogicalSplit const*)b)->lhs;
+    return va < vb ? -1 : va > vb ? 1 : 0;
+}
+
+// Nodes of the subtree are contiguous and in postorder in the table, so it is built by a linear scan.
+// Logical operators are found first, since they branch in the middle of their subtrees.
+IRSymbolID build_expression(IRBuilder* builder, NodeIndex root, IRFunction* f) {
+    NodeTable* t = builder->nodes;
+    struct build_expression_arg_t state = {
+        .builder = builder,
+        .f = f,
+        .syms = vector_new(sizeof(IRSymbolID)),
+        .splits = vector_new(sizeof(LogicalSplit)),
+        .next_split = 0,
+        .logicals = vector_new(sizeof(LogicalFrame)),
+    };
+
+    NodeIndex begin = node_table_subtree_begin(t, root);
+    for(NodeIndex node = begin; node <= root; ++node) {
+        if (is_logical_op(t, node)) {
+            LogicalSplit* split = (LogicalSplit*)vector_append(state.splits);
+            split->lhs = t->lhs[node];
+            split->node = node;
+        }
+    }
+    if (vector_len(state.splits) > 1) {
+        qsort(vector_at(state.splits, 0), vector_len(state.splits), sizeof(LogicalSplit), cmp_logical_split);
+    }
+
+    for(NodeIndex node = begin; node <= root; ++node) {
+        build_expression_node(&state, node);
+
+        if (state.next_split < vector_len(state.splits)) {
+            LogicalSplit* split = (LogicalSplit*)vector_at(state.splits, state.next_split);
+            if (split->lhs == node) {
+                build_logical_branch(&state, split->node);
+                state.next_split++;
+            }
+        }
+    }
+
+    assert(vector_len(state.syms) == 1);
+    assert(vector_len(state.logicals) == 0);
+    IRSymbolID sym_id = pop_sym(&state);
+    vector_drop(state.logicals);
+    vector_drop(state.splits);
+    vector_drop(state.syms);
+
+    return sym_id;
+}
+
+static void ir_module_insts_len_iter(IRBB* bb, void* args) {
+    size_t* len = (size_t*)args;
+    *len += vector_len(bb->insts) + (bb->term != NULL ? 1 : 0);
+}
+
+size_t ir_module_insts_len(IRModule* m) {
+    size_t len = 0;
+    for(size_t i=0; i<vector_len(m->functions); ++i) {
+        IRFunction* f = vector_at(m->functions, i);
+        ir_bb_visit(f->entry, ir_module_insts_len_iter, &len);
+    }
+
+    return len;
+}
+
 static void fprint_indent(FILE *fp, int indent);
 
 void ir_module_fprint(FILE* fp, IRModule* m) {
@@ -602,7 +1401,9 @@ void ir_inst_fprint(FILE* fp, IRInst* inst) {
 
         case IR_INST_VALUE_KIND_STRING:
         {
-            fprintf(fp, "\"%s\"", inst->value.let.rhs.value.string);
+            fprintf(fp, "\"");
+            literal_fprint_string(fp, inst->value.let.rhs.value.string.buf, inst->value.let.rhs.value.string.len);
+            fprintf(fp, "\"");
             break;
         }
 
@@ -623,24 +1424,24 @@ void ir_inst_fprint(FILE* fp, IRInst* inst) {
 
         case IR_INST_VALUE_KIND_IMM_INT:
         {
-            fprintf(fp, "%d", inst->value.let.rhs.value.imm_int);
+            fprintf(fp, "%ld", inst->value.let.rhs.value.imm_int);
             break;
         }
 
         case IR_INST_VALUE_KIND_OP_BIN:
         {
-            char const* op_buf = token_to_string(inst->value.let.rhs.value.op_bin.op);
             fprintf(fp, "%s %%%ld %%%ld",
-                    op_buf,
+                    token_kind_to_string(inst->value.let.rhs.value.op_bin.op),
                     inst->value.let.rhs.value.op_bin.lhs,
                     inst->value.let.rhs.value.op_bin.rhs);
-            free((char*)op_buf);
             break;
         }
 
         case IR_INST_VALUE_KIND_CALL:
         {
-            fprintf(fp, "call %%%ld", inst->value.let.rhs.value.call.lhs);
+            fprintf(fp, "%s %%%ld",
+                    inst->value.let.rhs.value.call.is_tail ? "tail call" : "call",
+                    inst->value.let.rhs.value.call.lhs);
             Vector* args = inst->value.let.rhs.value.call.args;
             for(size_t i=0; i<vector_len(args); ++i) {
                 IRSymbolID* sym = (IRSymbolID*)vector_at(args, i);
@@ -649,6 +1450,32 @@ void ir_inst_fprint(FILE* fp, IRInst* inst) {
             break;
         }
 
+        case IR_INST_VALUE_KIND_PARAM:
+        {
+            fprintf(fp, "param %ld", inst->value.let.rhs.value.param.index);
+            break;
+        }
+
+        case IR_INST_VALUE_KIND_SELECT:
+        {
+            fprintf(fp, "select %%%ld %%%ld %%%ld",
+                    inst->value.let.rhs.value.select.cond,
+                    inst->value.let.rhs.value.select.then_sym,
+                    inst->value.let.rhs.value.select.else_sym);
+            break;
+        }
+
+        case IR_INST_VALUE_KIND_PHI:
+        {
+            fprintf(fp, "phi");
+            Vector* incomings = inst->value.let.rhs.value.phi.incomings;
+            for(size_t i=0; i<vector_len(incomings); ++i) {
+                IRPhiIncoming* in = (IRPhiIncoming*)vector_at(incomings, i);
+                fprintf(fp, " [%ld: %%%ld]", in->bb->id, in->sym);
+            }
+            break;
+        }
+
         default:
             assert(0); // TODO: error handling
         }
@@ -670,6 +1497,18 @@ void ir_inst_fprint(FILE* fp, IRInst* inst) {
         fprintf(fp, "JUMP -> %ld\n", inst->value.jump.next_bb->id);
         break;
 
+    case IR_INST_KIND_SWITCH:
+    {
+        fprintf(fp, "SWITCH %%%ld: ", inst->value.switch_.cond);
+        Vector* cases = inst->value.switch_.cases;
+        for(size_t i=0; i<vector_len(cases); ++i) {
+            IRSwitchCase* c = (IRSwitchCase*)vector_at(cases, i);
+            fprintf(fp, "%ld -> %ld, ", c->value, c->bb->id);
+        }
+        fprintf(fp, "default -> %ld\n", inst->value.switch_.default_bb->id);
+        break;
+    }
+
     default:
         assert(0); // TODO: error handling
     }
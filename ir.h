@@ -5,7 +5,7 @@
 #include "ir_inst.h"
 #include "ir_bb.h"
 #include "ir_bb_arena.h"
-#include "node.h"
+#include "node_table.h"
 
 typedef size_t IRSymbolID;
 
@@ -27,6 +27,7 @@ struct ir_function_t {
     IRBBID bb_id;
     Vector* locals;         // Vector<size_t/*type_t*/> TODO: Change to type info
     IRSymbolID locals_id;
+    size_t params_num;
 };
 
 // TODO: encapsulate
@@ -39,6 +40,9 @@ struct ir_module_t {
 IRModule* ir_module_new();
 void ir_module_drop(IRModule* m);
 
+// Number of instructions in functions, including terminators
+size_t ir_module_insts_len(IRModule* m);
+
 void ir_module_fprint(FILE* fp, IRModule* m);
 void ir_function_fprint(FILE* fp, IRFunction* f);
 void ir_bb_fprint(FILE* fp, IRBB* bb);
@@ -50,6 +54,10 @@ typedef struct ir_builder_t IRBuilder;
 IRBuilder* ir_builder_new();
 void ir_builder_drop(IRBuilder* builder);
 
-IRModule* ir_builder_new_module(IRBuilder* builder, Node* node);
+// Called for each NODE_FUNC_DEF. Functions are not built if it returns 0, e.g. their code is reused.
+typedef int (*IRBuilderFunctionFilter)(NodeIndex func_def, char const* name, void* args);
+void ir_builder_set_function_filter(IRBuilder* builder, IRBuilderFunctionFilter filter, void* args);
+
+IRModule* ir_builder_new_module(IRBuilder* builder, NodeTable* nodes);
 
 #endif /*CC_IR_H*/
@@ -50,6 +50,16 @@ void ir_bb_foreach_nexts(IRBB* bb, void(*f)(IRBB*, void*), void* args) {
         return;
     }
 
+    case IR_INST_KIND_SWITCH:
+    {
+        Vector* cases = bb->term->value.switch_.cases;
+        for(size_t i=0; i<vector_len(cases); ++i) {
+            f(((IRSwitchCase*)vector_at(cases, i))->bb, args);
+        }
+        f(bb->term->value.switch_.default_bb, args);
+        return;
+    }
+
     default:
         assert(0); // TODO: error handling
         return;
@@ -83,6 +93,10 @@ void ir_bb_visit(IRBB* initial_bb, void(*f)(IRBB* bb, void*), void* args) {
     IRBB** bb = vector_append(state.bbs);
     *bb = initial_bb;
 
+    // Back edges may lead to the initial block
+    int exist;
+    uint_map_insert(state.visited, initial_bb->id, &exist);
+
     while(state.head < vector_len(state.bbs)) {
         bb = vector_at(state.bbs, state.head);
         state.head++;
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include "ir_dom.h"
+#include "ir_inst_defs.h"
+#include "vector.h"
+
+#define RPO_INDEX_NONE SIZE_MAX
+
+struct ir_dom_tree_t {
+    IRFunction* f;          // reference
+    Vector* rpo;            // Vector<IRBB*>
+    size_t* rpo_index;      // Indexed by IRBBID, RPO_INDEX_NONE for unreachable blocks
+    IRBB** idoms;           // Indexed by IRBBID
+    Vector** children;      // Indexed by IRBBID, Vector<IRBB*>, NULL for unreachable blocks
+};
+
+// Successors in the same order as ir_bb_foreach_nexts, NULL if 'index' is past the last one
+static IRBB* bb_next_at(IRBB* bb, size_t index) {
+    switch(bb->term->kind) {
+    case IR_INST_KIND_BRANCH:
+        return index == 0 ? bb->term->value.branch.then_bb
+            : index == 1 ? bb->term->value.branch.else_bb
+            : NULL;
+
+    case IR_INST_KIND_JUMP:
+        return index == 0 ? bb->term->value.jump.next_bb : NULL;
+
+    case IR_INST_KIND_SWITCH:
+    {
+        Vector* cases = bb->term->value.switch_.cases;
+        if (index < vector_len(cases)) {
+            return ((IRSwitchCase*)vector_at(cases, index))->bb;
+        }
+        return index == vector_len(cases) ? bb->term->value.switch_.default_bb : NULL;
+    }
+
+    default:
+        return NULL;
+    }
+}
+
+typedef struct {
+    IRBB* bb;
+    size_t next;    // An index of the next successor to visit
+} DFSFrame;
+
+static void build_rpo(IRDomTree* t) {
+    size_t bbs_num = t->f->bb_id;
+    Vector* postorder = vector_new(sizeof(IRBB*)); // Vector<IRBB*>
+    Vector* stack = vector_new(sizeof(DFSFrame)); // Vector<DFSFrame>
+
+    DFSFrame* root = (DFSFrame*)vector_append(stack);
+    root->bb = t->f->entry;
+    root->next = 0;
+    t->rpo_index[t->f->entry->id] = 0; // Marked as visited, and numbered later
+
+    while(vector_len(stack) > 0) {
+        DFSFrame* frame = (DFSFrame*)vector_at(stack, vector_len(stack) - 1);
+
+        IRBB* next = bb_next_at(frame->bb, frame->next);
+        if (next != NULL) {
+            frame->next++;
+
+            if (t->rpo_index[next->id] == RPO_INDEX_NONE) {
+                t->rpo_index[next->id] = 0;
+
+                // 'frame' may be invalidated
+                DFSFrame* child = (DFSFrame*)vector_append(stack);
+                child->bb = next;
+                child->next = 0;
+            }
+            continue;
+        }
+
+        IRBB** e = (IRBB**)vector_append(postorder);
+        *e = frame->bb;
+        vector_pop(stack);
+    }
+
+    size_t len = vector_len(postorder);
+    for(size_t i=0; i<len; ++i) {
+        IRBB** bb = (IRBB**)vector_at(postorder, len - 1 - i);
+        IRBB** e = (IRBB**)vector_append(t->rpo);
+        *e = *bb;
+        t->rpo_index[(*bb)->id] = i;
+    }
+    assert(len <= bbs_num);
+
+    vector_drop(stack);
+    vector_drop(postorder);
+}
+
+static IRBB* intersect(IRDomTree* t, IRBB* a, IRBB* b) {
+    while(a != b) {
+        while(t->rpo_index[a->id] > t->rpo_index[b->id]) {
+            a = t->idoms[a->id];
+        }
+        while(t->rpo_index[b->id] > t->rpo_index[a->id]) {
+            b = t->idoms[b->id];
+        }
+    }
+
+    return a;
+}
+
+static void build_idoms(IRDomTree* t) {
+    IRBB* entry = t->f->entry;
+    t->idoms[entry->id] = entry; // Only while computing
+
+    int changed = 1;
+    while(changed) {
+        changed = 0;
+
+        for(size_t i=1; i<vector_len(t->rpo); ++i) {
+            IRBB* bb = *(IRBB**)vector_at(t->rpo, i);
+
+            IRBB* new_idom = NULL;
+            for(size_t k=0; k<vector_len(bb->prevs); ++k) {
+                IRBB* prev = *(IRBB**)vector_at(bb->prevs, k);
+                if (t->rpo_index[prev->id] == RPO_INDEX_NONE || t->idoms[prev->id] == NULL) {
+                    continue; // Unreachable or not processed yet
+                }
+                new_idom = new_idom ? intersect(t, prev, new_idom) : prev;
+            }
+            assert(new_idom);
+
+            if (t->idoms[bb->id] != new_idom) {
+                t->idoms[bb->id] = new_idom;
+                changed = 1;
+            }
+        }
+    }
+
+    t->idoms[entry->id] = NULL;
+}
+
+IRDomTree* ir_dom_tree_new(IRFunction* f) {
+    size_t bbs_num = f->bb_id;
+
+    IRDomTree* t = (IRDomTree*)malloc(sizeof(IRDomTree));
+    assert(t); // TODO: error handling...
+    t->f = f;
+    t->rpo = vector_new(sizeof(IRBB*));
+    t->rpo_index = (size_t*)malloc(sizeof(size_t) * bbs_num);
+    t->idoms = (IRBB**)calloc(bbs_num, sizeof(IRBB*));
+    t->children = (Vector**)calloc(bbs_num, sizeof(Vector*));
+    for(size_t i=0; i<bbs_num; ++i) {
+        t->rpo_index[i] = RPO_INDEX_NONE;
+    }
+
+    build_rpo(t);
+    build_idoms(t);
+
+    for(size_t i=0; i<vector_len(t->rpo); ++i) {
+        IRBB* bb = *(IRBB**)vector_at(t->rpo, i);
+        t->children[bb->id] = vector_new(sizeof(IRBB*));
+
+        IRBB* idom = t->idoms[bb->id];
+        if (idom) {
+            IRBB** e = (IRBB**)vector_append(t->children[idom->id]);
+            *e = bb;
+        }
+    }
+
+    return t;
+}
+
+void ir_dom_tree_drop(IRDomTree* t) {
+    for(size_t i=0; i<t->f->bb_id; ++i) {
+        if (t->children[i]) {
+            vector_drop(t->children[i]);
+        }
+    }
+    free(t->children);
+    free(t->idoms);
+    free(t->rpo_index);
+    vector_drop(t->rpo);
+    free(t);
+}
+
+size_t ir_dom_tree_len(IRDomTree* t) {
+    return vector_len(t->rpo);
+}
+
+IRBB* ir_dom_tree_rpo_at(IRDomTree* t, size_t index) {
+    return *(IRBB**)vector_at(t->rpo, index);
+}
+
+IRBB* ir_dom_tree_idom(IRDomTree* t, IRBB* bb) {
+    return t->idoms[bb->id];
+}
+
+Vector* ir_dom_tree_children(IRDomTree* t, IRBB* bb) {
+    assert(t->children[bb->id]);
+    return t->children[bb->id];
+}
+
+int ir_dom_tree_dominates(IRDomTree* t, IRBB* a, IRBB* b) {
+    if (t->rpo_index[a->id] == RPO_INDEX_NONE || t->rpo_index[b->id] == RPO_INDEX_NONE) {
+        return 0;
+    }
+
+    for(IRBB* bb = b; bb; bb = t->idoms[bb->id]) {
+        if (bb == a) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
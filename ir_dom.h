@@ -0,0 +1,29 @@
+#ifndef CC_IR_DOM_H
+#define CC_IR_DOM_H
+
+#include <stddef.h>
+#include "ir.h"
+
+// The dominator tree of blocks of a function, computed by the iterative algorithm of Cooper, Harvey and Kennedy.
+// Blocks which are not reachable from the entry are not in the tree.
+// Predecessors are taken from 'prevs' of blocks, so the tree is stale once edges of the function are changed.
+
+struct ir_dom_tree_t;
+typedef struct ir_dom_tree_t IRDomTree;
+
+// 'f' is a reference, and must outlive the tree
+IRDomTree* ir_dom_tree_new(IRFunction* f);
+void ir_dom_tree_drop(IRDomTree* t);
+
+// Reachable blocks in reverse postorder, so dominators come before blocks they dominate
+size_t ir_dom_tree_len(IRDomTree* t);
+IRBB* ir_dom_tree_rpo_at(IRDomTree* t, size_t index);
+
+// Returns NULL for the entry
+IRBB* ir_dom_tree_idom(IRDomTree* t, IRBB* bb);
+// Blocks immediately dominated by 'bb', Vector<IRBB*>, reference
+Vector* ir_dom_tree_children(IRDomTree* t, IRBB* bb);
+// A block dominates itself
+int ir_dom_tree_dominates(IRDomTree* t, IRBB* a, IRBB* b);
+
+#endif /* CC_IR_DOM_H */
@@ -0,0 +1,364 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include "ir_gvn.h"
+#include "ir_dom.h"
+#include "ir_inst_defs.h"
+#include "hash.h"
+#include "vector.h"
+
+#define ENTRY_NONE SIZE_MAX
+
+typedef struct {
+    uint64_t hash;
+    IRInstValue value;  // Operands are leaders
+    IRSymbolID sym;
+    size_t next;        // An index of the next entry in the same bucket
+} Entry;
+
+// Entries are pushed while walking down the dominator tree and popped while walking up,
+// so a lookup only sees values available in dominating blocks
+typedef struct {
+    size_t* buckets;    // Indexes of the last entries, ENTRY_NONE if empty
+    size_t mask;
+    Vector* entries;    // Vector<Entry>
+} ValueTable;
+
+typedef struct {
+    IRFunction* f;              // reference
+    IRSymbolID* leaders;        // Indexed by IRSymbolID, the value which replaces the symbol
+    ValueTable table;
+    size_t removed;
+} GVN;
+
+typedef struct {
+    IRBB* bb;
+    size_t child;       // An index of the next child in the dominator tree
+    size_t mark;        // Length of the table before the block
+} WalkFrame;
+
+static int is_commutative(TokenKind op) {
+    switch(op) {
+    case TOK_KIND_PLUS:
+    case TOK_KIND_MUL:
+    case TOK_KIND_AND:
+    case TOK_KIND_OR:
+    case TOK_KIND_XOR:
+    case TOK_KIND_EQ:
+    case TOK_KIND_NE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Returns 0 if the value has side effects or depends on them.
+// Phis depend on the path which reaches them, so equal phis of different blocks are not the same value.
+static int is_pure(IRInstValue* v) {
+    switch(v->kind) {
+    case IR_INST_VALUE_KIND_REF:
+    case IR_INST_VALUE_KIND_ADDR_OF:
+    case IR_INST_VALUE_KIND_IMM_INT:
+    case IR_INST_VALUE_KIND_OP_BIN:
+    case IR_INST_VALUE_KIND_PARAM:
+    case IR_INST_VALUE_KIND_SELECT:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static uint64_t hash_value(IRInstValue* v) {
+    uint64_t h = hash_bytes(HASH_INIT, &v->kind, sizeof(v->kind));
+    switch(v->kind) {
+    case IR_INST_VALUE_KIND_REF:
+        h = hash_bytes(h, &v->value.ref.is_global, sizeof(v->value.ref.is_global));
+        h = hash_bytes(h, &v->value.ref.sym, sizeof(v->value.ref.sym));
+        break;
+    case IR_INST_VALUE_KIND_ADDR_OF:
+        h = hash_bytes(h, &v->value.addr_of.sym, sizeof(v->value.addr_of.sym));
+        break;
+    case IR_INST_VALUE_KIND_IMM_INT:
+        h = hash_bytes(h, &v->value.imm_int, sizeof(v->value.imm_int));
+        break;
+    case IR_INST_VALUE_KIND_OP_BIN:
+        h = hash_bytes(h, &v->value.op_bin.op, sizeof(v->value.op_bin.op));
+        h = hash_bytes(h, &v->value.op_bin.lhs, sizeof(v->value.op_bin.lhs));
+        h = hash_bytes(h, &v->value.op_bin.rhs, sizeof(v->value.op_bin.rhs));
+        break;
+    case IR_INST_VALUE_KIND_PARAM:
+        h = hash_bytes(h, &v->value.param.index, sizeof(v->value.param.index));
+        break;
+    case IR_INST_VALUE_KIND_SELECT:
+        h = hash_bytes(h, &v->value.select.cond, sizeof(v->value.select.cond));
+        h = hash_bytes(h, &v->value.select.then_sym, sizeof(v->value.select.then_sym));
+        h = hash_bytes(h, &v->value.select.else_sym, sizeof(v->value.select.else_sym));
+        break;
+    default:
+        assert(0); // unreachable
+    }
+
+    return h;
+}
+
+static int equal_values(IRInstValue* a, IRInstValue* b) {
+    if (a->kind != b->kind) {
+        return 0;
+    }
+
+    switch(a->kind) {
+    case IR_INST_VALUE_KIND_REF:
+        return a->value.ref.is_global == b->value.ref.is_global && a->value.ref.sym == b->value.ref.sym;
+    case IR_INST_VALUE_KIND_ADDR_OF:
+        return a->value.addr_of.sym == b->value.addr_of.sym;
+    case IR_INST_VALUE_KIND_IMM_INT:
+        return a->value.imm_int == b->value.imm_int;
+    case IR_INST_VALUE_KIND_OP_BIN:
+        return a->value.op_bin.op == b->value.op_bin.op
+            && a->value.op_bin.lhs == b->value.op_bin.lhs
+            && a->value.op_bin.rhs == b->value.op_bin.rhs;
+    case IR_INST_VALUE_KIND_PARAM:
+        return a->value.param.index == b->value.param.index;
+    case IR_INST_VALUE_KIND_SELECT:
+        return a->value.select.cond == b->value.select.cond
+            && a->value.select.then_sym == b->value.select.then_sym
+            && a->value.select.else_sym == b->value.select.else_sym;
+    default:
+        return 0;
+    }
+}
+
+// Returns the symbol of an equal value, or inserts 'sym' and returns it
+static IRSymbolID value_table_find_or_insert(ValueTable* t, IRInstValue* v, IRSymbolID sym) {
+    uint64_t h = hash_value(v);
+    size_t* bucket = &t->buckets[h & t->mask];
+    for(size_t i = *bucket; i != ENTRY_NONE; ) {
+        Entry* e = (Entry*)vector_at(t->entries, i);
+        if (e->hash == h && equal_values(&e->value, v)) {
+            return e->sym;
+        }
+        i = e->next;
+    }
+
+    size_t index = vector_len(t->entries);
+    Entry* e = (Entry*)vector_append(t->entries);
+    e->hash = h;
+    e->value = *v;
+    e->sym = sym;
+    e->next = *bucket;
+    *bucket = index;
+
+    return sym;
+}
+
+static void value_table_truncate(ValueTable* t, size_t mark) {
+    while(vector_len(t->entries) > mark) {
+        Entry* e = (Entry*)vector_pop(t->entries);
+        t->buckets[e->hash & t->mask] = e->next;
+    }
+}
+
+static void count_insts_iter(IRBB* bb, void* args) {
+    size_t* n = (size_t*)args;
+    *n += vector_len(bb->insts);
+}
+
+static IRSymbolID leader(GVN* g, IRSymbolID id) {
+    assert(id < g->f->locals_id);
+    return g->leaders[id];
+}
+
+static void rewrite_operands(GVN* g, IRInst* inst) {
+    switch(inst->kind) {
+    case IR_INST_KIND_LET:
+    {
+        IRInstValue* v = &inst->value.let.rhs;
+        switch(v->kind) {
+        case IR_INST_VALUE_KIND_REF:
+            if (!v->value.ref.is_global) {
+                v->value.ref.sym = leader(g, v->value.ref.sym);
+            }
+            break;
+
+        case IR_INST_VALUE_KIND_ADDR_OF:
+            v->value.addr_of.sym = leader(g, v->value.addr_of.sym);
+            break;
+
+        case IR_INST_VALUE_KIND_OP_BIN:
+            v->value.op_bin.lhs = leader(g, v->value.op_bin.lhs);
+            v->value.op_bin.rhs = leader(g, v->value.op_bin.rhs);
+            if (is_commutative(v->value.op_bin.op) && v->value.op_bin.lhs > v->value.op_bin.rhs) {
+                IRSymbolID tmp = v->value.op_bin.lhs;
+                v->value.op_bin.lhs = v->value.op_bin.rhs;
+                v->value.op_bin.rhs = tmp;
+            }
+            break;
+
+        case IR_INST_VALUE_KIND_SELECT:
+            v->value.select.cond = leader(g, v->value.select.cond);
+            v->value.select.then_sym = leader(g, v->value.select.then_sym);
+            v->value.select.else_sym = leader(g, v->value.select.else_sym);
+            break;
+
+        case IR_INST_VALUE_KIND_CALL:
+        {
+            v->value.call.lhs = leader(g, v->value.call.lhs);
+            Vector* args = v->value.call.args;
+            for(size_t i=0; i<vector_len(args); ++i) {
+                IRSymbolID* arg = (IRSymbolID*)vector_at(args, i);
+                *arg = leader(g, *arg);
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+        break;
+    }
+
+    case IR_INST_KIND_RET:
+        inst->value.ret.id = leader(g, inst->value.ret.id);
+        break;
+
+    case IR_INST_KIND_BRANCH:
+        inst->value.branch.cond = leader(g, inst->value.branch.cond);
+        break;
+
+    case IR_INST_KIND_SWITCH:
+        inst->value.switch_.cond = leader(g, inst->value.switch_.cond);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void number_bb(GVN* g, IRBB* bb) {
+    size_t kept = 0;
+    for(size_t i=0; i<vector_len(bb->insts); ++i) {
+        IRInst* inst = (IRInst*)vector_at(bb->insts, i);
+        assert(inst->kind == IR_INST_KIND_LET);
+        rewrite_operands(g, inst);
+
+        IRSymbolID id = inst->value.let.id;
+        IRInstValue* v = &inst->value.let.rhs;
+
+        IRSymbolID found = id;
+        if (v->kind == IR_INST_VALUE_KIND_REF && !v->value.ref.is_global) {
+            found = v->value.ref.sym;
+        } else if (is_pure(v)) {
+            found = value_table_find_or_insert(&g->table, v, id);
+        }
+
+        if (found != id) {
+            g->leaders[id] = found;
+            // The slot is not used anymore
+            ir_function_set_local(g->f, id, 0);
+            ir_inst_destruct(inst);
+            g->removed++;
+            continue;
+        }
+
+        if (kept != i) {
+            IRInst* dest = (IRInst*)vector_at(bb->insts, kept);
+            *dest = *inst;
+        }
+        kept++;
+    }
+    vector_truncate(bb->insts, kept);
+
+    assert(bb->term);
+    rewrite_operands(g, bb->term);
+}
+
+// Incoming values of phis come from predecessors, which may be numbered after the phi, so they are rewritten at last
+static void rewrite_phis_iter(IRBB* bb, void* args) {
+    GVN* g = (GVN*)args;
+    for(size_t i=0; i<vector_len(bb->insts); ++i) {
+        IRInst* inst = (IRInst*)vector_at(bb->insts, i);
+        if (inst->value.let.rhs.kind != IR_INST_VALUE_KIND_PHI) {
+            continue;
+        }
+
+        Vector* incomings = inst->value.let.rhs.value.phi.incomings;
+        for(size_t k=0; k<vector_len(incomings); ++k) {
+            IRPhiIncoming* in = (IRPhiIncoming*)vector_at(incomings, k);
+            in->sym = leader(g, in->sym);
+        }
+    }
+}
+
+size_t ir_function_gvn(IRFunction* f) {
+    size_t insts_num = 0;
+    ir_bb_visit(f->entry, count_insts_iter, &insts_num);
+
+    GVN g;
+    g.f = f;
+    g.leaders = (IRSymbolID*)malloc(sizeof(IRSymbolID) * (f->locals_id + 1));
+    for(IRSymbolID i=0; i<f->locals_id; ++i) {
+        g.leaders[i] = i;
+    }
+    g.removed = 0;
+
+    // Twice as many buckets as instructions at least
+    size_t buckets_num = 16;
+    while(buckets_num < insts_num * 2) {
+        buckets_num *= 2;
+    }
+    g.table.buckets = (size_t*)malloc(sizeof(size_t) * buckets_num);
+    for(size_t i=0; i<buckets_num; ++i) {
+        g.table.buckets[i] = ENTRY_NONE;
+    }
+    g.table.mask = buckets_num - 1;
+    g.table.entries = vector_new(sizeof(Entry));
+
+    IRDomTree* dom = ir_dom_tree_new(f);
+
+    // Preorder of the dominator tree, without recursion since it may be as deep as nested statements
+    Vector* stack = vector_new(sizeof(WalkFrame)); // Vector<WalkFrame>
+    WalkFrame* root = (WalkFrame*)vector_append(stack);
+    root->bb = f->entry;
+    root->child = 0;
+    root->mark = 0;
+    number_bb(&g, f->entry);
+
+    while(vector_len(stack) > 0) {
+        WalkFrame* frame = (WalkFrame*)vector_at(stack, vector_len(stack) - 1);
+        Vector* children = ir_dom_tree_children(dom, frame->bb);
+        if (frame->child < vector_len(children)) {
+            IRBB* child = *(IRBB**)vector_at(children, frame->child);
+            frame->child++;
+
+            // 'frame' may be invalidated
+            WalkFrame* next = (WalkFrame*)vector_append(stack);
+            next->bb = child;
+            next->child = 0;
+            next->mark = vector_len(g.table.entries);
+            number_bb(&g, child);
+            continue;
+        }
+
+        value_table_truncate(&g.table, frame->mark);
+        vector_pop(stack);
+    }
+
+    vector_drop(stack);
+    ir_bb_visit(f->entry, rewrite_phis_iter, &g);
+    ir_dom_tree_drop(dom);
+    vector_drop(g.table.entries);
+    free(g.table.buckets);
+    free(g.leaders);
+
+    return g.removed;
+}
+
+size_t ir_module_gvn(IRModule* m) {
+    size_t removed = 0;
+    for(size_t i=0; i<vector_len(m->functions); ++i) {
+        IRFunction* f = (IRFunction*)vector_at(m->functions, i);
+        removed += ir_function_gvn(f);
+    }
+
+    return removed;
+}
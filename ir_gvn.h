@@ -0,0 +1,16 @@
+#ifndef CC_IR_GVN_H
+#define CC_IR_GVN_H
+
+#include <stddef.h>
+#include "ir.h"
+
+// Global value numbering over the dominator tree.
+// A pure value, i.e. a reference, an address, an immediate, a parameter, a binary operation or a select, is replaced by
+// an equal value computed in the same block or a dominating one, and its instruction is removed.
+// Local references are aliases, so they are always removed. Calls are never merged.
+
+// Returns the number of removed instructions
+size_t ir_function_gvn(IRFunction* f);
+size_t ir_module_gvn(IRModule* m);
+
+#endif /* CC_IR_GVN_H */
@@ -0,0 +1,271 @@
+#include <assert.h>
+#include "ir_ifconv.h"
+#include "ir_dom.h"
+#include "ir_inst_defs.h"
+#include "vector.h"
+
+// Returns 0 if the value has side effects, or may trap when it is computed regardless of the branch
+static int is_speculatable(IRInstValue* v) {
+    switch(v->kind) {
+    case IR_INST_VALUE_KIND_REF:
+    case IR_INST_VALUE_KIND_ADDR_OF:
+    case IR_INST_VALUE_KIND_IMM_INT:
+    case IR_INST_VALUE_KIND_PARAM:
+    case IR_INST_VALUE_KIND_SELECT:
+        return 1;
+
+    case IR_INST_VALUE_KIND_OP_BIN:
+        return v->value.op_bin.op != TOK_KIND_DIV && v->value.op_bin.op != TOK_KIND_MOD;
+
+    default:
+        return 0;
+    }
+}
+
+// Returns the cost of moving instructions of 'arm' into 'bb', or -1 if it can not be moved.
+// 'arm' must end with a terminator of 'term_kind'.
+static long arm_cost(IRBB* bb, IRBB* arm, IRInstKind term_kind) {
+    if (arm == bb || vector_len(arm->prevs) != 1 || *(IRBB**)vector_at(arm->prevs, 0) != bb) {
+        return -1; // Reached from other blocks too
+    }
+    if (arm->term == NULL || arm->term->kind != term_kind) {
+        return -1;
+    }
+
+    long cost = 0;
+    for(size_t i=0; i<vector_len(arm->insts); ++i) {
+        IRInst* inst = (IRInst*)vector_at(arm->insts, i);
+        assert(inst->kind == IR_INST_KIND_LET);
+
+        IRInstValue* v = &inst->value.let.rhs;
+        if (!is_speculatable(v)) {
+            return -1;
+        }
+        if (v->kind == IR_INST_VALUE_KIND_REF && !v->value.ref.is_global) {
+            continue; // Aliases are removed by GVN later
+        }
+        cost++;
+    }
+
+    return cost;
+}
+
+// Moves instructions of 'arm' to the end of 'bb'
+static void hoist_arm(IRBB* bb, IRBB* arm) {
+    for(size_t i=0; i<vector_len(arm->insts); ++i) {
+        IRInst* inst = (IRInst*)vector_at(arm->insts, i);
+        IRInst* dest = (IRInst*)vector_append(bb->insts);
+        *dest = *inst;
+    }
+    vector_truncate(arm->insts, 0);
+
+    // 'arm' is not reachable anymore
+    vector_truncate(arm->prevs, 0);
+}
+
+static IRSymbolID append_select(IRFunction* f, IRBB* bb, IRSymbolID cond, IRSymbolID then_sym, IRSymbolID else_sym) {
+    IRSymbolID sym_id = f->locals_id;
+    f->locals_id++;
+
+    IRInst* inst = (IRInst*)vector_append(bb->insts);
+    inst->kind = IR_INST_KIND_LET;
+    inst->value.let.id = sym_id;
+    inst->value.let.rhs.kind = IR_INST_VALUE_KIND_SELECT;
+    inst->value.let.rhs.value.select.cond = cond;
+    inst->value.let.rhs.value.select.then_sym = then_sym;
+    inst->value.let.rhs.value.select.else_sym = else_sym;
+    ir_function_set_local(f, sym_id, 8); // TODO: fix
+
+    return sym_id;
+}
+
+static int try_convert(IRFunction* f, IRBB* bb, size_t threshold) {
+    if (bb->term == NULL || bb->term->kind != IR_INST_KIND_BRANCH) {
+        return 0;
+    }
+    IRBB* then_bb = bb->term->value.branch.then_bb;
+    IRBB* else_bb = bb->term->value.branch.else_bb;
+    if (then_bb == else_bb) {
+        return 0;
+    }
+
+    long then_cost = arm_cost(bb, then_bb, IR_INST_KIND_RET);
+    long else_cost = arm_cost(bb, else_bb, IR_INST_KIND_RET);
+    if (then_cost < 0 || else_cost < 0 || (size_t)(then_cost + else_cost) > threshold) {
+        return 0;
+    }
+
+    IRSymbolID cond = bb->term->value.branch.cond;
+    IRSymbolID then_sym = then_bb->term->value.ret.id;
+    IRSymbolID else_sym = else_bb->term->value.ret.id;
+    hoist_arm(bb, then_bb);
+    hoist_arm(bb, else_bb);
+
+    IRSymbolID sym_id = append_select(f, bb, cond, then_sym, else_sym);
+
+    // The branch has nothing to destruct
+    bb->term->kind = IR_INST_KIND_RET;
+    bb->term->value.ret.id = sym_id;
+
+    return 1;
+}
+
+struct replace_prev_args_t {
+    IRBB* from;
+    IRBB* to;
+};
+
+// Predecessors and incomings of phis of 'next' refer to 'to' instead of 'from'
+static void replace_prev_iter(IRBB* next, void* args) {
+    struct replace_prev_args_t* r = (struct replace_prev_args_t*)args;
+    for(size_t i=0; i<vector_len(next->prevs); ++i) {
+        IRBB** prev = (IRBB**)vector_at(next->prevs, i);
+        if (*prev == r->from) {
+            *prev = r->to;
+        }
+    }
+
+    for(size_t i=0; i<vector_len(next->insts); ++i) {
+        IRInst* inst = (IRInst*)vector_at(next->insts, i);
+        if (inst->value.let.rhs.kind != IR_INST_VALUE_KIND_PHI) {
+            break;
+        }
+
+        Vector* incomings = inst->value.let.rhs.value.phi.incomings;
+        for(size_t k=0; k<vector_len(incomings); ++k) {
+            IRPhiIncoming* in = (IRPhiIncoming*)vector_at(incomings, k);
+            if (in->bb == r->from) {
+                in->bb = r->to;
+            }
+        }
+    }
+}
+
+// '&&' and '||' are built into triangles whose values are merged by a phi.
+//   bb: BR cond -> arm, join (or join, arm)
+//   arm: ..., JUMP -> join
+//   join: phi [bb: x], [arm: y], ...
+// If 'arm' is speculatable, e.g. the right operand has no calls nor divisions, they become one block.
+//   bb: ..., select cond y x (or x y), ...
+static int try_convert_phi(IRBB* bb, size_t threshold) {
+    if (bb->term == NULL || bb->term->kind != IR_INST_KIND_BRANCH) {
+        return 0;
+    }
+    IRBB* then_bb = bb->term->value.branch.then_bb;
+    IRBB* else_bb = bb->term->value.branch.else_bb;
+
+    int arm_is_then;
+    IRBB* arm;
+    IRBB* join;
+    if (then_bb->term != NULL && then_bb->term->kind == IR_INST_KIND_JUMP && then_bb->term->value.jump.next_bb == else_bb) {
+        arm_is_then = 1;
+        arm = then_bb;
+        join = else_bb;
+    } else if (else_bb->term != NULL && else_bb->term->kind == IR_INST_KIND_JUMP && else_bb->term->value.jump.next_bb == then_bb) {
+        arm_is_then = 0;
+        arm = else_bb;
+        join = then_bb;
+    } else {
+        return 0;
+    }
+
+    long cost = arm_cost(bb, arm, IR_INST_KIND_JUMP);
+    if (cost < 0 || (size_t)cost > threshold || join == bb || vector_len(join->prevs) != 2) {
+        return 0;
+    }
+
+    // One phi of two incomings, which is what the builder makes
+    if (vector_len(join->insts) == 0) {
+        return 0;
+    }
+    IRInst* phi = (IRInst*)vector_at(join->insts, 0);
+    if (phi->value.let.rhs.kind != IR_INST_VALUE_KIND_PHI || vector_len(phi->value.let.rhs.value.phi.incomings) != 2) {
+        return 0;
+    }
+    if (vector_len(join->insts) > 1
+        && ((IRInst*)vector_at(join->insts, 1))->value.let.rhs.kind == IR_INST_VALUE_KIND_PHI) {
+        return 0;
+    }
+
+    IRSymbolID from_bb_sym = 0;
+    IRSymbolID from_arm_sym = 0;
+    int found = 0;
+    Vector* incomings = phi->value.let.rhs.value.phi.incomings;
+    for(size_t i=0; i<vector_len(incomings); ++i) {
+        IRPhiIncoming* in = (IRPhiIncoming*)vector_at(incomings, i);
+        if (in->bb == bb) {
+            from_bb_sym = in->sym;
+            found |= 1;
+        } else if (in->bb == arm) {
+            from_arm_sym = in->sym;
+            found |= 2;
+        }
+    }
+    if (found != 3) {
+        return 0;
+    }
+
+    IRSymbolID cond = bb->term->value.branch.cond;
+    hoist_arm(bb, arm);
+
+    // The phi becomes a select of the same symbol
+    ir_inst_value_destruct(&phi->value.let.rhs);
+    phi->value.let.rhs.kind = IR_INST_VALUE_KIND_SELECT;
+    phi->value.let.rhs.value.select.cond = cond;
+    phi->value.let.rhs.value.select.then_sym = arm_is_then ? from_arm_sym : from_bb_sym;
+    phi->value.let.rhs.value.select.else_sym = arm_is_then ? from_bb_sym : from_arm_sym;
+
+    // 'join' is reached only from 'bb' now, so it is merged into 'bb'
+    for(size_t i=0; i<vector_len(join->insts); ++i) {
+        IRInst* inst = (IRInst*)vector_at(join->insts, i);
+        IRInst* dest = (IRInst*)vector_append(bb->insts);
+        *dest = *inst;
+    }
+    vector_truncate(join->insts, 0);
+    vector_truncate(join->prevs, 0);
+
+    // The branch has nothing to destruct, and is left in 'join' which is not reachable anymore
+    IRInst* term = bb->term;
+    bb->term = join->term;
+    join->term = term;
+    join->term->kind = IR_INST_KIND_JUMP;
+    join->term->value.jump.next_bb = join;
+
+    struct replace_prev_args_t r = { join, bb };
+    ir_bb_foreach_nexts(bb, replace_prev_iter, &r);
+
+    return 1;
+}
+
+size_t ir_function_if_convert(IRFunction* f, size_t threshold) {
+    if (threshold == 0) {
+        return 0;
+    }
+
+    IRDomTree* dom = ir_dom_tree_new(f);
+
+    // Inner diamonds come later in reverse postorder, so they are converted first and outer ones may follow.
+    // A merged block ends with the terminator of its join, which may be converted again.
+    size_t converted = 0;
+    for(size_t i=ir_dom_tree_len(dom); i>0; --i) {
+        IRBB* bb = ir_dom_tree_rpo_at(dom, i - 1);
+        converted += (size_t)try_convert(f, bb, threshold);
+        while(try_convert_phi(bb, threshold)) {
+            converted++;
+        }
+    }
+
+    ir_dom_tree_drop(dom);
+
+    return converted;
+}
+
+size_t ir_module_if_convert(IRModule* m, size_t threshold) {
+    size_t converted = 0;
+    for(size_t i=0; i<vector_len(m->functions); ++i) {
+        IRFunction* f = (IRFunction*)vector_at(m->functions, i);
+        converted += ir_function_if_convert(f, threshold);
+    }
+
+    return converted;
+}
@@ -0,0 +1,19 @@
+#ifndef CC_IR_IFCONV_H
+#define CC_IR_IFCONV_H
+
+#include <stddef.h>
+#include "ir.h"
+
+// If-conversion of small diamonds, e.g. "if (a < b) { return a; } return b;".
+// A branch whose both successors only compute side-effect free values and return one of them is replaced by
+// the values computed unconditionally, a select of them, and a return of the select.
+// Values which may trap, i.e. division and modulo, are not computed speculatively.
+
+#define IR_IFCONV_DEFAULT_THRESHOLD 8
+
+// 'threshold' is the maximum number of instructions moved out of both successors, 0 disables the conversion.
+// Returns the number of converted branches
+size_t ir_function_if_convert(IRFunction* f, size_t threshold);
+size_t ir_module_if_convert(IRModule* m, size_t threshold);
+
+#endif /* CC_IR_IFCONV_H */
@@ -13,11 +13,17 @@ void ir_inst_value_destruct(IRInstValue* v) {
     case IR_INST_VALUE_KIND_ADDR_OF:
     case IR_INST_VALUE_KIND_IMM_INT:
     case IR_INST_VALUE_KIND_OP_BIN:
+    case IR_INST_VALUE_KIND_PARAM:
+    case IR_INST_VALUE_KIND_SELECT:
         break; // DO NOTHING
 
     case IR_INST_VALUE_KIND_CALL:
         vector_drop(v->value.call.args);
         break;
+
+    case IR_INST_VALUE_KIND_PHI:
+        vector_drop(v->value.phi.incomings);
+        break;
     }
 }
 
@@ -25,4 +31,7 @@ void ir_inst_destruct(IRInst* inst) {
     if (inst->kind == IR_INST_KIND_LET) {
         ir_inst_value_destruct(&inst->value.let.rhs);
     }
+    if (inst->kind == IR_INST_KIND_SWITCH) {
+        vector_drop(inst->value.switch_.cases);
+    }
 }
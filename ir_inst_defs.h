@@ -13,14 +13,25 @@ enum ir_inst_value_kind_t {
     IR_INST_VALUE_KIND_IMM_INT,
     IR_INST_VALUE_KIND_OP_BIN,
     IR_INST_VALUE_KIND_CALL,
+    IR_INST_VALUE_KIND_PARAM,
+    IR_INST_VALUE_KIND_SELECT,
+    IR_INST_VALUE_KIND_PHI,
 };
 
+typedef struct {
+    IRBB* bb;           // A predecessor of the block of the phi
+    IRSymbolID sym;     // The value if the block is entered from 'bb'
+} IRPhiIncoming;
+
 // TODO: encapsulate
 struct ir_inst_value_t {
     IRInstValueKind kind;
     union {
         char const* symbol;
-        char const* string;
+        struct {
+            char const* buf; // reference, may contain '\0'
+            size_t len;
+        } string;
         struct {
             int is_global;
             IRSymbolID sym;
@@ -28,16 +39,28 @@ struct ir_inst_value_t {
         struct {
             IRSymbolID sym;
         } addr_of;
-        int imm_int;
+        long imm_int;
         struct {
-            Token* op; // TODO: fix
+            TokenKind op;
             IRSymbolID lhs;
             IRSymbolID rhs;
         } op_bin;
         struct {
             IRSymbolID lhs;
             Vector* args; // Vector<IRSymbolID>
+            int is_tail;  // The result is returned by the following RET
         } call;
+        struct {
+            size_t index;
+        } param;
+        struct {
+            IRSymbolID cond;
+            IRSymbolID then_sym; // The result if 'cond' is not 0
+            IRSymbolID else_sym;
+        } select;
+        struct {
+            Vector* incomings; // Vector<IRPhiIncoming>, one for each predecessor
+        } phi;
     } value;
 };
 
@@ -46,8 +69,14 @@ enum ir_inst_kind_t {
     IR_INST_KIND_RET,
     IR_INST_KIND_BRANCH,
     IR_INST_KIND_JUMP,
+    IR_INST_KIND_SWITCH,
 };
 
+typedef struct {
+    long value;
+    IRBB* bb;
+} IRSwitchCase;
+
 // TODO: encapsulate
 struct ir_inst_t {
     IRInstKind kind;
@@ -67,6 +96,11 @@ struct ir_inst_t {
         struct {
             IRBB* next_bb;
         } jump;
+        struct {
+            IRSymbolID cond;
+            Vector* cases;      // Vector<IRSwitchCase>, sorted by values which are unique
+            IRBB* default_bb;   // Taken if no case matches
+        } switch_;
     } value;
 };
 
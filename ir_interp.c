@@ -0,0 +1,570 @@
+#define _GNU_SOURCE // RTLD_DEFAULT
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include "ir_interp.h"
+#include "ir_inst_defs.h"
+#include "vector.h"
+#include "map.h"
+
+// Frames are on the heap, so the limit is not bounded by the C stack
+#define IR_INTERP_MAX_DEPTH (1 << 20)
+#define IR_INTERP_MAX_ARGS 16
+
+typedef enum ir_interp_value_kind_t {
+    IR_INTERP_VALUE_KIND_UNDEF,
+    IR_INTERP_VALUE_KIND_INT,
+    IR_INTERP_VALUE_KIND_PTR,
+    IR_INTERP_VALUE_KIND_FUNC,
+    IR_INTERP_VALUE_KIND_FFI,
+} IRInterpValueKind;
+
+typedef struct ir_interp_value_t {
+    IRInterpValueKind kind;
+    union {
+        long i;
+        char const* ptr;
+        IRFunction* func;
+        struct {
+            void* fn;
+            int variadic;
+        } ffi;
+        char const* undef; // Name of an unresolved symbol, Nullable
+    } value;
+} IRInterpValue;
+
+// A call in progress. Arguments are followed by the register file in the register stack.
+typedef struct ir_interp_frame_t {
+    IRFunction* f;
+    size_t args_base;
+    size_t args_num;
+    size_t base;            // Register file
+    IRBB* bb;
+    IRBB* prev_bb;          // The block which jumped to 'bb', NULL at the entry
+    size_t index;           // Next instruction in 'bb'
+    IRSymbolID ret_id;      // Receives the result in the caller
+} IRInterpFrame;
+
+typedef struct ir_interp_ffi_t {
+    char const* name;
+    void* fn;
+    int variadic;
+} IRInterpFFI;
+
+// Known libc functions. Others are resolved by dlsym and called as int(long, ...) without varargs.
+static IRInterpFFI const ffi_table[] = {
+    { "puts", (void*)puts, 0 },
+    { "putchar", (void*)putchar, 0 },
+    { "printf", (void*)printf, 1 },
+};
+
+struct ir_interp_t {
+    IRModule* mod;              // reference
+    StringMap* functions;       // StringMap<IRFunction*>
+    IRInterpValue* globals;     // Indexed by IRSymbolID of definitions
+    size_t globals_len;
+
+    // Register files of active calls
+    IRInterpValue* regs;
+    size_t regs_len;
+    size_t regs_cap;
+
+    // Active calls
+    IRInterpFrame* frames;
+    size_t frames_len;
+    size_t frames_cap;
+
+    // Stats
+    size_t executed_insts;
+    size_t calls;
+    size_t tail_calls;
+    size_t ffi_calls;
+};
+
+static int resolve_symbol(IRInterp* interp, char const* name, IRInterpValue* out) {
+    IRFunction** f = string_map_find(interp->functions, name);
+    if (f) {
+        out->kind = IR_INTERP_VALUE_KIND_FUNC;
+        out->value.func = *f;
+        return 0;
+    }
+
+    for(size_t i=0; i<sizeof(ffi_table)/sizeof(ffi_table[0]); ++i) {
+        if (strcmp(ffi_table[i].name, name) == 0) {
+            out->kind = IR_INTERP_VALUE_KIND_FFI;
+            out->value.ffi.fn = ffi_table[i].fn;
+            out->value.ffi.variadic = ffi_table[i].variadic;
+            return 0;
+        }
+    }
+
+    void* fn = dlsym(RTLD_DEFAULT, name);
+    if (fn) {
+        out->kind = IR_INTERP_VALUE_KIND_FFI;
+        out->value.ffi.fn = fn;
+        out->value.ffi.variadic = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+IRInterp* ir_interp_new(IRModule* m) {
+    IRInterp* interp = (IRInterp*)malloc(sizeof(IRInterp));
+    interp->mod = m;
+    interp->functions = string_map_new(sizeof(IRFunction*), NULL);
+    interp->globals_len = m->defs_sym_id;
+    interp->globals = (IRInterpValue*)calloc(interp->globals_len + 1, sizeof(IRInterpValue));
+    interp->regs = NULL;
+    interp->regs_len = 0;
+    interp->regs_cap = 0;
+    interp->frames = NULL;
+    interp->frames_len = 0;
+    interp->frames_cap = 0;
+    interp->executed_insts = 0;
+    interp->calls = 0;
+    interp->tail_calls = 0;
+    interp->ffi_calls = 0;
+
+    for(size_t i=0; i<vector_len(m->functions); ++i) {
+        IRFunction* f = vector_at(m->functions, i);
+        IRFunction** e = string_map_insert(interp->functions, f->name, NULL);
+        *e = f;
+    }
+
+    // Definitions are evaluated once
+    for(size_t i=0; i<vector_len(m->definitions); ++i) {
+        IRInst* inst = vector_at(m->definitions, i);
+        assert(inst->kind == IR_INST_KIND_LET);
+        IRSymbolID id = inst->value.let.id;
+        IRInstValue* rhs = &inst->value.let.rhs;
+        assert(id < interp->globals_len);
+
+        IRInterpValue* g = &interp->globals[id];
+        switch(rhs->kind) {
+        case IR_INST_VALUE_KIND_SYMBOL:
+            if (resolve_symbol(interp, rhs->value.symbol, g)) {
+                // Reported when it is used
+                g->kind = IR_INTERP_VALUE_KIND_UNDEF;
+                g->value.undef = rhs->value.symbol;
+            }
+            break;
+
+        case IR_INST_VALUE_KIND_STRING:
+            // Pooled strings are terminated by '\0'
+            g->kind = IR_INTERP_VALUE_KIND_PTR;
+            g->value.ptr = rhs->value.string.buf;
+            break;
+
+        default:
+            fprintf(stderr, "Unexpected kind: %d\n", rhs->kind);
+            assert(0); // TODO: error handling
+        }
+    }
+
+    return interp;
+}
+
+void ir_interp_drop(IRInterp* interp) {
+    free(interp->frames);
+    free(interp->regs);
+    free(interp->globals);
+    string_map_drop(interp->functions);
+
+    free(interp);
+}
+
+static long value_to_word(IRInterpValue* v) {
+    switch(v->kind) {
+    case IR_INTERP_VALUE_KIND_INT:
+        return v->value.i;
+
+    case IR_INTERP_VALUE_KIND_PTR:
+        return (long)v->value.ptr;
+
+    default:
+        return 0;
+    }
+}
+
+// '&&' and '||' are not binary operations in the IR, since their right operands are evaluated by branches
+static int eval_op_bin(TokenKind op, long lhs, long rhs, long* out) {
+    switch(op) {
+    case TOK_KIND_PLUS:         *out = lhs + rhs; return 0;
+    case TOK_KIND_MINUS:        *out = lhs - rhs; return 0;
+    case TOK_KIND_MUL:          *out = lhs * rhs; return 0;
+    case TOK_KIND_DIV:
+        if (rhs == 0) {
+            return 1;
+        }
+        *out = lhs / rhs;
+        return 0;
+    case TOK_KIND_MOD:
+        if (rhs == 0) {
+            return 1;
+        }
+        *out = lhs % rhs;
+        return 0;
+    case TOK_KIND_AND:          *out = lhs & rhs; return 0;
+    case TOK_KIND_OR:           *out = lhs | rhs; return 0;
+    case TOK_KIND_XOR:          *out = lhs ^ rhs; return 0;
+    case TOK_KIND_LSHIFT:       *out = lhs << rhs; return 0;
+    case TOK_KIND_RSHIFT:       *out = lhs >> rhs; return 0;
+    case TOK_KIND_LT:           *out = lhs < rhs; return 0;
+    case TOK_KIND_GT:           *out = lhs > rhs; return 0;
+    case TOK_KIND_LE:           *out = lhs <= rhs; return 0;
+    case TOK_KIND_GE:           *out = lhs >= rhs; return 0;
+    case TOK_KIND_EQ:           *out = lhs == rhs; return 0;
+    case TOK_KIND_NE:           *out = lhs != rhs; return 0;
+    default:
+        return 1;
+    }
+}
+
+static int call_ffi(IRInterp* interp, IRInterpValue* callee, long* args, IRInterpValue* result) {
+    interp->ffi_calls++;
+
+    // Integer and pointer arguments are passed in registers and then on the stack in order by SysV ABI,
+    // so extra arguments are harmless
+    int r;
+    if (callee->value.ffi.variadic) {
+        int (*fn)(long, ...) = (int (*)(long, ...))callee->value.ffi.fn;
+        r = fn(args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7],
+               args[8], args[9], args[10], args[11], args[12], args[13], args[14], args[15]);
+    } else {
+        int (*fn)(long, long, long, long, long, long, long, long,
+                  long, long, long, long, long, long, long, long) =
+            (int (*)(long, long, long, long, long, long, long, long,
+                     long, long, long, long, long, long, long, long))callee->value.ffi.fn;
+        r = fn(args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7],
+               args[8], args[9], args[10], args[11], args[12], args[13], args[14], args[15]);
+    }
+
+    result->kind = IR_INTERP_VALUE_KIND_INT;
+    result->value.i = r;
+    return 0;
+}
+
+// Register files are held in one stack, so they are accessed by the base index since it may be reallocated
+#define REG(id) (interp->regs[base + (id)])
+
+// 'args' are arguments of the current call, and 'prev_bb' is the block which jumped to the current one
+static int eval_let(IRInterp* interp, size_t base, IRInterpValue* args, size_t args_num, IRBB* prev_bb, IRInst* inst) {
+    IRInstValue* rhs = &inst->value.let.rhs;
+    IRInterpValue v;
+
+    switch(rhs->kind) {
+    case IR_INST_VALUE_KIND_REF:
+        if (rhs->value.ref.is_global) {
+            assert(rhs->value.ref.sym < interp->globals_len);
+            v = interp->globals[rhs->value.ref.sym];
+        } else {
+            v = REG(rhs->value.ref.sym);
+        }
+        break;
+
+    case IR_INST_VALUE_KIND_ADDR_OF:
+        // Only addresses of objects held by a reference, e.g. string literals
+        v = REG(rhs->value.addr_of.sym);
+        if (v.kind != IR_INTERP_VALUE_KIND_PTR) {
+            fprintf(stderr, "INTERP: unsupported address of %%%ld\n", rhs->value.addr_of.sym);
+            return 1;
+        }
+        break;
+
+    case IR_INST_VALUE_KIND_IMM_INT:
+        v.kind = IR_INTERP_VALUE_KIND_INT;
+        v.value.i = rhs->value.imm_int;
+        break;
+
+    case IR_INST_VALUE_KIND_PARAM:
+        if (rhs->value.param.index >= args_num) {
+            fprintf(stderr, "INTERP: too few arguments\n");
+            return 1;
+        }
+        v = args[rhs->value.param.index];
+        break;
+
+    case IR_INST_VALUE_KIND_SELECT:
+        v = value_to_word(&REG(rhs->value.select.cond)) != 0
+            ? REG(rhs->value.select.then_sym)
+            : REG(rhs->value.select.else_sym);
+        break;
+
+    case IR_INST_VALUE_KIND_PHI:
+    {
+        Vector* incomings = rhs->value.phi.incomings;
+        size_t i = 0;
+        while(i < vector_len(incomings) && ((IRPhiIncoming*)vector_at(incomings, i))->bb != prev_bb) {
+            i++;
+        }
+        if (i == vector_len(incomings)) {
+            fprintf(stderr, "INTERP: no incoming of %%%ld\n", inst->value.let.id);
+            return 1;
+        }
+        v = REG(((IRPhiIncoming*)vector_at(incomings, i))->sym);
+        break;
+    }
+
+    case IR_INST_VALUE_KIND_OP_BIN:
+    {
+        long lhs = value_to_word(&REG(rhs->value.op_bin.lhs));
+        long r = value_to_word(&REG(rhs->value.op_bin.rhs));
+        v.kind = IR_INTERP_VALUE_KIND_INT;
+        if (eval_op_bin(rhs->value.op_bin.op, lhs, r, &v.value.i)) {
+            fprintf(stderr, "INTERP: failed to evaluate %s\n", token_kind_to_string(rhs->value.op_bin.op));
+            return 1;
+        }
+        break;
+    }
+
+    default:
+        fprintf(stderr, "Unexpected kind: %d\n", rhs->kind);
+        return 1;
+    }
+
+    REG(inst->value.let.id) = v;
+    return 0;
+}
+
+// Pushes a frame of 'f' whose result is stored to 'ret_id' of the caller.
+// Arguments are copied, so 'args' may point to the register stack.
+static int push_frame(IRInterp* interp, IRFunction* f, IRInterpValue const* args, size_t args_num, IRSymbolID ret_id) {
+    if (interp->frames_len >= IR_INTERP_MAX_DEPTH) {
+        fprintf(stderr, "INTERP: too deep calls: %s\n", f->name);
+        return 1;
+    }
+    interp->calls++;
+
+    if (interp->frames_len == interp->frames_cap) {
+        size_t cap = interp->frames_cap == 0 ? 64 : interp->frames_cap * 2;
+        IRInterpFrame* frames = (IRInterpFrame*)realloc(interp->frames, sizeof(IRInterpFrame) * cap);
+        if (frames == NULL) {
+            fprintf(stderr, "INTERP: out of memory: %s\n", f->name);
+            return 1;
+        }
+        interp->frames = frames;
+        interp->frames_cap = cap;
+    }
+
+    // Allocate arguments and a register file
+    size_t args_base = interp->regs_len;
+    size_t regs_num = args_num + f->locals_id;
+    if (args_base + regs_num > interp->regs_cap) {
+        size_t cap = interp->regs_cap == 0 ? 1024 : interp->regs_cap;
+        while(cap < args_base + regs_num) {
+            cap *= 2;
+        }
+        IRInterpValue* regs = (IRInterpValue*)realloc(interp->regs, sizeof(IRInterpValue) * cap);
+        if (regs == NULL) {
+            fprintf(stderr, "INTERP: out of memory: %s\n", f->name);
+            return 1;
+        }
+        interp->regs = regs;
+        interp->regs_cap = cap;
+    }
+    if (args_num > 0) {
+        memmove(&interp->regs[args_base], args, sizeof(IRInterpValue) * args_num);
+    }
+    memset(&interp->regs[args_base + args_num], 0, sizeof(IRInterpValue) * f->locals_id);
+    interp->regs_len += regs_num;
+
+    IRInterpFrame* frame = &interp->frames[interp->frames_len++];
+    frame->f = f;
+    frame->args_base = args_base;
+    frame->args_num = args_num;
+    frame->base = args_base + args_num;
+    frame->bb = f->entry;
+    frame->prev_bb = NULL;
+    frame->index = 0;
+    frame->ret_id = ret_id;
+    return 0;
+}
+
+static void pop_frame(IRInterp* interp) {
+    assert(interp->frames_len > 0);
+    IRInterpFrame* frame = &interp->frames[--interp->frames_len];
+    interp->regs_len = frame->args_base;
+}
+
+// 'inst' is the call at 'frame->index - 1' of the frame at the top.
+// Calls of defined functions push a frame, and others are completed here.
+static int eval_call(IRInterp* interp, IRInst* inst) {
+    IRInterpFrame* frame = &interp->frames[interp->frames_len - 1];
+    size_t base = frame->base;
+    IRInstValue* rhs = &inst->value.let.rhs;
+    IRInterpValue callee = REG(rhs->value.call.lhs);
+
+    Vector* call_args = rhs->value.call.args;
+    size_t call_args_num = vector_len(call_args);
+    if (call_args_num > IR_INTERP_MAX_ARGS) {
+        fprintf(stderr, "INTERP: too many arguments\n");
+        return 1;
+    }
+    IRInterpValue call_values[IR_INTERP_MAX_ARGS];
+    for(size_t i=0; i<call_args_num; ++i) {
+        IRSymbolID* a = vector_at(call_args, i);
+        call_values[i] = REG(*a);
+    }
+
+    switch(callee.kind) {
+    case IR_INTERP_VALUE_KIND_FUNC:
+    {
+        // Tail calls replace the frame of the caller as the native code does,
+        // if the result is returned as is, i.e. "return f(x);"
+        IRBB* bb = frame->bb;
+        if (rhs->value.call.is_tail
+            && frame->index == vector_len(bb->insts)
+            && bb->term->kind == IR_INST_KIND_RET
+            && bb->term->value.ret.id == inst->value.let.id) {
+            IRSymbolID ret_id = frame->ret_id;
+            pop_frame(interp);
+            interp->tail_calls++;
+            return push_frame(interp, callee.value.func, call_values, call_args_num, ret_id);
+        }
+        return push_frame(interp, callee.value.func, call_values, call_args_num, inst->value.let.id);
+    }
+
+    case IR_INTERP_VALUE_KIND_FFI:
+    {
+        long words[IR_INTERP_MAX_ARGS] = {0};
+        for(size_t i=0; i<call_args_num; ++i) {
+            words[i] = value_to_word(&call_values[i]);
+        }
+        IRInterpValue v;
+        if (call_ffi(interp, &callee, words, &v)) {
+            return 1;
+        }
+        REG(inst->value.let.id) = v;
+        return 0;
+    }
+
+    case IR_INTERP_VALUE_KIND_UNDEF:
+        fprintf(stderr, "INTERP: undefined symbol: %s\n", callee.value.undef ? callee.value.undef : "?");
+        return 1;
+
+    default:
+        fprintf(stderr, "INTERP: not callable: %%%ld\n", rhs->value.call.lhs);
+        return 1;
+    }
+}
+
+// Runs frames until the frame at 'bottom' returns.
+// Calls are not nested on the C stack, so deep recursions fail by the limit instead of a stack overflow.
+static int execute(IRInterp* interp, size_t bottom, IRInterpValue* result) {
+    while(interp->frames_len > bottom) {
+        IRInterpFrame* frame = &interp->frames[interp->frames_len - 1];
+        size_t base = frame->base;
+        IRBB* bb = frame->bb;
+
+        if (frame->index < vector_len(bb->insts)) {
+            IRInst* inst = vector_at(bb->insts, frame->index++);
+            assert(inst->kind == IR_INST_KIND_LET);
+            interp->executed_insts++;
+
+            int err = inst->value.let.rhs.kind == IR_INST_VALUE_KIND_CALL
+                ? eval_call(interp, inst)
+                : eval_let(interp, base, &interp->regs[frame->args_base], frame->args_num, frame->prev_bb, inst);
+            if (err) {
+                return 1;
+            }
+            continue;
+        }
+
+        IRInst* term = bb->term;
+        assert(term);
+        interp->executed_insts++;
+
+        switch(term->kind) {
+        case IR_INST_KIND_RET:
+        {
+            IRInterpValue v = REG(term->value.ret.id);
+            IRSymbolID ret_id = frame->ret_id;
+            pop_frame(interp);
+            if (interp->frames_len == bottom) {
+                *result = v;
+            } else {
+                base = interp->frames[interp->frames_len - 1].base;
+                REG(ret_id) = v;
+            }
+            continue;
+        }
+
+        case IR_INST_KIND_BRANCH:
+            bb = value_to_word(&REG(term->value.branch.cond)) != 0
+                ? term->value.branch.then_bb
+                : term->value.branch.else_bb;
+            break;
+
+        case IR_INST_KIND_JUMP:
+            bb = term->value.jump.next_bb;
+            break;
+
+        case IR_INST_KIND_SWITCH:
+        {
+            // Binary search over sorted cases
+            // Compared in 64bits as the native code does
+            long cond = value_to_word(&REG(term->value.switch_.cond));
+            Vector* cases = term->value.switch_.cases;
+            size_t lo = 0;
+            size_t hi = vector_len(cases);
+            bb = term->value.switch_.default_bb;
+            while(lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                IRSwitchCase* c = (IRSwitchCase*)vector_at(cases, mid);
+                if (c->value == cond) {
+                    bb = c->bb;
+                    break;
+                }
+                if (c->value < cond) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            break;
+        }
+
+        default:
+            fprintf(stderr, "Unexpected kind: %d\n", term->kind);
+            return 1;
+        }
+
+        frame->prev_bb = frame->bb;
+        frame->bb = bb;
+        frame->index = 0;
+    }
+
+    return 0;
+}
+
+#undef REG
+
+int ir_interp_run(IRInterp* interp, char const* entry, long* result) {
+    IRFunction** f = string_map_find(interp->functions, entry);
+    if (f == NULL) {
+        fprintf(stderr, "INTERP: entry is not found: %s\n", entry);
+        return 1;
+    }
+
+    // Frames are left by errors
+    size_t bottom = interp->frames_len;
+    size_t regs_len = interp->regs_len;
+    IRInterpValue v;
+    if (push_frame(interp, *f, NULL, 0, 0) || execute(interp, bottom, &v)) {
+        interp->frames_len = bottom;
+        interp->regs_len = regs_len;
+        return 1;
+    }
+    *result = value_to_word(&v);
+
+    return 0;
+}
+
+void ir_interp_fprint_stats(FILE* fp, IRInterp* interp) {
+    fprintf(fp, "executed insts: %zu\n", interp->executed_insts);
+    fprintf(fp, "calls: %zu\n", interp->calls);
+    fprintf(fp, "tail calls: %zu\n", interp->tail_calls);
+    fprintf(fp, "ffi calls: %zu\n", interp->ffi_calls);
+}
@@ -0,0 +1,24 @@
+#ifndef CC_IR_INTERP_H
+#define CC_IR_INTERP_H
+
+#include <stdio.h>
+#include "ir.h"
+
+// Evaluates IRModule directly without code generation.
+// Locals of a call are held in a dense register file indexed by IRSymbolID.
+// Functions which are not defined in the module are called through a small FFI to libc.
+
+struct ir_interp_t;
+typedef struct ir_interp_t IRInterp;
+
+// 'm' is a reference, and must outlive the interpreter
+IRInterp* ir_interp_new(IRModule* m);
+void ir_interp_drop(IRInterp* interp);
+
+// Calls 'entry' without arguments. Returns 0 on success.
+int ir_interp_run(IRInterp* interp, char const* entry, long* result);
+
+// Executed instructions and calls
+void ir_interp_fprint_stats(FILE* fp, IRInterp* interp);
+
+#endif /* CC_IR_INTERP_H */
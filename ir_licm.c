@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <assert.h>
+#include "ir_licm.h"
+#include "ir_dom.h"
+#include "ir_loop.h"
+#include "ir_inst_defs.h"
+#include "vector.h"
+
+typedef struct {
+    IRFunction* f;              // reference
+    IRBB** def_bbs;             // Indexed by IRSymbolID, the block which defines the symbol
+    char* safe_divisors;        // Indexed by IRSymbolID, 1 for immediates other than 0 and -1
+    size_t moved;
+} LICM;
+
+static int is_defined_outside(LICM* l, IRLoop* loop, IRSymbolID id) {
+    assert(id < l->f->locals_id);
+    IRBB* bb = l->def_bbs[id];
+    return bb == NULL || !ir_loop_contains(loop, bb);
+}
+
+// Returns 1 if the value is pure, never traps, and its operands are defined outside 'loop'
+static int is_invariant(LICM* l, IRLoop* loop, IRInstValue* v) {
+    switch(v->kind) {
+    case IR_INST_VALUE_KIND_REF:
+        return v->value.ref.is_global || is_defined_outside(l, loop, v->value.ref.sym);
+
+    case IR_INST_VALUE_KIND_ADDR_OF:
+        return is_defined_outside(l, loop, v->value.addr_of.sym);
+
+    case IR_INST_VALUE_KIND_IMM_INT:
+        return 1;
+
+    case IR_INST_VALUE_KIND_OP_BIN:
+        if ((v->value.op_bin.op == TOK_KIND_DIV || v->value.op_bin.op == TOK_KIND_MOD)
+            && !l->safe_divisors[v->value.op_bin.rhs]) {
+            return 0;
+        }
+        return is_defined_outside(l, loop, v->value.op_bin.lhs) && is_defined_outside(l, loop, v->value.op_bin.rhs);
+
+    case IR_INST_VALUE_KIND_SELECT:
+        return is_defined_outside(l, loop, v->value.select.cond)
+            && is_defined_outside(l, loop, v->value.select.then_sym)
+            && is_defined_outside(l, loop, v->value.select.else_sym);
+
+    default:
+        // Calls have side effects, and parameters are read at the entry
+        return 0;
+    }
+}
+
+static void hoist_loop(LICM* l, IRLoop* loop) {
+    IRBB* preheader = loop->preheader;
+    if (preheader == NULL) {
+        return;
+    }
+
+    // Operands come before their uses in reverse postorder, so one pass moves chains of invariant values
+    for(size_t i=0; i<vector_len(loop->bbs); ++i) {
+        IRBB* bb = *(IRBB**)vector_at(loop->bbs, i);
+
+        size_t kept = 0;
+        for(size_t k=0; k<vector_len(bb->insts); ++k) {
+            IRInst* inst = (IRInst*)vector_at(bb->insts, k);
+            assert(inst->kind == IR_INST_KIND_LET);
+
+            if (is_invariant(l, loop, &inst->value.let.rhs)) {
+                IRInst* dest = (IRInst*)vector_append(preheader->insts);
+                *dest = *inst;
+                l->def_bbs[inst->value.let.id] = preheader;
+                l->moved++;
+                continue;
+            }
+
+            if (kept != k) {
+                IRInst* dest = (IRInst*)vector_at(bb->insts, kept);
+                *dest = *inst;
+            }
+            kept++;
+        }
+        vector_truncate(bb->insts, kept);
+    }
+}
+
+size_t ir_function_licm(IRFunction* f) {
+    ir_function_insert_preheaders(f);
+
+    IRDomTree* dom = ir_dom_tree_new(f);
+    IRLoopForest* lf = ir_loop_forest_new(f, dom);
+    if (ir_loop_forest_len(lf) == 0) {
+        ir_loop_forest_drop(lf);
+        ir_dom_tree_drop(dom);
+        return 0;
+    }
+
+    LICM l;
+    l.f = f;
+    l.def_bbs = (IRBB**)calloc(f->locals_id + 1, sizeof(IRBB*));
+    l.safe_divisors = (char*)calloc(f->locals_id + 1, sizeof(char));
+    assert(l.def_bbs && l.safe_divisors); // TODO: error handling...
+    l.moved = 0;
+
+    for(size_t i=0; i<ir_dom_tree_len(dom); ++i) {
+        IRBB* bb = ir_dom_tree_rpo_at(dom, i);
+        for(size_t k=0; k<vector_len(bb->insts); ++k) {
+            IRInst* inst = (IRInst*)vector_at(bb->insts, k);
+            IRInstValue* v = &inst->value.let.rhs;
+
+            l.def_bbs[inst->value.let.id] = bb;
+            if (v->kind == IR_INST_VALUE_KIND_IMM_INT && v->value.imm_int != 0 && v->value.imm_int != -1) {
+                l.safe_divisors[inst->value.let.id] = 1;
+            }
+        }
+    }
+
+    for(size_t i=0; i<ir_loop_forest_len(lf); ++i) {
+        hoist_loop(&l, ir_loop_forest_at(lf, i));
+    }
+
+    free(l.safe_divisors);
+    free(l.def_bbs);
+    ir_loop_forest_drop(lf);
+    ir_dom_tree_drop(dom);
+
+    return l.moved;
+}
+
+size_t ir_module_licm(IRModule* m) {
+    size_t moved = 0;
+    for(size_t i=0; i<vector_len(m->functions); ++i) {
+        IRFunction* f = (IRFunction*)vector_at(m->functions, i);
+        moved += ir_function_licm(f);
+    }
+
+    return moved;
+}
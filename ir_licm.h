@@ -0,0 +1,18 @@
+#ifndef CC_IR_LICM_H
+#define CC_IR_LICM_H
+
+#include <stddef.h>
+#include "ir.h"
+
+// Loop-invariant code motion.
+// A pure value in a loop whose operands are all defined outside the loop, e.g. "n * 3" in "while (f()) { g(n * 3); }",
+// is computed once in the preheader of the loop instead of every iteration. Inner loops are processed first,
+// so values moved into their preheaders may be moved further out of enclosing loops.
+// The preheader runs even if the loop body does not, so values which may trap are only moved if they never trap,
+// i.e. division and modulo by a constant other than 0 and -1.
+
+// Returns the number of moved instructions
+size_t ir_function_licm(IRFunction* f);
+size_t ir_module_licm(IRModule* m);
+
+#endif /* CC_IR_LICM_H */
@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <assert.h>
+#include "ir_loop.h"
+#include "ir_inst_defs.h"
+#include "vector.h"
+
+struct ir_loop_forest_t {
+    IRFunction* f;          // reference
+    IRDomTree* dom;         // reference
+    Vector* loops;          // Vector<IRLoop>
+};
+
+static int is_reachable(IRLoopForest* lf, IRBB* bb) {
+    return ir_dom_tree_dominates(lf->dom, lf->f->entry, bb);
+}
+
+// Returns the loop of 'header', created if it does not exist
+static IRLoop* loop_of_header(IRLoopForest* lf, IRBB* header) {
+    for(size_t i=0; i<vector_len(lf->loops); ++i) {
+        IRLoop* loop = (IRLoop*)vector_at(lf->loops, i);
+        if (loop->header == header) {
+            return loop;
+        }
+    }
+
+    IRLoop* loop = (IRLoop*)vector_append(lf->loops);
+    loop->header = header;
+    loop->preheader = NULL;
+    loop->bbs = vector_new(sizeof(IRBB*));
+    loop->contains = (char*)calloc(lf->f->bb_id, sizeof(char));
+    assert(loop->contains); // TODO: error handling...
+    loop->contains[header->id] = 1;
+
+    return loop;
+}
+
+// Adds blocks which reach 'latch' without passing through the header
+static void add_back_edge(IRLoopForest* lf, IRLoop* loop, IRBB* latch) {
+    if (loop->contains[latch->id]) {
+        return;
+    }
+    loop->contains[latch->id] = 1;
+
+    Vector* stack = vector_new(sizeof(IRBB*)); // Vector<IRBB*>
+    IRBB** e = (IRBB**)vector_append(stack);
+    *e = latch;
+
+    while(vector_len(stack) > 0) {
+        IRBB* bb = *(IRBB**)vector_pop(stack);
+        for(size_t i=0; i<vector_len(bb->prevs); ++i) {
+            IRBB* prev = *(IRBB**)vector_at(bb->prevs, i);
+            if (loop->contains[prev->id] || !is_reachable(lf, prev)) {
+                continue;
+            }
+            loop->contains[prev->id] = 1;
+
+            e = (IRBB**)vector_append(stack);
+            *e = prev;
+        }
+    }
+
+    vector_drop(stack);
+}
+
+static IRBB* find_preheader(IRLoopForest* lf, IRLoop* loop) {
+    IRBB* preheader = NULL;
+    for(size_t i=0; i<vector_len(loop->header->prevs); ++i) {
+        IRBB* prev = *(IRBB**)vector_at(loop->header->prevs, i);
+        if (loop->contains[prev->id] || !is_reachable(lf, prev)) {
+            continue;
+        }
+        if (preheader != NULL) {
+            return NULL; // Entered from several blocks, or by both edges of a branch
+        }
+        preheader = prev;
+    }
+
+    if (preheader == NULL || preheader->term->kind != IR_INST_KIND_JUMP) {
+        return NULL;
+    }
+
+    return preheader;
+}
+
+static int cmp_loop_size(void const* a, void const* b) {
+    size_t la = vector_len(((IRLoop const*)a)->bbs);
+    size_t lb = vector_len(((IRLoop const*)b)->bbs);
+    return la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+IRLoopForest* ir_loop_forest_new(IRFunction* f, IRDomTree* dom) {
+    IRLoopForest* lf = (IRLoopForest*)malloc(sizeof(IRLoopForest));
+    assert(lf); // TODO: error handling...
+    lf->f = f;
+    lf->dom = dom;
+    lf->loops = vector_new(sizeof(IRLoop));
+
+    for(size_t i=0; i<ir_dom_tree_len(dom); ++i) {
+        IRBB* bb = ir_dom_tree_rpo_at(dom, i);
+        for(size_t k=0; k<vector_len(bb->prevs); ++k) {
+            IRBB* prev = *(IRBB**)vector_at(bb->prevs, k);
+            if (!ir_dom_tree_dominates(dom, bb, prev)) {
+                continue;
+            }
+
+            // 'loops' may be reallocated by loop_of_header
+            IRLoop* loop = loop_of_header(lf, bb);
+            add_back_edge(lf, loop, prev);
+        }
+    }
+
+    for(size_t i=0; i<vector_len(lf->loops); ++i) {
+        IRLoop* loop = (IRLoop*)vector_at(lf->loops, i);
+        for(size_t k=0; k<ir_dom_tree_len(dom); ++k) {
+            IRBB* bb = ir_dom_tree_rpo_at(dom, k);
+            if (loop->contains[bb->id]) {
+                IRBB** e = (IRBB**)vector_append(loop->bbs);
+                *e = bb;
+            }
+        }
+        loop->preheader = find_preheader(lf, loop);
+    }
+
+    // A loop has less blocks than loops enclosing it
+    if (vector_len(lf->loops) > 1) {
+        qsort(vector_at(lf->loops, 0), vector_len(lf->loops), sizeof(IRLoop), cmp_loop_size);
+    }
+
+    return lf;
+}
+
+void ir_loop_forest_drop(IRLoopForest* lf) {
+    for(size_t i=0; i<vector_len(lf->loops); ++i) {
+        IRLoop* loop = (IRLoop*)vector_at(lf->loops, i);
+        vector_drop(loop->bbs);
+        free(loop->contains);
+    }
+    vector_drop(lf->loops);
+    free(lf);
+}
+
+size_t ir_loop_forest_len(IRLoopForest* lf) {
+    return vector_len(lf->loops);
+}
+
+IRLoop* ir_loop_forest_at(IRLoopForest* lf, size_t index) {
+    return (IRLoop*)vector_at(lf->loops, index);
+}
+
+int ir_loop_contains(IRLoop* loop, IRBB* bb) {
+    return loop->contains[bb->id];
+}
+
+static void retarget(IRBB* bb, IRBB* from, IRBB* to) {
+    switch(bb->term->kind) {
+    case IR_INST_KIND_BRANCH:
+        if (bb->term->value.branch.then_bb == from) {
+            bb->term->value.branch.then_bb = to;
+        }
+        if (bb->term->value.branch.else_bb == from) {
+            bb->term->value.branch.else_bb = to;
+        }
+        break;
+
+    case IR_INST_KIND_JUMP:
+        if (bb->term->value.jump.next_bb == from) {
+            bb->term->value.jump.next_bb = to;
+        }
+        break;
+
+    case IR_INST_KIND_SWITCH:
+    {
+        Vector* cases = bb->term->value.switch_.cases;
+        for(size_t i=0; i<vector_len(cases); ++i) {
+            IRSwitchCase* c = (IRSwitchCase*)vector_at(cases, i);
+            if (c->bb == from) {
+                c->bb = to;
+            }
+        }
+        if (bb->term->value.switch_.default_bb == from) {
+            bb->term->value.switch_.default_bb = to;
+        }
+        break;
+    }
+
+    default:
+        assert(0); // unreachable
+    }
+}
+
+// 'outside' is a Vector<IRBB*> of predecessors of 'header' entering the loop
+static void insert_preheader(IRFunction* f, IRBB* header, Vector* outside) {
+    IRBB* preheader = ir_bb_arena_malloc(f->bb_arena);
+    ir_bb_construct(preheader, f->bb_id);
+    f->bb_id++;
+
+    preheader->term = (IRInst*)malloc(sizeof(IRInst));
+    preheader->term->kind = IR_INST_KIND_JUMP;
+    preheader->term->value.jump.next_bb = header;
+
+    // A block is in 'prevs' once for each edge, e.g. twice for a branch whose both edges enter the loop
+    size_t kept = 0;
+    for(size_t i=0; i<vector_len(header->prevs); ++i) {
+        IRBB* prev = *(IRBB**)vector_at(header->prevs, i);
+
+        int is_outside = 0;
+        for(size_t k=0; k<vector_len(outside); ++k) {
+            if (*(IRBB**)vector_at(outside, k) == prev) {
+                is_outside = 1;
+                break;
+            }
+        }
+
+        if (is_outside) {
+            retarget(prev, header, preheader);
+            IRBB** e = (IRBB**)vector_append(preheader->prevs);
+            *e = prev;
+            continue;
+        }
+
+        IRBB** dest = (IRBB**)vector_at(header->prevs, kept);
+        *dest = prev;
+        kept++;
+    }
+    vector_truncate(header->prevs, kept);
+
+    IRBB** e = (IRBB**)vector_append(header->prevs);
+    *e = preheader;
+}
+
+size_t ir_function_insert_preheaders(IRFunction* f) {
+    IRDomTree* dom = ir_dom_tree_new(f);
+    IRLoopForest* lf = ir_loop_forest_new(f, dom);
+
+    // Edges are collected first, since the tree can not see inserted blocks
+    Vector* headers = vector_new(sizeof(IRBB*)); // Vector<IRBB*>
+    Vector* outsides = vector_new(sizeof(Vector*)); // Vector<Vector<IRBB*>*>
+    for(size_t i=0; i<ir_loop_forest_len(lf); ++i) {
+        IRLoop* loop = ir_loop_forest_at(lf, i);
+        if (loop->preheader != NULL) {
+            continue;
+        }
+
+        Vector* outside = vector_new(sizeof(IRBB*));
+        for(size_t k=0; k<vector_len(loop->header->prevs); ++k) {
+            IRBB* prev = *(IRBB**)vector_at(loop->header->prevs, k);
+            if (!loop->contains[prev->id]) {
+                IRBB** e = (IRBB**)vector_append(outside);
+                *e = prev;
+            }
+        }
+
+        IRBB** e = (IRBB**)vector_append(headers);
+        *e = loop->header;
+        Vector** o = (Vector**)vector_append(outsides);
+        *o = outside;
+    }
+
+    ir_loop_forest_drop(lf);
+    ir_dom_tree_drop(dom);
+
+    size_t inserted = vector_len(headers);
+    for(size_t i=0; i<inserted; ++i) {
+        IRBB* header = *(IRBB**)vector_at(headers, i);
+        Vector* outside = *(Vector**)vector_at(outsides, i);
+        insert_preheader(f, header, outside);
+        vector_drop(outside);
+    }
+
+    vector_drop(outsides);
+    vector_drop(headers);
+
+    return inserted;
+}
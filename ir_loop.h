@@ -0,0 +1,42 @@
+#ifndef CC_IR_LOOP_H
+#define CC_IR_LOOP_H
+
+#include <stddef.h>
+#include "ir.h"
+#include "ir_dom.h"
+#include "vector.h"
+
+// Natural loops of a function, found from back edges of the dominator tree.
+// An edge from 'latch' to 'header' is a back edge if 'header' dominates 'latch', and the loop of 'header' is the header
+// and blocks which reach one of its latches without passing through the header. Loops sharing a header are merged.
+// Loops are either nested or disjoint, so each block belongs to the innermost loop and all enclosing ones.
+
+struct ir_loop_t;
+typedef struct ir_loop_t IRLoop;
+
+// TODO: encapsulate
+struct ir_loop_t {
+    IRBB* header;
+    IRBB* preheader;    // Nullable, the only block entering the loop, which jumps to the header unconditionally
+    Vector* bbs;        // Vector<IRBB*>, in reverse postorder, so the header comes first
+    char* contains;     // Indexed by IRBBID
+};
+
+struct ir_loop_forest_t;
+typedef struct ir_loop_forest_t IRLoopForest;
+
+// 'f' and 'dom' are references, and must outlive the forest. The forest is stale once edges of the function are changed.
+IRLoopForest* ir_loop_forest_new(IRFunction* f, IRDomTree* dom);
+void ir_loop_forest_drop(IRLoopForest* lf);
+
+// Inner loops come before loops which enclose them
+size_t ir_loop_forest_len(IRLoopForest* lf);
+IRLoop* ir_loop_forest_at(IRLoopForest* lf, size_t index);
+
+int ir_loop_contains(IRLoop* loop, IRBB* bb);
+
+// Gives a preheader to every loop without one, by a new block between the header and edges entering the loop.
+// Dominator trees of the function are stale if any block is inserted. Returns the number of inserted blocks
+size_t ir_function_insert_preheaders(IRFunction* f);
+
+#endif /* CC_IR_LOOP_H */
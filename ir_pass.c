@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "ir_pass.h"
+#include "ir_verify.h"
+#include "ir_ifconv.h"
+#include "ir_licm.h"
+#include "ir_gvn.h"
+#include "vector.h"
+#include "log.h"
+
+// Longer names are unknown
+#define IR_PASS_NAME_MAX 32
+
+static size_t run_if_convert(IRModule* m, IRPassOptions const* opts) {
+    return ir_module_if_convert(m, opts->if_conversion_threshold);
+}
+
+static size_t run_licm(IRModule* m, IRPassOptions const* opts) {
+    return opts->move_loop_invariants ? ir_module_licm(m) : 0;
+}
+
+static size_t run_gvn(IRModule* m, IRPassOptions const* opts) {
+    (void)opts;
+    return ir_module_gvn(m);
+}
+
+static IRPass const passes[] = {
+    { "ifconv", "Replace small diamonds by selects", "converted branches", run_if_convert },
+    { "licm", "Move loop-invariant values into preheaders", "moved instructions", run_licm },
+    { "gvn", "Remove values computed by dominating blocks", "removed instructions", run_gvn },
+};
+#define IR_PASSES_NUM (sizeof(passes) / sizeof(IRPass))
+
+static char const* const presets[IR_PASS_MAX_LEVEL + 1] = {
+    "",                 // -O0
+    "gvn",              // -O1
+    "ifconv,licm,gvn",  // -O2
+};
+
+IRPass const* ir_pass_find(char const* name) {
+    for(size_t i=0; i<IR_PASSES_NUM; ++i) {
+        if (strcmp(passes[i].name, name) == 0) {
+            return &passes[i];
+        }
+    }
+
+    return NULL;
+}
+
+void ir_pass_fprint_list(FILE* fp) {
+    for(size_t i=0; i<IR_PASSES_NUM; ++i) {
+        fprintf(fp, "  %-8s %s\n", passes[i].name, passes[i].desc);
+    }
+}
+
+char const* ir_pass_preset(int level) {
+    if (level < 0) {
+        level = 0;
+    }
+    if (level > IR_PASS_MAX_LEVEL) {
+        level = IR_PASS_MAX_LEVEL;
+    }
+
+    return presets[level];
+}
+
+// Calls 'f' for each pass of 'names' until it returns non 0. Returns 1 on an unknown pass
+static int foreach_pass(char const* names, int (*f)(IRPass const* pass, void* args), void* args) {
+    char const* p = names;
+    while(*p != '\0') {
+        char const* end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+
+        char name[IR_PASS_NAME_MAX];
+        IRPass const* pass = NULL;
+        if (len < sizeof(name)) {
+            memcpy(name, p, len);
+            name[len] = '\0';
+            pass = ir_pass_find(name);
+        }
+        if (pass == NULL) {
+            fprintf(stderr, "Unknown pass: %.*s\n", (int)len, p);
+            return 1;
+        }
+        if (f && f(pass, args)) {
+            return 1;
+        }
+
+        p = end ? end + 1 : p + len;
+    }
+
+    return 0;
+}
+
+int ir_pass_check_list(char const* names) {
+    return foreach_pass(names, NULL, NULL);
+}
+
+typedef struct {
+    IRPass const* pass;
+    double sec;
+    size_t insts_before;
+    size_t insts_after;
+    size_t changes;
+} IRPassRun;
+
+struct ir_pass_manager_t {
+    IRPassOptions opts;
+    Vector* passes;     // Vector<IRPass const*>
+    Vector* runs;       // Vector<IRPassRun>
+    FILE* dump;         // reference, Nullable
+};
+
+IRPassManager* ir_pass_manager_new(IRPassOptions const* opts) {
+    IRPassManager* pm = (IRPassManager*)malloc(sizeof(IRPassManager));
+    assert(pm); // TODO: error handling...
+    pm->opts = *opts;
+    pm->passes = vector_new(sizeof(IRPass const*));
+    pm->runs = vector_new(sizeof(IRPassRun));
+    pm->dump = NULL;
+
+    return pm;
+}
+
+void ir_pass_manager_drop(IRPassManager* pm) {
+    vector_drop(pm->runs);
+    vector_drop(pm->passes);
+    free(pm);
+}
+
+void ir_pass_manager_add(IRPassManager* pm, IRPass const* pass) {
+    IRPass const** e = (IRPass const**)vector_append(pm->passes);
+    *e = pass;
+}
+
+static int add_iter(IRPass const* pass, void* args) {
+    ir_pass_manager_add((IRPassManager*)args, pass);
+    return 0;
+}
+
+int ir_pass_manager_add_list(IRPassManager* pm, char const* names) {
+    if (ir_pass_check_list(names)) {
+        return 1;
+    }
+
+    return foreach_pass(names, add_iter, pm);
+}
+
+void ir_pass_manager_set_dump(IRPassManager* pm, FILE* fp) {
+    pm->dump = fp;
+}
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Returns 0 if the IR is not broken. 'after' is the name of the last pass, or NULL for the input
+static int verify(IRModule* m, char const* after) {
+#ifndef NDEBUG
+    size_t errors = ir_module_verify(m, stderr);
+    if (errors > 0) {
+        fprintf(stderr, "Broken IR %s %s: %zu errors\n", after ? "after pass" : "from", after ? after : "the builder", errors);
+        return 1;
+    }
+#else
+    (void)m;
+    (void)after;
+#endif
+
+    return 0;
+}
+
+int ir_pass_manager_run(IRPassManager* pm, IRModule* m) {
+    vector_truncate(pm->runs, 0);
+
+    if (verify(m, NULL)) {
+        return 1;
+    }
+
+    size_t insts = vector_len(pm->passes) > 0 ? ir_module_insts_len(m) : 0;
+    for(size_t i=0; i<vector_len(pm->passes); ++i) {
+        IRPass const* pass = *(IRPass const**)vector_at(pm->passes, i);
+
+        IRPassRun* run = (IRPassRun*)vector_append(pm->runs);
+        run->pass = pass;
+        run->insts_before = insts;
+
+        double begin = now_sec();
+        run->changes = pass->run(m, &pm->opts);
+        run->sec = now_sec() - begin;
+
+        run->insts_after = ir_module_insts_len(m);
+        insts = run->insts_after;
+        fprintf(DEBUGOUT, "PASS %s: %zu %s, %zu -> %zu insts, %.6f sec\n",
+                pass->name, run->changes, pass->changes, run->insts_before, run->insts_after, run->sec);
+
+        if (pm->dump) {
+            fprintf(pm->dump, "= IR AFTER %s =\n", pass->name);
+            ir_module_fprint(pm->dump, m);
+            fprintf(pm->dump, "\n");
+        }
+
+        if (verify(m, pass->name)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void ir_pass_manager_fprint_stats(FILE* fp, IRPassManager* pm) {
+    fprintf(fp, "= PASS STATS =\n");
+    fprintf(fp, "%-8s %10s %8s %8s %8s\n", "pass", "time(ms)", "before", "after", "changes");
+
+    double total = 0;
+    for(size_t i=0; i<vector_len(pm->runs); ++i) {
+        IRPassRun* run = (IRPassRun*)vector_at(pm->runs, i);
+        fprintf(fp, "%-8s %10.3f %8zu %8zu %8zu\n",
+                run->pass->name, run->sec * 1000, run->insts_before, run->insts_after, run->changes);
+        total += run->sec;
+    }
+    fprintf(fp, "%-8s %10.3f\n", "total", total * 1000);
+}
@@ -0,0 +1,59 @@
+#ifndef CC_IR_PASS_H
+#define CC_IR_PASS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "ir.h"
+
+// A pass manager over modules. Passes are named, and run in the order they are added, e.g. by a preset of -O levels
+// or by an explicit list. Each run is measured by its time and the number of IR instructions before and after it.
+// Without NDEBUG, the module is verified before the first pass and after each pass, and a broken pass is reported.
+
+typedef struct {
+    size_t if_conversion_threshold;     // 0 disables "ifconv"
+    int move_loop_invariants;           // 0 disables "licm"
+} IRPassOptions;
+
+// Returns the number of changes, e.g. removed instructions
+typedef size_t (*IRPassFunc)(IRModule* m, IRPassOptions const* opts);
+
+typedef struct {
+    char const* name;
+    char const* desc;
+    char const* changes;    // What the number of changes counts
+    IRPassFunc run;
+} IRPass;
+
+#define IR_PASS_MAX_LEVEL 2
+
+// Returns NULL if there is no such pass
+IRPass const* ir_pass_find(char const* name);
+void ir_pass_fprint_list(FILE* fp);
+
+// Comma separated names of passes of -O'level', e.g. "ifconv,licm,gvn". Levels over the max are the max
+char const* ir_pass_preset(int level);
+
+// Returns 0 if 'names' is a comma separated list of known passes, otherwise reports an unknown one to stderr.
+// An empty list has no passes
+int ir_pass_check_list(char const* names);
+
+struct ir_pass_manager_t;
+typedef struct ir_pass_manager_t IRPassManager;
+
+IRPassManager* ir_pass_manager_new(IRPassOptions const* opts);
+void ir_pass_manager_drop(IRPassManager* pm);
+
+void ir_pass_manager_add(IRPassManager* pm, IRPass const* pass);
+// Returns 0 on success. Nothing is added if 'names' has an unknown pass
+int ir_pass_manager_add_list(IRPassManager* pm, char const* names);
+
+// 'fp' is nullable, then the IR is not dumped after each pass
+void ir_pass_manager_set_dump(IRPassManager* pm, FILE* fp);
+
+// Runs all passes over 'm', and logs each run to DEBUGOUT. Returns 0 on success, 1 if the IR is broken
+int ir_pass_manager_run(IRPassManager* pm, IRModule* m);
+
+// Runs of the last ir_pass_manager_run
+void ir_pass_manager_fprint_stats(FILE* fp, IRPassManager* pm);
+
+#endif /* CC_IR_PASS_H */
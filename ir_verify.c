@@ -0,0 +1,273 @@
+#include <stdlib.h>
+#include <stdarg.h>
+#include <assert.h>
+#include "ir_verify.h"
+#include "ir_dom.h"
+#include "ir_inst_defs.h"
+#include "vector.h"
+
+typedef struct {
+    IRFunction* f;          // reference
+    FILE* fp;               // reference
+    IRBB** def_bbs;         // Indexed by IRSymbolID, NULL if not defined
+    size_t* def_pos;        // Indexed by IRSymbolID, the index of the definition in its block
+    IRDomTree* dom;         // Nullable, dominance is not checked if edges are broken
+    Vector* bbs;            // Vector<IRBB*>, reachable blocks
+    int edges_broken;       // Or terminators
+    size_t errors;
+} Verifier;
+
+static void report(Verifier* v, IRBB* bb, char const* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fprintf(v->fp, "IR VERIFY: %s: bb %zu: ", v->f->name, bb->id);
+    vfprintf(v->fp, fmt, args);
+    fprintf(v->fp, "\n");
+    va_end(args);
+
+    v->errors++;
+}
+
+struct edge_args_t {
+    Verifier* v;
+    IRBB* bb;
+};
+
+static void check_edge(IRBB* next, void* args) {
+    struct edge_args_t* e = (struct edge_args_t*)args;
+    for(size_t i=0; i<vector_len(next->prevs); ++i) {
+        if (*(IRBB**)vector_at(next->prevs, i) == e->bb) {
+            return;
+        }
+    }
+    report(e->v, e->bb, "not in prevs of its successor bb %zu", next->id);
+    e->v->edges_broken = 1;
+}
+
+static void collect_defs_iter(IRBB* bb, void* args) {
+    Verifier* v = (Verifier*)args;
+    IRBB** reached = (IRBB**)vector_append(v->bbs);
+    *reached = bb;
+
+    for(size_t i=0; i<vector_len(bb->insts); ++i) {
+        IRInst* inst = (IRInst*)vector_at(bb->insts, i);
+        if (inst->kind != IR_INST_KIND_LET) {
+            report(v, bb, "instruction %zu is not a LET", i);
+            continue;
+        }
+
+        IRSymbolID id = inst->value.let.id;
+        if (id >= v->f->locals_id) {
+            report(v, bb, "%%%zu is out of range", id);
+            continue;
+        }
+        if (v->def_bbs[id] != NULL) {
+            report(v, bb, "%%%zu is already defined in bb %zu", id, v->def_bbs[id]->id);
+            continue;
+        }
+        v->def_bbs[id] = bb;
+        v->def_pos[id] = i;
+    }
+
+    if (bb->term == NULL) {
+        report(v, bb, "no terminator");
+        v->edges_broken = 1;
+        return;
+    }
+
+    switch(bb->term->kind) {
+    case IR_INST_KIND_RET:
+    case IR_INST_KIND_BRANCH:
+    case IR_INST_KIND_JUMP:
+        break;
+
+    case IR_INST_KIND_SWITCH:
+    {
+        Vector* cases = bb->term->value.switch_.cases;
+        for(size_t i=1; i<vector_len(cases); ++i) {
+            IRSwitchCase* prev = (IRSwitchCase*)vector_at(cases, i - 1);
+            IRSwitchCase* c = (IRSwitchCase*)vector_at(cases, i);
+            if (prev->value >= c->value) {
+                report(v, bb, "switch cases are not sorted at %ld", c->value);
+            }
+        }
+        break;
+    }
+
+    default:
+        report(v, bb, "terminator of kind %d", bb->term->kind);
+        v->edges_broken = 1;
+        return;
+    }
+
+    struct edge_args_t e = { v, bb };
+    ir_bb_foreach_nexts(bb, check_edge, &e);
+}
+
+// 'id' is used at 'pos' of 'bb'
+static void check_use(Verifier* v, IRBB* bb, size_t pos, IRSymbolID id) {
+    if (id >= v->f->locals_id) {
+        report(v, bb, "%%%zu is out of range", id);
+        return;
+    }
+
+    IRBB* def_bb = v->def_bbs[id];
+    if (def_bb == NULL) {
+        report(v, bb, "%%%zu is used but not defined", id);
+        return;
+    }
+
+    if (def_bb == bb) {
+        if (v->def_pos[id] >= pos) {
+            report(v, bb, "%%%zu is used before its definition", id);
+        }
+        return;
+    }
+
+    if (v->dom != NULL && !ir_dom_tree_dominates(v->dom, def_bb, bb)) {
+        report(v, bb, "%%%zu is defined in bb %zu which does not dominate its use", id, def_bb->id);
+    }
+}
+
+static void check_value(Verifier* v, IRBB* bb, size_t pos, IRInstValue* val) {
+    switch(val->kind) {
+    case IR_INST_VALUE_KIND_REF:
+        if (val->value.ref.is_global) {
+            if (val->value.ref.sym >= v->f->mod->defs_sym_id) {
+                report(v, bb, "global %zu is out of range", val->value.ref.sym);
+            }
+            break;
+        }
+        check_use(v, bb, pos, val->value.ref.sym);
+        break;
+
+    case IR_INST_VALUE_KIND_ADDR_OF:
+        check_use(v, bb, pos, val->value.addr_of.sym);
+        break;
+
+    case IR_INST_VALUE_KIND_OP_BIN:
+        check_use(v, bb, pos, val->value.op_bin.lhs);
+        check_use(v, bb, pos, val->value.op_bin.rhs);
+        break;
+
+    case IR_INST_VALUE_KIND_SELECT:
+        check_use(v, bb, pos, val->value.select.cond);
+        check_use(v, bb, pos, val->value.select.then_sym);
+        check_use(v, bb, pos, val->value.select.else_sym);
+        break;
+
+    case IR_INST_VALUE_KIND_CALL:
+        check_use(v, bb, pos, val->value.call.lhs);
+        for(size_t i=0; i<vector_len(val->value.call.args); ++i) {
+            check_use(v, bb, pos, *(IRSymbolID*)vector_at(val->value.call.args, i));
+        }
+        break;
+
+    case IR_INST_VALUE_KIND_PHI:
+    {
+        // Phis lead the block, and each incoming value is used at the end of its predecessor
+        if (pos > 0) {
+            IRInst* prev = (IRInst*)vector_at(bb->insts, pos - 1);
+            if (prev->kind != IR_INST_KIND_LET || prev->value.let.rhs.kind != IR_INST_VALUE_KIND_PHI) {
+                report(v, bb, "phi at %zu follows other instructions", pos);
+            }
+        }
+
+        Vector* incomings = val->value.phi.incomings;
+        if (vector_len(incomings) != vector_len(bb->prevs)) {
+            report(v, bb, "phi at %zu has %zu incomings for %zu predecessors", pos, vector_len(incomings), vector_len(bb->prevs));
+        }
+        for(size_t i=0; i<vector_len(incomings); ++i) {
+            IRPhiIncoming* in = (IRPhiIncoming*)vector_at(incomings, i);
+
+            int found = 0;
+            for(size_t k=0; k<vector_len(bb->prevs); ++k) {
+                if (*(IRBB**)vector_at(bb->prevs, k) == in->bb) {
+                    found = 1;
+                    break;
+                }
+            }
+            if (!found) {
+                report(v, bb, "phi at %zu has an incoming from bb %zu which is not a predecessor", pos, in->bb->id);
+                continue;
+            }
+            check_use(v, in->bb, vector_len(in->bb->insts), in->sym);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+static void check_uses(Verifier* v, IRBB* bb) {
+    for(size_t i=0; i<vector_len(bb->insts); ++i) {
+        IRInst* inst = (IRInst*)vector_at(bb->insts, i);
+        if (inst->kind == IR_INST_KIND_LET) {
+            check_value(v, bb, i, &inst->value.let.rhs);
+        }
+    }
+
+    if (bb->term == NULL) {
+        return;
+    }
+
+    // Terminators come after all instructions of the block
+    size_t pos = vector_len(bb->insts);
+    switch(bb->term->kind) {
+    case IR_INST_KIND_RET:
+        check_use(v, bb, pos, bb->term->value.ret.id);
+        break;
+    case IR_INST_KIND_BRANCH:
+        check_use(v, bb, pos, bb->term->value.branch.cond);
+        break;
+    case IR_INST_KIND_SWITCH:
+        check_use(v, bb, pos, bb->term->value.switch_.cond);
+        break;
+    default:
+        break;
+    }
+}
+
+size_t ir_function_verify(IRFunction* f, FILE* fp) {
+    Verifier v;
+    v.f = f;
+    v.fp = fp;
+    v.def_bbs = (IRBB**)calloc(f->locals_id + 1, sizeof(IRBB*));
+    v.def_pos = (size_t*)calloc(f->locals_id + 1, sizeof(size_t));
+    assert(v.def_bbs && v.def_pos); // TODO: error handling...
+    v.dom = NULL;
+    v.bbs = vector_new(sizeof(IRBB*));
+    v.edges_broken = 0;
+    v.errors = 0;
+
+    ir_bb_visit(f->entry, collect_defs_iter, &v);
+
+    // The dominator tree is built from 'prevs', so it is meaningless if they are broken
+    if (!v.edges_broken) {
+        v.dom = ir_dom_tree_new(f);
+    }
+    for(size_t i=0; i<vector_len(v.bbs); ++i) {
+        check_uses(&v, *(IRBB**)vector_at(v.bbs, i));
+    }
+
+    if (v.dom != NULL) {
+        ir_dom_tree_drop(v.dom);
+    }
+    vector_drop(v.bbs);
+    free(v.def_pos);
+    free(v.def_bbs);
+
+    return v.errors;
+}
+
+size_t ir_module_verify(IRModule* m, FILE* fp) {
+    size_t errors = 0;
+    for(size_t i=0; i<vector_len(m->functions); ++i) {
+        IRFunction* f = (IRFunction*)vector_at(m->functions, i);
+        errors += ir_function_verify(f, fp);
+    }
+
+    return errors;
+}
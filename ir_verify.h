@@ -0,0 +1,17 @@
+#ifndef CC_IR_VERIFY_H
+#define CC_IR_VERIFY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "ir.h"
+
+// Checks invariants which passes rely on, over blocks reachable from the entry:
+// - a block has only LETs, and ends with a terminator
+// - a symbol is defined once, and its definition comes before its uses in the same block or dominates them
+// - a block is in 'prevs' of each of its successors
+// - cases of a switch are sorted and unique
+// Problems are reported to 'fp'. Returns the number of problems
+size_t ir_function_verify(IRFunction* f, FILE* fp);
+size_t ir_module_verify(IRModule* m, FILE* fp);
+
+#endif /* CC_IR_VERIFY_H */
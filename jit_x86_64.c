@@ -0,0 +1,889 @@
+#define _GNU_SOURCE // RTLD_DEFAULT
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include "jit_x86_64.h"
+#include "asm_x86_64_defs.h"
+#include "vector.h"
+#include "map.h"
+
+typedef enum jit_x86_64_section_t {
+    JIT_X86_64_SECTION_TEXT,
+    JIT_X86_64_SECTION_DATA,
+} JIT_X86_64_Section;
+
+typedef struct jit_x86_64_label_t {
+    JIT_X86_64_Section section;
+    size_t offset;  // In the section, fixed in the encoding pass
+} JIT_X86_64_Label;
+
+typedef enum jit_x86_64_fixup_kind_t {
+    JIT_X86_64_FIXUP_LABEL, // rel32 to a label
+    JIT_X86_64_FIXUP_SLOT,  // rel32 to a slot of an external symbol
+    JIT_X86_64_FIXUP_TABLE, // 32bits offset of a label from a jump table, in the data
+} JIT_X86_64_FixupKind;
+
+typedef struct jit_x86_64_fixup_t {
+    JIT_X86_64_FixupKind kind;
+    size_t pos;     // Offset of rel32 in the code, or of the entry in the data
+    size_t end;     // Offset of the next instruction, rel32 is relative to it
+    union {
+        char const* label;
+        size_t slot;
+        struct {
+            char const* label;
+            char const* table;
+        } entry;
+    } value;
+} JIT_X86_64_Fixup;
+
+typedef struct jit_x86_64_bytes_t {
+    uint8_t* buf;
+    size_t len;
+    size_t cap;
+} JIT_X86_64_Bytes;
+
+struct jit_x86_64_t {
+    StringMap* labels;      // StringMap<JIT_X86_64_Label>, keys are references to names in ASM_X86_64
+    StringMap* externals;   // StringMap<size_t>, symbol -> slot index
+    Vector* slot_names;     // Vector<char const*>, reference
+    Vector* fixups;         // Vector<JIT_X86_64_Fixup>
+    JIT_X86_64_Bytes code;
+    JIT_X86_64_Bytes data;
+
+    // Layout: [code][data][slots]
+    uint8_t* mem;           // mmap-ed, Nullable
+    size_t mem_size;
+    size_t data_offset;
+    size_t slots_offset;
+};
+
+static void bytes_put(JIT_X86_64_Bytes* b, void const* p, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap == 0 ? 4096 : b->cap;
+        while(cap < b->len + len) {
+            cap *= 2;
+        }
+        b->buf = (uint8_t*)realloc(b->buf, cap);
+        assert(b->buf); // TODO: error handling...
+        b->cap = cap;
+    }
+
+    memcpy(b->buf + b->len, p, len);
+    b->len += len;
+}
+
+static void bytes_put_u8(JIT_X86_64_Bytes* b, uint8_t v) {
+    bytes_put(b, &v, 1);
+}
+
+static void bytes_put_i32(JIT_X86_64_Bytes* b, int32_t v) {
+    uint8_t le[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    bytes_put(b, le, 4);
+}
+
+static int reg_code(ASM_X86_64_Reg reg) {
+    switch(reg) {
+    case ASM_X86_64_REG_RAX: return 0;
+    case ASM_X86_64_REG_RCX: return 1;
+    case ASM_X86_64_REG_RDX: return 2;
+    case ASM_X86_64_REG_RBX: return 3;
+    case ASM_X86_64_REG_RSP: return 4;
+    case ASM_X86_64_REG_RBP: return 5;
+    case ASM_X86_64_REG_RSI: return 6;
+    case ASM_X86_64_REG_RDI: return 7;
+    case ASM_X86_64_REG_R8:  return 8;
+    case ASM_X86_64_REG_R9:  return 9;
+    case ASM_X86_64_REG_EAX: return 0;
+    case ASM_X86_64_REG_AL:  return 0;
+    case ASM_X86_64_REG_CL:  return 1;
+    default:
+        return -1;
+    }
+}
+
+static int fits_i8(int v) {
+    return v >= -128 && v <= 127;
+}
+
+static int is_mem(ASM_X86_64_Value* v) {
+    return v->kind == ASM_X86_64_VALUE_KIND_DISP_REG
+        || v->kind == ASM_X86_64_VALUE_KIND_INDEX
+        || v->kind == ASM_X86_64_VALUE_KIND_STRING;
+}
+
+static int scale_bits(int scale) {
+    switch(scale) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    case 8: return 3;
+    default:
+        return -1;
+    }
+}
+
+static void put_label_fixup(JIT_X86_64* j, char const* label) {
+    JIT_X86_64_Fixup* f = (JIT_X86_64_Fixup*)vector_append(j->fixups);
+    f->kind = JIT_X86_64_FIXUP_LABEL;
+    f->pos = j->code.len;
+    f->end = 0; // Fixed after the instruction is encoded
+    f->value.label = label;
+
+    bytes_put_i32(&j->code, 0);
+}
+
+// ModRM (and SIB, disp) of 'rm' with 'reg_field'. Returns 0 on success.
+static int put_modrm(JIT_X86_64* j, int reg_field, ASM_X86_64_Value* rm) {
+    switch(rm->kind) {
+    case ASM_X86_64_VALUE_KIND_REG:
+    {
+        int r = reg_code(rm->value.reg);
+        if (r < 0) {
+            return 1;
+        }
+        bytes_put_u8(&j->code, (uint8_t)(0xc0 | ((reg_field & 7) << 3) | (r & 7)));
+        return 0;
+    }
+
+    case ASM_X86_64_VALUE_KIND_STRING:
+        // label(%rip)
+        bytes_put_u8(&j->code, (uint8_t)(0x05 | ((reg_field & 7) << 3)));
+        put_label_fixup(j, rm->value.string.label);
+        return 0;
+
+    case ASM_X86_64_VALUE_KIND_DISP_REG:
+    {
+        if (rm->value.disp_reg.reg == ASM_X86_64_REG_RIP) {
+            if (!rm->value.disp_reg.symbol) {
+                return 1;
+            }
+            bytes_put_u8(&j->code, (uint8_t)(0x05 | ((reg_field & 7) << 3)));
+            put_label_fixup(j, rm->value.disp_reg.symbol);
+            return 0;
+        }
+
+        if (rm->value.disp_reg.symbol) {
+            return 1; // TODO: support absolute symbols
+        }
+
+        int base = reg_code(rm->value.disp_reg.reg);
+        if (base < 0) {
+            return 1;
+        }
+        int disp = rm->value.disp_reg.disp;
+
+        // disp8 or disp32. mod=00 is not used, so RBP as a base needs no special case.
+        int mod = fits_i8(disp) ? 0x40 : 0x80;
+        bytes_put_u8(&j->code, (uint8_t)(mod | ((reg_field & 7) << 3) | (base & 7)));
+        if ((base & 7) == 4) {
+            bytes_put_u8(&j->code, 0x24); // SIB for RSP as a base
+        }
+        if (mod == 0x40) {
+            bytes_put_u8(&j->code, (uint8_t)(int8_t)disp);
+        } else {
+            bytes_put_i32(&j->code, disp);
+        }
+        return 0;
+    }
+
+    case ASM_X86_64_VALUE_KIND_INDEX:
+    {
+        int base = reg_code(rm->value.index.base);
+        int index = reg_code(rm->value.index.index);
+        int ss = scale_bits(rm->value.index.scale);
+        if (base < 0 || index < 0 || index == 4 || ss < 0) {
+            return 1; // RSP can not be an index
+        }
+        int disp = rm->value.index.disp;
+
+        int mod = fits_i8(disp) ? 0x40 : 0x80;
+        bytes_put_u8(&j->code, (uint8_t)(mod | ((reg_field & 7) << 3) | 0x04));
+        bytes_put_u8(&j->code, (uint8_t)((ss << 6) | ((index & 7) << 3) | (base & 7)));
+        if (mod == 0x40) {
+            bytes_put_u8(&j->code, (uint8_t)(int8_t)disp);
+        } else {
+            bytes_put_i32(&j->code, disp);
+        }
+        return 0;
+    }
+
+    default:
+        return 1;
+    }
+}
+
+// REX prefix if needed. R extends 'reg_field', X extends the index, and B extends the register or the base of 'rm'.
+static void put_rex(JIT_X86_64* j, int wide, int reg_field, ASM_X86_64_Value* rm) {
+    int b = 0;
+    int x = 0;
+    if (rm->kind == ASM_X86_64_VALUE_KIND_REG) {
+        b = reg_code(rm->value.reg) >= 8;
+    } else if (rm->kind == ASM_X86_64_VALUE_KIND_DISP_REG) {
+        b = reg_code(rm->value.disp_reg.reg) >= 8;
+    } else if (rm->kind == ASM_X86_64_VALUE_KIND_INDEX) {
+        b = reg_code(rm->value.index.base) >= 8;
+        x = reg_code(rm->value.index.index) >= 8;
+    }
+    int r = reg_field >= 8;
+
+    if (wide || r || x || b) {
+        bytes_put_u8(&j->code, (uint8_t)(0x40 | (wide ? 0x08 : 0) | (r ? 0x04 : 0) | (x ? 0x02 : 0) | (b ? 0x01 : 0)));
+    }
+}
+
+// ALU instructions of the form 'op dst, src'. 'ext' is the /digit of the imm form (81 /ext).
+static int put_alu(JIT_X86_64* j, int wide, uint8_t op_rm_r, uint8_t op_r_rm, int ext, ASM_X86_64_Value* dst, ASM_X86_64_Value* src) {
+    switch(src->kind) {
+    case ASM_X86_64_VALUE_KIND_IMM_INT:
+    {
+        int imm = src->value.imm_int;
+        put_rex(j, wide, ext, dst);
+        if (fits_i8(imm)) {
+            bytes_put_u8(&j->code, 0x83);
+            if (put_modrm(j, ext, dst)) {
+                return 1;
+            }
+            bytes_put_u8(&j->code, (uint8_t)(int8_t)imm);
+        } else {
+            bytes_put_u8(&j->code, 0x81);
+            if (put_modrm(j, ext, dst)) {
+                return 1;
+            }
+            bytes_put_i32(&j->code, imm);
+        }
+        return 0;
+    }
+
+    case ASM_X86_64_VALUE_KIND_REG:
+        put_rex(j, wide, reg_code(src->value.reg), dst);
+        bytes_put_u8(&j->code, op_rm_r);
+        return put_modrm(j, reg_code(src->value.reg), dst);
+
+    default:
+        if (!is_mem(src) || dst->kind != ASM_X86_64_VALUE_KIND_REG) {
+            return 1;
+        }
+        put_rex(j, wide, reg_code(dst->value.reg), src);
+        bytes_put_u8(&j->code, op_r_rm);
+        return put_modrm(j, reg_code(dst->value.reg), src);
+    }
+}
+
+static int put_mov(JIT_X86_64* j, int wide, ASM_X86_64_Value* dst, ASM_X86_64_Value* src) {
+    if (src->kind == ASM_X86_64_VALUE_KIND_IMM_INT) {
+        // C7 /0 id, sign-extended with REX.W
+        put_rex(j, wide, 0, dst);
+        bytes_put_u8(&j->code, 0xc7);
+        if (put_modrm(j, 0, dst)) {
+            return 1;
+        }
+        bytes_put_i32(&j->code, src->value.imm_int);
+        return 0;
+    }
+
+    return put_alu(j, wide, 0x89, 0x8b, 0, dst, src);
+}
+
+// rel32 to the slot of an external symbol, after FF /2 (call) or FF /4 (jmp)
+static void put_slot_fixup(JIT_X86_64* j, char const* name) {
+    int found;
+    size_t* slot = string_map_insert(j->externals, name, &found);
+    if (!found) {
+        *slot = vector_len(j->slot_names);
+        char const** slot_name = (char const**)vector_append(j->slot_names);
+        *slot_name = name;
+    }
+
+    JIT_X86_64_Fixup* f = (JIT_X86_64_Fixup*)vector_append(j->fixups);
+    f->kind = JIT_X86_64_FIXUP_SLOT;
+    f->pos = j->code.len;
+    f->end = 0;
+    f->value.slot = *slot;
+    bytes_put_i32(&j->code, 0);
+}
+
+static int is_text_label(JIT_X86_64* j, char const* name) {
+    JIT_X86_64_Label* label = string_map_find(j->labels, name);
+    return label && label->section == JIT_X86_64_SECTION_TEXT;
+}
+
+// Instructions of the form 'op r/m' by F7 /ext, e.g. negq
+static int put_unary(JIT_X86_64* j, int ext, ASM_X86_64_Value* v) {
+    put_rex(j, 1, ext, v);
+    bytes_put_u8(&j->code, 0xf7);
+    return put_modrm(j, ext, v);
+}
+
+// Shifts by C1 /ext ib or D3 /ext (CL)
+static int put_shift(JIT_X86_64* j, int ext, ASM_X86_64_Value* dst, ASM_X86_64_Value* count) {
+    put_rex(j, 1, ext, dst);
+    if (count->kind == ASM_X86_64_VALUE_KIND_IMM_INT) {
+        bytes_put_u8(&j->code, 0xc1);
+        if (put_modrm(j, ext, dst)) {
+            return 1;
+        }
+        bytes_put_u8(&j->code, (uint8_t)count->value.imm_int);
+        return 0;
+    }
+
+    if (count->kind != ASM_X86_64_VALUE_KIND_REG || count->value.reg != ASM_X86_64_REG_CL) {
+        return 1;
+    }
+    bytes_put_u8(&j->code, 0xd3);
+    return put_modrm(j, ext, dst);
+}
+
+static int put_imul(JIT_X86_64* j, ASM_X86_64_Value* dst, ASM_X86_64_Value* src) {
+    if (dst->kind != ASM_X86_64_VALUE_KIND_REG) {
+        return 1;
+    }
+    int r = reg_code(dst->value.reg);
+
+    if (src->kind == ASM_X86_64_VALUE_KIND_IMM_INT) {
+        // 6B /r ib or 69 /r id, 'dst' is both the source and the destination
+        int imm = src->value.imm_int;
+        put_rex(j, 1, r, dst);
+        bytes_put_u8(&j->code, fits_i8(imm) ? 0x6b : 0x69);
+        if (put_modrm(j, r, dst)) {
+            return 1;
+        }
+        if (fits_i8(imm)) {
+            bytes_put_u8(&j->code, (uint8_t)(int8_t)imm);
+        } else {
+            bytes_put_i32(&j->code, imm);
+        }
+        return 0;
+    }
+
+    // 0F AF /r
+    put_rex(j, 1, r, src);
+    bytes_put_u8(&j->code, 0x0f);
+    bytes_put_u8(&j->code, 0xaf);
+    return put_modrm(j, r, src);
+}
+
+static int put_movabs(JIT_X86_64* j, ASM_X86_64_Value* dst, ASM_X86_64_Value* src) {
+    if (dst->kind != ASM_X86_64_VALUE_KIND_REG || src->kind != ASM_X86_64_VALUE_KIND_IMM_INT64) {
+        return 1;
+    }
+
+    // REX.W B8+r io
+    int r = reg_code(dst->value.reg);
+    bytes_put_u8(&j->code, (uint8_t)(0x48 | (r >= 8 ? 0x01 : 0)));
+    bytes_put_u8(&j->code, (uint8_t)(0xb8 + (r & 7)));
+    uint64_t v = (uint64_t)src->value.imm_int64;
+    for(int i=0; i<8; ++i) {
+        bytes_put_u8(&j->code, (uint8_t)(v >> (i * 8)));
+    }
+    return 0;
+}
+
+// SETcc r/m8 by 0F 90+cc /0, only for registers which do not need REX
+static int put_setcc(JIT_X86_64* j, int cc, ASM_X86_64_Value* v) {
+    if (v->kind != ASM_X86_64_VALUE_KIND_REG || reg_code(v->value.reg) < 0 || reg_code(v->value.reg) >= 4) {
+        return 1;
+    }
+    bytes_put_u8(&j->code, 0x0f);
+    bytes_put_u8(&j->code, (uint8_t)(0x90 + cc));
+    return put_modrm(j, 0, v);
+}
+
+// Instructions of the form 'op r64, r/m' by REX.W 0F 'op2' /r, e.g. cmovne and movzbq
+static int put_0f_reg_rm(JIT_X86_64* j, uint8_t op2, ASM_X86_64_Value* dst, ASM_X86_64_Value* src) {
+    if (dst->kind != ASM_X86_64_VALUE_KIND_REG) {
+        return 1;
+    }
+    int r = reg_code(dst->value.reg);
+    put_rex(j, 1, r, src);
+    bytes_put_u8(&j->code, 0x0f);
+    bytes_put_u8(&j->code, op2);
+    return put_modrm(j, r, src);
+}
+
+static int put_call(JIT_X86_64* j, ASM_X86_64_Value* target) {
+    switch(target->kind) {
+    case ASM_X86_64_VALUE_KIND_SYMBOL:
+    {
+        char const* name = target->value.symbol;
+        if (is_text_label(j, name)) {
+            // call rel32
+            bytes_put_u8(&j->code, 0xe8);
+            put_label_fixup(j, name);
+            return 0;
+        }
+
+        // call *slot(%rip)
+        bytes_put_u8(&j->code, 0xff);
+        bytes_put_u8(&j->code, 0x15);
+        put_slot_fixup(j, name);
+        return 0;
+    }
+
+    case ASM_X86_64_VALUE_KIND_REG:
+        // call *reg
+        put_rex(j, 0, 2, target);
+        bytes_put_u8(&j->code, 0xff);
+        return put_modrm(j, 2, target);
+
+    default:
+        return 1;
+    }
+}
+
+static int put_jump(JIT_X86_64* j, ASM_X86_64_Op op, ASM_X86_64_Value* target) {
+    if (op == ASM_X86_64_OP_JMP_INDIRECT) {
+        // jmp *reg
+        if (target->kind != ASM_X86_64_VALUE_KIND_REG) {
+            return 1;
+        }
+        put_rex(j, 0, 4, target);
+        bytes_put_u8(&j->code, 0xff);
+        return put_modrm(j, 4, target);
+    }
+
+    if (target->kind != ASM_X86_64_VALUE_KIND_SYMBOL) {
+        return 1;
+    }
+
+    if (op == ASM_X86_64_OP_JMP && !is_text_label(j, target->value.symbol)) {
+        // jmp *slot(%rip), tail calls of external functions
+        bytes_put_u8(&j->code, 0xff);
+        bytes_put_u8(&j->code, 0x25);
+        put_slot_fixup(j, target->value.symbol);
+        return 0;
+    }
+
+    switch(op) {
+    case ASM_X86_64_OP_JE:
+        bytes_put_u8(&j->code, 0x0f);
+        bytes_put_u8(&j->code, 0x84);
+        break;
+
+    case ASM_X86_64_OP_JNE:
+        bytes_put_u8(&j->code, 0x0f);
+        bytes_put_u8(&j->code, 0x85);
+        break;
+
+    case ASM_X86_64_OP_JA:
+        bytes_put_u8(&j->code, 0x0f);
+        bytes_put_u8(&j->code, 0x87);
+        break;
+
+    case ASM_X86_64_OP_JL:
+        bytes_put_u8(&j->code, 0x0f);
+        bytes_put_u8(&j->code, 0x8c);
+        break;
+
+    case ASM_X86_64_OP_JGE:
+        bytes_put_u8(&j->code, 0x0f);
+        bytes_put_u8(&j->code, 0x8d);
+        break;
+
+    case ASM_X86_64_OP_JLE:
+        bytes_put_u8(&j->code, 0x0f);
+        bytes_put_u8(&j->code, 0x8e);
+        break;
+
+    case ASM_X86_64_OP_JG:
+        bytes_put_u8(&j->code, 0x0f);
+        bytes_put_u8(&j->code, 0x8f);
+        break;
+
+    default:
+        bytes_put_u8(&j->code, 0xe9);
+        break;
+    }
+    put_label_fixup(j, target->value.symbol);
+
+    return 0;
+}
+
+static int encode_op(JIT_X86_64* j, ASM_X86_64_Inst* inst) {
+    ASM_X86_64_Value* args = inst->value.op.args;
+    switch(inst->value.op.op) {
+    case ASM_X86_64_OP_PUSHQ:
+    case ASM_X86_64_OP_POPQ:
+    {
+        uint8_t base = inst->value.op.op == ASM_X86_64_OP_PUSHQ ? 0x50 : 0x58;
+        if (args[0].kind != ASM_X86_64_VALUE_KIND_REG || reg_code(args[0].value.reg) < 0) {
+            return 1;
+        }
+        int r = reg_code(args[0].value.reg);
+        if (r >= 8) {
+            bytes_put_u8(&j->code, 0x41); // REX.B
+        }
+        bytes_put_u8(&j->code, (uint8_t)(base + (r & 7)));
+        return 0;
+    }
+
+    case ASM_X86_64_OP_MOVQ:
+        return put_mov(j, 1, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_MOVL:
+        return put_mov(j, 0, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_ADDQ:
+        return put_alu(j, 1, 0x01, 0x03, 0, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_SUBQ:
+        return put_alu(j, 1, 0x29, 0x2b, 5, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_CMPQ:
+        return put_alu(j, 1, 0x39, 0x3b, 7, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_SETE:
+        return put_setcc(j, 0x4, &args[0]);
+
+    case ASM_X86_64_OP_SETNE:
+        return put_setcc(j, 0x5, &args[0]);
+
+    case ASM_X86_64_OP_SETL:
+        return put_setcc(j, 0xc, &args[0]);
+
+    case ASM_X86_64_OP_SETGE:
+        return put_setcc(j, 0xd, &args[0]);
+
+    case ASM_X86_64_OP_SETLE:
+        return put_setcc(j, 0xe, &args[0]);
+
+    case ASM_X86_64_OP_SETG:
+        return put_setcc(j, 0xf, &args[0]);
+
+    case ASM_X86_64_OP_MOVZBQ:
+        return put_0f_reg_rm(j, 0xb6, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_CMOVNE:
+        return put_0f_reg_rm(j, 0x45, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_MOVSLQ:
+        // REX.W 63 /r
+        if (args[0].kind != ASM_X86_64_VALUE_KIND_REG) {
+            return 1;
+        }
+        put_rex(j, 1, reg_code(args[0].value.reg), &args[1]);
+        bytes_put_u8(&j->code, 0x63);
+        return put_modrm(j, reg_code(args[0].value.reg), &args[1]);
+
+    case ASM_X86_64_OP_ANDQ:
+        return put_alu(j, 1, 0x21, 0x23, 4, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_ORQ:
+        return put_alu(j, 1, 0x09, 0x0b, 1, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_XORQ:
+        return put_alu(j, 1, 0x31, 0x33, 6, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_IMULQ:
+        return put_imul(j, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_IMULQ_WIDE:
+        return put_unary(j, 5, &args[0]);
+
+    case ASM_X86_64_OP_IDIVQ:
+        return put_unary(j, 7, &args[0]);
+
+    case ASM_X86_64_OP_NEGQ:
+        return put_unary(j, 3, &args[0]);
+
+    case ASM_X86_64_OP_CQTO:
+        bytes_put_u8(&j->code, 0x48);
+        bytes_put_u8(&j->code, 0x99);
+        return 0;
+
+    case ASM_X86_64_OP_SHLQ:
+        return put_shift(j, 4, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_SHRQ:
+        return put_shift(j, 5, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_SARQ:
+        return put_shift(j, 7, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_MOVABSQ:
+        return put_movabs(j, &args[0], &args[1]);
+
+    case ASM_X86_64_OP_LEAQ:
+        if (args[0].kind != ASM_X86_64_VALUE_KIND_REG || !is_mem(&args[1])) {
+            return 1;
+        }
+        put_rex(j, 1, reg_code(args[0].value.reg), &args[1]);
+        bytes_put_u8(&j->code, 0x8d);
+        return put_modrm(j, reg_code(args[0].value.reg), &args[1]);
+
+    case ASM_X86_64_OP_CALL:
+        return put_call(j, &args[0]);
+
+    case ASM_X86_64_OP_JMP:
+    case ASM_X86_64_OP_JE:
+    case ASM_X86_64_OP_JNE:
+    case ASM_X86_64_OP_JA:
+    case ASM_X86_64_OP_JL:
+    case ASM_X86_64_OP_JLE:
+    case ASM_X86_64_OP_JG:
+    case ASM_X86_64_OP_JGE:
+    case ASM_X86_64_OP_JMP_INDIRECT:
+        return put_jump(j, inst->value.op.op, &args[0]);
+
+    case ASM_X86_64_OP_RET:
+        bytes_put_u8(&j->code, 0xc3);
+        return 0;
+
+    default:
+        return 1;
+    }
+}
+
+static void collect_labels(JIT_X86_64* j, ASM_X86_64* a) {
+    JIT_X86_64_Section section = JIT_X86_64_SECTION_TEXT;
+    for(size_t i=0; i<vector_len(a->insts); ++i) {
+        ASM_X86_64_Inst* inst = vector_at(a->insts, i);
+        switch(inst->kind) {
+        case ASM_X86_64_INST_KIND_SECTION:
+            section = JIT_X86_64_SECTION_DATA; // TODO: other sections than .rodata
+            break;
+
+        case ASM_X86_64_INST_KIND_TEXT:
+            section = JIT_X86_64_SECTION_TEXT;
+            break;
+
+        case ASM_X86_64_INST_KIND_LABEL:
+        {
+            JIT_X86_64_Label* label = string_map_insert(j->labels, inst->value.label.name, NULL);
+            label->section = section;
+            label->offset = 0;
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+}
+
+static int encode(JIT_X86_64* j, ASM_X86_64* a) {
+    JIT_X86_64_Section section = JIT_X86_64_SECTION_TEXT;
+    for(size_t i=0; i<vector_len(a->insts); ++i) {
+        ASM_X86_64_Inst* inst = vector_at(a->insts, i);
+        switch(inst->kind) {
+        case ASM_X86_64_INST_KIND_SECTION:
+            section = JIT_X86_64_SECTION_DATA;
+            break;
+
+        case ASM_X86_64_INST_KIND_TEXT:
+            section = JIT_X86_64_SECTION_TEXT;
+            break;
+
+        case ASM_X86_64_INST_KIND_GLOBAL:
+        case ASM_X86_64_INST_KIND_TYPE:
+            break;
+
+        case ASM_X86_64_INST_KIND_LABEL:
+        {
+            JIT_X86_64_Label* label = string_map_find(j->labels, inst->value.label.name);
+            assert(label);
+            label->offset = section == JIT_X86_64_SECTION_TEXT ? j->code.len : j->data.len;
+            break;
+        }
+
+        case ASM_X86_64_INST_KIND_STRING:
+            bytes_put(&j->data, inst->value.string.s, inst->value.string.len);
+            bytes_put_u8(&j->data, '\0');
+            break;
+
+        case ASM_X86_64_INST_KIND_ALIGN:
+        {
+            // The data starts at an aligned offset, see load
+            JIT_X86_64_Bytes* b = section == JIT_X86_64_SECTION_TEXT ? &j->code : &j->data;
+            uint8_t pad = section == JIT_X86_64_SECTION_TEXT ? 0x90 : 0x00; // nop in the code
+            while(b->len % (size_t)inst->value.align.bytes != 0) {
+                bytes_put_u8(b, pad);
+            }
+            break;
+        }
+
+        case ASM_X86_64_INST_KIND_JUMP_TABLE_ENTRY:
+        {
+            if (section != JIT_X86_64_SECTION_DATA) {
+                fprintf(stderr, "JIT: jump table out of the data\n");
+                return 1;
+            }
+
+            JIT_X86_64_Fixup* f = (JIT_X86_64_Fixup*)vector_append(j->fixups);
+            f->kind = JIT_X86_64_FIXUP_TABLE;
+            f->pos = j->data.len;
+            f->end = 0;
+            f->value.entry.label = inst->value.jump_table_entry.label;
+            f->value.entry.table = inst->value.jump_table_entry.table;
+            bytes_put_i32(&j->data, 0);
+            break;
+        }
+
+        case ASM_X86_64_INST_KIND_OP:
+        {
+            size_t fixups_begin = vector_len(j->fixups);
+            if (encode_op(j, inst)) {
+                fprintf(stderr, "JIT: unsupported instruction: %d\n", inst->value.op.op);
+                return 1;
+            }
+            for(size_t k=fixups_begin; k<vector_len(j->fixups); ++k) {
+                JIT_X86_64_Fixup* f = vector_at(j->fixups, k);
+                f->end = j->code.len;
+            }
+            break;
+        }
+        }
+    }
+
+    return 0;
+}
+
+static int load(JIT_X86_64* j) {
+    j->data_offset = (j->code.len + 15) & ~(size_t)15;
+    j->slots_offset = (j->data_offset + j->data.len + 7) & ~(size_t)7;
+    size_t size = j->slots_offset + sizeof(void*) * vector_len(j->slot_names);
+
+    size_t page = 4096;
+    j->mem_size = (size + page - 1) & ~(page - 1);
+    if (j->mem_size == 0) {
+        j->mem_size = page;
+    }
+    void* mem = mmap(NULL, j->mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return 1;
+    }
+    j->mem = (uint8_t*)mem;
+
+    if (j->code.len) {
+        memcpy(j->mem, j->code.buf, j->code.len);
+    }
+    if (j->data.len) {
+        memcpy(j->mem + j->data_offset, j->data.buf, j->data.len);
+    }
+
+    for(size_t i=0; i<vector_len(j->slot_names); ++i) {
+        char const** name = vector_at(j->slot_names, i);
+        void* addr = dlsym(RTLD_DEFAULT, *name);
+        if (addr == NULL) {
+            fprintf(stderr, "JIT: undefined symbol: %s\n", *name);
+            return 1;
+        }
+        memcpy(j->mem + j->slots_offset + sizeof(void*) * i, &addr, sizeof(void*));
+    }
+
+    for(size_t i=0; i<vector_len(j->fixups); ++i) {
+        JIT_X86_64_Fixup* f = vector_at(j->fixups, i);
+
+        size_t target;
+        switch(f->kind) {
+        case JIT_X86_64_FIXUP_LABEL:
+        {
+            JIT_X86_64_Label* label = string_map_find(j->labels, f->value.label);
+            if (label == NULL) {
+                fprintf(stderr, "JIT: undefined label: %s\n", f->value.label);
+                return 1;
+            }
+            target = label->offset + (label->section == JIT_X86_64_SECTION_TEXT ? 0 : j->data_offset);
+            break;
+        }
+
+        case JIT_X86_64_FIXUP_SLOT:
+            target = j->slots_offset + sizeof(void*) * f->value.slot;
+            break;
+
+        case JIT_X86_64_FIXUP_TABLE:
+        {
+            JIT_X86_64_Label* label = string_map_find(j->labels, f->value.entry.label);
+            JIT_X86_64_Label* table = string_map_find(j->labels, f->value.entry.table);
+            if (label == NULL || table == NULL) {
+                fprintf(stderr, "JIT: undefined label: %s\n", label == NULL ? f->value.entry.label : f->value.entry.table);
+                return 1;
+            }
+
+            // Both are absolute here, a text label and a table in the data
+            size_t abs_label = label->offset + (label->section == JIT_X86_64_SECTION_TEXT ? 0 : j->data_offset);
+            size_t abs_table = table->offset + (table->section == JIT_X86_64_SECTION_TEXT ? 0 : j->data_offset);
+            int32_t offset = (int32_t)((int64_t)abs_label - (int64_t)abs_table);
+            memcpy(j->mem + j->data_offset + f->pos, &offset, sizeof(offset));
+            continue;
+        }
+
+        default:
+            assert(0);
+        }
+
+        int32_t rel = (int32_t)((int64_t)target - (int64_t)f->end);
+        memcpy(j->mem + f->pos, &rel, sizeof(rel));
+    }
+
+    // W^X
+    if (mprotect(j->mem, j->mem_size, PROT_READ | PROT_EXEC) != 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+JIT_X86_64* jit_x86_64_new(ASM_X86_64* a) {
+    JIT_X86_64* j = (JIT_X86_64*)malloc(sizeof(JIT_X86_64));
+    j->labels = string_map_new(sizeof(JIT_X86_64_Label), NULL);
+    j->externals = string_map_new(sizeof(size_t), NULL);
+    j->slot_names = vector_new(sizeof(char const*));
+    j->fixups = vector_new(sizeof(JIT_X86_64_Fixup));
+    j->code = (JIT_X86_64_Bytes){ NULL, 0, 0 };
+    j->data = (JIT_X86_64_Bytes){ NULL, 0, 0 };
+    j->mem = NULL;
+    j->mem_size = 0;
+    j->data_offset = 0;
+    j->slots_offset = 0;
+
+    collect_labels(j, a);
+    if (encode(j, a) || load(j)) {
+        jit_x86_64_drop(j);
+        return NULL;
+    }
+
+    return j;
+}
+
+void jit_x86_64_drop(JIT_X86_64* j) {
+    if (j->mem) {
+        munmap(j->mem, j->mem_size);
+    }
+    free(j->code.buf);
+    free(j->data.buf);
+    vector_drop(j->fixups);
+    vector_drop(j->slot_names);
+    string_map_drop(j->externals);
+    string_map_drop(j->labels);
+
+    free(j);
+}
+
+int jit_x86_64_run(JIT_X86_64* j, char const* entry, int* exit_code) {
+    JIT_X86_64_Label* label = string_map_find(j->labels, entry);
+    if (label == NULL || label->section != JIT_X86_64_SECTION_TEXT) {
+        fprintf(stderr, "JIT: entry is not found: %s\n", entry);
+        return 1;
+    }
+
+    int (*f)(void);
+    void* addr = j->mem + label->offset;
+    memcpy(&f, &addr, sizeof(f));
+
+    *exit_code = f();
+
+    return 0;
+}
+
+size_t jit_x86_64_code_size(JIT_X86_64* j) {
+    return j->code.len;
+}
+
+size_t jit_x86_64_data_size(JIT_X86_64* j) {
+    return j->data.len;
+}
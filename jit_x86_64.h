@@ -0,0 +1,23 @@
+#ifndef CC_JIT_X86_64_H
+#define CC_JIT_X86_64_H
+
+#include <stddef.h>
+#include "asm_x86_64.h"
+
+// Encodes ASM_X86_64 into machine code in an executable buffer, and runs it in-process.
+// External symbols are resolved by dlsym.
+
+struct jit_x86_64_t;
+typedef struct jit_x86_64_t JIT_X86_64;
+
+// Returns NULL on failure, e.g. unsupported instructions or undefined symbols
+JIT_X86_64* jit_x86_64_new(ASM_X86_64* a);
+void jit_x86_64_drop(JIT_X86_64* j);
+
+// Calls 'entry' as int(void). Returns 0 on success.
+int jit_x86_64_run(JIT_X86_64* j, char const* entry, int* exit_code);
+
+size_t jit_x86_64_code_size(JIT_X86_64* j);
+size_t jit_x86_64_data_size(JIT_X86_64* j);
+
+#endif /* CC_JIT_X86_64_H */
@@ -1,14 +1,17 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
 #include "lexer.h"
 
 static Token read_id(Lexer* lex);
+static int is_keyword(char const* keyword, char const* buf, size_t len);
 static Token read_number_lit(Lexer* lex);
 static Token read_char_lit(Lexer* lex);
 static Token read_string_lit(Lexer* lex);
 
 static Token make_token(Lexer* lex, TokenKind kind);
+static Token make_token_if_assign(Lexer* lex, TokenKind kind, TokenKind assign_kind);
 static char current(Lexer* lex);
 static void skip(Lexer* lex);
 
@@ -17,6 +20,7 @@ struct lexer_t {
     size_t current_pos;
     size_t begin_pos;
     const char* filepath;
+    char const* error;  // Nullable
 };
 
 Lexer* lexer_new(const char *buffer, const char* filepath) {
@@ -25,6 +29,7 @@ Lexer* lexer_new(const char *buffer, const char* filepath) {
     lex->current_pos = 0;
     lex->begin_pos = -1;
     lex->filepath = filepath;
+    lex->error = NULL;
 
     return lex;
 }
@@ -33,7 +38,15 @@ void lexer_delete(Lexer *lex) {
     free(lex);
 }
 
+char const* lexer_error(Lexer* lex) {
+    return lex->error;
+}
+
 Token lexer_read(Lexer* lex) {
+    if (lex->error) {
+        return make_token(lex, TOK_KIND_EOF);
+    }
+
     for(;;) {
         lex->begin_pos = lex->current_pos;
 
@@ -68,11 +81,19 @@ Token lexer_read(Lexer* lex) {
 
         case '>':
             skip(lex);
-            return make_token(lex, TOK_KIND_GT);
+            if (current(lex) == '>') {
+                skip(lex);
+                return make_token_if_assign(lex, TOK_KIND_RSHIFT, TOK_KIND_RSHIFT_ASSIGN);
+            }
+            return make_token_if_assign(lex, TOK_KIND_GT, TOK_KIND_GE);
 
         case '<':
             skip(lex);
-            return make_token(lex, TOK_KIND_LT);
+            if (current(lex) == '<') {
+                skip(lex);
+                return make_token_if_assign(lex, TOK_KIND_LSHIFT, TOK_KIND_LSHIFT_ASSIGN);
+            }
+            return make_token_if_assign(lex, TOK_KIND_LT, TOK_KIND_LE);
 
         case '(':
             skip(lex);
@@ -116,35 +137,71 @@ Token lexer_read(Lexer* lex) {
 
         case '+':
             skip(lex);
-            return make_token(lex, TOK_KIND_PLUS);
+            if (current(lex) == '+') {
+                skip(lex);
+                return make_token(lex, TOK_KIND_INC);
+            }
+            return make_token_if_assign(lex, TOK_KIND_PLUS, TOK_KIND_PLUS_ASSIGN);
 
         case '-':
             skip(lex);
-            return make_token(lex, TOK_KIND_MINUS);
+            if (current(lex) == '-') {
+                skip(lex);
+                return make_token(lex, TOK_KIND_DEC);
+            }
+            if (current(lex) == '>') {
+                skip(lex);
+                return make_token(lex, TOK_KIND_ARROW);
+            }
+            return make_token_if_assign(lex, TOK_KIND_MINUS, TOK_KIND_MINUS_ASSIGN);
 
         case '*':
             skip(lex);
-            return make_token(lex, TOK_KIND_MUL);
+            return make_token_if_assign(lex, TOK_KIND_MUL, TOK_KIND_MUL_ASSIGN);
 
         case '/':
             skip(lex);
-            return make_token(lex, TOK_KIND_DIV);
+            return make_token_if_assign(lex, TOK_KIND_DIV, TOK_KIND_DIV_ASSIGN);
+
+        case '%':
+            skip(lex);
+            return make_token_if_assign(lex, TOK_KIND_MOD, TOK_KIND_MOD_ASSIGN);
 
         case '=':
             skip(lex);
-            return make_token(lex, TOK_KIND_ASSIGN);
+            return make_token_if_assign(lex, TOK_KIND_ASSIGN, TOK_KIND_EQ);
 
         case '!':
             skip(lex);
-            return make_token(lex, TOK_KIND_NOT);
+            return make_token_if_assign(lex, TOK_KIND_NOT, TOK_KIND_NE);
+
+        case '~':
+            skip(lex);
+            return make_token(lex, TOK_KIND_TILDE);
+
+        case '^':
+            skip(lex);
+            return make_token_if_assign(lex, TOK_KIND_XOR, TOK_KIND_XOR_ASSIGN);
+
+        case '?':
+            skip(lex);
+            return make_token(lex, TOK_KIND_QUESTION);
 
         case '&':
             skip(lex);
-            return make_token(lex, TOK_KIND_AND);
+            if (current(lex) == '&') {
+                skip(lex);
+                return make_token(lex, TOK_KIND_LOGICAL_AND);
+            }
+            return make_token_if_assign(lex, TOK_KIND_AND, TOK_KIND_AND_ASSIGN);
 
         case '|':
             skip(lex);
-            return make_token(lex, TOK_KIND_OR);
+            if (current(lex) == '|') {
+                skip(lex);
+                return make_token(lex, TOK_KIND_LOGICAL_OR);
+            }
+            return make_token_if_assign(lex, TOK_KIND_OR, TOK_KIND_OR_ASSIGN);
 
         case '\0':
             return make_token(lex, TOK_KIND_EOF);
@@ -171,23 +228,48 @@ static Token read_id(Lexer* lex) {
         }
 
         Token tok = make_token(lex, TOK_KIND_ID);
-        char const* buf = tok.buf_ref + tok.pos_begin;
-        if (strncmp("else", buf, tok.pos_end - tok.pos_begin) == 0) {
+        char const* buf = token_begin(lex->buffer, &tok);
+        size_t len = token_len(&tok);
+        if (is_keyword("else", buf, len)) {
             tok.kind = TOK_KIND_ELSE;
-        } else if (strncmp("if", buf, tok.pos_end - tok.pos_begin) == 0) {
+        } else if (is_keyword("if", buf, len)) {
             tok.kind = TOK_KIND_IF;
-        } else if (strncmp("return", buf, tok.pos_end - tok.pos_begin) == 0) {
+        } else if (is_keyword("return", buf, len)) {
             tok.kind = TOK_KIND_RETURN;
+        } else if (is_keyword("while", buf, len)) {
+            tok.kind = TOK_KIND_WHILE;
+        } else if (is_keyword("do", buf, len)) {
+            tok.kind = TOK_KIND_DO;
+        } else if (is_keyword("for", buf, len)) {
+            tok.kind = TOK_KIND_FOR;
+        } else if (is_keyword("break", buf, len)) {
+            tok.kind = TOK_KIND_BREAK;
+        } else if (is_keyword("continue", buf, len)) {
+            tok.kind = TOK_KIND_CONTINUE;
+        } else if (is_keyword("switch", buf, len)) {
+            tok.kind = TOK_KIND_SWITCH;
+        } else if (is_keyword("case", buf, len)) {
+            tok.kind = TOK_KIND_CASE;
+        } else if (is_keyword("default", buf, len)) {
+            tok.kind = TOK_KIND_DEFAULT;
         }
         return tok;
     }
 }
 
+static int is_keyword(char const* keyword, char const* buf, size_t len) {
+    return strlen(keyword) == len && strncmp(keyword, buf, len) == 0;
+}
+
 static Token read_number_lit(Lexer* lex) {
     for(;;) {
         char c0 = current(lex);
 
-        if (c0 >= '0' && c0 <= '9') {
+        // Letters are read together for hex digits and suffixes (e.g. 0x1fUL), and validated by the parser
+        switch(c0) {
+        case '0' ... '9':
+        case 'A' ... 'Z':
+        case 'a' ... 'z':
             skip(lex);
             continue;
         }
@@ -197,6 +279,8 @@ static Token read_number_lit(Lexer* lex) {
 }
 
 static Token read_char_lit(Lexer* lex) {
+    lex->begin_pos = lex->current_pos;
+
     for(;;) {
         char c0 = current(lex);
         switch(c0) {
@@ -207,6 +291,18 @@ static Token read_char_lit(Lexer* lex) {
             return tok;
         }
 
+        case '\\':
+            // An escaped char never terminates the literal
+            skip(lex);
+            if (current(lex) != '\0') {
+                skip(lex);
+            }
+            continue;
+
+        case '\0':
+            assert(0); // TODO: error handling...
+            return make_token(lex, TOK_KIND_EOF);
+
         default:
             skip(lex);
             continue;
@@ -227,6 +323,18 @@ static Token read_string_lit(Lexer* lex) {
             return tok;
         }
 
+        case '\\':
+            // An escaped char never terminates the literal
+            skip(lex);
+            if (current(lex) != '\0') {
+                skip(lex);
+            }
+            continue;
+
+        case '\0':
+            assert(0); // TODO: error handling...
+            return make_token(lex, TOK_KIND_EOF);
+
         default:
             skip(lex);
             continue;
@@ -234,16 +342,39 @@ static Token read_string_lit(Lexer* lex) {
     }
 }
 
+// Positions and lengths are packed into 32 bits, so tokens beyond the limits stop reading as EOF
 Token make_token(Lexer* lex, TokenKind kind) {
+    if (!lex->error && lex->current_pos > TOKEN_MAX_POS) {
+        lex->error = "The source is larger than 4 GiB";
+    } else if (!lex->error && lex->current_pos - lex->begin_pos > TOKEN_MAX_LEN) {
+        lex->error = "A token is longer than 16 MiB";
+    }
+    if (lex->error) {
+        Token eof = {
+            .pos = 0,
+            .len = 0,
+            .kind = TOK_KIND_EOF,
+        };
+        return eof;
+    }
+
     Token tok = {
+        .pos = (uint32_t)lex->begin_pos,
+        .len = (uint32_t)(lex->current_pos - lex->begin_pos),
         .kind = kind,
-        .buf_ref = lex->buffer,
-        .pos_begin = lex->begin_pos,
-        .pos_end = lex->current_pos,
     };
     return tok;
 }
 
+// Makes 'assign_kind' token if the next char is '=' (e.g. "+" and "+=")
+Token make_token_if_assign(Lexer* lex, TokenKind kind, TokenKind assign_kind) {
+    if (current(lex) == '=') {
+        skip(lex);
+        return make_token(lex, assign_kind);
+    }
+    return make_token(lex, kind);
+}
+
 char current(Lexer* lex) {
     return lex->buffer[lex->current_pos];
 }
@@ -10,5 +10,8 @@ Lexer* lexer_new(const char *buffer, const char* filepath);
 void lexer_delete(Lexer *lex);
 
 Token lexer_read(Lexer* lex);
+// Returns NULL, or a message of the error which stopped reading, e.g. of a too large input.
+// Tokens are EOF after an error.
+char const* lexer_error(Lexer* lex);
 
 #endif /*CC_LEXER_H*/
@@ -0,0 +1,158 @@
+#include <assert.h>
+#include "literal.h"
+
+static int digit_value(char c) {
+    switch(c) {
+    case '0' ... '9':
+        return c - '0';
+    case 'a' ... 'f':
+        return c - 'a' + 10;
+    case 'A' ... 'F':
+        return c - 'A' + 10;
+    default:
+        return -1;
+    }
+}
+
+int literal_decode_int(char const* s, size_t len, long* out) {
+    size_t i = 0;
+    int base = 10;
+    if (len >= 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        i = 2;
+    } else if (len >= 2 && s[0] == '0') {
+        base = 8;
+        i = 1;
+    }
+
+    size_t digits_begin = i;
+    unsigned long v = 0;
+    for(; i<len; ++i) {
+        int d = digit_value(s[i]);
+        if (d < 0 || d >= base) {
+            break;
+        }
+        v = v * base + d; // TODO: overflow
+    }
+    if (base == 16 && i == digits_begin) {
+        return 1;
+    }
+
+    // Suffixes
+    for(; i<len; ++i) {
+        switch(s[i]) {
+        case 'u': case 'U':
+        case 'l': case 'L':
+            continue;
+        default:
+            return 1;
+        }
+    }
+
+    *out = (long)v;
+    return 0;
+}
+
+size_t literal_decode_escape(char const* s, size_t len, char* out) {
+    assert(len > 0);
+    if (s[0] != '\\' || len == 1) {
+        *out = s[0];
+        return 1;
+    }
+
+    switch(s[1]) {
+    case 'n': *out = '\n'; return 2;
+    case 't': *out = '\t'; return 2;
+    case 'r': *out = '\r'; return 2;
+    case 'a': *out = '\a'; return 2;
+    case 'b': *out = '\b'; return 2;
+    case 'f': *out = '\f'; return 2;
+    case 'v': *out = '\v'; return 2;
+    case 'e': *out = 27; return 2; // GNU extension
+
+    case 'x':
+    {
+        size_t i = 2;
+        unsigned v = 0;
+        for(; i<len; ++i) {
+            int d = digit_value(s[i]);
+            if (d < 0) {
+                break;
+            }
+            v = v * 16 + d;
+        }
+        *out = (char)v;
+        return i;
+    }
+
+    case '0' ... '7':
+    {
+        size_t i = 1;
+        unsigned v = 0;
+        for(; i<len && i<4 && s[i] >= '0' && s[i] <= '7'; ++i) {
+            v = v * 8 + (s[i] - '0');
+        }
+        *out = (char)v;
+        return i;
+    }
+
+    default:
+        // \\, \', \", \? and unknown escapes
+        *out = s[1];
+        return 2;
+    }
+}
+
+int literal_decode_char(char const* s, size_t len, int* out) {
+    if (len == 0) {
+        return 1;
+    }
+
+    char c;
+    size_t n = literal_decode_escape(s, len, &c);
+    if (n != len) {
+        return 1; // TODO: multi-character constants
+    }
+
+    *out = c;
+    return 0;
+}
+
+void literal_fprint_string(FILE* fp, char const* s, size_t len) {
+    for(size_t i=0; i<len; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        switch(c) {
+        case '"':  fputs("\\\"", fp); break;
+        case '\\': fputs("\\\\", fp); break;
+        case '\n': fputs("\\n", fp); break;
+        case '\t': fputs("\\t", fp); break;
+        default:
+            if (c < 0x20 || c >= 0x7f) {
+                fprintf(fp, "\\%03o", c);
+            } else {
+                fputc(c, fp);
+            }
+            break;
+        }
+    }
+}
+
+void literal_write_string(Writer* w, char const* s, size_t len) {
+    for(size_t i=0; i<len; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        switch(c) {
+        case '"':  writer_put_bytes(w, "\\\"", 2); break;
+        case '\\': writer_put_bytes(w, "\\\\", 2); break;
+        case '\n': writer_put_bytes(w, "\\n", 2); break;
+        case '\t': writer_put_bytes(w, "\\t", 2); break;
+        default:
+            if (c < 0x20 || c >= 0x7f) {
+                char oct[4] = { '\\', (char)('0' + (c >> 6)), (char)('0' + ((c >> 3) & 7)), (char)('0' + (c & 7)) };
+                writer_put_bytes(w, oct, 4);
+            } else {
+                writer_put_char(w, (char)c);
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef CC_LITERAL_H
+#define CC_LITERAL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "writer.h"
+
+// Decoders of literals. They read spans of the source directly, and never allocate.
+
+// Decimal, octal (0...) and hexadecimal (0x...) integers with optional u/l suffixes.
+// Returns 0 on success.
+int literal_decode_int(char const* s, size_t len, long* out);
+
+// A body of a character literal, e.g. "a" or "\n". Returns 0 on success.
+int literal_decode_char(char const* s, size_t len, int* out);
+
+// Decodes one character of a string or character literal body at 's', and returns the number of consumed chars
+size_t literal_decode_escape(char const* s, size_t len, char* out);
+
+// Writes decoded bytes with escapes in the form of C and GNU as
+void literal_fprint_string(FILE* fp, char const* s, size_t len);
+void literal_write_string(Writer* w, char const* s, size_t len);
+
+#endif /* CC_LITERAL_H */
@@ -0,0 +1,11 @@
+#include "log.h"
+
+static FILE* debugout = NULL;
+
+FILE* log_debugout() {
+    return debugout ? debugout : stdout;
+}
+
+void log_set_debugout(FILE* fp) {
+    debugout = fp;
+}
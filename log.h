@@ -3,6 +3,11 @@
 
 #include "stdio.h"
 
-#define DEBUGOUT stdout
+// Stream of debug dumps, stdout unless it is set, e.g. to stderr while stdout carries the output
+FILE* log_debugout();
+// 'fp' is nullable, then dumps go to stdout
+void log_set_debugout(FILE* fp);
+
+#define DEBUGOUT log_debugout()
 
 #endif /*CC_LOG_H*/
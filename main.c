@@ -1,13 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <signal.h>
 #include "lexer.h"
 #include "parser.h"
 #include "ir.h"
 #include "analyzer.h"
 #include "asm_x86_64.h"
 #include "vector.h"
+#include "options.h"
 #include "cc.h"
+#include "server.h"
+#include "log.h"
+#include "compile_cache.h"
 
 static char* read_all(FILE* fp) {
     fseek(fp, 0, SEEK_END);
@@ -21,47 +27,71 @@ static char* read_all(FILE* fp) {
     return fcontent;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "argc: %d shoule be 2", argc);
-        return 1;
-    }
-
+// 'ws' is nullable. Returns an exit code.
+static int compile(CCOptions const* opts, CCWorkspace* ws) {
     int exit_code = 1;
-    char *fpath = argv[1];
+    char const* fpath = opts->input_path;
+    char* fcontent = NULL;
 
-    printf("C => %s\n", fpath);
+    // Dumps would be mixed into the output otherwise
+    log_set_debugout(options_writes_stdout(opts) ? stderr : NULL);
+    compile_cache_reset_stats();
+
+    fprintf(DEBUGOUT, "C => %s\n", fpath);
     FILE *fp = fopen(fpath, "rb");
     if (fp == NULL) {
         fprintf(stderr, "Failed to open file: ");
         goto exit_0;
     }
 
-    char *fcontent = read_all(fp);
+    fcontent = read_all(fp);
     fclose(fp);
 
-    printf("%s\n", fcontent);
+    fprintf(DEBUGOUT, "%s\n", fcontent);
+
+    CC* cc = cc_new(fcontent, fpath, opts, ws);
+
+    if (cc_fetch_compile_cache(cc)) {
+        exit_code = 0;
+        goto exit;
+    }
 
-    CC* cc = cc_new(fcontent, fpath);
+    if (cc_load_ast_cache(cc)) {
+        fprintf(DEBUGOUT, "= AST = (cached)\n\n");
+        goto compile;
+    }
 
     ParserResult res = cc_parse(cc);
     if (res.result == PARSER_ERROR) {
         fprintf(stderr, "ERROR: ");
-        parser_fprint_error(stderr, &res.error);
+        parser_fprint_error(stderr, fcontent, &res.error);
         fprintf(stderr, "\n");
         goto exit;
     }
     assert(res.value.node);
 
-    printf("= AST =\n");
-    node_fprint(stdout, res.value.node);
-    printf("\n");
+    fprintf(DEBUGOUT, "= AST =\n");
+    node_fprint(DEBUGOUT, fcontent, res.value.node);
+    fprintf(DEBUGOUT, "\n");
 
     /*AnalyzerResult res = */cc_analyze(cc, res.value.node);
     /* TODO: error check */
 
+compile:
+    ;
+    if (opts->run || opts->interp) {
+        int run_exit_code;
+        int err = opts->interp ? cc_interp(cc, &run_exit_code) : cc_run(cc, &run_exit_code);
+        if (err) {
+            goto exit;
+        }
+
+        exit_code = run_exit_code;
+        goto exit;
+    }
+
     int err =
-    /*CompileResult res = */cc_compile(cc, res.value.node);
+    /*CompileResult res = */cc_compile(cc);
     if (err) {
         goto exit;
     }
@@ -76,3 +106,66 @@ exit_0:
 
     return exit_code;
 }
+
+// 'args' is the CCWorkspace kept across jobs
+static int server_job(int argc, char* argv[], void* args) {
+    CCOptions opts;
+    options_init(&opts);
+    if (options_parse(&opts, argc, argv) || opts.server_path || opts.connect_path) {
+        options_fprint_usage(stderr, argv[0]);
+        return 1;
+    }
+    // The program would run in the server, and e.g. exit() of it would end the worker
+    if (opts.run || opts.interp) {
+        fprintf(stderr, "cc server: --run and --interp are not served\n");
+        return 1;
+    }
+
+    return compile(&opts, (CCWorkspace*)args);
+}
+
+int main(int argc, char *argv[]) {
+    CCOptions opts;
+    options_init(&opts);
+    if (options_parse(&opts, argc, argv)) {
+        options_fprint_usage(stderr, argv[0]);
+        return 1;
+    }
+
+    // Write errors to the assembler pipe and clients are handled by the caller
+    signal(SIGPIPE, SIG_IGN);
+
+    if (opts.server_path) {
+        CCWorkspace* ws = cc_workspace_new();
+        int err = server_run(opts.server_path, server_job, ws);
+        cc_workspace_drop(ws);
+        return err;
+    }
+
+    // Programs run by --run and --interp are run locally
+    if (opts.connect_path && !opts.run && !opts.interp) {
+        // Forward argv without '--connect SOCKET'
+        char* fwd_argv[argc];
+        int fwd_argc = 0;
+        for(int i=0; i<argc; ++i) {
+            if (strcmp(argv[i], "--connect") == 0) {
+                ++i;
+                continue;
+            }
+            fwd_argv[fwd_argc++] = argv[i];
+        }
+
+        int code = server_client_run(opts.connect_path, fwd_argc, fwd_argv);
+        if (code == SERVER_JOB_LOST) {
+            // Outputs may be written partially, so it is not compiled again
+            fprintf(stderr, "cc: the server failed the job\n");
+            return 1;
+        }
+        if (code >= 0) {
+            return code;
+        }
+        fprintf(stderr, "cc: server is not available, compile locally\n");
+    }
+
+    return compile(&opts, NULL);
+}
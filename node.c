@@ -2,7 +2,7 @@
 #include <assert.h>
 #include "node.h"
 
-static void fprint_impl(FILE *fp, Node* node, int indent);
+static void fprint_impl(FILE *fp, char const* buffer, Node* node, int indent);
 static void fprint_indent(FILE *fp, int indent);
 
 void node_destruct(Node* node) {
@@ -15,10 +15,6 @@ void node_destruct(Node* node) {
         vector_drop(node->value.stmt_compound.stmts);
         break;
 
-    case NODE_LIT_STRING:
-        free((char*)node->value.lit_string.v);
-        break;
-
     case NODE_ARGS_LIST:
         vector_drop(node->value.args_list.args);
         break;
@@ -33,184 +29,607 @@ void node_destruct(Node* node) {
     }
 }
 
-void node_fprint(FILE *fp, Node* node) {
-    fprint_impl(fp, node, 0);
+void node_fprint(FILE *fp, char const* buffer, Node* node) {
+    fprint_impl(fp, buffer, node, 0);
 }
 
 Token* node_declarator_extract_id_token(Node* node) {
-    switch(node->kind) {
-    case NODE_DECLARATOR:
-        return node_declarator_extract_id_token(node->value.declarator.node);
-    case NODE_DIRECT_DECLARATOR:
-        return node_declarator_extract_id_token(node->value.direct_declarator.base);
-    case NODE_ID:
-        return node->value.id.tok;
-    default:
-        return NULL;
+    for(;;) {
+        switch(node->kind) {
+        case NODE_DECLARATOR:
+            node = node->value.declarator.node;
+            continue;
+        case NODE_DIRECT_DECLARATOR:
+            node = node->value.direct_declarator.base;
+            continue;
+        case NODE_ID:
+            return node->value.id.tok;
+        default:
+            return NULL;
+        }
+    }
+}
+
+static void foreach_in_vector(Vector* nodes, void (*f)(Node*, void*), void* args) {
+    for(size_t i=0; i<vector_len(nodes); ++i) {
+        Node** n = (Node**)vector_at(nodes, i);
+        f(*n, args);
     }
 }
 
-void fprint_impl(FILE *fp, Node* node, int indent) {
+void node_foreach_children(Node* node, void (*f)(Node*, void*), void* args) {
     switch(node->kind) {
     case NODE_TRANS_UNIT:
-    {
-        Vector* decls = node->value.trans_unit.decls;
-        for(size_t i=0; i<vector_len(decls); ++i) {
-            Node** n = (Node**)vector_at(decls, i);
-            fprint_impl(fp, *n, indent);
-        }
+        foreach_in_vector(node->value.trans_unit.decls, f, args);
         break;
-    }
 
     case NODE_FUNC_DEF:
-        fprint_indent(fp, indent); fprint_impl(fp, node->value.func_def.decl_spec, 0);
-        fprintf(fp, " ");
-        fprint_indent(fp, indent); fprint_impl(fp, node->value.func_def.decl, 0);
-        fprint_indent(fp, indent); fprintf(fp, "\n");
-        fprint_impl(fp, node->value.func_def.block, indent);
+        f(node->value.func_def.decl_spec, args);
+        f(node->value.func_def.decl, args);
+        f(node->value.func_def.block, args);
         break;
 
     case NODE_STMT_COMPOUND:
-    {
-        fprint_indent(fp, indent); fprintf(fp, "{\n");
-        Vector* stmts = node->value.stmt_compound.stmts;
-        for(size_t i=0; i<vector_len(stmts); ++i) {
-            Node** n = (Node**)vector_at(stmts, i);
-            fprint_impl(fp, *n, indent + 1);
-        }
-        fprint_indent(fp, indent); fprintf(fp, "}\n");
+        foreach_in_vector(node->value.stmt_compound.stmts, f, args);
         break;
-    }
 
     case NODE_STMT_EXPR:
         if (node->value.stmt_expr.expr) {
-            fprint_indent(fp, indent); fprint_impl(fp, node->value.stmt_expr.expr, 0);
+            f(node->value.stmt_expr.expr, args);
         }
-        fprintf(fp, " ;\n");
         break;
 
     case NODE_STMT_IF:
-        fprint_indent(fp, indent); fprintf(fp, "if ( ");
-        fprint_impl(fp, node->value.stmt_if.cond, 0);
-        fprintf(fp, " )\n");
-
-        fprint_impl(fp, node->value.stmt_if.then_b, indent);
-
+        f(node->value.stmt_if.cond, args);
+        f(node->value.stmt_if.then_b, args);
         if (node->value.stmt_if.else_b) {
-            fprint_impl(fp, node->value.stmt_if.else_b, indent);
+            f(node->value.stmt_if.else_b, args);
         }
         break;
 
-    case NODE_STMT_JUMP:
-        switch(node->value.stmt_jump.kind) {
-        case TOK_KIND_RETURN:
-            fprint_indent(fp, indent); fprintf(fp, "return ");
-            fprint_impl(fp, node->value.stmt_jump.expr, 0);
-            fprintf(fp, " ;\n");
-            break;
+    case NODE_STMT_WHILE:
+        f(node->value.stmt_while.cond, args);
+        f(node->value.stmt_while.body, args);
+        break;
 
-        default:
-            assert(0); // TODO: error handling...
-            break;
+    case NODE_STMT_DO:
+        f(node->value.stmt_do.body, args);
+        f(node->value.stmt_do.cond, args);
+        break;
+
+    case NODE_STMT_FOR:
+        if (node->value.stmt_for.init) {
+            f(node->value.stmt_for.init, args);
         }
+        if (node->value.stmt_for.cond) {
+            f(node->value.stmt_for.cond, args);
+        }
+        if (node->value.stmt_for.step) {
+            f(node->value.stmt_for.step, args);
+        }
+        f(node->value.stmt_for.body, args);
         break;
 
-    case NODE_EXPR_BIN:
-        fprint_impl(fp, node->value.expr_bin.lhs, indent);
-        token_fprint_buf(fp, node->value.expr_bin.op);
-        fprint_impl(fp, node->value.expr_bin.rhs, indent);
+    case NODE_STMT_SWITCH:
+        f(node->value.stmt_switch.cond, args);
+        f(node->value.stmt_switch.body, args);
         break;
 
-    case NODE_EXPR_POSTFIX:
-        switch(node->value.expr_postfix.kind) {
-        case NODE_EXPR_POSTFIX_KIND_FUNC_CALL:
-            fprint_impl(fp, node->value.expr_postfix.lhs, indent);
-            fprintf(fp, "(");
-            if (node->value.expr_postfix.rhs) {
-                fprint_impl(fp, node->value.expr_postfix.rhs, indent);
-            }
-            fprintf(fp, ")");
-            break;
+    case NODE_STMT_CASE:
+        f(node->value.stmt_case.expr, args);
+        f(node->value.stmt_case.stmt, args);
+        break;
 
-        default:
-            assert(0); // TODO: error handling...
+    case NODE_STMT_DEFAULT:
+        f(node->value.stmt_default.stmt, args);
+        break;
+
+    case NODE_STMT_JUMP:
+        if (node->value.stmt_jump.expr) {
+            f(node->value.stmt_jump.expr, args);
         }
         break;
 
-    case NODE_LIT_INT:
-        fprintf(fp, "%d", node->value.lit_int.v);
+    case NODE_EXPR_BIN:
+        f(node->value.expr_bin.lhs, args);
+        f(node->value.expr_bin.rhs, args);
         break;
 
-    case NODE_LIT_STRING:
-        fprintf(fp, "\"%s\"", node->value.lit_string.v);
+    case NODE_EXPR_UNARY:
+        f(node->value.expr_unary.expr, args);
         break;
 
-    case NODE_ID:
-        token_fprint_buf(fp, node->value.id.tok);
+    case NODE_EXPR_COND:
+        f(node->value.expr_cond.cond, args);
+        f(node->value.expr_cond.then_e, args);
+        f(node->value.expr_cond.else_e, args);
         break;
 
-    case NODE_ARGS_LIST:
-    {
-        Vector* args = node->value.args_list.args;
-        for(size_t i=0; i<vector_len(args); ++i) {
-            if (i != 0) {
-                fprintf(fp, ", ");
-            }
-            Node** n = (Node**)vector_at(args, i);
-            fprint_impl(fp, *n, 0);
+    case NODE_EXPR_POSTFIX:
+        f(node->value.expr_postfix.lhs, args);
+        if (node->value.expr_postfix.rhs) {
+            f(node->value.expr_postfix.rhs, args);
         }
         break;
-    }
+
+    case NODE_ARGS_LIST:
+        foreach_in_vector(node->value.args_list.args, f, args);
+        break;
 
     case NODE_DECLARATOR:
-        fprint_impl(fp, node->value.declarator.node, 0);
+        f(node->value.declarator.node, args);
         break;
 
     case NODE_DIRECT_DECLARATOR:
-        fprint_impl(fp, node->value.direct_declarator.base, 0);
-        switch(node->value.direct_declarator.kind) {
-        case NODE_DIRECT_DECLARATOR_KIND_BASE:
-            break; // DO NOTHING
-
-        case NODE_DIRECT_DECLARATOR_KIND_PARAM_TYPE_LIST:
-            fprintf(fp, "(");
-            fprint_impl(fp, node->value.direct_declarator.args[0], 0);
-            fprintf(fp, ")");
-            break;
-
-        default:
-            assert(0); // TODO: error handling...
+        f(node->value.direct_declarator.base, args);
+        if (node->value.direct_declarator.kind == NODE_DIRECT_DECLARATOR_KIND_PARAM_TYPE_LIST) {
+            f(node->value.direct_declarator.args[0], args);
         }
         break;
 
     case NODE_PARAM_DECL:
-        fprint_impl(fp, node->value.param_decl.spec, 0);
+        f(node->value.param_decl.spec, args);
         if (node->value.param_decl.decl) {
-            fprintf(fp, " ");
-            fprint_impl(fp, node->value.param_decl.decl, 0);
+            f(node->value.param_decl.decl, args);
         }
         break;
 
     case NODE_PARAM_LIST:
-    {
-        Vector* params = node->value.param_list.params;
-        for(size_t i=0; i<vector_len(params); ++i) {
-            if (i != 0) {
-                fprintf(fp, ", ");
-            }
-            Node** n = (Node**)vector_at(params, i);
-            fprint_impl(fp, *n, 0);
-        }
+        foreach_in_vector(node->value.param_list.params, f, args);
         break;
+
+    case NODE_LIT_INT:
+    case NODE_LIT_STRING:
+    case NODE_ID:
+        break; // DO NOTHING
     }
+}
 
-    default:
-        fprintf(stderr, "Unknown kind: %d\n", node->kind);
-        assert(0); // TODO: error handling...
-        break;
+typedef struct {
+    Node* node;
+    int expanded;
+} VisitFrame;
+
+static void node_visit_postorder_iter(Node* child, void* args) {
+    Vector* stack = (Vector*)args;
+
+    VisitFrame* frame = (VisitFrame*)vector_append(stack);
+    frame->node = child;
+    frame->expanded = 0;
+}
+
+void node_visit_postorder(Node* root, void (*f)(Node*, void*), void* args) {
+    Vector* stack = vector_new(sizeof(VisitFrame)); // Vector<VisitFrame>
+    node_visit_postorder_iter(root, stack);
+
+    while(vector_len(stack) > 0) {
+        size_t top = vector_len(stack) - 1;
+        VisitFrame* frame = (VisitFrame*)vector_at(stack, top);
+        Node* node = frame->node;
+
+        if (frame->expanded) {
+            vector_pop(stack);
+            f(node, args);
+            continue;
+        }
+        frame->expanded = 1;
+
+        node_foreach_children(node, node_visit_postorder_iter, stack);
+
+        // Reverse pushed children to visit them from the first one
+        size_t begin = top + 1;
+        size_t end = vector_len(stack);
+        while(begin + 1 < end) {
+            VisitFrame* l = (VisitFrame*)vector_at(stack, begin);
+            VisitFrame* r = (VisitFrame*)vector_at(stack, end - 1);
+            VisitFrame t = *l;
+            *l = *r;
+            *r = t;
+
+            begin++;
+            end--;
+        }
+    }
+
+    vector_drop(stack);
+}
+
+typedef enum {
+    PRINT_ACTION_NODE,
+    PRINT_ACTION_TEXT,
+    PRINT_ACTION_INDENT,
+    PRINT_ACTION_TOKEN,
+} PrintActionKind;
+
+typedef struct {
+    PrintActionKind kind;
+    union {
+        struct {
+            Node* node;
+            int indent;
+        } node;
+        char const* text;
+        int indent;
+        Token* token;
+    } value;
+} PrintAction;
+
+static PrintAction print_node(Node* node, int indent) {
+    PrintAction act = {
+        .kind = PRINT_ACTION_NODE,
+        .value = {
+            .node = {
+                .node = node,
+                .indent = indent,
+            },
+        },
+    };
+    return act;
+}
+
+static PrintAction print_text(char const* text) {
+    PrintAction act = {
+        .kind = PRINT_ACTION_TEXT,
+        .value = {
+            .text = text,
+        },
+    };
+    return act;
+}
+
+static PrintAction print_indent(int indent) {
+    PrintAction act = {
+        .kind = PRINT_ACTION_INDENT,
+        .value = {
+            .indent = indent,
+        },
+    };
+    return act;
+}
+
+static PrintAction print_token(Token* token) {
+    PrintAction act = {
+        .kind = PRINT_ACTION_TOKEN,
+        .value = {
+            .token = token,
+        },
+    };
+    return act;
+}
+
+static void push_action(Vector* stack, PrintAction act) {
+    PrintAction* a = (PrintAction*)vector_append(stack);
+    *a = act;
+}
+
+// Pushes actions in reverse order, so they are performed from the first one
+static void push_actions(Vector* stack, PrintAction* acts, size_t num) {
+    for(size_t i=num; i>0; --i) {
+        push_action(stack, acts[i-1]);
+    }
+}
+
+static void push_node_list(Vector* stack, Vector* nodes, int indent, char const* sep) {
+    for(size_t i=vector_len(nodes); i>0; --i) {
+        Node** n = (Node**)vector_at(nodes, i-1);
+        push_action(stack, print_node(*n, indent));
+        if (sep && i-1 != 0) {
+            push_action(stack, print_text(sep));
+        }
     }
 }
 
+// Prints nodes with an explicit stack of actions instead of recursion
+void fprint_impl(FILE *fp, char const* buffer, Node* root, int root_indent) {
+    Vector* stack = vector_new(sizeof(PrintAction)); // Vector<PrintAction>
+    push_action(stack, print_node(root, root_indent));
+
+    while(vector_len(stack) > 0) {
+        PrintAction act = *(PrintAction*)vector_pop(stack);
+
+        switch(act.kind) {
+        case PRINT_ACTION_TEXT:
+            fprintf(fp, "%s", act.value.text);
+            continue;
+
+        case PRINT_ACTION_INDENT:
+            fprint_indent(fp, act.value.indent);
+            continue;
+
+        case PRINT_ACTION_TOKEN:
+            token_fprint_buf(fp, buffer, act.value.token);
+            continue;
+
+        case PRINT_ACTION_NODE:
+            break;
+        }
+
+        Node* node = act.value.node.node;
+        int indent = act.value.node.indent;
+
+        switch(node->kind) {
+        case NODE_TRANS_UNIT:
+            push_node_list(stack, node->value.trans_unit.decls, indent, NULL);
+            break;
+
+        case NODE_FUNC_DEF:
+        {
+            PrintAction acts[] = {
+                print_indent(indent), print_node(node->value.func_def.decl_spec, 0),
+                print_text(" "),
+                print_indent(indent), print_node(node->value.func_def.decl, 0),
+                print_indent(indent), print_text("\n"),
+                print_node(node->value.func_def.block, indent),
+            };
+            push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+            break;
+        }
+
+        case NODE_STMT_COMPOUND:
+            fprint_indent(fp, indent); fprintf(fp, "{\n");
+
+            push_action(stack, print_text("}\n"));
+            push_action(stack, print_indent(indent));
+            push_node_list(stack, node->value.stmt_compound.stmts, indent + 1, NULL);
+            break;
+
+        case NODE_STMT_EXPR:
+            push_action(stack, print_text(" ;\n"));
+            if (node->value.stmt_expr.expr) {
+                push_action(stack, print_node(node->value.stmt_expr.expr, 0));
+                push_action(stack, print_indent(indent));
+            }
+            break;
+
+        case NODE_STMT_IF:
+        {
+            fprint_indent(fp, indent); fprintf(fp, "if ( ");
+
+            if (node->value.stmt_if.else_b) {
+                push_action(stack, print_node(node->value.stmt_if.else_b, indent));
+            }
+            PrintAction acts[] = {
+                print_node(node->value.stmt_if.cond, 0),
+                print_text(" )\n"),
+                print_node(node->value.stmt_if.then_b, indent),
+            };
+            push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+            break;
+        }
+
+        case NODE_STMT_WHILE:
+        {
+            fprint_indent(fp, indent); fprintf(fp, "while ( ");
+
+            PrintAction acts[] = {
+                print_node(node->value.stmt_while.cond, 0),
+                print_text(" )\n"),
+                print_node(node->value.stmt_while.body, indent),
+            };
+            push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+            break;
+        }
+
+        case NODE_STMT_DO:
+        {
+            fprint_indent(fp, indent); fprintf(fp, "do\n");
+
+            PrintAction acts[] = {
+                print_node(node->value.stmt_do.body, indent),
+                print_indent(indent), print_text("while ( "),
+                print_node(node->value.stmt_do.cond, 0),
+                print_text(" ) ;\n"),
+            };
+            push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+            break;
+        }
+
+        case NODE_STMT_FOR:
+        {
+            fprint_indent(fp, indent); fprintf(fp, "for ( ");
+
+            // Pushed in reverse order
+            push_action(stack, print_node(node->value.stmt_for.body, indent));
+            push_action(stack, print_text(" )\n"));
+            if (node->value.stmt_for.step) {
+                push_action(stack, print_node(node->value.stmt_for.step, 0));
+            }
+            push_action(stack, print_text(" ; "));
+            if (node->value.stmt_for.cond) {
+                push_action(stack, print_node(node->value.stmt_for.cond, 0));
+            }
+            push_action(stack, print_text(" ; "));
+            if (node->value.stmt_for.init) {
+                push_action(stack, print_node(node->value.stmt_for.init, 0));
+            }
+            break;
+        }
+
+        case NODE_STMT_SWITCH:
+        {
+            fprint_indent(fp, indent); fprintf(fp, "switch ( ");
+
+            PrintAction acts[] = {
+                print_node(node->value.stmt_switch.cond, 0),
+                print_text(" )\n"),
+                print_node(node->value.stmt_switch.body, indent),
+            };
+            push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+            break;
+        }
+
+        case NODE_STMT_CASE:
+        {
+            fprint_indent(fp, indent); fprintf(fp, "case ");
+
+            PrintAction acts[] = {
+                print_node(node->value.stmt_case.expr, 0),
+                print_text(" :\n"),
+                print_node(node->value.stmt_case.stmt, indent),
+            };
+            push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+            break;
+        }
+
+        case NODE_STMT_DEFAULT:
+        {
+            fprint_indent(fp, indent); fprintf(fp, "default :\n");
+
+            push_action(stack, print_node(node->value.stmt_default.stmt, indent));
+            break;
+        }
+
+        case NODE_STMT_JUMP:
+            switch(node->value.stmt_jump.kind) {
+            case TOK_KIND_RETURN:
+            {
+                fprint_indent(fp, indent); fprintf(fp, "return ");
+
+                PrintAction acts[] = {
+                    print_node(node->value.stmt_jump.expr, 0),
+                    print_text(" ;\n"),
+                };
+                push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+                break;
+            }
+
+            case TOK_KIND_BREAK:
+                fprint_indent(fp, indent); fprintf(fp, "break ;\n");
+                break;
+
+            case TOK_KIND_CONTINUE:
+                fprint_indent(fp, indent); fprintf(fp, "continue ;\n");
+                break;
+
+            default:
+                assert(0); // TODO: error handling...
+                break;
+            }
+            break;
+
+        case NODE_EXPR_BIN:
+        {
+            fprintf(fp, "(");
+
+            PrintAction acts[] = {
+                print_node(node->value.expr_bin.lhs, indent),
+                print_token(node->value.expr_bin.op),
+                print_node(node->value.expr_bin.rhs, indent),
+                print_text(")"),
+            };
+            push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+            break;
+        }
+
+        case NODE_EXPR_UNARY:
+            token_fprint_buf(fp, buffer, node->value.expr_unary.op);
+
+            push_action(stack, print_node(node->value.expr_unary.expr, indent));
+            break;
+
+        case NODE_EXPR_COND:
+        {
+            fprintf(fp, "(");
+
+            PrintAction acts[] = {
+                print_node(node->value.expr_cond.cond, indent),
+                print_text(" ? "),
+                print_node(node->value.expr_cond.then_e, indent),
+                print_text(" : "),
+                print_node(node->value.expr_cond.else_e, indent),
+                print_text(")"),
+            };
+            push_actions(stack, acts, sizeof(acts)/sizeof(PrintAction));
+            break;
+        }
+
+        case NODE_EXPR_POSTFIX:
+            switch(node->value.expr_postfix.kind) {
+            case NODE_EXPR_POSTFIX_KIND_FUNC_CALL:
+                push_action(stack, print_text(")"));
+                if (node->value.expr_postfix.rhs) {
+                    push_action(stack, print_node(node->value.expr_postfix.rhs, indent));
+                }
+                push_action(stack, print_text("("));
+                push_action(stack, print_node(node->value.expr_postfix.lhs, indent));
+                break;
+
+            case NODE_EXPR_POSTFIX_KIND_INC:
+                push_action(stack, print_text("++"));
+                push_action(stack, print_node(node->value.expr_postfix.lhs, indent));
+                break;
+
+            case NODE_EXPR_POSTFIX_KIND_DEC:
+                push_action(stack, print_text("--"));
+                push_action(stack, print_node(node->value.expr_postfix.lhs, indent));
+                break;
+
+            default:
+                assert(0); // TODO: error handling...
+            }
+            break;
+
+        case NODE_LIT_INT:
+            fprintf(fp, "%ld", node->value.lit_int.v);
+            break;
+
+        case NODE_LIT_STRING:
+            fprintf(fp, "\"");
+            token_fprint_buf(fp, buffer, node->value.lit_string.tok);
+            fprintf(fp, "\"");
+            break;
+
+        case NODE_ID:
+            token_fprint_buf(fp, buffer, node->value.id.tok);
+            break;
+
+        case NODE_ARGS_LIST:
+            push_node_list(stack, node->value.args_list.args, 0, ", ");
+            break;
+
+        case NODE_DECLARATOR:
+            push_action(stack, print_node(node->value.declarator.node, 0));
+            break;
+
+        case NODE_DIRECT_DECLARATOR:
+            switch(node->value.direct_declarator.kind) {
+            case NODE_DIRECT_DECLARATOR_KIND_BASE:
+                break; // DO NOTHING
+
+            case NODE_DIRECT_DECLARATOR_KIND_PARAM_TYPE_LIST:
+                push_action(stack, print_text(")"));
+                push_action(stack, print_node(node->value.direct_declarator.args[0], 0));
+                push_action(stack, print_text("("));
+                break;
+
+            default:
+                assert(0); // TODO: error handling...
+            }
+            push_action(stack, print_node(node->value.direct_declarator.base, 0));
+            break;
+
+        case NODE_PARAM_DECL:
+            if (node->value.param_decl.decl) {
+                push_action(stack, print_node(node->value.param_decl.decl, 0));
+                push_action(stack, print_text(" "));
+            }
+            push_action(stack, print_node(node->value.param_decl.spec, 0));
+            break;
+
+        case NODE_PARAM_LIST:
+            push_node_list(stack, node->value.param_list.params, 0, ", ");
+            break;
+
+        default:
+            fprintf(stderr, "Unknown kind: %d\n", node->kind);
+            assert(0); // TODO: error handling...
+            break;
+        }
+    }
+
+    vector_drop(stack);
+}
+
 void fprint_indent(FILE *fp, int indent) {
     for(int i=0; i<indent*4; ++i) {
         fprintf(fp, " ");
@@ -15,8 +15,16 @@ typedef enum {
     NODE_STMT_COMPOUND,
     NODE_STMT_EXPR,
     NODE_STMT_IF,
+    NODE_STMT_WHILE,
+    NODE_STMT_DO,
+    NODE_STMT_FOR,
+    NODE_STMT_SWITCH,
+    NODE_STMT_CASE,
+    NODE_STMT_DEFAULT,
     NODE_STMT_JUMP,
     NODE_EXPR_BIN, // TODO: Rename to NODE_EXPR_BINARY
+    NODE_EXPR_UNARY,
+    NODE_EXPR_COND,
     NODE_EXPR_POSTFIX,
     NODE_LIT_INT,
     NODE_LIT_STRING,
@@ -35,6 +43,8 @@ typedef enum {
 
 typedef enum {
     NODE_EXPR_POSTFIX_KIND_FUNC_CALL,
+    NODE_EXPR_POSTFIX_KIND_INC,
+    NODE_EXPR_POSTFIX_KIND_DEC,
 } NodeExprPostfixKind;
 
 typedef union {
@@ -57,25 +67,59 @@ typedef union {
         Node* then_b;
         Node* else_b; // Nullable
     } stmt_if;
+    struct {
+        Node* cond;
+        Node* body;
+    } stmt_while;
+    struct {
+        Node* body;
+        Node* cond;
+    } stmt_do;
+    struct {
+        Node* init; // Nullable
+        Node* cond; // Nullable
+        Node* step; // Nullable
+        Node* body;
+    } stmt_for;
+    struct {
+        Node* cond;
+        Node* body;
+    } stmt_switch;
+    struct {
+        Node* expr; // An integer literal
+        Node* stmt;
+    } stmt_case;
+    struct {
+        Node* stmt;
+    } stmt_default;
     struct {
         TokenKind kind; // TODO: Change to Token*
-        Node* expr;
+        Node* expr; // Nullable for break and continue
     } stmt_jump;
     struct {
         Token* op;
         Node* lhs;
         Node* rhs;
     } expr_bin;
+    struct {
+        Token* op;
+        Node* expr;
+    } expr_unary;
+    struct {
+        Node* cond;
+        Node* then_e;
+        Node* else_e;
+    } expr_cond;
     struct {
         NodeExprPostfixKind kind;
         Node* lhs;
         Node* rhs; // Nullable
     } expr_postfix;
     struct {
-        int v;
+        long v;
     } lit_int;
     struct {
-        char const* v;
+        Token* tok; // A body of the literal without quotes
     } lit_string;
     struct {
         Token* tok;
@@ -107,7 +151,12 @@ struct node_t {
 };
 
 void node_destruct(Node* node);
-void node_fprint(FILE *fp, Node* node);
+void node_fprint(FILE *fp, char const* buffer, Node* node);
+
+// Calls 'f' for each child in source order
+void node_foreach_children(Node* node, void (*f)(Node* child, void*), void* args);
+// Visits nodes in postorder with an explicit stack, so deep trees never overflow the C stack
+void node_visit_postorder(Node* root, void (*f)(Node* node, void*), void* args);
 
 Token* node_declarator_extract_id_token(Node* node);
 
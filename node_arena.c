@@ -9,6 +9,10 @@ void node_arena_drop(NodeArena *arena) {
     arena_drop(arena);
 }
 
+void node_arena_reset(NodeArena *arena) {
+    arena_reset(arena);
+}
+
 Node* node_arena_malloc(NodeArena *arena) {
     return (Node*)arena_malloc(arena);
 }
@@ -7,6 +7,7 @@ typedef struct arena_t NodeArena;
 
 NodeArena* node_arena_new();
 void node_arena_drop(NodeArena* arena);
+void node_arena_reset(NodeArena* arena);
 
 Node* node_arena_malloc(NodeArena *arena);
 
@@ -0,0 +1,468 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include "node_table.h"
+
+static void reserve_nodes(NodeTable* t, size_t cap) {
+    if (t->cap >= cap) {
+        return;
+    }
+
+    size_t new_cap = t->cap == 0 ? 64 : t->cap * 2;
+    while(new_cap < cap) {
+        new_cap *= 2;
+    }
+
+    t->kinds = (uint8_t*)realloc(t->kinds, sizeof(uint8_t) * new_cap);
+    t->main_tokens = (uint32_t*)realloc(t->main_tokens, sizeof(uint32_t) * new_cap);
+    t->lhs = (uint32_t*)realloc(t->lhs, sizeof(uint32_t) * new_cap);
+    t->rhs = (uint32_t*)realloc(t->rhs, sizeof(uint32_t) * new_cap);
+    t->types = (Type**)realloc(t->types, sizeof(Type*) * new_cap);
+    assert(t->kinds && t->main_tokens && t->lhs && t->rhs && t->types); // TODO: error handling...
+
+    t->cap = new_cap;
+}
+
+static void reserve_extra(NodeTable* t, size_t cap) {
+    if (t->extra_cap >= cap) {
+        return;
+    }
+
+    size_t new_cap = t->extra_cap == 0 ? 64 : t->extra_cap * 2;
+    while(new_cap < cap) {
+        new_cap *= 2;
+    }
+
+    t->extra = (uint32_t*)realloc(t->extra, sizeof(uint32_t) * new_cap);
+    assert(t->extra); // TODO: error handling...
+
+    t->extra_cap = new_cap;
+}
+
+static NodeIndex append_node(NodeTable* t, NodeKind kind, uint32_t main_token, uint32_t lhs, uint32_t rhs) {
+    reserve_nodes(t, t->len + 1);
+    assert(t->len < NODE_INDEX_NONE);
+
+    NodeIndex i = (NodeIndex)t->len;
+    t->kinds[i] = (uint8_t)kind;
+    t->main_tokens[i] = main_token;
+    t->lhs[i] = lhs;
+    t->rhs[i] = rhs;
+    t->types[i] = NULL;
+    t->len++;
+
+    return i;
+}
+
+static uint32_t append_extra(NodeTable* t, uint32_t const* values, size_t len) {
+    reserve_extra(t, t->extra_len + len);
+
+    uint32_t begin = (uint32_t)t->extra_len;
+    memcpy(t->extra + begin, values, sizeof(uint32_t) * len);
+    t->extra_len += len;
+
+    return begin;
+}
+
+static uint32_t token_index(NodeTable* t, Token* tok) {
+    assert(tok >= t->tokens);
+    return (uint32_t)(tok - t->tokens);
+}
+
+struct build_iter_arg_t {
+    NodeTable* t;
+    Vector* indices; // Vector<NodeIndex>, indices of visited nodes which are not consumed by parents yet
+};
+
+static void count_children_iter(Node* child, void* args) {
+    (void)child;
+    size_t* n = (size_t*)args;
+    (*n)++;
+}
+
+// Called in postorder, so indices of children are on the top of 'indices' in source order
+static void build_iter(Node* node, void* args) {
+    struct build_iter_arg_t* state = (struct build_iter_arg_t*)args;
+    NodeTable* t = state->t;
+
+    size_t children_num = 0;
+    node_foreach_children(node, count_children_iter, &children_num);
+
+    assert(vector_len(state->indices) >= children_num);
+    size_t base = vector_len(state->indices) - children_num;
+    NodeIndex* c = children_num > 0 ? (NodeIndex*)vector_at(state->indices, base) : NULL;
+
+    uint32_t main_token = 0;
+    uint32_t lhs = NODE_INDEX_NONE;
+    uint32_t rhs = NODE_INDEX_NONE;
+
+    switch(node->kind) {
+    case NODE_TRANS_UNIT:
+    case NODE_STMT_COMPOUND:
+    case NODE_ARGS_LIST:
+    case NODE_PARAM_LIST:
+        lhs = append_extra(t, c, children_num);
+        rhs = lhs + (uint32_t)children_num;
+        break;
+
+    case NODE_FUNC_DEF:
+        lhs = append_extra(t, c, 2);
+        rhs = c[2];
+        break;
+
+    case NODE_STMT_EXPR:
+        if (node->value.stmt_expr.expr) {
+            lhs = c[0];
+        }
+        break;
+
+    case NODE_STMT_IF:
+    {
+        uint32_t branches[2] = {
+            c[1],
+            node->value.stmt_if.else_b ? c[2] : NODE_INDEX_NONE,
+        };
+        lhs = c[0];
+        rhs = append_extra(t, branches, 2);
+        break;
+    }
+
+    case NODE_STMT_WHILE:
+    case NODE_STMT_DO:
+    case NODE_STMT_SWITCH:
+    case NODE_STMT_CASE:
+        lhs = c[0];
+        rhs = c[1];
+        break;
+
+    case NODE_STMT_DEFAULT:
+        lhs = c[0];
+        break;
+
+    case NODE_STMT_FOR:
+    {
+        // Children are pushed only if they exist
+        size_t k = 0;
+        uint32_t clauses[3] = {
+            node->value.stmt_for.init ? c[k++] : NODE_INDEX_NONE,
+            node->value.stmt_for.cond ? c[k++] : NODE_INDEX_NONE,
+            node->value.stmt_for.step ? c[k++] : NODE_INDEX_NONE,
+        };
+        lhs = append_extra(t, clauses, 3);
+        rhs = c[k];
+        break;
+    }
+
+    case NODE_STMT_JUMP:
+        if (node->value.stmt_jump.expr) {
+            lhs = c[0];
+        }
+        rhs = (uint32_t)node->value.stmt_jump.kind;
+        break;
+
+    case NODE_EXPR_BIN:
+        main_token = token_index(t, node->value.expr_bin.op);
+        lhs = c[0];
+        rhs = c[1];
+        break;
+
+    case NODE_EXPR_UNARY:
+        main_token = token_index(t, node->value.expr_unary.op);
+        lhs = c[0];
+        break;
+
+    case NODE_EXPR_COND:
+        lhs = c[0];
+        rhs = append_extra(t, c + 1, 2);
+        break;
+
+    case NODE_EXPR_POSTFIX:
+    {
+        uint32_t postfix[2] = {
+            (uint32_t)node->value.expr_postfix.kind,
+            node->value.expr_postfix.rhs ? c[1] : NODE_INDEX_NONE,
+        };
+        lhs = c[0];
+        rhs = append_extra(t, postfix, 2);
+        break;
+    }
+
+    case NODE_LIT_INT:
+        lhs = (uint32_t)(uint64_t)node->value.lit_int.v;
+        rhs = (uint32_t)((uint64_t)node->value.lit_int.v >> 32);
+        break;
+
+    case NODE_LIT_STRING:
+    {
+        Token* tok = node->value.lit_string.tok;
+        main_token = token_index(t, tok);
+        lhs = string_pool_intern_escaped(t->strings, token_begin(t->buffer, tok), token_len(tok));
+        break;
+    }
+
+    case NODE_ID:
+    {
+        Token* tok = node->value.id.tok;
+        main_token = token_index(t, tok);
+        rhs = string_pool_intern(t->idents, token_begin(t->buffer, tok), token_len(tok));
+        break;
+    }
+
+    case NODE_DECLARATOR:
+        lhs = c[0];
+        break;
+
+    case NODE_DIRECT_DECLARATOR:
+        lhs = c[0];
+        if (children_num > 1) {
+            rhs = c[1];
+        }
+        break;
+
+    case NODE_PARAM_DECL:
+        lhs = c[0];
+        if (node->value.param_decl.decl) {
+            rhs = c[1];
+        }
+        break;
+    }
+
+    vector_truncate(state->indices, base);
+
+    NodeIndex i = append_node(t, node->kind, main_token, lhs, rhs);
+    NodeIndex* e = (NodeIndex*)vector_append(state->indices);
+    *e = i;
+}
+
+NodeTable* node_table_new(Node* root, char const* buffer, Vector* tokens) {
+    NodeTable* t = node_table_new_with_pools(root, buffer, tokens, string_pool_new(), string_pool_new());
+    t->borrows_pools = 0;
+
+    return t;
+}
+
+NodeTable* node_table_new_with_pools(Node* root, char const* buffer, Vector* tokens, StringPool* strings, StringPool* idents) {
+    assert(string_pool_len(strings) == 0 && string_pool_len(idents) == 0);
+
+    NodeTable* t = (NodeTable*)malloc(sizeof(NodeTable));
+    t->buffer = buffer;
+    t->tokens = (Token*)vector_at(tokens, 0);
+    t->len = 0;
+    t->cap = 0;
+    t->kinds = NULL;
+    t->main_tokens = NULL;
+    t->lhs = NULL;
+    t->rhs = NULL;
+    t->types = NULL;
+    t->extra = NULL;
+    t->extra_len = 0;
+    t->extra_cap = 0;
+    t->strings = strings;
+    t->idents = idents;
+    t->borrows_pools = 1;
+    t->mapping = NULL;
+    t->mapping_len = 0;
+
+    struct build_iter_arg_t state = {
+        .t = t,
+        .indices = vector_new(sizeof(NodeIndex)),
+    };
+    node_visit_postorder(root, build_iter, &state);
+
+    assert(vector_len(state.indices) == 1);
+    vector_drop(state.indices);
+
+    return t;
+}
+
+void node_table_drop(NodeTable* t) {
+    int owned = t->mapping == NULL;
+
+    if (!t->borrows_pools) {
+        string_pool_drop(t->strings);
+        string_pool_drop(t->idents);
+    }
+
+    if (owned) {
+        free(t->kinds);
+        free(t->main_tokens);
+        free(t->lhs);
+        free(t->rhs);
+        free(t->extra);
+    } else {
+        munmap(t->mapping, t->mapping_len);
+    }
+    free(t->types);
+    free(t);
+}
+
+NodeIndex node_table_root(NodeTable* t) {
+    assert(t->len > 0);
+    return (NodeIndex)(t->len - 1);
+}
+
+Token* node_table_token(NodeTable* t, NodeIndex i) {
+    return &t->tokens[t->main_tokens[i]];
+}
+
+char const* node_table_string(NodeTable* t, NodeIndex i) {
+    return string_pool_at(t->strings, node_table_string_id(t, i));
+}
+
+uint32_t node_table_string_id(NodeTable* t, NodeIndex i) {
+    assert(t->kinds[i] == NODE_LIT_STRING);
+    return t->lhs[i];
+}
+
+char const* node_table_ident(NodeTable* t, NodeIndex i) {
+    return string_pool_at(t->idents, node_table_ident_id(t, i));
+}
+
+uint32_t node_table_ident_id(NodeTable* t, NodeIndex i) {
+    assert(t->kinds[i] == NODE_ID);
+    return t->rhs[i];
+}
+
+long node_table_lit_int(NodeTable* t, NodeIndex i) {
+    assert(t->kinds[i] == NODE_LIT_INT);
+    return (long)(((uint64_t)t->rhs[i] << 32) | t->lhs[i]);
+}
+
+NodeIndex node_table_first_child(NodeTable* t, NodeIndex i) {
+    switch((NodeKind)t->kinds[i]) {
+    case NODE_TRANS_UNIT:
+    case NODE_STMT_COMPOUND:
+    case NODE_ARGS_LIST:
+    case NODE_PARAM_LIST:
+        return t->lhs[i] < t->rhs[i] ? t->extra[t->lhs[i]] : NODE_INDEX_NONE;
+
+    case NODE_FUNC_DEF:
+        return t->extra[t->lhs[i]];
+
+    case NODE_STMT_FOR:
+        for(uint32_t k=0; k<3; ++k) {
+            if (t->extra[t->lhs[i] + k] != NODE_INDEX_NONE) {
+                return t->extra[t->lhs[i] + k];
+            }
+        }
+        return t->rhs[i];
+
+    case NODE_STMT_EXPR:
+    case NODE_STMT_IF:
+    case NODE_STMT_WHILE:
+    case NODE_STMT_DO:
+    case NODE_STMT_SWITCH:
+    case NODE_STMT_CASE:
+    case NODE_STMT_DEFAULT:
+    case NODE_STMT_JUMP:
+    case NODE_EXPR_BIN:
+    case NODE_EXPR_UNARY:
+    case NODE_EXPR_COND:
+    case NODE_EXPR_POSTFIX:
+    case NODE_DECLARATOR:
+    case NODE_DIRECT_DECLARATOR:
+    case NODE_PARAM_DECL:
+        return t->lhs[i];
+
+    case NODE_LIT_INT:
+    case NODE_LIT_STRING:
+    case NODE_ID:
+        return NODE_INDEX_NONE;
+    }
+
+    assert(0); // unreachable
+    return NODE_INDEX_NONE;
+}
+
+NodeIndex node_table_subtree_begin(NodeTable* t, NodeIndex i) {
+    for(;;) {
+        NodeIndex c = node_table_first_child(t, i);
+        if (c == NODE_INDEX_NONE) {
+            return i;
+        }
+        i = c;
+    }
+}
+
+NodeIndex node_table_declarator_extract_id(NodeTable* t, NodeIndex i) {
+    for(;;) {
+        switch(t->kinds[i]) {
+        case NODE_DECLARATOR:
+        case NODE_DIRECT_DECLARATOR:
+            i = t->lhs[i];
+            continue;
+        case NODE_ID:
+            return i;
+        default:
+            return NODE_INDEX_NONE;
+        }
+    }
+}
+
+NodeIndex node_table_declarator_extract_params(NodeTable* t, NodeIndex i) {
+    for(;;) {
+        switch(t->kinds[i]) {
+        case NODE_DECLARATOR:
+            i = t->lhs[i];
+            continue;
+        case NODE_DIRECT_DECLARATOR:
+            if (t->rhs[i] != NODE_INDEX_NONE && t->kinds[t->rhs[i]] == NODE_PARAM_LIST) {
+                return t->rhs[i];
+            }
+            i = t->lhs[i];
+            continue;
+        default:
+            return NODE_INDEX_NONE;
+        }
+    }
+}
+
+size_t node_table_bytes(NodeTable* t) {
+    size_t per_node = sizeof(uint8_t) + sizeof(uint32_t) * 3 + sizeof(Type*);
+    return per_node * t->len + sizeof(uint32_t) * t->extra_len;
+}
+
+struct tree_stats_t {
+    size_t nodes;
+    size_t bytes;
+};
+
+static void tree_stats_iter(Node* node, void* args) {
+    struct tree_stats_t* stats = (struct tree_stats_t*)args;
+    stats->nodes++;
+    stats->bytes += sizeof(Node);
+
+    Vector* children = NULL;
+    switch(node->kind) {
+    case NODE_TRANS_UNIT:
+        children = node->value.trans_unit.decls;
+        break;
+    case NODE_STMT_COMPOUND:
+        children = node->value.stmt_compound.stmts;
+        break;
+    case NODE_ARGS_LIST:
+        children = node->value.args_list.args;
+        break;
+    case NODE_PARAM_LIST:
+        children = node->value.param_list.params;
+        break;
+    default:
+        break;
+    }
+    if (children) {
+        // Only buffers are counted, headers of vectors are opaque
+        stats->bytes += sizeof(Node*) * vector_cap(children);
+    }
+}
+
+void node_table_fprint_stats(FILE* fp, NodeTable* t, Node* root) {
+    fprintf(fp, "nodes: %ld, extra: %ld, strings: %ld, idents: %ld, bytes: %ld\n",
+            t->len, t->extra_len, string_pool_len(t->strings), string_pool_len(t->idents), node_table_bytes(t));
+
+    if (root) {
+        struct tree_stats_t stats = {0, 0};
+        node_visit_postorder(root, tree_stats_iter, &stats);
+        fprintf(fp, "tree nodes: %ld, bytes: >= %ld\n", stats.nodes, stats.bytes);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef CC_NODE_TABLE_H
+#define CC_NODE_TABLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "node.h"
+#include "vector.h"
+#include "token.h"
+#include "type.h"
+#include "string_pool.h"
+
+// A flat encoding of the AST.
+//
+// Nodes are stored in postorder as a struct of arrays, so children always have smaller
+// indices than their parent, the root is the last node, and every subtree occupies
+// a contiguous range of indices. Children are referred by 32-bit indices.
+//
+// Layout of (main_token, lhs, rhs) for each kind. 'extra' is an index of 'extra',
+// 'begin'/'end' are a range of 'extra' which holds indices of children.
+//
+//  NODE_TRANS_UNIT           : -, begin, end
+//  NODE_FUNC_DEF             : -, extra -> {decl_spec, decl}, block
+//  NODE_STMT_COMPOUND        : -, begin, end
+//  NODE_STMT_EXPR            : -, expr (Nullable), -
+//  NODE_STMT_IF              : -, cond, extra -> {then_b, else_b (Nullable)}
+//  NODE_STMT_WHILE           : -, cond, body
+//  NODE_STMT_DO              : -, body, cond
+//  NODE_STMT_FOR             : -, extra -> {init, cond, step (Nullable)}, body
+//  NODE_STMT_SWITCH          : -, cond, body
+//  NODE_STMT_CASE            : -, expr, stmt
+//  NODE_STMT_DEFAULT         : -, stmt, -
+//  NODE_STMT_JUMP            : -, expr (Nullable), TokenKind
+//  NODE_EXPR_BIN             : op, lhs, rhs
+//  NODE_EXPR_UNARY           : op, expr, -
+//  NODE_EXPR_COND            : -, cond, extra -> {then_e, else_e}
+//  NODE_EXPR_POSTFIX         : -, lhs, extra -> {NodeExprPostfixKind, args (Nullable)}
+//  NODE_LIT_INT              : -, value (low 32 bits), value (high 32 bits)
+//  NODE_LIT_STRING           : tok, id of 'strings', -
+//  NODE_ID                   : tok, -, id of 'idents'
+//  NODE_ARGS_LIST            : -, begin, end
+//  NODE_DECLARATOR           : -, node, -
+//  NODE_DIRECT_DECLARATOR    : -, base, params (Nullable)
+//  NODE_PARAM_DECL           : -, spec, decl (Nullable)
+//  NODE_PARAM_LIST           : -, begin, end
+
+typedef uint32_t NodeIndex;
+
+#define NODE_INDEX_NONE ((NodeIndex)UINT32_MAX)
+
+// TODO: encapsulate
+typedef struct {
+    char const* buffer;     // reference, source of tokens
+    Token* tokens;          // reference, base of token indices
+    size_t len;
+    size_t cap;
+    uint8_t* kinds;         // NodeKind
+    uint32_t* main_tokens;  // Index of tokens
+    uint32_t* lhs;
+    uint32_t* rhs;
+    Type** types;           // Set by the analyzer, Nullable
+    uint32_t* extra;
+    size_t extra_len;
+    size_t extra_cap;
+    StringPool* strings;    // Decoded string literals
+    StringPool* idents;     // Interned identifiers
+    int borrows_pools;      // 'strings' and 'idents' are owned by the caller, e.g. kept across compiles
+    void* mapping;          // Nullable, columns and strings point into it when the table is loaded from a cache
+    size_t mapping_len;
+} NodeTable;
+
+// Flattens the tree. 'tokens' must be the Vector<Token> which tokens of the tree point into.
+NodeTable* node_table_new(Node* root, char const* buffer, Vector* tokens);
+// Same as node_table_new, but strings are interned into empty 'strings' and 'idents' which outlive the table
+NodeTable* node_table_new_with_pools(Node* root, char const* buffer, Vector* tokens, StringPool* strings, StringPool* idents);
+void node_table_drop(NodeTable* t);
+
+NodeIndex node_table_root(NodeTable* t);
+Token* node_table_token(NodeTable* t, NodeIndex i);
+char const* node_table_string(NodeTable* t, NodeIndex i);
+uint32_t node_table_string_id(NodeTable* t, NodeIndex i);
+char const* node_table_ident(NodeTable* t, NodeIndex i);
+uint32_t node_table_ident_id(NodeTable* t, NodeIndex i);
+long node_table_lit_int(NodeTable* t, NodeIndex i);
+
+// Returns NODE_INDEX_NONE, if the node is a leaf
+NodeIndex node_table_first_child(NodeTable* t, NodeIndex i);
+// Returns the first index of the subtree which 'i' is the root of
+NodeIndex node_table_subtree_begin(NodeTable* t, NodeIndex i);
+
+// Returns an index of NODE_ID, NODE_INDEX_NONE if not found
+NodeIndex node_table_declarator_extract_id(NodeTable* t, NodeIndex i);
+// Returns an index of NODE_PARAM_LIST of a function declarator, NODE_INDEX_NONE if not found
+NodeIndex node_table_declarator_extract_params(NodeTable* t, NodeIndex i);
+
+size_t node_table_bytes(NodeTable* t);
+void node_table_fprint_stats(FILE* fp, NodeTable* t, Node* root);
+
+#endif /* CC_NODE_TABLE_H */
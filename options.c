@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "ir_ifconv.h"
+#include "ir_pass.h"
+
+void options_init(CCOptions* opts) {
+    opts->input_path = NULL;
+    opts->output_path = NULL;
+    opts->stage = CC_STAGE_EXE;
+    opts->run = 0;
+    opts->interp = 0;
+    opts->server_path = NULL;
+    opts->connect_path = NULL;
+    opts->parser_memo = 0;
+    opts->opt_level = IR_PASS_MAX_LEVEL;
+    opts->passes = NULL;
+    opts->dump_passes = 0;
+    opts->omit_frame_pointer = 0;
+    opts->strength_reduce = 1;
+    opts->if_conversion_threshold = IR_IFCONV_DEFAULT_THRESHOLD;
+    opts->move_loop_invariants = 1;
+    opts->jump_tables = 1;
+    opts->tree_isel = 1;
+    opts->ast_cache_path = NULL;
+    opts->compile_cache_dir = NULL;
+    opts->compile_cache_max_size = OPTIONS_DEFAULT_COMPILE_CACHE_MAX_SIZE;
+    opts->incremental_path = NULL;
+}
+
+int options_writes_stdout(CCOptions const* opts) {
+    if (opts->run || opts->interp) {
+        return 1;
+    }
+
+    return opts->stage == CC_STAGE_ASM && opts->output_path && strcmp(opts->output_path, "-") == 0;
+}
+
+int options_parse(CCOptions* opts, int argc, char* argv[]) {
+    for(int i=1; i<argc; ++i) {
+        char const* arg = argv[i];
+
+        if (strcmp(arg, "-S") == 0) {
+            opts->stage = CC_STAGE_ASM;
+            continue;
+        }
+
+        if (strcmp(arg, "-c") == 0) {
+            opts->stage = CC_STAGE_OBJ;
+            continue;
+        }
+
+        if (strcmp(arg, "-o") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing file name after -o\n");
+                return 1;
+            }
+            opts->output_path = argv[++i];
+            continue;
+        }
+
+        if (strcmp(arg, "--run") == 0) {
+            opts->run = 1;
+            continue;
+        }
+
+        if (strcmp(arg, "--interp") == 0) {
+            opts->interp = 1;
+            continue;
+        }
+
+        if (strcmp(arg, "--server") == 0 || strcmp(arg, "--connect") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Missing socket path after %s\n", arg);
+                return 1;
+            }
+            if (arg[2] == 's') {
+                opts->server_path = argv[++i];
+            } else {
+                opts->connect_path = argv[++i];
+            }
+            continue;
+        }
+
+        if (strcmp(arg, "-fparser-memo") == 0) {
+            opts->parser_memo = 1;
+            continue;
+        }
+
+        if (strcmp(arg, "-fno-parser-memo") == 0) {
+            opts->parser_memo = 0;
+            continue;
+        }
+
+        if (strcmp(arg, "-fomit-frame-pointer") == 0) {
+            opts->omit_frame_pointer = 1;
+            continue;
+        }
+
+        if (strcmp(arg, "-fno-omit-frame-pointer") == 0) {
+            opts->omit_frame_pointer = 0;
+            continue;
+        }
+
+        if (strcmp(arg, "-fstrength-reduce") == 0) {
+            opts->strength_reduce = 1;
+            continue;
+        }
+
+        if (strcmp(arg, "-fno-strength-reduce") == 0) {
+            opts->strength_reduce = 0;
+            continue;
+        }
+
+        if (strcmp(arg, "-O") == 0) {
+            opts->opt_level = 1;
+            continue;
+        }
+
+        if (strncmp(arg, "-O", 2) == 0) {
+            char* end;
+            long level = strtol(arg + 2, &end, 10);
+            if (*end != '\0' || level < 0) {
+                fprintf(stderr, "Invalid optimization level: %s\n", arg);
+                return 1;
+            }
+            opts->opt_level = level > IR_PASS_MAX_LEVEL ? IR_PASS_MAX_LEVEL : (int)level;
+            continue;
+        }
+
+        if (strncmp(arg, "-fpass=", 7) == 0) {
+            if (ir_pass_check_list(arg + 7)) {
+                fprintf(stderr, "Passes:\n");
+                ir_pass_fprint_list(stderr);
+                return 1;
+            }
+            opts->passes = arg + 7;
+            continue;
+        }
+
+        if (strcmp(arg, "-fdump-passes") == 0) {
+            opts->dump_passes = 1;
+            continue;
+        }
+
+        if (strncmp(arg, "-fif-conversion-threshold=", 26) == 0) {
+            char* end;
+            unsigned long n = strtoul(arg + 26, &end, 10);
+            if (*end != '\0' || end == arg + 26) {
+                fprintf(stderr, "Invalid threshold: %s\n", arg);
+                return 1;
+            }
+            opts->if_conversion_threshold = (size_t)n;
+            continue;
+        }
+
+        if (strcmp(arg, "-fmove-loop-invariants") == 0) {
+            opts->move_loop_invariants = 1;
+            continue;
+        }
+
+        if (strcmp(arg, "-fno-move-loop-invariants") == 0) {
+            opts->move_loop_invariants = 0;
+            continue;
+        }
+
+        if (strcmp(arg, "-fjump-tables") == 0) {
+            opts->jump_tables = 1;
+            continue;
+        }
+
+        if (strcmp(arg, "-fno-jump-tables") == 0) {
+            opts->jump_tables = 0;
+            continue;
+        }
+
+        if (strcmp(arg, "-ftree-isel") == 0) {
+            opts->tree_isel = 1;
+            continue;
+        }
+
+        if (strcmp(arg, "-fno-tree-isel") == 0) {
+            opts->tree_isel = 0;
+            continue;
+        }
+
+        if (strncmp(arg, "-fcache-ast=", 12) == 0) {
+            opts->ast_cache_path = arg + 12;
+            continue;
+        }
+
+        if (strncmp(arg, "-fcache-dir=", 12) == 0) {
+            opts->compile_cache_dir = arg + 12;
+            continue;
+        }
+
+        if (strncmp(arg, "-fcache-max-size=", 17) == 0) {
+            char* end;
+            unsigned long long size = strtoull(arg + 17, &end, 10);
+            if (*end != '\0' || end == arg + 17) {
+                fprintf(stderr, "Invalid size: %s\n", arg);
+                return 1;
+            }
+            opts->compile_cache_max_size = (size_t)size;
+            continue;
+        }
+
+        if (strncmp(arg, "-fincremental=", 14) == 0) {
+            opts->incremental_path = arg + 14;
+            continue;
+        }
+
+        if (arg[0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return 1;
+        }
+
+        if (opts->input_path) {
+            fprintf(stderr, "Multiple input files: %s\n", arg);
+            return 1;
+        }
+        opts->input_path = arg;
+    }
+
+    if (!opts->input_path && !opts->server_path) {
+        fprintf(stderr, "No input file\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+void options_fprint_usage(FILE* fp, char const* prog) {
+    fprintf(fp, "Usage: %s [options] file\n", prog);
+    fprintf(fp, "Options:\n");
+    fprintf(fp, "  -S               Stop after generating the assembly\n");
+    fprintf(fp, "  -c               Stop after assembling\n");
+    fprintf(fp, "  -o FILE          Write the output to FILE (\"-\" is stdout for -S)\n");
+    fprintf(fp, "  --run            Run the program in-process without the assembler and the linker\n");
+    fprintf(fp, "  --interp         Evaluate the IR by the interpreter without code generation\n");
+    fprintf(fp, "  --server SOCKET  Serve compile jobs on the Unix socket\n");
+    fprintf(fp, "  --connect SOCKET Send the job to the server, or compile locally if it is not available\n");
+    fprintf(fp, "  -fparser-memo    Memoize parser rules (packrat parsing)\n");
+    fprintf(fp, "  -fomit-frame-pointer\n");
+    fprintf(fp, "                   Do not set up RBP, and use the red zone in leaf functions\n");
+    fprintf(fp, "  -fno-strength-reduce\n");
+    fprintf(fp, "                   Use imul and idiv for multiplication and division by constants\n");
+    fprintf(fp, "  -O0, -O1, -O2    Run no IR passes, only gvn, or ifconv,licm,gvn (the default)\n");
+    fprintf(fp, "  -fpass=LIST      Run the comma separated IR passes of LIST in order instead of the -O level\n");
+    fprintf(fp, "  -fdump-passes    Print the IR after each pass\n");
+    fprintf(fp, "  -fif-conversion-threshold=N\n");
+    fprintf(fp, "                   Replace branches which select one of values of up to N instructions by cmov, 0 disables it\n");
+    fprintf(fp, "  -fno-move-loop-invariants\n");
+    fprintf(fp, "                   Compute values which do not change in loops every iteration\n");
+    fprintf(fp, "  -fno-jump-tables Dispatch all switches by compare trees\n");
+    fprintf(fp, "  -fno-tree-isel   Generate code for each IR instruction through stack slots\n");
+    fprintf(fp, "  -fcache-ast=FILE Reuse the analyzed AST stored in FILE if the source is unchanged\n");
+    fprintf(fp, "  -fcache-dir=DIR  Reuse outputs of the same input and options stored in DIR\n");
+    fprintf(fp, "  -fcache-max-size=BYTES\n");
+    fprintf(fp, "                   Evict least recently used outputs in DIR over BYTES\n");
+    fprintf(fp, "  -fincremental=FILE\n");
+    fprintf(fp, "                   Reuse code of functions stored in FILE which are unchanged\n");
+}
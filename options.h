@@ -0,0 +1,48 @@
+#ifndef CC_OPTIONS_H
+#define CC_OPTIONS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define OPTIONS_DEFAULT_COMPILE_CACHE_MAX_SIZE ((size_t)64 * 1024 * 1024)
+
+typedef enum {
+    CC_STAGE_ASM,   // -S
+    CC_STAGE_OBJ,   // -c
+    CC_STAGE_EXE,
+} CCStage;
+
+typedef struct {
+    char const* input_path;
+    char const* output_path;    // -o FILE, Nullable. "-" is stdout.
+    CCStage stage;
+    int run;                // --run, JIT and run in-process instead of writing an output
+    int interp;             // --interp, evaluate the IR instead of generating code
+    char const* server_path;    // --server SOCKET, Nullable
+    char const* connect_path;   // --connect SOCKET, Nullable
+    int parser_memo;        // -fparser-memo
+    int opt_level;          // -O0, -O1 or -O2
+    char const* passes;     // -fpass=LIST, Nullable, then passes of 'opt_level'
+    int dump_passes;        // -fdump-passes
+    int omit_frame_pointer; // -fomit-frame-pointer
+    int strength_reduce;    // -fstrength-reduce
+    size_t if_conversion_threshold; // -fif-conversion-threshold=N
+    int move_loop_invariants;       // -fmove-loop-invariants
+    int jump_tables;        // -fjump-tables
+    int tree_isel;          // -ftree-isel
+    char const* ast_cache_path; // -fcache-ast=FILE, Nullable
+    char const* compile_cache_dir;  // -fcache-dir=DIR, Nullable
+    size_t compile_cache_max_size;  // -fcache-max-size=BYTES
+    char const* incremental_path;   // -fincremental=FILE, Nullable
+} CCOptions;
+
+void options_init(CCOptions* opts);
+
+// The output goes to stdout, i.e. '-S -o -', or the program runs and writes to stdout, i.e. --run and --interp
+int options_writes_stdout(CCOptions const* opts);
+
+// Returns 0 on success
+int options_parse(CCOptions* opts, int argc, char* argv[]);
+void options_fprint_usage(FILE* fp, char const* prog);
+
+#endif /* CC_OPTIONS_H */
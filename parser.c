@@ -4,6 +4,7 @@
 #include "parser.h"
 #include "vector.h"
 #include "token.h"
+#include "literal.h"
 #include "log.h"
 
 #define ErrRet                                  \
@@ -13,6 +14,101 @@
 #define ErrProp                                 \
     if (res.result == PARSER_ERROR) {ErrRet}
 
+typedef size_t state_t;
+
+// Parenthesized expressions, arguments and statements recurse, so their nesting is limited
+// before it overflows the stack
+#define PARSER_MAX_DEPTH 1000
+
+// Binding powers of operators, higher binds tighter
+typedef enum {
+    PREC_NONE,
+    PREC_COMMA,
+    PREC_ASSIGN,
+    PREC_COND,
+    PREC_LOGICAL_OR,
+    PREC_LOGICAL_AND,
+    PREC_OR,
+    PREC_XOR,
+    PREC_AND,
+    PREC_EQUALITY,
+    PREC_RELATIONAL,
+    PREC_SHIFT,
+    PREC_ADDITIVE,
+    PREC_MULTIPLICATIVE,
+    PREC_UNARY,
+} Prec;
+
+typedef enum {
+    OP_ASSOC_LEFT,
+    OP_ASSOC_RIGHT,
+} OpAssoc;
+
+typedef struct {
+    Prec prec; // PREC_NONE, if a token is not an infix operator
+    OpAssoc assoc;
+} InfixOp;
+
+static InfixOp const infix_ops[TOK_KIND_EOF + 1] = {
+    [TOK_KIND_COMMA]         = {PREC_COMMA, OP_ASSOC_LEFT},
+    [TOK_KIND_ASSIGN]        = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_PLUS_ASSIGN]   = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_MINUS_ASSIGN]  = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_MUL_ASSIGN]    = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_DIV_ASSIGN]    = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_MOD_ASSIGN]    = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_AND_ASSIGN]    = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_OR_ASSIGN]     = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_XOR_ASSIGN]    = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_LSHIFT_ASSIGN] = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_RSHIFT_ASSIGN] = {PREC_ASSIGN, OP_ASSOC_RIGHT},
+    [TOK_KIND_QUESTION]      = {PREC_COND, OP_ASSOC_RIGHT},
+    [TOK_KIND_LOGICAL_OR]    = {PREC_LOGICAL_OR, OP_ASSOC_LEFT},
+    [TOK_KIND_LOGICAL_AND]   = {PREC_LOGICAL_AND, OP_ASSOC_LEFT},
+    [TOK_KIND_OR]            = {PREC_OR, OP_ASSOC_LEFT},
+    [TOK_KIND_XOR]           = {PREC_XOR, OP_ASSOC_LEFT},
+    [TOK_KIND_AND]           = {PREC_AND, OP_ASSOC_LEFT},
+    [TOK_KIND_EQ]            = {PREC_EQUALITY, OP_ASSOC_LEFT},
+    [TOK_KIND_NE]            = {PREC_EQUALITY, OP_ASSOC_LEFT},
+    [TOK_KIND_LT]            = {PREC_RELATIONAL, OP_ASSOC_LEFT},
+    [TOK_KIND_GT]            = {PREC_RELATIONAL, OP_ASSOC_LEFT},
+    [TOK_KIND_LE]            = {PREC_RELATIONAL, OP_ASSOC_LEFT},
+    [TOK_KIND_GE]            = {PREC_RELATIONAL, OP_ASSOC_LEFT},
+    [TOK_KIND_LSHIFT]        = {PREC_SHIFT, OP_ASSOC_LEFT},
+    [TOK_KIND_RSHIFT]        = {PREC_SHIFT, OP_ASSOC_LEFT},
+    [TOK_KIND_PLUS]          = {PREC_ADDITIVE, OP_ASSOC_LEFT},
+    [TOK_KIND_MINUS]         = {PREC_ADDITIVE, OP_ASSOC_LEFT},
+    [TOK_KIND_MUL]           = {PREC_MULTIPLICATIVE, OP_ASSOC_LEFT},
+    [TOK_KIND_DIV]           = {PREC_MULTIPLICATIVE, OP_ASSOC_LEFT},
+    [TOK_KIND_MOD]           = {PREC_MULTIPLICATIVE, OP_ASSOC_LEFT},
+};
+
+static int const prefix_ops[TOK_KIND_EOF + 1] = {
+    [TOK_KIND_PLUS]  = 1,
+    [TOK_KIND_MINUS] = 1,
+    [TOK_KIND_NOT]   = 1,
+    [TOK_KIND_TILDE] = 1,
+    [TOK_KIND_MUL]   = 1, // dereference
+    [TOK_KIND_AND]   = 1, // address-of
+    [TOK_KIND_INC]   = 1,
+    [TOK_KIND_DEC]   = 1,
+};
+
+typedef enum {
+    OP_FRAME_PREFIX,
+    OP_FRAME_INFIX,
+    OP_FRAME_COND_THEN, // '?' is read, waiting for ':'
+    OP_FRAME_COND_ELSE, // ':' is read
+} OpFrameKind;
+
+typedef struct {
+    OpFrameKind kind;
+    Token* op;
+    Prec prec;
+    state_t state;          // A position of the operator
+    size_t operands_len;    // A length of the operand stack when the operator is read
+} OpFrame;
+
 static ParserResult parse_transition_unit(Parser *parser);
 static ParserResult parse_external_declaration(Parser *parser);
 static ParserResult parse_function_definition(Parser *parser);
@@ -23,20 +119,75 @@ static ParserResult parse_parameter_type_list(Parser *parser);
 static ParserResult parse_parameter_list(Parser *parser);
 static ParserResult parse_parameter_declaration(Parser *parser);
 static ParserResult parse_stmt(Parser *parser);
+static ParserResult parse_stmt_labeled(Parser *parser);
 static ParserResult parse_stmt_compound(Parser *parser);
 static ParserResult parse_block_item(Parser *parser);
 static ParserResult parse_stmt_expr(Parser *parser);
 static ParserResult parse_stmt_selection(Parser *parser);
+static ParserResult parse_stmt_iteration(Parser *parser);
 static ParserResult parse_stmt_jump(Parser *parser);
 static ParserResult parse_expr(Parser *parser);
 static ParserResult parse_expr_assign(Parser *parser);
-static ParserResult parse_expr_additive(Parser *parser);
+static ParserResult parse_expr_prec(Parser *parser, Prec min_prec);
+static ParserResult parse_expr_prec_impl(Parser *parser, Prec min_prec);
 static ParserResult parse_expr_postfix(Parser *parser);
 static ParserResult parse_argument_expr_list(Parser *parser);
 static ParserResult parse_expr_primary(Parser *parser);
 static ParserResult parse_constant(Parser *parser);
 static ParserResult parse_id(Parser *parser);
 
+static ParserResult parse_declarator_impl(Parser *parser);
+static ParserResult parse_direct_declarator_impl(Parser *parser);
+static ParserResult parse_parameter_declaration_impl(Parser *parser);
+static ParserResult parse_stmt_impl(Parser *parser);
+static ParserResult parse_stmt_labeled_impl(Parser *parser);
+static ParserResult parse_stmt_compound_impl(Parser *parser);
+static ParserResult parse_stmt_expr_impl(Parser *parser);
+static ParserResult parse_stmt_selection_impl(Parser *parser);
+static ParserResult parse_stmt_iteration_impl(Parser *parser);
+static ParserResult parse_stmt_jump_impl(Parser *parser);
+static ParserResult parse_expr_impl(Parser *parser);
+static ParserResult parse_expr_assign_impl(Parser *parser);
+static ParserResult parse_expr_postfix_impl(Parser *parser);
+static ParserResult parse_argument_expr_list_impl(Parser *parser);
+static ParserResult parse_expr_primary_impl(Parser *parser);
+static ParserResult parse_constant_impl(Parser *parser);
+static ParserResult parse_id_impl(Parser *parser);
+
+// Rules which are memoized when the memo table is enabled
+typedef enum {
+    RULE_DECLARATOR,
+    RULE_DIRECT_DECLARATOR,
+    RULE_PARAMETER_DECLARATION,
+    RULE_STMT,
+    RULE_STMT_LABELED,
+    RULE_STMT_COMPOUND,
+    RULE_STMT_EXPR,
+    RULE_STMT_SELECTION,
+    RULE_STMT_ITERATION,
+    RULE_STMT_JUMP,
+    RULE_EXPR,
+    RULE_EXPR_ASSIGN,
+    RULE_EXPR_POSTFIX,
+    RULE_ARGUMENT_EXPR_LIST,
+    RULE_EXPR_PRIMARY,
+    RULE_CONSTANT,
+    RULE_ID,
+
+    RULE_NUM,
+} Rule;
+
+typedef struct {
+    int filled;
+    size_t end_position;
+    ParserResult result;
+} MemoEntry;
+
+static ParserResult memoize(Parser *parser, Rule rule, ParserResult (*f)(Parser *parser));
+
+static void reduce_ops(Parser *parser, size_t ops_base, Prec prec, OpAssoc assoc);
+static void abandon_op_frame(Parser *parser, OpFrame* frame);
+
 static ParserResult combinator_more1(Parser *parser, ParserResult (*f)(Parser *parser));
 static ParserResult combinator_more1_sep(Parser *parser, TokenKind sep, ParserResult (*f)(Parser *parser));
 
@@ -45,27 +196,54 @@ static ParserResult assume_token(Parser *parser, TokenKind kind);
 static void forward_token(Parser *parser);
 static void debug_print_current_token(Parser *parser);
 
-typedef size_t state_t;
 static state_t save_state(Parser *parser);
 static void rewind_state(Parser *parser, state_t state);
 
+static int enter_nested(Parser *parser, ParserResult* res);
+static void leave_nested(Parser *parser);
+
 struct parser_t {
+    char const* buffer;     // reference, source of tokens
     Vector* tokens;
     NodeArena* arena;
 
     size_t position;
     Vector* position_stack;
+
+    Vector* op_stack;       // Vector<OpFrame>
+    Vector* operand_stack;  // Vector<Node*>
+
+    // [position][rule], Nullable. A row is allocated when a rule is first tried at the position,
+    // so positions which no memoized rule starts at, e.g. of operators, take only a pointer.
+    size_t depth;           // Of nested rules, see PARSER_MAX_DEPTH
+    int too_deep;           // Fails the whole parse
+
+    MemoEntry** memo;
+    size_t memo_len;        // Number of positions
+    size_t memo_rows;       // Number of allocated rows
+    size_t memo_hits;
+    size_t memo_misses;
 };
 
-Parser* parser_new(Vector* tokens, NodeArena* arena) {
+Parser* parser_new(char const* buffer, Vector* tokens, NodeArena* arena) {
     Parser* p = (Parser*)malloc(sizeof(Parser));
     if (!p) {
         return 0;
     }
+    p->buffer = buffer;
     p->tokens = tokens;
     p->arena = arena;
     p->position = 0;
     p->position_stack = vector_new(sizeof(size_t));
+    p->op_stack = vector_new(sizeof(OpFrame));
+    p->operand_stack = vector_new(sizeof(Node*));
+    p->depth = 0;
+    p->too_deep = 0;
+    p->memo = NULL;
+    p->memo_len = 0;
+    p->memo_rows = 0;
+    p->memo_hits = 0;
+    p->memo_misses = 0;
 
     return p;
 }
@@ -75,20 +253,48 @@ void parser_drop(Parser *parser) {
         return;
     }
     vector_drop(parser->position_stack);
+    vector_drop(parser->op_stack);
+    vector_drop(parser->operand_stack);
+    parser_set_memoize(parser, 0);
 
     free(parser);
 }
 
+void parser_set_memoize(Parser *parser, int enabled) {
+    for(size_t i=0; i<parser->memo_len; ++i) {
+        free(parser->memo[i]);
+    }
+    free(parser->memo);
+    parser->memo = NULL;
+    parser->memo_len = 0;
+    parser->memo_rows = 0;
+
+    if (!enabled) {
+        return;
+    }
+
+    // A position can go one past the last token (EOF)
+    parser->memo_len = vector_len(parser->tokens) + 1;
+    parser->memo = (MemoEntry**)calloc(parser->memo_len, sizeof(MemoEntry*));
+    assert(parser->memo); // TODO: error handling...
+}
+
 ParserResult parser_parse(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
-    res = parse_transition_unit(parser); ErrProp;
+    res = parse_transition_unit(parser);
+    if (parser->too_deep) {
+        // Alternatives tried after the limit fail by other errors
+        res.result = PARSER_ERROR;
+        res.error.kind = PARSER_ERROR_KIND_TOO_DEEP;
+    }
+    ErrProp;
 
     return res;
 }
 
-void parser_fprint_error(FILE *fp, ParseError *err) {
+void parser_fprint_error(FILE *fp, char const* buffer, ParseError *err) {
     switch (err->kind) {
     case PARSER_ERROR_KIND_EOF:
         fprintf(fp, "Unexpected EOF");
@@ -96,13 +302,37 @@ void parser_fprint_error(FILE *fp, ParseError *err) {
 
     case PARSER_ERROR_KIND_UNEXPECTED:
         fprintf(fp, "Unexpected token: ");
-        token_fprint(fp, err->value.unexpected.token);
+        token_fprint(fp, buffer, err->value.unexpected.token);
         break;
 
     case PARSER_ERROR_KIND_MORE1:
         fprintf(fp, "Eexpected more than 0 tokens");
         break;
+
+    case PARSER_ERROR_KIND_LEXER:
+        fprintf(fp, "Failed to read tokens");
+        break;
+
+    case PARSER_ERROR_KIND_TOO_DEEP:
+        fprintf(fp, "Too deeply nested, more than %d levels", PARSER_MAX_DEPTH);
+        break;
+    }
+}
+
+void parser_fprint_stats(FILE *fp, Parser *parser) {
+    if (!parser->memo) {
+        fprintf(fp, "memo: disabled\n");
+        return;
     }
+
+    size_t total = parser->memo_hits + parser->memo_misses;
+    fprintf(fp, "memo: hits = %zu, misses = %zu, hit rate = %.1f%%, rows = %zu of %zu, bytes = %zu\n",
+            parser->memo_hits,
+            parser->memo_misses,
+            total != 0 ? 100.0 * parser->memo_hits / total : 0.0,
+            parser->memo_rows,
+            parser->memo_len,
+            sizeof(MemoEntry*) * parser->memo_len + sizeof(MemoEntry) * RULE_NUM * parser->memo_rows);
 }
 
 ParserResult parse_transition_unit(Parser *parser) {
@@ -155,6 +385,10 @@ ParserResult parse_declaration_specifiers(Parser *parser) {
 }
 
 ParserResult parse_declarator(Parser *parser) {
+    return memoize(parser, RULE_DECLARATOR, parse_declarator_impl);
+}
+
+ParserResult parse_declarator_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -171,6 +405,10 @@ ParserResult parse_declarator(Parser *parser) {
 }
 
 ParserResult parse_direct_declarator(Parser *parser) {
+    return memoize(parser, RULE_DIRECT_DECLARATOR, parse_direct_declarator_impl);
+}
+
+ParserResult parse_direct_declarator_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -301,6 +539,10 @@ ParserResult parse_parameter_list(Parser *parser) {
 }
 
 ParserResult parse_parameter_declaration(Parser *parser) {
+    return memoize(parser, RULE_PARAMETER_DECLARATION, parse_parameter_declaration_impl);
+}
+
+ParserResult parse_parameter_declaration_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -334,6 +576,23 @@ next_phase:
 
 ParserResult parse_stmt(Parser *parser) {
     ParserResult res;
+    if (enter_nested(parser, &res)) {
+        return res;
+    }
+
+    res = memoize(parser, RULE_STMT, parse_stmt_impl);
+    leave_nested(parser);
+
+    return res;
+}
+
+ParserResult parse_stmt_impl(Parser *parser) {
+    ParserResult res;
+
+    res = parse_stmt_labeled(parser);
+    if (res.result == PARSER_OK) {
+        goto finish;
+    }
 
     res = parse_stmt_compound(parser);
     if (res.result == PARSER_OK) {
@@ -350,6 +609,11 @@ ParserResult parse_stmt(Parser *parser) {
         goto finish;
     }
 
+    res = parse_stmt_iteration(parser);
+    if (res.result == PARSER_OK) {
+        goto finish;
+    }
+
     res = parse_stmt_jump(parser);
     if (res.result == PARSER_OK) {
         goto finish;
@@ -365,6 +629,10 @@ finish:
 }
 
 ParserResult parse_stmt_compound(Parser *parser) {
+    return memoize(parser, RULE_STMT_COMPOUND, parse_stmt_compound_impl);
+}
+
+ParserResult parse_stmt_compound_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -404,6 +672,10 @@ finish:
 }
 
 ParserResult parse_stmt_expr(Parser *parser) {
+    return memoize(parser, RULE_STMT_EXPR, parse_stmt_expr_impl);
+}
+
+ParserResult parse_stmt_expr_impl(Parser *parser) {
     fprintf(DEBUGOUT, "parse_stmt_expr: START!\n");
     ParserResult res;
     state_t _parser_state = save_state(parser);
@@ -432,6 +704,10 @@ ParserResult parse_stmt_expr(Parser *parser) {
 }
 
 ParserResult parse_stmt_selection(Parser *parser) {
+    return memoize(parser, RULE_STMT_SELECTION, parse_stmt_selection_impl);
+}
+
+ParserResult parse_stmt_selection_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -487,8 +763,226 @@ ParserResult parse_stmt_selection(Parser *parser) {
 
         return res;
 
+    case TOK_KIND_SWITCH:
+    {
+        res = assume_token(parser, TOK_KIND_LPAREN); ErrProp;
+        forward_token(parser);
+
+        res = parse_expr(parser); ErrProp;
+        Node* cond_expr = res.value.node;
+
+        res = assume_token(parser, TOK_KIND_RPAREN); ErrProp;
+        forward_token(parser);
+
+        res = parse_stmt(parser); ErrProp;
+        Node* body = res.value.node;
+
+        Node* node = node_arena_malloc(parser->arena);
+        node->kind = NODE_STMT_SWITCH;
+        node->value.stmt_switch.cond = cond_expr;
+        node->value.stmt_switch.body = body;
+
+        res.result = PARSER_OK;
+        res.value.node = node;
+
+        return res;
+    }
+
+    default:
+        res.result = PARSER_ERROR;
+        res.error.kind = PARSER_ERROR_KIND_UNEXPECTED;
+        res.error.value.unexpected.token = t;
+
+        rewind_state(parser, _parser_state);
+        return res;
+    }
+}
+
+ParserResult parse_stmt_labeled(Parser *parser) {
+    return memoize(parser, RULE_STMT_LABELED, parse_stmt_labeled_impl);
+}
+
+// TODO: support labels of goto
+ParserResult parse_stmt_labeled_impl(Parser *parser) {
+    ParserResult res;
+    state_t _parser_state = save_state(parser);
+
+    res = current_token(parser); ErrProp;
+    forward_token(parser);
+
+    Token* t = res.value.token;
+    switch (t->kind) {
+    case TOK_KIND_CASE:
+    {
+        // A conditional expression, which is folded by the analyzer
+        res = parse_expr_prec(parser, PREC_COND); ErrProp;
+        Node* expr = res.value.node;
+
+        res = assume_token(parser, TOK_KIND_COLON); ErrProp;
+        forward_token(parser);
+
+        res = parse_stmt(parser); ErrProp;
+        Node* stmt = res.value.node;
+
+        Node* node = node_arena_malloc(parser->arena);
+        node->kind = NODE_STMT_CASE;
+        node->value.stmt_case.expr = expr;
+        node->value.stmt_case.stmt = stmt;
+
+        res.result = PARSER_OK;
+        res.value.node = node;
+
+        return res;
+    }
+
+    case TOK_KIND_DEFAULT:
+    {
+        res = assume_token(parser, TOK_KIND_COLON); ErrProp;
+        forward_token(parser);
+
+        res = parse_stmt(parser); ErrProp;
+        Node* stmt = res.value.node;
+
+        Node* node = node_arena_malloc(parser->arena);
+        node->kind = NODE_STMT_DEFAULT;
+        node->value.stmt_default.stmt = stmt;
+
+        res.result = PARSER_OK;
+        res.value.node = node;
+
+        return res;
+    }
+
+    default:
+        res.result = PARSER_ERROR;
+        res.error.kind = PARSER_ERROR_KIND_UNEXPECTED;
+        res.error.value.unexpected.token = t;
+
+        rewind_state(parser, _parser_state);
+        return res;
+    }
+}
+
+ParserResult parse_stmt_iteration(Parser *parser) {
+    return memoize(parser, RULE_STMT_ITERATION, parse_stmt_iteration_impl);
+}
+
+// Reads an optional expression followed by 'term', e.g. clauses of for statements
+static ParserResult parse_expr_opt_until(Parser *parser, TokenKind term, Node** expr) {
+    ParserResult res;
+    state_t _parser_state = save_state(parser);
+
+    *expr = NULL;
+    res = parse_expr(parser); // Optional
+    if (res.result == PARSER_OK) {
+        *expr = res.value.node;
+    }
+
+    res = assume_token(parser, term); ErrProp;
+    forward_token(parser);
+
+    return res;
+}
+
+ParserResult parse_stmt_iteration_impl(Parser *parser) {
+    ParserResult res;
+    state_t _parser_state = save_state(parser);
+
+    fprintf(DEBUGOUT, "parse_stmt_iteration: START!\n");
+
+    res = current_token(parser); ErrProp;
+    forward_token(parser);
+
+    Token* t = res.value.token;
+    switch (t->kind) {
+    case TOK_KIND_WHILE:
+    {
+        res = assume_token(parser, TOK_KIND_LPAREN); ErrProp;
+        forward_token(parser);
+
+        res = parse_expr(parser); ErrProp;
+        Node* cond_expr = res.value.node;
+
+        res = assume_token(parser, TOK_KIND_RPAREN); ErrProp;
+        forward_token(parser);
+
+        res = parse_stmt(parser); ErrProp;
+        Node* body = res.value.node;
+
+        Node* node = node_arena_malloc(parser->arena);
+        node->kind = NODE_STMT_WHILE;
+        node->value.stmt_while.cond = cond_expr;
+        node->value.stmt_while.body = body;
+
+        res.result = PARSER_OK;
+        res.value.node = node;
+
+        return res;
+    }
+
+    case TOK_KIND_DO:
+    {
+        res = parse_stmt(parser); ErrProp;
+        Node* body = res.value.node;
+
+        res = assume_token(parser, TOK_KIND_WHILE); ErrProp;
+        forward_token(parser);
+
+        res = assume_token(parser, TOK_KIND_LPAREN); ErrProp;
+        forward_token(parser);
+
+        res = parse_expr(parser); ErrProp;
+        Node* cond_expr = res.value.node;
+
+        res = assume_token(parser, TOK_KIND_RPAREN); ErrProp;
+        forward_token(parser);
+
+        res = assume_token(parser, TOK_KIND_SEMICOLON); ErrProp;
+        forward_token(parser);
+
+        Node* node = node_arena_malloc(parser->arena);
+        node->kind = NODE_STMT_DO;
+        node->value.stmt_do.body = body;
+        node->value.stmt_do.cond = cond_expr;
+
+        res.result = PARSER_OK;
+        res.value.node = node;
+
+        return res;
+    }
+
+    case TOK_KIND_FOR:
+    {
+        // TODO: support declarations in the first clause
+        res = assume_token(parser, TOK_KIND_LPAREN); ErrProp;
+        forward_token(parser);
+
+        Node* init_expr;
+        res = parse_expr_opt_until(parser, TOK_KIND_SEMICOLON, &init_expr); ErrProp;
+
+        Node* cond_expr;
+        res = parse_expr_opt_until(parser, TOK_KIND_SEMICOLON, &cond_expr); ErrProp;
+
+        Node* step_expr;
+        res = parse_expr_opt_until(parser, TOK_KIND_RPAREN, &step_expr); ErrProp;
+
+        res = parse_stmt(parser); ErrProp;
+        Node* body = res.value.node;
+
+        Node* node = node_arena_malloc(parser->arena);
+        node->kind = NODE_STMT_FOR;
+        node->value.stmt_for.init = init_expr;
+        node->value.stmt_for.cond = cond_expr;
+        node->value.stmt_for.step = step_expr;
+        node->value.stmt_for.body = body;
+
+        res.result = PARSER_OK;
+        res.value.node = node;
+
+        return res;
+    }
+
     default:
-        // TODO: support switch
         res.result = PARSER_ERROR;
         res.error.kind = PARSER_ERROR_KIND_UNEXPECTED;
         res.error.value.unexpected.token = t;
@@ -499,6 +993,10 @@ ParserResult parse_stmt_selection(Parser *parser) {
 }
 
 ParserResult parse_stmt_jump(Parser *parser) {
+    return memoize(parser, RULE_STMT_JUMP, parse_stmt_jump_impl);
+}
+
+ParserResult parse_stmt_jump_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -524,6 +1022,23 @@ ParserResult parse_stmt_jump(Parser *parser) {
 
         return res;
 
+    case TOK_KIND_BREAK:
+    case TOK_KIND_CONTINUE:
+    {
+        res = assume_token(parser, TOK_KIND_SEMICOLON); ErrProp;
+        forward_token(parser);
+
+        Node* node = node_arena_malloc(parser->arena);
+        node->kind = NODE_STMT_JUMP;
+        node->value.stmt_jump.kind = t->kind;
+        node->value.stmt_jump.expr = NULL;
+
+        res.result = PARSER_OK;
+        res.value.node = node;
+
+        return res;
+    }
+
     default:
         res.result = PARSER_ERROR;
         res.error.kind = PARSER_ERROR_KIND_UNEXPECTED;
@@ -535,62 +1050,224 @@ ParserResult parse_stmt_jump(Parser *parser) {
 }
 
 ParserResult parse_expr(Parser *parser) {
-    return parse_expr_assign(parser);
+    return memoize(parser, RULE_EXPR, parse_expr_impl);
+}
+
+ParserResult parse_expr_impl(Parser *parser) {
+    return parse_expr_prec(parser, PREC_COMMA);
 }
 
 ParserResult parse_expr_assign(Parser *parser) {
-    return parse_expr_additive(parser);
+    return memoize(parser, RULE_EXPR_ASSIGN, parse_expr_assign_impl);
+}
+
+ParserResult parse_expr_assign_impl(Parser *parser) {
+    return parse_expr_prec(parser, PREC_ASSIGN);
 }
 
-ParserResult parse_expr_additive(Parser *parser) {
+// Operator-precedence (Pratt) parser for unary, binary and ternary operators.
+// Operators and operands are kept in explicit stacks, so a whole expression is parsed by one loop
+// regardless of the number of precedence levels or the length of operator chains.
+// Only parenthesized expressions and arguments make a recursive call.
+ParserResult parse_expr_prec(Parser *parser, Prec min_prec) {
+    ParserResult res;
+    if (enter_nested(parser, &res)) {
+        return res;
+    }
+
+    res = parse_expr_prec_impl(parser, min_prec);
+    leave_nested(parser);
+
+    return res;
+}
+
+ParserResult parse_expr_prec_impl(Parser *parser, Prec min_prec) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
-    res = parse_expr_postfix(parser); ErrProp;
+    size_t ops_base = vector_len(parser->op_stack);
+    size_t operands_base = vector_len(parser->operand_stack);
+    size_t cond_depth = 0; // Number of '?' which are waiting for ':'
 
-    for (;;) {
-        _parser_state = save_state(parser);
+    for(;;) {
+        // Operand: prefix operators followed by a postfix expression
+        state_t operand_state = save_state(parser);
+        size_t prefix_base = vector_len(parser->op_stack);
+        for(;;) {
+            res = current_token(parser);
+            if (res.result == PARSER_ERROR || !prefix_ops[res.value.token->kind]) {
+                break;
+            }
 
-        ParserResult res0 = current_token(parser);
-        if (res0.result == PARSER_ERROR) {
-            rewind_state(parser, _parser_state);
-            goto escape;
+            OpFrame* frame = (OpFrame*)vector_append(parser->op_stack);
+            frame->kind = OP_FRAME_PREFIX;
+            frame->op = res.value.token;
+            frame->prec = PREC_UNARY;
+            frame->state = save_state(parser);
+            frame->operands_len = vector_len(parser->operand_stack);
+
+            forward_token(parser);
         }
-        Token* op = res0.value.token;
 
-        switch (op->kind) {
-        case TOK_KIND_PLUS:
-            break;
-        case TOK_KIND_MINUS:
-            break;
-        default:
-            rewind_state(parser, _parser_state);
-            goto escape;
+        res = parse_expr_postfix(parser);
+        if (res.result == PARSER_ERROR) {
+            vector_truncate(parser->op_stack, prefix_base);
+            rewind_state(parser, operand_state);
+
+            if (vector_len(parser->operand_stack) == operands_base) {
+                // No operands
+                ErrRet;
+            }
+
+            // The last operator has no operand, give it up
+            OpFrame* frame = (OpFrame*)vector_pop(parser->op_stack);
+            assert(frame);
+            if (frame->kind == OP_FRAME_COND_THEN) {
+                cond_depth--;
+            }
+            abandon_op_frame(parser, frame);
+            goto finish;
         }
+
+        Node** operand = (Node**)vector_append(parser->operand_stack);
+        *operand = res.value.node;
+
+        // Infix operator
+        state_t op_state = save_state(parser);
+        res = current_token(parser);
+        if (res.result == PARSER_ERROR) {
+            goto finish;
+        }
+        Token* op = res.value.token;
+
+        if (op->kind == TOK_KIND_COLON && cond_depth > 0) {
+            // Reduce a middle operand of the ternary operator
+            reduce_ops(parser, ops_base, PREC_NONE, OP_ASSOC_LEFT);
+
+            OpFrame* frame = (OpFrame*)vector_at(parser->op_stack, vector_len(parser->op_stack) - 1);
+            assert(frame && frame->kind == OP_FRAME_COND_THEN);
+            frame->kind = OP_FRAME_COND_ELSE;
+            cond_depth--;
+
+            forward_token(parser);
+            continue;
+        }
+
+        // Any expressions can be placed between '?' and ':'
+        Prec limit_prec = cond_depth > 0 ? PREC_COMMA : min_prec;
+        InfixOp info = infix_ops[op->kind];
+        if (info.prec == PREC_NONE || info.prec < limit_prec) {
+            goto finish;
+        }
+
+        reduce_ops(parser, ops_base, info.prec, info.assoc);
+
+        OpFrame* frame = (OpFrame*)vector_append(parser->op_stack);
+        frame->kind = op->kind == TOK_KIND_QUESTION ? OP_FRAME_COND_THEN : OP_FRAME_INFIX;
+        frame->op = op;
+        frame->prec = info.prec;
+        frame->state = op_state;
+        frame->operands_len = vector_len(parser->operand_stack);
+        if (frame->kind == OP_FRAME_COND_THEN) {
+            cond_depth++;
+        }
+
         forward_token(parser);
+    }
 
-        res0 = parse_expr_postfix(parser);
-        if (res0.result == PARSER_ERROR) {
-            rewind_state(parser, _parser_state);
-            goto escape;
+finish:
+    if (cond_depth > 0) {
+        // Give up the outermost '?' which has no ':', inner operators are discarded with it
+        for(size_t i=ops_base; i<vector_len(parser->op_stack); ++i) {
+            OpFrame* frame = (OpFrame*)vector_at(parser->op_stack, i);
+            if (frame->kind == OP_FRAME_COND_THEN) {
+                OpFrame abandoned = *frame;
+                vector_truncate(parser->op_stack, i);
+                abandon_op_frame(parser, &abandoned);
+                break;
+            }
         }
+    }
+
+    reduce_ops(parser, ops_base, PREC_NONE, OP_ASSOC_LEFT);
+    assert(vector_len(parser->op_stack) == ops_base);
+    assert(vector_len(parser->operand_stack) == operands_base + 1);
+
+    Node** node = (Node**)vector_pop(parser->operand_stack);
+
+    res.result = PARSER_OK;
+    res.value.node = *node;
+
+    return res;
+}
+
+// Builds nodes from operators on the stack while they bind tighter than an operator which has 'prec'.
+// Unclosed '?' works as a barrier.
+void reduce_ops(Parser *parser, size_t ops_base, Prec prec, OpAssoc assoc) {
+    while(vector_len(parser->op_stack) > ops_base) {
+        OpFrame* frame = (OpFrame*)vector_at(parser->op_stack, vector_len(parser->op_stack) - 1);
+        if (frame->kind == OP_FRAME_COND_THEN) {
+            break;
+        }
+        if (frame->prec < prec || (frame->prec == prec && assoc == OP_ASSOC_RIGHT)) {
+            break;
+        }
+        vector_pop(parser->op_stack);
 
         Node* node = node_arena_malloc(parser->arena);
-        node->kind = NODE_EXPR_BIN;
-        node->value.expr_bin.op = op;
-        node->value.expr_bin.lhs = res.value.node;
-        node->value.expr_bin.rhs = res0.value.node;
+        switch(frame->kind) {
+        case OP_FRAME_PREFIX:
+        {
+            Node** expr = (Node**)vector_pop(parser->operand_stack);
+            node->kind = NODE_EXPR_UNARY;
+            node->value.expr_unary.op = frame->op;
+            node->value.expr_unary.expr = *expr;
+            break;
+        }
 
-        res.value.node = node;
+        case OP_FRAME_INFIX:
+        {
+            Node* rhs = *(Node**)vector_pop(parser->operand_stack);
+            Node* lhs = *(Node**)vector_pop(parser->operand_stack);
+            node->kind = NODE_EXPR_BIN;
+            node->value.expr_bin.op = frame->op;
+            node->value.expr_bin.lhs = lhs;
+            node->value.expr_bin.rhs = rhs;
+            break;
+        }
+
+        case OP_FRAME_COND_ELSE:
+        {
+            Node* else_e = *(Node**)vector_pop(parser->operand_stack);
+            Node* then_e = *(Node**)vector_pop(parser->operand_stack);
+            Node* cond = *(Node**)vector_pop(parser->operand_stack);
+            node->kind = NODE_EXPR_COND;
+            node->value.expr_cond.cond = cond;
+            node->value.expr_cond.then_e = then_e;
+            node->value.expr_cond.else_e = else_e;
+            break;
+        }
+
+        default:
+            assert(0); // unreachable
+        }
 
-        _parser_state = save_state(parser); // Forward state
+        Node** operand = (Node**)vector_append(parser->operand_stack);
+        *operand = node;
     }
+}
 
-escape:
-    return res;
+// Rewinds the state to just before the operator, and drops operands which are read after it
+void abandon_op_frame(Parser *parser, OpFrame* frame) {
+    rewind_state(parser, frame->state);
+    vector_truncate(parser->operand_stack, frame->operands_len);
 }
 
 ParserResult parse_expr_postfix(Parser *parser) {
+    return memoize(parser, RULE_EXPR_POSTFIX, parse_expr_postfix_impl);
+}
+
+ParserResult parse_expr_postfix_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -635,6 +1312,14 @@ ParserResult parse_expr_postfix(Parser *parser) {
             forward_token(parser);
             break;
 
+        case TOK_KIND_INC:
+            d = NODE_EXPR_POSTFIX_KIND_INC;
+            break;
+
+        case TOK_KIND_DEC:
+            d = NODE_EXPR_POSTFIX_KIND_DEC;
+            break;
+
         default:
             goto total_passed;
         }
@@ -648,6 +1333,10 @@ ParserResult parse_expr_postfix(Parser *parser) {
         case NODE_EXPR_POSTFIX_KIND_FUNC_CALL:
             node->value.expr_postfix.rhs = nodes[0]; // Nullable
             break;
+        case NODE_EXPR_POSTFIX_KIND_INC:
+        case NODE_EXPR_POSTFIX_KIND_DEC:
+            node->value.expr_postfix.rhs = NULL;
+            break;
         default:
             assert(0); // TODO: error handling...
         }
@@ -665,6 +1354,10 @@ total_passed:
 }
 
 ParserResult parse_argument_expr_list(Parser *parser) {
+    return memoize(parser, RULE_ARGUMENT_EXPR_LIST, parse_argument_expr_list_impl);
+}
+
+ParserResult parse_argument_expr_list_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -681,7 +1374,12 @@ ParserResult parse_argument_expr_list(Parser *parser) {
 }
 
 ParserResult parse_expr_primary(Parser *parser) {
+    return memoize(parser, RULE_EXPR_PRIMARY, parse_expr_primary_impl);
+}
+
+ParserResult parse_expr_primary_impl(Parser *parser) {
     ParserResult res;
+    state_t _parser_state = save_state(parser);
 
     res = parse_id(parser);
     if (res.result == PARSER_OK) {
@@ -693,6 +1391,20 @@ ParserResult parse_expr_primary(Parser *parser) {
         goto finish;
     }
 
+    res = assume_token(parser, TOK_KIND_LPAREN);
+    if (res.result == PARSER_OK) {
+        forward_token(parser);
+
+        res = parse_expr(parser); ErrProp;
+        Node* expr = res.value.node;
+
+        res = assume_token(parser, TOK_KIND_RPAREN); ErrProp;
+        forward_token(parser);
+
+        res.value.node = expr;
+        goto finish;
+    }
+
     // Not matched...
     res.result = PARSER_ERROR;
     res.error.kind = PARSER_ERROR_KIND_UNEXPECTED; // TODO: fix
@@ -702,6 +1414,10 @@ finish:
 }
 
 ParserResult parse_constant(Parser *parser) {
+    return memoize(parser, RULE_CONSTANT, parse_constant_impl);
+}
+
+ParserResult parse_constant_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -711,10 +1427,26 @@ ParserResult parse_constant(Parser *parser) {
     Token* t = res.value.token;
     switch (t->kind) {
     case TOK_KIND_INT_LIT:
+    case TOK_KIND_CHAR_LIT:
     {
-        char* const tok_buf = token_to_string(t);
-        long int n = strtol(tok_buf, NULL, 10); // TODO: fix type
-        free(tok_buf);
+        // Decoded from the source directly
+        long int n = 0; // TODO: fix type
+        int err;
+        if (t->kind == TOK_KIND_INT_LIT) {
+            err = literal_decode_int(token_begin(parser->buffer, t), token_len(t), &n);
+        } else {
+            int c = 0;
+            err = literal_decode_char(token_begin(parser->buffer, t), token_len(t), &c);
+            n = c;
+        }
+        if (err) {
+            res.result = PARSER_ERROR;
+            res.error.kind = PARSER_ERROR_KIND_UNEXPECTED;
+            res.error.value.unexpected.token = t;
+
+            rewind_state(parser, _parser_state);
+            return res;
+        }
 
         Node* node = node_arena_malloc(parser->arena);
         node->kind = NODE_LIT_INT;
@@ -728,11 +1460,10 @@ ParserResult parse_constant(Parser *parser) {
 
     case TOK_KIND_STRING_LIT:
     {
-        char* const tok_buf = token_to_string(t);
-
+        // Escapes are processed when strings are pooled
         Node* node = node_arena_malloc(parser->arena);
         node->kind = NODE_LIT_STRING;
-        node->value.lit_string.v = tok_buf;
+        node->value.lit_string.tok = t;
 
         res.result = PARSER_OK;
         res.value.node = node;
@@ -751,6 +1482,10 @@ ParserResult parse_constant(Parser *parser) {
 }
 
 ParserResult parse_id(Parser *parser) {
+    return memoize(parser, RULE_ID, parse_id_impl);
+}
+
+ParserResult parse_id_impl(Parser *parser) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
 
@@ -783,11 +1518,44 @@ ParserResult parse_id(Parser *parser) {
     }
 }
 
+// Memoized results are shared between callers. It is safe since nodes are owned by the arena,
+// and a node never appears twice in an accepted tree.
+ParserResult memoize(Parser *parser, Rule rule, ParserResult (*f)(Parser *parser)) {
+    if (!parser->memo) {
+        return f(parser);
+    }
+
+    size_t position = parser->position;
+    assert(position < parser->memo_len);
+    if (parser->memo[position] == NULL) {
+        parser->memo[position] = (MemoEntry*)calloc(RULE_NUM, sizeof(MemoEntry));
+        assert(parser->memo[position]); // TODO: error handling...
+        parser->memo_rows++;
+    }
+
+    MemoEntry* e = &parser->memo[position][rule];
+    if (e->filled) {
+        parser->memo_hits++;
+        parser->position = e->end_position;
+        return e->result;
+    }
+    parser->memo_misses++;
+
+    ParserResult res = f(parser);
+
+    // Rows are not moved by 'f'
+    e->filled = 1;
+    e->end_position = parser->position;
+    e->result = res;
+
+    return res;
+}
+
 ParserResult combinator_more1(Parser *parser, ParserResult (*f)(Parser *parser)) {
     return combinator_more1_sep(parser, TOK_KIND_EMPTY, f);
 }
 
-// TODO: Use sep
+// 'sep' is not used if it is TOK_KIND_EMPTY
 ParserResult combinator_more1_sep(Parser *parser, TokenKind sep, ParserResult (*f)(Parser *parser)) {
     ParserResult res;
     state_t _parser_state = save_state(parser);
@@ -795,8 +1563,19 @@ ParserResult combinator_more1_sep(Parser *parser, TokenKind sep, ParserResult (*
     Vector* elems = vector_new(sizeof(Node*));
 
     for(;;) {
+        state_t elem_state = save_state(parser);
+
+        if (sep != TOK_KIND_EMPTY && vector_len(elems) != 0) {
+            res = assume_token(parser, sep);
+            if (res.result == PARSER_ERROR) {
+                break;
+            }
+            forward_token(parser);
+        }
+
         res = f(parser);
         if (res.result == PARSER_ERROR) {
+            rewind_state(parser, elem_state);
             break;
         }
 
@@ -820,10 +1599,29 @@ ParserResult combinator_more1_sep(Parser *parser, TokenKind sep, ParserResult (*
     return res;
 }
 
+// Returns non 0 with an error in 'res' if the nesting is too deep
+int enter_nested(Parser *parser, ParserResult* res) {
+    if (parser->depth >= PARSER_MAX_DEPTH) {
+        parser->too_deep = 1;
+        res->result = PARSER_ERROR;
+        res->error.kind = PARSER_ERROR_KIND_TOO_DEEP;
+        return 1;
+    }
+
+    parser->depth++;
+    return 0;
+}
+
+void leave_nested(Parser *parser) {
+    assert(parser->depth > 0);
+    parser->depth--;
+}
+
 ParserResult current_token(Parser *parser) {
     ParserResult res;
 
-    Token* t = (Token*)vector_at(parser->tokens, parser->position);
+    // Nothing matches after the limit, so backtracking ends soon
+    Token* t = parser->too_deep ? NULL : (Token*)vector_at(parser->tokens, parser->position);
     if (!t) {
         res.result = PARSER_ERROR;
         res.error.kind = PARSER_ERROR_KIND_EOF;
@@ -882,6 +1680,6 @@ void debug_print_current_token(Parser *parser) {
     }
 
     fprintf(DEBUGOUT, "OK! -> ");
-    token_fprint_buf(DEBUGOUT, res.value.token);
+    token_fprint_buf(DEBUGOUT, parser->buffer, res.value.token);
     fprintf(DEBUGOUT, "\n");
 }
@@ -18,6 +18,8 @@ typedef enum {
     PARSER_ERROR_KIND_EOF,
     PARSER_ERROR_KIND_UNEXPECTED,
     PARSER_ERROR_KIND_MORE1,
+    PARSER_ERROR_KIND_LEXER, // Tokens are not read to the end
+    PARSER_ERROR_KIND_TOO_DEEP,
 } ParserErrorKind;
 
 typedef union {
@@ -41,11 +43,16 @@ typedef struct parser_result_t {
     } value;
 } ParserResult;
 
-Parser* parser_new(Vector* tokens, NodeArena* arena);
+Parser* parser_new(char const* buffer, Vector* tokens, NodeArena* arena);
 void parser_drop(Parser *parser);
 
+// Enables the memo table keyed by (rule, token position), a.k.a. packrat parsing.
+// Must be called before parser_parse.
+void parser_set_memoize(Parser *parser, int enabled);
+
 ParserResult parser_parse();
 
-void parser_fprint_error(FILE *fp, ParseError *err);
+void parser_fprint_error(FILE *fp, char const* buffer, ParseError *err);
+void parser_fprint_stats(FILE *fp, Parser *parser);
 
 #endif /* CC_PARSER_H */
@@ -0,0 +1,388 @@
+#define _GNU_SOURCE // struct ucred
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include "server.h"
+
+#define SERVER_MAX_ARGS 256
+#define SERVER_MAX_ARG_LEN (64 * 1024)
+#define SERVER_FDS_NUM 2 // stdout and stderr
+
+static int read_all(int fd, void* buf, size_t len) {
+    char* p = (char*)buf;
+    while(len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+static int write_all(int fd, void const* buf, size_t len) {
+    char const* p = (char const*)buf;
+    while(len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+// Written at once, so the client wakes up once
+static int write_exit(int fd, int32_t code) {
+    char frame[5 + sizeof(code)];
+    uint32_t len = sizeof(code);
+    frame[0] = (char)SERVER_FRAME_EXIT;
+    memcpy(&frame[1], &len, sizeof(len));
+    memcpy(&frame[5], &code, sizeof(code));
+
+    return write_all(fd, frame, sizeof(frame));
+}
+
+// Appends (u32 len, bytes) at 'p', and returns the end
+static char* put_string(char* p, char const* s) {
+    uint32_t len = (uint32_t)strlen(s);
+    memcpy(p, &len, sizeof(len));
+    memcpy(p + sizeof(len), s, len);
+
+    return p + sizeof(len) + len;
+}
+
+static int init_addr(struct sockaddr_un* addr, char const* socket_path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Too long socket path: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr->sun_path, socket_path);
+
+    return 0;
+}
+
+// The request follows the byte which carries 'fds' in the same message, so the server reads it without
+// waiting for the client again
+static int send_fds(int sock, int const* fds, char const* req, size_t req_len) {
+    char byte = 0;
+    struct iovec iov[2] = {
+        { .iov_base = &byte, .iov_len = 1 },
+        { .iov_base = (void*)req, .iov_len = req_len },
+    };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * SERVER_FDS_NUM)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * SERVER_FDS_NUM);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * SERVER_FDS_NUM);
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, 0);
+    } while(n < 0 && errno == EINTR);
+    if (n < 1) {
+        return 1;
+    }
+
+    // The rest of a long request
+    size_t sent = (size_t)n - 1;
+    return write_all(sock, req + sent, req_len - sent);
+}
+
+// Received fds are owned by the caller
+static int recv_fds(int sock, int* fds) {
+    char byte;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * SERVER_FDS_NUM)];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while(n < 0 && errno == EINTR);
+    if (n != 1) {
+        return 1;
+    }
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * SERVER_FDS_NUM)) {
+        return 1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * SERVER_FDS_NUM);
+
+    return 0;
+}
+
+// Jobs run with the permissions of the server, so only its user may send them
+static int check_peer(int conn) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 || len != sizeof(cred)) {
+        perror("getsockopt");
+        return 1;
+    }
+    if (cred.uid != getuid()) {
+        fprintf(stderr, "cc server: rejected a client of uid %d\n", (int)cred.uid);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Returns 0 on success
+static int serve(int conn, ServerJob job, void* args) {
+    int err = 1;
+    if (check_peer(conn)) {
+        return 1;
+    }
+    int fds[SERVER_FDS_NUM];
+    if (recv_fds(conn, fds)) {
+        return 1;
+    }
+
+    uint32_t count = 0;
+    char* strs[SERVER_MAX_ARGS + 1] = {0};
+    if (read_all(conn, &count, sizeof(count)) || count < 2 || count > SERVER_MAX_ARGS) {
+        count = 0;
+        goto exit;
+    }
+    for(uint32_t i=0; i<count; ++i) {
+        uint32_t len;
+        if (read_all(conn, &len, sizeof(len)) || len > SERVER_MAX_ARG_LEN) {
+            goto exit;
+        }
+        strs[i] = (char*)malloc(len + 1);
+        if (read_all(conn, strs[i], len)) {
+            goto exit;
+        }
+        strs[i][len] = '\0';
+    }
+
+    if (chdir(strs[0]) != 0) {
+        int32_t code = 1;
+        char const msg[] = "cc server: failed to change the directory\n";
+        write_all(fds[1], msg, sizeof(msg) - 1);
+        err = write_exit(conn, code);
+        goto exit;
+    }
+
+    // Replaced at the fd level, so outputs of child processes such as 'as' also go to the client
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+
+    int32_t code = job((int)count - 1, &strs[1], args);
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+
+    err = write_exit(conn, code);
+
+exit:
+    for(uint32_t i=0; i<count && i<=SERVER_MAX_ARGS; ++i) {
+        free(strs[i]);
+    }
+    for(size_t i=0; i<SERVER_FDS_NUM; ++i) {
+        close(fds[i]);
+    }
+    return err;
+}
+
+// Accepts and serves jobs one by one until an error occurs
+static int serve_loop(int sock, ServerJob job, void* args) {
+    size_t jobs = 0;
+    double total_sec = 0;
+    for(;;) {
+        int conn = accept(sock, NULL, NULL);
+        if (conn == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            return 1;
+        }
+
+        struct timespec begin, end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        int err = serve(conn, job, args);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        close(conn);
+
+        jobs++;
+        total_sec += (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+        fprintf(stderr, "cc server: job %zu %s, avg %.3f ms/job\n",
+                jobs, err ? "failed" : "done", total_sec * 1000 / jobs);
+    }
+}
+
+int server_run(char const* socket_path, ServerJob job, void* args) {
+    struct sockaddr_un addr;
+    if (init_addr(&addr, socket_path)) {
+        return 1;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        perror("socket");
+        return 1;
+    }
+
+    // Created as 0600 regardless of the umask, so other users can not connect in the first place
+    unlink(socket_path); // A stale one
+    mode_t mask = umask(0077);
+    int bound = bind(sock, (struct sockaddr*)&addr, sizeof(addr));
+    umask(mask);
+    if (bound != 0 || chmod(socket_path, 0600) != 0 || listen(sock, 16) != 0) {
+        perror("bind");
+        close(sock);
+        return 1;
+    }
+    fprintf(stderr, "cc server: listening on %s\n", socket_path);
+
+    // Jobs run in a worker process which keeps 'args' warm across them. A job which crashes, e.g. by an
+    // assertion on unsupported input, takes down only the worker, and another one takes over the socket.
+    pid_t server_pid = getpid();
+    for(;;) {
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            break;
+        }
+        if (pid == 0) {
+            // Does not outlive the server
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != server_pid) {
+                _exit(1);
+            }
+            _exit(serve_loop(sock, job, args));
+        }
+
+        int status;
+        while(waitpid(pid, &status, 0) == -1) {
+            if (errno != EINTR) {
+                perror("waitpid");
+                status = 0;
+                break;
+            }
+        }
+        if (!WIFSIGNALED(status)) {
+            break;
+        }
+        fprintf(stderr, "cc server: worker %d is killed by signal %d, restarting\n", (int)pid, WTERMSIG(status));
+    }
+
+    close(sock);
+    unlink(socket_path);
+    return 1;
+}
+
+int server_client_run(char const* socket_path, int argc, char* argv[]) {
+    struct sockaddr_un addr;
+    if (init_addr(&addr, socket_path)) {
+        return SERVER_UNAVAILABLE;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        return SERVER_UNAVAILABLE;
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(sock);
+        return SERVER_UNAVAILABLE;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        close(sock);
+        return SERVER_UNAVAILABLE;
+    }
+
+    uint32_t count = (uint32_t)argc + 1;
+    size_t req_len = sizeof(count) + sizeof(uint32_t) + strlen(cwd);
+    for(int i=0; i<argc; ++i) {
+        req_len += sizeof(uint32_t) + strlen(argv[i]);
+    }
+    char* req = (char*)malloc(req_len);
+    memcpy(req, &count, sizeof(count));
+    char* p = put_string(req + sizeof(count), cwd);
+    for(int i=0; i<argc; ++i) {
+        p = put_string(p, argv[i]);
+    }
+    assert((size_t)(p - req) == req_len);
+
+    int const fds[SERVER_FDS_NUM] = { STDOUT_FILENO, STDERR_FILENO };
+    int err = send_fds(sock, fds, req, req_len);
+    free(req);
+    if (err) {
+        close(sock);
+        return SERVER_UNAVAILABLE;
+    }
+
+    // Outputs are written by the server, only the exit code comes back
+    int code = SERVER_JOB_LOST;
+    char header[5];
+    if (!read_all(sock, header, sizeof(header)) && (uint8_t)header[0] == SERVER_FRAME_EXIT) {
+        uint32_t len;
+        memcpy(&len, &header[1], sizeof(len));
+        int32_t c;
+        if (len == sizeof(c) && !read_all(sock, &c, sizeof(c))) {
+            code = c;
+        }
+    }
+
+    close(sock);
+    return code;
+}
@@ -0,0 +1,34 @@
+#ifndef CC_SERVER_H
+#define CC_SERVER_H
+
+#include <stdio.h>
+
+// A compile server on a local Unix socket, and its thin client.
+//
+// Request:  one byte which carries stdout and stderr of the client by SCM_RIGHTS, u32 count, then 'count'
+//           strings of (u32 len, bytes). The first one is the working directory of the client, and the
+//           rest is argv.
+// Response: frames of (u8 kind, u32 len, bytes). Kinds are SERVER_FRAME_*. The last frame is EXIT with
+//           an i32 exit code.
+//
+// Jobs write to the descriptors of the client directly, so outputs are not copied through the socket.
+
+#define SERVER_FRAME_EXIT   0
+
+// Returned by server_client_run instead of exit codes
+#define SERVER_UNAVAILABLE  (-1)    // Nothing is sent, e.g. no server listens
+#define SERVER_JOB_LOST     (-2)    // No exit code comes back, e.g. the job crashed its worker
+
+// A compile job. Returns an exit code.
+typedef int (*ServerJob)(int argc, char* argv[], void* args);
+
+// Serves jobs one by one in a worker process, which is restarted if a job kills it, until an error occurs.
+// stdout and stderr of a job, including ones of child processes, are the ones of the client.
+// Returns non 0 on failure.
+int server_run(char const* socket_path, ServerJob job, void* args);
+
+// Forwards argv to the server and writes back the output. Returns the exit code of the job, or
+// SERVER_UNAVAILABLE or SERVER_JOB_LOST.
+int server_client_run(char const* socket_path, int argc, char* argv[]);
+
+#endif /* CC_SERVER_H */
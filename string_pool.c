@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "string_pool.h"
+#include "literal.h"
+#include "hash.h"
+
+struct string_pool_t {
+    char* bytes;
+    size_t bytes_len;
+    size_t bytes_cap;
+    StringPoolEntry* entries;
+    size_t len;
+    size_t cap;
+    uint32_t* slots;    // Open addressing table of (id + 1), 0 is an empty slot. NULL if borrowed.
+    size_t slots_cap;
+};
+
+StringPool* string_pool_new() {
+    StringPool* pool = (StringPool*)malloc(sizeof(StringPool));
+    pool->bytes = NULL;
+    pool->bytes_len = 0;
+    pool->bytes_cap = 0;
+    pool->entries = NULL;
+    pool->len = 0;
+    pool->cap = 0;
+    pool->slots_cap = 64;
+    pool->slots = (uint32_t*)calloc(pool->slots_cap, sizeof(uint32_t));
+
+    return pool;
+}
+
+StringPool* string_pool_new_borrowed(char const* bytes, size_t bytes_len, StringPoolEntry const* entries, size_t len) {
+    StringPool* pool = (StringPool*)malloc(sizeof(StringPool));
+    pool->bytes = (char*)bytes;
+    pool->bytes_len = bytes_len;
+    pool->bytes_cap = 0;
+    pool->entries = (StringPoolEntry*)entries;
+    pool->len = len;
+    pool->cap = 0;
+    pool->slots = NULL;
+    pool->slots_cap = 0;
+
+    return pool;
+}
+
+void string_pool_drop(StringPool* pool) {
+    if (pool->slots) {
+        free(pool->bytes);
+        free(pool->entries);
+        free(pool->slots);
+    }
+    free(pool);
+}
+
+void string_pool_clear(StringPool* pool) {
+    assert(pool->slots); // Not borrowed
+    pool->bytes_len = 0;
+    pool->len = 0;
+    memset(pool->slots, 0, sizeof(uint32_t) * pool->slots_cap);
+}
+
+static void reserve_bytes(StringPool* pool, size_t cap) {
+    if (pool->bytes_cap >= cap) {
+        return;
+    }
+
+    size_t new_cap = pool->bytes_cap == 0 ? 256 : pool->bytes_cap * 2;
+    while(new_cap < cap) {
+        new_cap *= 2;
+    }
+    pool->bytes = (char*)realloc(pool->bytes, new_cap);
+    assert(pool->bytes); // TODO: error handling...
+
+    pool->bytes_cap = new_cap;
+}
+
+static uint32_t* find_slot(StringPool* pool, char const* s, size_t len) {
+    size_t mask = pool->slots_cap - 1;
+    size_t pos = (size_t)hash_bytes(HASH_INIT, s, len) & mask;
+    for(;;) {
+        uint32_t* slot = &pool->slots[pos];
+        if (*slot == 0) {
+            return slot;
+        }
+
+        StringPoolEntry* e = &pool->entries[*slot - 1];
+        if (e->len == len && memcmp(pool->bytes + e->offset, s, len) == 0) {
+            return slot;
+        }
+
+        pos = (pos + 1) & mask;
+    }
+}
+
+static void grow_slots(StringPool* pool) {
+    free(pool->slots);
+    pool->slots_cap *= 2;
+    pool->slots = (uint32_t*)calloc(pool->slots_cap, sizeof(uint32_t));
+
+    for(size_t i=0; i<pool->len; ++i) {
+        StringPoolEntry* e = &pool->entries[i];
+        uint32_t* slot = find_slot(pool, pool->bytes + e->offset, e->len);
+        *slot = (uint32_t)(i + 1);
+    }
+}
+
+// The string must be placed at the tail of 'bytes' already. It is committed if it is a new one.
+static uint32_t intern_tail(StringPool* pool, size_t len) {
+    assert(pool->slots); // Borrowed pools are read only
+
+    char const* s = pool->bytes + pool->bytes_len;
+    uint32_t* slot = find_slot(pool, s, len);
+    if (*slot != 0) {
+        return *slot - 1;
+    }
+
+    if (pool->len == pool->cap) {
+        pool->cap = pool->cap == 0 ? 64 : pool->cap * 2;
+        pool->entries = (StringPoolEntry*)realloc(pool->entries, sizeof(StringPoolEntry) * pool->cap);
+        assert(pool->entries); // TODO: error handling...
+    }
+
+    uint32_t id = (uint32_t)pool->len;
+    pool->entries[id].offset = (uint32_t)pool->bytes_len;
+    pool->entries[id].len = (uint32_t)len;
+    pool->len++;
+
+    pool->bytes[pool->bytes_len + len] = '\0';
+    pool->bytes_len += len + 1;
+
+    *slot = id + 1;
+
+    // Keep the load factor under 1/2
+    if (pool->len * 2 > pool->slots_cap) {
+        grow_slots(pool);
+    }
+
+    return id;
+}
+
+uint32_t string_pool_intern(StringPool* pool, char const* s, size_t len) {
+    reserve_bytes(pool, pool->bytes_len + len + 1);
+    memcpy(pool->bytes + pool->bytes_len, s, len);
+
+    return intern_tail(pool, len);
+}
+
+uint32_t string_pool_intern_escaped(StringPool* pool, char const* s, size_t len) {
+    // Decoded strings are never longer than the source
+    reserve_bytes(pool, pool->bytes_len + len + 1);
+
+    char* out = pool->bytes + pool->bytes_len;
+    size_t out_len = 0;
+    for(size_t i=0; i<len;) {
+        i += literal_decode_escape(s + i, len - i, &out[out_len]);
+        out_len++;
+    }
+
+    return intern_tail(pool, out_len);
+}
+
+size_t string_pool_len(StringPool* pool) {
+    return pool->len;
+}
+
+char const* string_pool_at(StringPool* pool, uint32_t id) {
+    assert(id < pool->len);
+    return pool->bytes + pool->entries[id].offset;
+}
+
+size_t string_pool_str_len(StringPool* pool, uint32_t id) {
+    assert(id < pool->len);
+    return pool->entries[id].len;
+}
+
+char const* string_pool_bytes(StringPool* pool, size_t* bytes_len) {
+    *bytes_len = pool->bytes_len;
+    return pool->bytes;
+}
+
+StringPoolEntry const* string_pool_entries(StringPool* pool) {
+    return pool->entries;
+}
@@ -0,0 +1,36 @@
+#ifndef CC_STRING_POOL_H
+#define CC_STRING_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Strings deduplicated by content. Each string is referred by a dense 32-bit id,
+// and its bytes are stored in one buffer followed by '\0'. Strings may contain '\0'.
+
+struct string_pool_t;
+typedef struct string_pool_t StringPool;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+} StringPoolEntry;
+
+StringPool* string_pool_new();
+// A read only pool which refers 'bytes' and 'entries', e.g. a mapped cache
+StringPool* string_pool_new_borrowed(char const* bytes, size_t bytes_len, StringPoolEntry const* entries, size_t len);
+void string_pool_drop(StringPool* pool);
+// Removes all strings, and keeps buffers for following ones
+void string_pool_clear(StringPool* pool);
+
+uint32_t string_pool_intern(StringPool* pool, char const* s, size_t len);
+// Interns a string literal body after escape processing. Nothing is allocated if it is already interned.
+uint32_t string_pool_intern_escaped(StringPool* pool, char const* s, size_t len);
+
+size_t string_pool_len(StringPool* pool);
+char const* string_pool_at(StringPool* pool, uint32_t id);
+size_t string_pool_str_len(StringPool* pool, uint32_t id);
+
+char const* string_pool_bytes(StringPool* pool, size_t* bytes_len);
+StringPoolEntry const* string_pool_entries(StringPool* pool);
+
+#endif /* CC_STRING_POOL_H */
@@ -0,0 +1,83 @@
+
+int f3(int a, int b, int c) {
+    return a + b * 4 + 8;
+}
+
+int f4(int a, int b, int c) {
+    return (a + b) * (b - c) + (a ^ c) - (b << 2) + (c >> 1);
+}
+
+int f5(int a, int b, int c) {
+    return (a * 3 + b / 7) % 11 + (c - 3) * (a + 1) - (b | c) + (a & 5);
+}
+
+int f6(int a, int b, int c) {
+    return ((a + b) * (a - b)) + ((b + c) * (b - c)) + ((a + c) * (c - a)) + ((a * b) - (c * 2));
+}
+
+int deep(int a, int b) {
+    return ((((((a + b) * 2 + 1) * 3 - b) + a * 8) - (b << 3)) + ((a - b) * (a + b) - (a * b + 7))) * ((a + 2) - (b + 3));
+}
+
+int cmp(int a, int b) {
+    if (a + 1 < b * 2) {
+        return 1;
+    }
+    if (a - b >= 3) {
+        return 2;
+    }
+    if ((a & 1) == (b & 1)) {
+        return 3;
+    }
+    if (a * b != 12) {
+        return 4;
+    }
+    return (a > b) + (a <= b) * 2;
+}
+
+int sw(int a) {
+    switch (a * 2 + 1) {
+    case 1: return 10;
+    case 3: return 20;
+    case 5: return 30;
+    case 7: return 40;
+    default: return a - 100;
+    }
+}
+
+int logic(int a, int b) {
+    return (a && b) + (a || b) * 2 + ((a + b) && (a - b)) * 4;
+}
+
+int callmix(int a, int b) {
+    return (a + b) + rand() % 3 * 0 + (a * 4 + b) + f3(a, b, a + b) - (f4(a, b, 1) + 2);
+}
+
+int sub(int a, int b) {
+    return a - b - 5 + (7 - a) - (0 - b);
+}
+
+int sh(int a, int b) {
+    return (a << 1) + (a << 3) + (b >> 2) + (a << (b & 3)) + a * 2 + 2 * b + a * 8 + (a + b * 8);
+}
+
+int main(void) {
+    printf("%ld\n", f3(1, 2, 3));
+    printf("%ld\n", f4(5, 0 - 7, 9));
+    printf("%ld\n", f5(17, 100, 0 - 4));
+    printf("%ld\n", f6(3, 9, 0 - 2));
+    printf("%ld\n", deep(6, 0 - 3));
+    printf("%ld\n", deep(0 - 100, 7));
+    printf("%ld\n", cmp(1, 5));
+    printf("%ld\n", cmp(10, 2));
+    printf("%ld\n", cmp(3, 5));
+    printf("%ld\n", cmp(4, 3));
+    printf("%ld\n", cmp(2, 3));
+    printf("%ld\n", cmp(3, 4) + cmp(6, 2) + cmp(12, 1));
+    printf("%ld\n", sw(0) + sw(1) * 10 + sw(3) * 100 + sw(9));
+    printf("%ld\n", logic(0, 3) + logic(2, 2) * 10 + logic(5, 1) * 100);
+    printf("%ld\n", callmix(3, 4));
+    printf("%ld\n", sub(10, 3));
+    printf("%ld\n", sh(5, 7) + sh(0 - 3, 2));
+    return f3(1, 1, 1) + 0 * deep(1, 2);
+}
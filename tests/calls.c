@@ -0,0 +1,47 @@
+int sum8(int a, int b, int c, int d, int e, int f, int g, int h) {
+    printf("%ld %ld %ld %ld %ld %ld %ld %ld\n", a, b, c, d, e, f, g, h);
+    return a + b + c + d + e + f + g + h;
+}
+
+int id(int x) {
+    return x;
+}
+
+int many(int a, int b, int c, int d, int e, int f, int g, int h) {
+    return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8;
+}
+
+int fwd8(int a, int b, int c, int d, int e, int f, int g, int h) {
+    return many(h, g, f, e, d, c, b, a);
+}
+
+int sumto(int n, int acc) {
+    if (n == 0) {
+        return acc;
+    }
+    return sumto(n - 1, acc + n);
+}
+
+int depth(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return 1 + depth(n - 1);
+}
+
+int fib(int n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main(void) {
+    printf("%s-%s-%s\n", "one", "two", "three");
+    printf("%ld\n", sum8(1, 2, 3, 4, 5, 6, 7, id(8)));
+    printf("%ld\n", fwd8(1, 2, 3, 4, 5, 6, 7, 8));
+    printf("%ld\n", sumto(1000000, 0));
+    printf("%ld\n", depth(10000));
+    printf("%ld\n", fib(20));
+    return id(42);
+}
@@ -0,0 +1,49 @@
+int div3(int x) {
+    return x / 3;
+}
+
+int mod3(int x) {
+    return x % 3;
+}
+
+int div7(int x) {
+    return x / 7;
+}
+
+int mod7(int x) {
+    return x % 7;
+}
+
+int div8(int x) {
+    return x / 8;
+}
+
+int mod8(int x) {
+    return x % 8;
+}
+
+int divneg(int x) {
+    return x / (0 - 5);
+}
+
+int mul(int x) {
+    return x * 9 + x * 16 + x * (0 - 3) + x * 1000;
+}
+
+int show(int x) {
+    printf("%ld: %ld %ld %ld %ld %ld %ld %ld %ld\n", x, div3(x), mod3(x), div7(x), mod7(x), div8(x), mod8(x), divneg(x), mul(x));
+    return 0;
+}
+
+int main(void) {
+    show(0);
+    show(1);
+    show(7);
+    show(100);
+    show(0 - 1);
+    show(0 - 7);
+    show(0 - 100);
+    show(2147483647);
+    show(0 - 2147483647);
+    return div7(1000) % 256;
+}
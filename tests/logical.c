@@ -0,0 +1,37 @@
+int trace(int x) {
+    printf("[%ld]", x);
+    return x;
+}
+
+int guarded(int a, int b) {
+    return b && a / b > 1;
+}
+
+int either(int a, int b) {
+    return b == 0 || a % b == 0;
+}
+
+int both(int a, int b) {
+    return a > 0 && b > 0 || a == b;
+}
+
+int main(void) {
+    printf("%ld\n", 0 && puts("not printed"));
+    printf("%ld\n", 1 || puts("not printed"));
+    printf("%ld\n", trace(0) && trace(1));
+    printf("%ld\n", trace(2) && trace(3));
+    printf("%ld\n", trace(0) || trace(0));
+    printf("%ld\n", trace(4) || trace(5) && trace(6));
+    printf("%ld\n", (trace(0) || trace(7)) && trace(8));
+    printf("%ld\n", trace(9) && (trace(0) || trace(10)));
+    printf("%ld %ld %ld\n", guarded(10, 0), guarded(10, 3), guarded(10, 7));
+    printf("%ld %ld %ld\n", either(10, 0), either(10, 5), either(10, 3));
+    printf("%ld %ld %ld %ld\n", both(1, 2), both(0, 2), both(3, 3), both(0 - 1, 0 - 1));
+    if (trace(1) && trace(0) || trace(11)) {
+        puts("taken");
+    }
+    while (trace(0) && puts("not printed")) {
+        puts("not printed");
+    }
+    return trace(0) || 7 && 3;
+}
@@ -0,0 +1,40 @@
+int f(int n) {
+    while (rand() % n) {
+        printf("w %ld %ld\n", n * 3 + 1, n / 3);
+        if (rand() % 5 == 0) {
+            break;
+        }
+        if (rand() % 3 == 0) {
+            continue;
+        }
+        puts("tail");
+    }
+    do {
+        puts("do");
+        if (rand() % 7 == 0) {
+            continue;
+        }
+        printf("d %ld\n", n * n);
+    } while (rand() % 3);
+    for (puts("init"); rand() % 4; puts("step")) {
+        for (;;) {
+            if (rand() % 2) {
+                break;
+            }
+            puts("inner");
+        }
+        if (rand() % 9 == 0) {
+            return n + 100;
+        }
+    }
+    return n * 7;
+}
+
+int main(void) {
+    printf("%ld\n", f(5));
+    printf("%ld\n", f(9));
+    printf("%ld\n", f(2));
+    while (1) {
+        return 3;
+    }
+}
@@ -0,0 +1,153 @@
+#!/bin/sh
+# Compiles each tests/NAME.c with each set of flags, runs it natively, by --run and by --interp,
+# and compares its stdout and exit code with tests/NAME.expected. Then it checks the caches,
+# the server and the parser memo on each tests/NAME.c.
+#
+# Usage: tests/run.sh CC
+
+CC=${1:-./cc}
+DIR=$(dirname "$0")
+OUT=$DIR/out
+
+mkdir -p "$OUT" || exit 1
+
+failed=0
+passed=0
+for src in "$DIR"/*.c; do
+    name=$(basename "$src" .c)
+    expected=$DIR/$name.expected
+
+    for flags in \
+        "-O0" \
+        "-O1" \
+        "-O2" \
+        "-O2 -fno-tree-isel" \
+        "-O2 -fno-jump-tables" \
+        "-O2 -fno-strength-reduce" \
+        "-O2 -fno-move-loop-invariants" \
+        "-O2 -fif-conversion-threshold=0" \
+        "-O2 -fomit-frame-pointer" \
+        "-O2 -fparser-memo"; do
+        for mode in native run interp; do
+            actual=$OUT/$name.actual
+            case $mode in
+            native)
+                # Dumps of phases go to stdout unless the output is stdout
+                if ! $CC $flags -o "$OUT/$name" "$src" > /dev/null 2> "$OUT/$name.log"; then
+                    echo "FAIL $name ($mode $flags): compile error, see $OUT/$name.log"
+                    failed=$((failed + 1))
+                    continue
+                fi
+                "$OUT/$name" > "$actual"
+                ;;
+            run)
+                $CC $flags --run "$src" > "$actual" 2> "$OUT/$name.log"
+                ;;
+            interp)
+                $CC $flags --interp "$src" > "$actual" 2> "$OUT/$name.log"
+                ;;
+            esac
+            echo "exit $?" >> "$actual"
+
+            if cmp -s "$actual" "$expected"; then
+                passed=$((passed + 1))
+            else
+                echo "FAIL $name ($mode $flags)"
+                diff "$expected" "$actual" | head -10
+                failed=$((failed + 1))
+            fi
+        done
+    done
+done
+
+# Runs the compiled tests/NAME.c and compares it with the expected output
+check_run() {
+    what=$1
+    actual=$OUT/$name.actual
+    "$OUT/$name" > "$actual"
+    echo "exit $?" >> "$actual"
+    if cmp -s "$actual" "$expected"; then
+        passed=$((passed + 1))
+    else
+        echo "FAIL $name ($what)"
+        diff "$expected" "$actual" | head -10
+        failed=$((failed + 1))
+    fi
+}
+
+# Checks that the dump of the last compile contains the line
+check_dump() {
+    what=$1
+    line=$2
+    if grep -qx "$line" "$OUT/$name.dump"; then
+        passed=$((passed + 1))
+    else
+        echo "FAIL $name ($what): no \"$line\" in $OUT/$name.dump"
+        failed=$((failed + 1))
+    fi
+}
+
+sock=$OUT/server.sock
+rm -f "$sock"
+$CC --server "$sock" > "$OUT/server.log" 2>&1 &
+server=$!
+sleep 1
+
+for src in "$DIR"/*.c; do
+    name=$(basename "$src" .c)
+    expected=$DIR/$name.expected
+    log=$OUT/$name.log
+
+    # Compile cache: the first compile stores the output and the second one reuses it
+    rm -rf "$OUT/cache"
+    $CC -fcache-dir="$OUT/cache" -o "$OUT/$name" "$src" > "$OUT/$name.dump" 2> "$log"
+    check_dump "cache miss" "stored: $OUT/$name"
+    $CC -fcache-dir="$OUT/cache" -o "$OUT/$name" "$src" > "$OUT/$name.dump" 2> "$log"
+    check_dump "cache hit" "hit: $OUT/$name"
+    check_run "cache hit"
+
+    # AST cache: loaded for the same source, and invalidated by another one
+    rm -f "$OUT/ast"
+    $CC -fcache-ast="$OUT/ast" -o "$OUT/$name" "$src" > /dev/null 2> "$log"
+    $CC -fcache-ast="$OUT/ast" -o "$OUT/$name" "$src" > "$OUT/$name.dump" 2> "$log"
+    check_dump "ast cache load" "= AST = (cached)"
+    check_run "ast cache load"
+    other=$DIR/arith.c
+    [ "$src" = "$other" ] && other=$DIR/calls.c
+    $CC -fcache-ast="$OUT/ast" -o "$OUT/other" "$other" > "$OUT/$name.dump" 2> "$log"
+    check_dump "ast cache invalidation" "LOG: ast cache is stale"
+
+    # Incremental: every function is reused by the second compile
+    rm -f "$OUT/incremental"
+    $CC -fincremental="$OUT/incremental" -o "$OUT/$name" "$src" > /dev/null 2> "$log"
+    $CC -fincremental="$OUT/incremental" -o "$OUT/$name" "$src" > "$OUT/$name.dump" 2> "$log"
+    functions=$(sed -n 's/^functions: //p' "$OUT/$name.dump")
+    check_dump "incremental" "reused: $functions"
+    check_run "incremental"
+
+    # Server: the job is compiled by the server, not locally
+    if $CC --connect "$sock" -o "$OUT/$name" "$src" > /dev/null 2> "$log" && ! grep -q "compile locally" "$log"; then
+        passed=$((passed + 1))
+    else
+        echo "FAIL $name (server): see $log and $OUT/server.log"
+        failed=$((failed + 1))
+    fi
+    check_run "server"
+
+    # Parser memo: the same assembly with and without it
+    $CC -S -o "$OUT/$name.s" "$src" > /dev/null 2> "$log"
+    $CC -fparser-memo -S -o "$OUT/$name.memo.s" "$src" > /dev/null 2> "$log"
+    if cmp -s "$OUT/$name.s" "$OUT/$name.memo.s"; then
+        passed=$((passed + 1))
+    else
+        echo "FAIL $name (parser memo): assembly differs"
+        failed=$((failed + 1))
+    fi
+done
+
+kill $server
+wait $server 2> /dev/null
+rm -f "$sock"
+
+echo "tests: $passed passed, $failed failed"
+[ $failed -eq 0 ]
@@ -0,0 +1,52 @@
+int min(int a, int b) {
+    if (a < b) {
+        return a;
+    }
+    return b;
+}
+
+int max(int a, int b) {
+    if (a > b) {
+        return a;
+    } else {
+        return b;
+    }
+}
+
+int clamp(int x, int lo, int hi) {
+    return min(max(x, lo), hi);
+}
+
+int pick(int c, int a, int b) {
+    if (c) {
+        return a * 3 + b;
+    }
+    return b - a * 5;
+}
+
+int sign(int x) {
+    if (x < 0) {
+        return 0 - 1;
+    }
+    if (x > 0) {
+        return 1;
+    }
+    return 0;
+}
+
+int safediv(int a, int b) {
+    if (b == 0) {
+        return 0;
+    }
+    return a / b;
+}
+
+int main(void) {
+    printf("%ld %ld %ld %ld\n", min(3, 9), min(9, 3), min(0 - 4, 2), min(5, 5));
+    printf("%ld %ld %ld %ld\n", max(3, 9), max(9, 3), max(0 - 4, 2), max(5, 5));
+    printf("%ld %ld %ld\n", clamp(50, 0, 10), clamp(0 - 50, 0, 10), clamp(7, 0, 10));
+    printf("%ld %ld\n", pick(1, 4, 5), pick(0, 4, 5));
+    printf("%ld %ld %ld\n", sign(0 - 12), sign(0), sign(12));
+    printf("%ld %ld %ld\n", safediv(100, 7), safediv(100, 0), safediv(0 - 100, 7));
+    return clamp(300, 0, 200);
+}
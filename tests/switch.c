@@ -0,0 +1,115 @@
+int dense(int x) {
+    switch (x) {
+    case 0: return 10;
+    case 1: return 11;
+    case 2:
+    case 3: return 23;
+    case 5: return 15;
+    case 6:
+        puts("six");
+    case 7:
+        puts("seven");
+        break;
+    default:
+        return 99;
+    }
+    return 7;
+}
+
+int sparse(int x) {
+    switch (x) {
+    case 1: return 1;
+    case 100: return 2;
+    case 1000: return 3;
+    case 5000: return 4;
+    case 20000: return 5;
+    case 77777: return 6;
+    case 123456: return 7;
+    }
+    return 0;
+}
+
+int mixed(int x) {
+    switch (x) {
+    case 1: puts("m1");
+    case 2: puts("m2"); break;
+    case 3: puts("m3"); break;
+    case 4: puts("m4"); break;
+    case 5: puts("m5"); break;
+    case 1000: puts("m1000"); break;
+    case 2000: puts("m2000"); break;
+    case 3000: puts("m3000"); break;
+    default: puts("mdef");
+    }
+    return x;
+}
+
+int loops(int n) {
+    while (rand() % n) {
+        switch (rand() % 6) {
+        case 0: puts("zero"); break;
+        case 1: puts("one"); continue;
+        case 2: { puts("two"); }
+        case 3: puts("three"); break;
+        default:
+            switch (rand() % 3) {
+            case 0: puts("n0"); break;
+            case 2: puts("n2");
+            }
+            puts("after nested");
+        }
+        puts("loop tail");
+    }
+    return 0;
+}
+
+int labels(int x) {
+    switch (x) {
+        puts("never");
+    case 1: {
+        puts("b1");
+        return 1;
+    case 2:
+        puts("b2");
+    }
+    default:
+        puts("bdef");
+    }
+    switch (x) {
+    case 4: ;
+    }
+    switch (x) default: puts("only default");
+    return 0;
+}
+
+int main(void) {
+    printf("dense %ld %ld\n", 0, dense(0));
+    printf("dense %ld %ld\n", 1, dense(1));
+    printf("dense %ld %ld\n", 2, dense(2));
+    printf("dense %ld %ld\n", 3, dense(3));
+    printf("dense %ld %ld\n", 4, dense(4));
+    printf("dense %ld %ld\n", 5, dense(5));
+    printf("dense %ld %ld\n", 6, dense(6));
+    printf("dense %ld %ld\n", 7, dense(7));
+    printf("dense %ld %ld\n", 8, dense(8));
+    printf("dense %ld %ld\n", 9, dense(9));
+    printf("%ld %ld %ld %ld %ld %ld %ld %ld %ld\n", sparse(1), sparse(100), sparse(1000), sparse(5000), sparse(20000), sparse(77777), sparse(123456), sparse(3), sparse(200000));
+    mixed(0);
+    mixed(1);
+    mixed(2);
+    mixed(3);
+    mixed(4);
+    mixed(5);
+    mixed(6);
+    mixed(1000);
+    mixed(2000);
+    mixed(3000);
+    mixed(2500);
+    mixed(999999);
+    loops(13);
+    loops(7);
+    labels(1);
+    labels(2);
+    labels(3);
+    return 0;
+}
@@ -0,0 +1,49 @@
+int negative(int x) {
+    switch (x) {
+    case -3: return 30;
+    case -2: return 20;
+    case -1: return 10;
+    case 0: return 0;
+    case +1: return 1;
+    }
+    return 99;
+}
+
+int wide(int x) {
+    switch (x) {
+    case 1099511627776: return 1;
+    case 1099511627777: return 2;
+    case 1099511627778: return 3;
+    case 1099511627779: return 4;
+    case -9000000000: return 5;
+    case 2147483647: return 6;
+    case 2147483648: return 7;
+    case -2147483648: return 8;
+    case -2147483649: return 9;
+    }
+    return 0;
+}
+
+int folded(int x) {
+    switch (x) {
+    case 2 * 3 + 1: return 1;
+    case (1099511627776 >> 2) * 4 + 8: return 2;
+    case ~0 - 1: return 3;
+    case 1 ? 100 : 1 / 0: return 4;
+    case 0 && 1 / 0: return 5;
+    case 1 || 1 / 0: return 6;
+    case (10 < 20) + (7 % 4) * 100 + (1000 >> 2): return 7;
+    case !0 + 40: return 8;
+    }
+    return 0;
+}
+
+int main(void) {
+    printf("%ld %ld %ld %ld %ld %ld\n", negative(0 - 3), negative(0 - 2), negative(0 - 1), negative(0), negative(1), negative(2));
+    printf("%ld %ld %ld %ld %ld\n", wide(1099511627776), wide(1099511627777), wide(1099511627778), wide(1099511627779), wide(1099511627780));
+    printf("%ld %ld %ld %ld %ld\n", wide(0 - 9000000000), wide(2147483647), wide(2147483648), wide(0 - 2147483648), wide(0 - 2147483649));
+    printf("%ld %ld %ld\n", wide(0), wide(4294967296 + 1), wide(1));
+    printf("%ld %ld %ld %ld %ld\n", folded(7), folded(1099511627784), folded(0 - 2), folded(100), folded(0));
+    printf("%ld %ld %ld %ld\n", folded(1), folded(551), folded(41), folded(5));
+    return 0;
+}
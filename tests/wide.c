@@ -0,0 +1,18 @@
+int wide(int x) {
+    return x * 4294967296 + 1099511627776 + x;
+}
+int pick(int c) {
+    if (c) {
+        return 8589934592;
+    }
+    return 0 - 4294967297;
+}
+int main(void) {
+    printf("%ld\n", 4294967296);
+    printf("%ld\n", wide(3));
+    printf("%ld\n", pick(1));
+    printf("%ld\n", pick(0));
+    printf("%ld\n", 9223372036854775807 - 4294967295);
+    printf("%ld\n", 2147483647 + 1);
+    return 4294967296 + 7;
+}
@@ -3,16 +3,26 @@
 #include <string.h>
 #include "token.h"
 
-char* token_to_string(Token *tok) {
-    size_t range_size = tok->pos_end - tok->pos_begin;
+_Static_assert(sizeof(Token) == 8, "Token must be 8 bytes");
+
+char const* token_begin(char const* buffer, Token const* tok) {
+    return buffer + tok->pos;
+}
+
+size_t token_len(Token const* tok) {
+    return tok->len;
+}
+
+char* token_to_string(char const* buffer, Token const* tok) {
+    size_t range_size = token_len(tok);
     char* range = malloc(sizeof(char) * (range_size + 1));
-    memcpy(range, tok->buf_ref + tok->pos_begin, range_size);
+    memcpy(range, token_begin(buffer, tok), range_size);
     range[range_size] = '\0';
 
     return range;
 }
 
-void token_fprint(FILE *fp, Token *tok) {
+void token_fprint(FILE *fp, char const* buffer, Token const* tok) {
     switch(tok->kind) {
     case TOK_KIND_SHARP:
         fprintf(fp, "#");
@@ -38,12 +48,66 @@ void token_fprint(FILE *fp, Token *tok) {
     }
 
     fprintf(fp, " ");
-    token_fprint_buf(fp, tok);
-    fprintf(fp, " (%ld, %ld)", tok->pos_begin, tok->pos_end);
+    token_fprint_buf(fp, buffer, tok);
+    fprintf(fp, " (%u, %u)", tok->pos, tok->pos + tok->len);
 }
 
-void token_fprint_buf(FILE *fp, Token *tok) {
-    char const* range = token_to_string(tok);
-    fprintf(fp, "%s", range);
-    free((char*)range);
+void token_fprint_buf(FILE *fp, char const* buffer, Token const* tok) {
+    fprintf(fp, "%.*s", (int)token_len(tok), token_begin(buffer, tok));
+}
+
+static char const* const kind_strings[TOK_KIND_EOF + 1] = {
+    [TOK_KIND_SHARP] = "#",
+    [TOK_KIND_LT] = "<",
+    [TOK_KIND_GT] = ">",
+    [TOK_KIND_LPAREN] = "(",
+    [TOK_KIND_RPAREN] = ")",
+    [TOK_KIND_LBRACKET] = "[",
+    [TOK_KIND_RBRACKET] = "]",
+    [TOK_KIND_LBRACE] = "{",
+    [TOK_KIND_RBRACE] = "}",
+    [TOK_KIND_SEMICOLON] = ";",
+    [TOK_KIND_COLON] = ":",
+    [TOK_KIND_DOT] = ".",
+    [TOK_KIND_COMMA] = ",",
+    [TOK_KIND_PLUS] = "+",
+    [TOK_KIND_MINUS] = "-",
+    [TOK_KIND_MUL] = "*",
+    [TOK_KIND_DIV] = "/",
+    [TOK_KIND_MOD] = "%",
+    [TOK_KIND_ASSIGN] = "=",
+    [TOK_KIND_PLUS_ASSIGN] = "+=",
+    [TOK_KIND_MINUS_ASSIGN] = "-=",
+    [TOK_KIND_MUL_ASSIGN] = "*=",
+    [TOK_KIND_DIV_ASSIGN] = "/=",
+    [TOK_KIND_MOD_ASSIGN] = "%=",
+    [TOK_KIND_AND_ASSIGN] = "&=",
+    [TOK_KIND_OR_ASSIGN] = "|=",
+    [TOK_KIND_XOR_ASSIGN] = "^=",
+    [TOK_KIND_LSHIFT_ASSIGN] = "<<=",
+    [TOK_KIND_RSHIFT_ASSIGN] = ">>=",
+    [TOK_KIND_NOT] = "!",
+    [TOK_KIND_TILDE] = "~",
+    [TOK_KIND_AND] = "&",
+    [TOK_KIND_OR] = "|",
+    [TOK_KIND_XOR] = "^",
+    [TOK_KIND_LOGICAL_AND] = "&&",
+    [TOK_KIND_LOGICAL_OR] = "||",
+    [TOK_KIND_EQ] = "==",
+    [TOK_KIND_NE] = "!=",
+    [TOK_KIND_LE] = "<=",
+    [TOK_KIND_GE] = ">=",
+    [TOK_KIND_LSHIFT] = "<<",
+    [TOK_KIND_RSHIFT] = ">>",
+    [TOK_KIND_INC] = "++",
+    [TOK_KIND_DEC] = "--",
+    [TOK_KIND_ARROW] = "->",
+    [TOK_KIND_QUESTION] = "?",
+};
+
+char const* token_kind_to_string(TokenKind kind) {
+    if ((unsigned)kind > TOK_KIND_EOF) {
+        return NULL;
+    }
+    return kind_strings[kind];
 }
@@ -2,6 +2,7 @@
 #define CC_TOKEN_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 typedef enum {
     TOK_KIND_EMPTY,
@@ -22,32 +23,70 @@ typedef enum {
     TOK_KIND_MINUS,
     TOK_KIND_MUL,
     TOK_KIND_DIV,
+    TOK_KIND_MOD,
     TOK_KIND_ASSIGN,
+    TOK_KIND_PLUS_ASSIGN,
+    TOK_KIND_MINUS_ASSIGN,
+    TOK_KIND_MUL_ASSIGN,
+    TOK_KIND_DIV_ASSIGN,
+    TOK_KIND_MOD_ASSIGN,
+    TOK_KIND_AND_ASSIGN,
+    TOK_KIND_OR_ASSIGN,
+    TOK_KIND_XOR_ASSIGN,
+    TOK_KIND_LSHIFT_ASSIGN,
+    TOK_KIND_RSHIFT_ASSIGN,
     TOK_KIND_NOT,
+    TOK_KIND_TILDE,
     TOK_KIND_AND,
     TOK_KIND_OR,
+    TOK_KIND_XOR,
     TOK_KIND_LOGICAL_AND,
     TOK_KIND_LOGICAL_OR,
+    TOK_KIND_EQ,
+    TOK_KIND_NE,
+    TOK_KIND_LE,
+    TOK_KIND_GE,
+    TOK_KIND_LSHIFT,
+    TOK_KIND_RSHIFT,
+    TOK_KIND_INC,
+    TOK_KIND_DEC,
+    TOK_KIND_ARROW,
+    TOK_KIND_QUESTION,
     TOK_KIND_ID,
     TOK_KIND_RETURN,
     TOK_KIND_IF,
     TOK_KIND_ELSE,
+    TOK_KIND_WHILE,
+    TOK_KIND_DO,
+    TOK_KIND_FOR,
+    TOK_KIND_BREAK,
+    TOK_KIND_CONTINUE,
+    TOK_KIND_SWITCH,
+    TOK_KIND_CASE,
+    TOK_KIND_DEFAULT,
     TOK_KIND_INT_LIT,
     TOK_KIND_CHAR_LIT,
     TOK_KIND_STRING_LIT,
     TOK_KIND_EOF,
 } TokenKind;
 
+// 8 bytes per token. A source buffer is not held by tokens, it is held once by the owner of tokens.
 typedef struct {
-    TokenKind kind;
-
-    char const* buf_ref;
-    size_t pos_begin;
-    size_t pos_end;
+    uint32_t pos;       // An offset in the source buffer
+    uint32_t len : 24;
+    uint32_t kind : 8;  // TokenKind
 } Token;
 
-char* token_to_string(Token *tok);
-void token_fprint(FILE *fp, Token *tok);
-void token_fprint_buf(FILE *fp, Token *tok);
+#define TOKEN_MAX_POS UINT32_MAX
+#define TOKEN_MAX_LEN ((1u << 24) - 1)
+
+char const* token_begin(char const* buffer, Token const* tok);
+size_t token_len(Token const* tok);
+char* token_to_string(char const* buffer, Token const* tok);
+void token_fprint(FILE *fp, char const* buffer, Token const* tok);
+void token_fprint_buf(FILE *fp, char const* buffer, Token const* tok);
+
+// Returns a spelling of operators and punctuators, NULL for other kinds
+char const* token_kind_to_string(TokenKind kind);
 
 #endif /*CC_TOKEN_H*/
@@ -9,6 +9,10 @@ void type_arena_drop(TypeArena* arena) {
     arena_drop(arena);
 }
 
+void type_arena_reset(TypeArena* arena) {
+    arena_reset(arena);
+}
+
 Type* type_arena_malloc(TypeArena *arena) {
     return (Type*)arena_malloc(arena);
 }
@@ -7,6 +7,7 @@ typedef struct arena_t TypeArena;
 
 TypeArena* type_arena_new();
 void type_arena_drop(TypeArena* arena);
+void type_arena_reset(TypeArena* arena);
 
 Type* type_arena_malloc(TypeArena *arena);
 
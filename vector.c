@@ -61,6 +61,22 @@ void* vector_append(Vector *v) {
     return p;
 }
 
+// Returns the removed element, it is valid until the next append
+void* vector_pop(Vector *v) {
+    if (v->len == 0) {
+        return 0;
+    }
+    v->len--;
+
+    return &v->buffer[v->elem_size * v->len];
+}
+
+void vector_truncate(Vector *v, size_t len) {
+    if (len < v->len) {
+        v->len = len;
+    }
+}
+
 void* vector_at(Vector *v, size_t index) {
     if (index >= v->len) {
         return 0;
@@ -11,6 +11,8 @@ Vector* vector_new_with_cap(size_t elem_size, size_t cap);
 void vector_drop(Vector *vector);
 
 void* vector_append(Vector *vector);
+void* vector_pop(Vector *vector);
+void vector_truncate(Vector *vector, size_t len);
 void* vector_at(Vector *vector, size_t index);
 size_t vector_len(Vector *vector);
 size_t vector_cap(Vector *vector);
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include "writer.h"
+
+#define WRITER_BUFFER_SIZE (256 * 1024)
+
+struct writer_t {
+    int fd;             // WRITER_NO_FD if not used
+    char* buf;          // WRITER_BUFFER_SIZE bytes
+    size_t len;
+    int keep_in_memory;
+    char* mem;          // Nullable
+    size_t mem_len;
+    size_t mem_cap;
+    size_t total;       // Bytes written so far including the buffered ones
+    int err;
+};
+
+Writer* writer_new(int fd, int keep_in_memory) {
+    Writer* w = (Writer*)malloc(sizeof(Writer));
+    w->fd = fd;
+    w->buf = (char*)malloc(WRITER_BUFFER_SIZE);
+    w->len = 0;
+    w->keep_in_memory = keep_in_memory;
+    w->mem = NULL;
+    w->mem_len = 0;
+    w->mem_cap = 0;
+    w->total = 0;
+    w->err = 0;
+
+    return w;
+}
+
+void writer_drop(Writer* w) {
+    free(w->buf);
+    free(w->mem);
+    free(w);
+}
+
+static void keep(Writer* w, char const* s, size_t len) {
+    if (w->mem_len + len > w->mem_cap) {
+        size_t cap = w->mem_cap == 0 ? WRITER_BUFFER_SIZE : w->mem_cap;
+        while(cap < w->mem_len + len) {
+            cap *= 2;
+        }
+        w->mem = (char*)realloc(w->mem, cap);
+        assert(w->mem); // TODO: error handling...
+        w->mem_cap = cap;
+    }
+
+    memcpy(w->mem + w->mem_len, s, len);
+    w->mem_len += len;
+}
+
+static int write_all(int fd, char const* s, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(fd, s, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        s += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+int writer_flush(Writer* w) {
+    if (w->len == 0) {
+        return w->err;
+    }
+
+    if (w->keep_in_memory) {
+        keep(w, w->buf, w->len);
+    }
+    if (w->fd != WRITER_NO_FD && write_all(w->fd, w->buf, w->len)) {
+        w->err = 1;
+    }
+    w->len = 0;
+
+    return w->err;
+}
+
+void writer_put_bytes(Writer* w, char const* s, size_t len) {
+    w->total += len;
+
+    if (w->len + len > WRITER_BUFFER_SIZE) {
+        writer_flush(w);
+
+        if (len > WRITER_BUFFER_SIZE) {
+            // Too large to buffer
+            if (w->keep_in_memory) {
+                keep(w, s, len);
+            }
+            if (w->fd != WRITER_NO_FD && write_all(w->fd, s, len)) {
+                w->err = 1;
+            }
+            return;
+        }
+    }
+
+    memcpy(w->buf + w->len, s, len);
+    w->len += len;
+}
+
+void writer_put_char(Writer* w, char c) {
+    if (w->len == WRITER_BUFFER_SIZE) {
+        writer_flush(w);
+    }
+    w->buf[w->len++] = c;
+    w->total++;
+}
+
+void writer_put_str(Writer* w, char const* s) {
+    writer_put_bytes(w, s, strlen(s));
+}
+
+void writer_put_uint(Writer* w, unsigned long v) {
+    char digits[24];
+    size_t i = sizeof(digits);
+    do {
+        digits[--i] = (char)('0' + v % 10);
+        v /= 10;
+    } while(v != 0);
+
+    writer_put_bytes(w, digits + i, sizeof(digits) - i);
+}
+
+void writer_put_int(Writer* w, long v) {
+    if (v < 0) {
+        writer_put_char(w, '-');
+        writer_put_uint(w, -(unsigned long)v);
+        return;
+    }
+    writer_put_uint(w, (unsigned long)v);
+}
+
+char const* writer_memory(Writer* w, size_t* len) {
+    *len = w->mem_len;
+    return w->keep_in_memory ? w->mem : NULL;
+}
+
+size_t writer_total_bytes(Writer* w) {
+    return w->total;
+}
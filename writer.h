@@ -0,0 +1,31 @@
+#ifndef CC_WRITER_H
+#define CC_WRITER_H
+
+#include <stddef.h>
+
+// A buffered output. Formatting is done by hand instead of printf, and each flush is a single write(2).
+// Output goes to a file descriptor, a memory buffer, or both.
+
+struct writer_t;
+typedef struct writer_t Writer;
+
+#define WRITER_NO_FD (-1)
+
+// 'fd' may be WRITER_NO_FD. If 'keep_in_memory' is set, all output is also kept in memory.
+Writer* writer_new(int fd, int keep_in_memory);
+void writer_drop(Writer* w);
+
+void writer_put_char(Writer* w, char c);
+void writer_put_bytes(Writer* w, char const* s, size_t len);
+void writer_put_str(Writer* w, char const* s);
+void writer_put_int(Writer* w, long v);
+void writer_put_uint(Writer* w, unsigned long v);
+
+// Returns 0 on success
+int writer_flush(Writer* w);
+
+// Flushed output kept in memory, NULL if 'keep_in_memory' is not set
+char const* writer_memory(Writer* w, size_t* len);
+size_t writer_total_bytes(Writer* w);
+
+#endif /* CC_WRITER_H */